@@ -0,0 +1,339 @@
+/*
+	ARM7 recompiler against interpreter
+
+	The build only uses one of them (FEAT_AREC), so the interpreter is
+	compiled into this program as well, under other names. Both run the same
+	random programs (data processing with every shift form, loads and stores,
+	ldm/stm, multiplies, psr moves, conditional forward branches) from the
+	same registers and sound ram, and the registers and ram are compared at
+	the end. Two small programs that store over their own code come first.
+	Then each runs a loop of one program for the same number of cycles.
+
+	bench/arm7 [--programs N] [--seed N]
+*/
+#include "types.h"
+#include "hw/arm7/arm7.h"
+#include "hw/arm7/arm_mem.h"
+
+#if FEAT_AREC == DYNAREC_JIT
+//the interpreter, as interp_arm_Run_ and so on, on its own registers
+#define arm_Reg       interp_arm_Reg
+#define armIrqEnable  interp_armIrqEnable
+#define armFiqEnable  interp_armFiqEnable
+#define armMode       interp_armMode
+#define Arm7Enabled   interp_Arm7Enabled
+#define cpuBitsSet    interp_cpuBitsSet
+#define intState      interp_intState
+#define stopState     interp_stopState
+#define holdState     interp_holdState
+#define CPUFiq        interp_CPUFiq
+#define arm_printf    interp_arm_printf
+#define arm_Run_      interp_arm_Run_
+#define arm_Run       interp_arm_Run
+#define arm_Init      interp_arm_Init
+#define arm_Reset     interp_arm_Reset
+#define arm_SetEnabled interp_arm_SetEnabled
+#define arm_single_op interp_arm_single_op
+#undef FEAT_AREC
+#define FEAT_AREC DYNAREC_NONE
+//arm7.h is already in, so these aren't declared yet
+void arm_Reset();
+#include "hw/arm7/arm7.cpp"
+#undef FEAT_AREC
+#define FEAT_AREC DYNAREC_JIT
+#undef arm_Reg
+#undef armIrqEnable
+#undef armFiqEnable
+#undef armMode
+#undef Arm7Enabled
+#undef cpuBitsSet
+#undef intState
+#undef stopState
+#undef holdState
+#undef CPUFiq
+#undef arm_printf
+#undef arm_Run_
+#undef arm_Run
+#undef arm_Init
+#undef arm_Reset
+#undef arm_SetEnabled
+#undef arm_single_op
+#undef reg
+
+extern bool Arm7Enabled;
+void arm_Run_(u32 CycleCount);
+#endif
+
+#include "bench.h"
+#include "hw/aica/aica_if.h"
+
+#if FEAT_AREC == DYNAREC_JIT
+#define CODE 0x1000
+#define DATA 0x40000
+
+static u32 code[8192];
+static u32 code_len;
+
+static u32 cond()
+{
+	return bench_rand() % 4 ? 0xE : bench_rand() % 14;
+}
+
+static void emit(u32 op)
+{
+	code[code_len++] = op;
+}
+
+//one random instruction, sometimes with a setup instruction in front
+static void random_op(u32 end)
+{
+	u32 kind = bench_rand() % 20;
+	u32 rd = bench_rand() % 9, rn = bench_rand() % 13, rm = bench_rand() % 13;
+	if (bench_rand() % 16 == 0)
+		rn = 15;
+	if (bench_rand() % 16 == 0)
+		rm = 15;
+	u32 c = cond() << 28;
+
+	if (kind < 8)
+	{
+		//data processing: immediate, shift by immediate, shift by register
+		u32 op = bench_rand() % 16, S = bench_rand() % 2;
+		if (op >= 8 && op <= 11)
+			S = 1;
+		u32 o = c | (op << 21) | (S << 20) | (rn << 16) | (rd << 12);
+		u32 form = bench_rand() % 3;
+		if (form == 0)
+			o |= (1 << 25) | (bench_rand() & 0xFFF);
+		else if (form == 1)
+			o |= (bench_rand() & 0xFE0) | rm;
+		else
+		{
+			//shift amounts at and around the edges, in r9
+			static const u32 amounts[] = { 0, 1, 16, 31, 32, 33, 64, 255 };
+			emit(0xE3A09000 | amounts[bench_rand() % 8]);	//mov r9,#amount
+			o |= (9 << 8) | ((bench_rand() % 4) << 5) | 0x10 | (rm == 15 ? 0 : rm);
+		}
+		emit(o);
+	}
+	else if (kind < 13)
+	{
+		//ldr/str(b) off r10/r11, which point to the data area
+		u32 base = 10 + bench_rand() % 2;
+		u32 P = bench_rand() % 2, U = bench_rand() % 2, B = bench_rand() % 2, W = bench_rand() % 2, L = bench_rand() % 2;
+		u32 o = c | (1 << 26) | (P << 24) | (U << 23) | (B << 22) | (W << 21) | (L << 20) | (base << 16) | (rd << 12);
+		if (bench_rand() % 2)
+		{
+			emit(0xE3A09000 | (bench_rand() & 0xFF));	//mov r9,#offset
+			o |= (1 << 25) | ((bench_rand() % 3) << 7) | 9;
+		}
+		else
+			o |= bench_rand() & 0x3F;
+		if (!P)
+			o &= ~(1 << 21);
+		if (W || !P)
+			emit(0xE3A00A40 | (base << 12));	//mov base,#DATA
+		emit(o);
+	}
+	else if (kind < 14)
+	{
+		//mul/mla
+		emit(c | ((bench_rand() % 2) << 21) | ((bench_rand() % 2) << 20) | (rd << 16) |
+			((bench_rand() % 9) << 12) | ((bench_rand() % 9) << 8) | 0x90 | (bench_rand() % 9));
+	}
+	else if (kind < 15)
+	{
+		//ldm/stm off r11, r0-r8, sometimes pc, r10 and r12 on stores
+		emit(0xE3A0BA40);	//mov r11,#DATA
+		u32 L = bench_rand() % 2;
+		u32 list = bench_rand() & 0x1FF;
+		if (!L && bench_rand() % 4 == 0)
+			list |= 0x8000;
+		if (!L && bench_rand() % 4 == 0)
+			list |= 0x1400;
+		emit(c | (4 << 25) | ((bench_rand() % 2) << 24) | ((bench_rand() % 2) << 23) | ((bench_rand() % 2) << 21) |
+			((bench_rand() % 8 == 0) << 22) | (L << 20) | (11 << 16) | list);
+	}
+	else if (kind < 16)
+	{
+		//mrs, msr to the flags
+		if (bench_rand() % 2)
+			emit(c | 0x010F0000 | (rd << 12));
+		else
+			emit(c | 0x0328F000 | (bench_rand() & 0xFFF));
+	}
+	else if (kind < 17 && code_len + 10 < end)
+	{
+		//short forward branch
+		emit(c | (0xA << 24) | (bench_rand() % 6));
+	}
+	else
+	{
+		//mov rd,#imm
+		emit(c | (1 << 25) | (13 << 21) | (rd << 12) | (bench_rand() & 0xFFF));
+	}
+}
+
+//ends in "b ." so both cores stop at the same place
+static void random_program(u32 len, bool loop)
+{
+	code_len = 0;
+	emit(0xE3A0AA40);	//mov r10,#DATA
+	emit(0xE3A0BA40);	//mov r11,#DATA
+	u32 loop_at = 0;
+	if (loop)
+	{
+		emit(0xE3A0CC01);	//mov r12,#256
+		loop_at = code_len;
+		emit(0xE3A0AA40);
+		emit(0xE3A0BA40);
+	}
+
+	u32 end = code_len + len;
+	while (code_len < end)
+		random_op(end);
+
+	//branches can land past the end
+	for (int i = 0; i < 8; i++)
+		emit(0xE1A00000);	//nop
+
+	if (loop)
+	{
+		emit(0xE25CC001);	//subs r12,r12,#1
+		emit(0x1A000000 | ((loop_at - (code_len + 2)) & 0xFFFFFF));	//bne loop
+	}
+	emit(0xEAFFFFFE);	//b .
+}
+
+static u8* ram_start;
+static reg_pair regs_start[RN_ARM_REG_COUNT];
+
+//loads the program and random registers and data, and keeps a copy for the other core
+static void load()
+{
+	memcpy(&aica_ram.data[CODE], code, code_len * 4);
+	for (u32 i = 0; i < 0x1000; i += 4)
+		*(u32*)&aica_ram.data[DATA + i] = bench_rand();
+
+	arm_Reset();
+	Arm7Enabled = true;
+	for (int i = 0; i < 16; i++)
+		arm_Reg[i].I = bench_rand();
+	arm_Reg[RN_PSR_FLAGS].I = bench_rand() & 0xF0000000;
+	arm_Reg[R15_ARM_NEXT].I = CODE;
+	arm_Reg[CYCL_CNT].I = 0;
+
+	memcpy(ram_start, aica_ram.data, ARAM_SIZE);
+	memcpy(regs_start, arm_Reg, sizeof(regs_start));
+}
+
+static void load_interp()
+{
+	memcpy(aica_ram.data, ram_start, ARAM_SIZE);
+	interp_arm_Reset();
+	interp_Arm7Enabled = true;
+	memcpy(interp_arm_Reg, regs_start, sizeof(regs_start));
+}
+
+//runs both, true if they agree
+static bool compare(const char* name, u32 slices)
+{
+	static u8* ram_jit = (u8*)malloc(ARAM_SIZE);
+
+	load();
+	for (u32 s = 0; s < slices; s++)
+		arm_Run_(512);
+	memcpy(ram_jit, aica_ram.data, ARAM_SIZE);
+
+	load_interp();
+	for (u32 s = 0; s < slices; s++)
+		interp_arm_Run_(512);
+
+	bool same = true;
+	for (int i = 0; i < RN_ARM_REG_COUNT; i++)
+	{
+		//r15 and the cycle count are kept differently by the two
+		if (i == 15 || i == CYCL_CNT)
+			continue;
+		if (arm_Reg[i].I != interp_arm_Reg[i].I)
+		{
+			printf("%s: reg %d, recompiler %08X interpreter %08X\n", name, i, arm_Reg[i].I, interp_arm_Reg[i].I);
+			same = false;
+		}
+	}
+	if (memcmp(ram_jit, aica_ram.data, ARAM_SIZE))
+	{
+		printf("%s: sound ram differs\n", name);
+		same = false;
+	}
+
+	return same;
+}
+
+int main(int argc, char** argv)
+{
+	u32 programs = bench_arg(argc, argv, "--programs", 2000);
+	bench_srand(bench_arg(argc, argv, "--seed", 1));
+
+	common_libretro_setup();
+	_vmem_reserve();
+	libAICA_Init();
+	init_mem();
+	arm_Init();
+	interp_arm_Init();
+
+	ram_start = (u8*)malloc(ARAM_SIZE);
+	u32 bad = 0;
+
+	//a loop that stores over a later instruction in its own block, then in the next one
+	static const u32 smc_same_block[] = { 0xE3A0AA01, 0xE3A0C004, 0xE59A0020, 0xE58A0010, 0xE3A01005, 0xE25CC001, 0x1AFFFFFA, 0xEAFFFFFE, 0xE2811001 };
+	static const u32 smc_next_block[] = { 0xE3A0AA01, 0xE3A0C004, 0xE59A0024, 0xE58A0014, 0xEAFFFFFF, 0xE3A01005, 0xE25CC001, 0x1AFFFFF9, 0xEAFFFFFE, 0xE2811001 };
+
+	code_len = sizeof(smc_same_block) / 4;
+	memcpy(code, smc_same_block, sizeof(smc_same_block));
+	bad += !compare("smc, same block", 100);
+
+	code_len = sizeof(smc_next_block) / 4;
+	memcpy(code, smc_next_block, sizeof(smc_next_block));
+	bad += !compare("smc, next block", 100);
+
+	char name[32];
+	for (u32 p = 0; p < programs; p++)
+	{
+		random_program(20 + bench_rand() % 150, p & 1);
+		sprintf(name, "program %u", p);
+		bad += !compare(name, 4000);
+	}
+
+	printf("%u programs, %u differ\n", programs + 2, bad);
+
+	//one program as an endless loop, 80M cycles on each
+	random_program(100, false);
+	code[code_len - 1] = 0xEA000000 | ((2 - (code_len + 1)) & 0xFFFFFF);	//b to the first random op
+	const u32 slices = 20000, cycles = 4096;
+
+	load();
+	double t = bench_now();
+	for (u32 s = 0; s < slices; s++)
+		arm_Run_(cycles);
+	double t_jit = bench_now() - t;
+
+	load_interp();
+	t = bench_now();
+	for (u32 s = 0; s < slices; s++)
+		interp_arm_Run_(cycles);
+	double t_interp = bench_now() - t;
+
+	double total = (double)slices * cycles;
+	printf("recompiler:  %.1f M cycles/s\n", total / t_jit / 1e6);
+	printf("interpreter: %.1f M cycles/s\n", total / t_interp / 1e6);
+
+	return bad ? 1 : 0;
+}
+#else
+int main()
+{
+	printf("no ARM7 recompiler in this build, nothing to compare the interpreter with\n");
+	return 0;
+}
+#endif
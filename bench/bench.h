@@ -0,0 +1,81 @@
+#pragma once
+/*
+	Shared helpers for the benchmarks in this directory
+
+	Each bench is a small program linked against the core objects, built by
+	"make bench" and run by hand. They map the guest memory the way dc_init
+	does, but boot no bios or game, so they only drive the piece they time.
+*/
+#include "types.h"
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void common_libretro_setup(void);
+
+static inline double bench_now(void)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//xorshift, so every run and every path sees the same inputs
+static u32 bench_seed = 0x12345678;
+
+static inline void bench_srand(u32 seed)
+{
+	bench_seed = seed ? seed : 1;
+}
+
+static inline u32 bench_rand(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+static inline void bench_fill(void* dst, u32 size)
+{
+	u8* p = (u8*)dst;
+	for (u32 i = 0; i < size; i++)
+		p[i] = bench_rand() >> 24;
+}
+
+//fault handler, address space and the default memory map
+static inline void bench_init_mem(void)
+{
+	common_libretro_setup();
+
+	if (!_vmem_reserve())
+	{
+		printf("bench: can't reserve the guest address space\n");
+		exit(1);
+	}
+
+	mem_Init();
+	mem_map_default();
+	mem_Reset(false);
+}
+
+//"--name value" style options, with a default
+static inline int bench_arg(int argc, char** argv, const char* name, int def)
+{
+	for (int i = 1; i < argc - 1; i++)
+		if (!strcmp(argv[i], name))
+			return atoi(argv[i + 1]);
+	return def;
+}
+
+static inline bool bench_flag(int argc, char** argv, const char* name)
+{
+	for (int i = 1; i < argc; i++)
+		if (!strcmp(argv[i], name))
+			return true;
+	return false;
+}
@@ -0,0 +1,158 @@
+/*
+	AICA DSP, recompiler against interpreter
+
+	The build only uses one of them (FEAT_DSPREC), so the interpreter is
+	compiled into this program as well, under other names. Both run the same
+	random programs over the same sound ram, and the outputs are compared
+	(EFREG every sample, then TEMP, MEMS, the registers and sound ram).
+	Then each runs 10 seconds worth of samples of one program.
+
+	bench/dsp [--programs N] [--samples N]
+*/
+#include "types.h"
+
+#if FEAT_DSPREC == DYNAREC_JIT
+//the interpreter, as dsp_interp_recompile/dsp_interp_run
+#undef FEAT_DSPREC
+#define FEAT_DSPREC DYNAREC_CPP
+#define dsp_recompile dsp_interp_recompile
+#include "hw/aica/dsp_interp.cpp"
+#undef dsp_recompile
+#undef FEAT_DSPREC
+#define FEAT_DSPREC DYNAREC_JIT
+void dsp_recompile(void);
+#endif
+
+#include "bench.h"
+#include "hw/aica/dsp.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/aica_mem.h"
+
+#if FEAT_DSPREC == DYNAREC_JIT
+//dsp_step, for the interpreter
+static void interp_step(void)
+{
+	memset(DSPData->EFREG, 0, sizeof(DSPData->EFREG));
+
+	if (dsp.dyndirty)
+		dsp_interp_recompile();
+
+	dsp_interp_run();
+
+	dsp.regs.MDEC_CT--;
+	if (dsp.regs.MDEC_CT == 0)
+		dsp.regs.MDEC_CT = dsp.RBL;
+}
+
+static void random_program(u32 seed)
+{
+	bench_srand(seed);
+
+	for (int i = 0; i < 128 * 4; i++)
+		DSPData->MPRO[i] = bench_rand() & 0xFFFF;
+	for (int i = 0; i < 128; i++)
+		DSPData->COEF[i] = bench_rand() & 0xFFFF;
+	for (int i = 0; i < 64; i++)
+		DSPData->MADRS[i] = bench_rand() & 0xFFFF;
+	for (int i = 0; i < 2; i++)
+		DSPData->EXTS[i] = bench_rand() & 0xFFFF;
+
+	bench_fill(aica_ram.data, ARAM_SIZE);
+
+	dsp.RBL = (8192 << (seed & 3)) - 1;
+	dsp.RBP = (bench_rand() * 2048) & AICA_RAM_MASK;
+	dsp.dyndirty = true;
+}
+
+static void run(void (*step)(void), u32 samples, u32* efreg)
+{
+	for (u32 k = 0; k < samples; k++)
+	{
+		dsp.MIXS[k & 15] = (k * 7919) & 0xFFFFF;
+		step();
+		memcpy(&efreg[k * 16], DSPData->EFREG, 16 * 4);
+	}
+}
+
+static bool same_regs(const dsp_t& a, const dsp_t& b)
+{
+	return a.regs.MAD_OUT == b.regs.MAD_OUT && a.regs.FRC_REG == b.regs.FRC_REG &&
+		a.regs.Y_REG == b.regs.Y_REG && a.regs.ADRS_REG == b.regs.ADRS_REG &&
+		a.regs.MEM_RD_DATA == b.regs.MEM_RD_DATA && a.regs.MDEC_CT == b.regs.MDEC_CT;
+}
+
+int main(int argc, char** argv)
+{
+	u32 programs = bench_arg(argc, argv, "--programs", 20);
+	u32 samples = bench_arg(argc, argv, "--samples", 2000);
+
+	common_libretro_setup();
+	_vmem_reserve();
+	libAICA_Init();
+	dsp_init();
+
+	static dsp_t start, jit;
+	u8* aram_start = (u8*)malloc(ARAM_SIZE);
+	u8* aram_jit = (u8*)malloc(ARAM_SIZE);
+	u32* ef_jit = (u32*)malloc(samples * 16 * 4);
+	u32* ef_interp = (u32*)malloc(samples * 16 * 4);
+	u32 bad = 0;
+
+	for (u32 p = 0; p < programs; p++)
+	{
+		random_program(p + 1);
+		memcpy(&start, &dsp, sizeof(dsp));
+		memcpy(aram_start, aica_ram.data, ARAM_SIZE);
+
+		run(dsp_step, samples, ef_jit);
+		memcpy(&jit, &dsp, sizeof(dsp));
+		memcpy(aram_jit, aica_ram.data, ARAM_SIZE);
+
+		memcpy(&dsp, &start, sizeof(dsp));
+		memcpy(aica_ram.data, aram_start, ARAM_SIZE);
+		dsp.dyndirty = true;
+
+		run(interp_step, samples, ef_interp);
+
+		bool ef = memcmp(ef_jit, ef_interp, samples * 16 * 4) == 0;
+		bool temp = memcmp(jit.TEMP, dsp.TEMP, sizeof(dsp.TEMP)) == 0;
+		bool mems = memcmp(jit.MEMS, dsp.MEMS, sizeof(dsp.MEMS)) == 0;
+		bool ram = memcmp(aram_jit, aica_ram.data, ARAM_SIZE) == 0;
+		bool regs = same_regs(jit, dsp);
+
+		if (!ef || !temp || !mems || !ram || !regs)
+		{
+			printf("program %u differs: efreg %d temp %d mems %d ram %d regs %d\n", p, !ef, !temp, !mems, !ram, !regs);
+			bad++;
+		}
+	}
+
+	printf("%u programs, %u samples each, %u differ\n", programs, samples, bad);
+
+	//10 seconds of audio
+	const u32 bench_samples = 441000;
+
+	random_program(1000);
+	double t = bench_now();
+	for (u32 k = 0; k < bench_samples; k++)
+		dsp_step();
+	double t_jit = bench_now() - t;
+
+	random_program(1000);
+	t = bench_now();
+	for (u32 k = 0; k < bench_samples; k++)
+		interp_step();
+	double t_interp = bench_now() - t;
+
+	printf("recompiler:  %.0f samples/s (%.1fx realtime)\n", bench_samples / t_jit, bench_samples / t_jit / 44100);
+	printf("interpreter: %.0f samples/s (%.1fx realtime)\n", bench_samples / t_interp, bench_samples / t_interp / 44100);
+
+	return bad ? 1 : 0;
+}
+#else
+int main()
+{
+	printf("no DSP recompiler in this build, nothing to compare the interpreter with\n");
+	return 0;
+}
+#endif
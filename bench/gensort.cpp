@@ -0,0 +1,224 @@
+/*
+	Translucent triangle sort (GenSorted in gles.cpp)
+
+	Builds a TA-like translucent list: strips of 4 to 12 vertices, depths
+	from a coarse grid so many triangles tie (zeroes of both signs among
+	them), and runs of polygon params that only differ in fields the draw
+	batches ignore. GenSorted has to produce the same index list and draw
+	batches as the previous version, an IndexTrig list ordered with
+	std::stable_sort, which is kept here as the reference. Both are timed
+	at 2k, 14k and 42k triangles.
+
+	bench/gensort [--reps N]
+*/
+#include "bench.h"
+#include "hw/pvr/Renderer_if.h"
+#include "rend/gles/gles.h"
+
+#include <algorithm>
+
+//the previous GenSorted, without the upload
+struct IndexTrig
+{
+	u16 id[3];
+	u16 pid;
+	f32 z;
+};
+
+static bool operator<(const IndexTrig& left, const IndexTrig& right)
+{
+	return left.z < right.z;
+}
+
+static inline float minZ(Vertex* v, u16* mod)
+{
+	return min(min(v[mod[0]].z, v[mod[1]].z), v[mod[2]].z);
+}
+
+static inline bool PP_EQ(PolyParam* pp0, PolyParam* pp1)
+{
+	return (pp0->pcw.full & PCW_DRAW_MASK) == (pp1->pcw.full & PCW_DRAW_MASK)
+		&& pp0->isp.full == pp1->isp.full
+		&& pp0->tcw.full == pp1->tcw.full
+		&& pp0->tsp.full == pp1->tsp.full
+		&& pp0->tileclip == pp1->tileclip;
+}
+
+static vector<IndexTrig> lst;
+static vector<u16> ref_vidx;
+static vector<SortTrigDrawParam> ref_batches;
+
+static void RefGenSorted(void)
+{
+	Vertex* vtx_base = pvrrc.verts.head();
+	u16* idx_base = pvrrc.idx.head();
+	PolyParam* pp_base = pvrrc.global_param_tr.head();
+	PolyParam* pp_end = pp_base + pvrrc.global_param_tr.used();
+	int idx = -1;
+	u32 pfsti = 0;
+
+	ref_batches.clear();
+	lst.resize(pvrrc.verts.used() * 4);
+
+	for (PolyParam* pp = pp_base; pp != pp_end; pp++)
+	{
+		if (pp->count <= 2)
+			continue;
+
+		u16* pidx = idx_base + pp->first;
+		Vertex* vtx = vtx_base + pidx[0];
+		Vertex* vtx_end = vtx_base + pidx[pp->count - 1] - 1;
+		u32 flip = 0;
+
+		while (vtx != vtx_end)
+		{
+			Vertex* v0 = &vtx[0];
+			Vertex* v1 = &vtx[1];
+			Vertex* v2 = &vtx[2];
+
+			if (flip)
+			{
+				v0 = &vtx[2];
+				v2 = &vtx[0];
+			}
+
+			u16* d = lst[pfsti].id;
+			d[0] = v0 - vtx_base;
+			d[1] = v1 - vtx_base;
+			d[2] = v2 - vtx_base;
+			lst[pfsti].pid = pp - pp_base;
+			lst[pfsti].z = minZ(vtx_base, d);
+			pfsti++;
+
+			flip ^= 1;
+			vtx++;
+		}
+	}
+
+	lst.resize(pfsti);
+	std::stable_sort(lst.begin(), lst.end());
+
+	for (u32 k = 1; k < pfsti; k++)
+	{
+		if (lst[k].pid != lst[k - 1].pid && PP_EQ(&pp_base[lst[k].pid], &pp_base[lst[k - 1].pid]))
+			lst[k].pid = lst[k - 1].pid;
+	}
+
+	ref_vidx.resize(pfsti * 3);
+
+	for (u32 i = 0; i < pfsti; i++)
+	{
+		memcpy(&ref_vidx[i * 3], lst[i].id, 6);
+
+		if (idx == lst[i].pid)
+			continue;
+
+		SortTrigDrawParam stdp = { pp_base + lst[i].pid, i * 3, 0 };
+
+		if (idx != -1)
+			ref_batches.back().count = stdp.first - ref_batches.back().first;
+
+		ref_batches.push_back(stdp);
+		idx = lst[i].pid;
+	}
+
+	if (!ref_batches.empty())
+		ref_batches.back().count = pfsti * 3 - ref_batches.back().first;
+}
+
+//a translucent list of about 'triangles' triangles
+static void build_list(u32 triangles)
+{
+	static const float zeroes[2] = { 0.0f, -0.0f };
+
+	pvrrc.Clear();
+
+	u32 made = 0;
+	PolyParam* prev = 0;
+
+	while (made < triangles)
+	{
+		u32 count = 4 + bench_rand() % 9;
+		PolyParam* pp = pvrrc.global_param_tr.Append();
+
+		if (prev && bench_rand() % 2)
+			*pp = *prev;
+		else
+		{
+			memset(pp, 0, sizeof(*pp));
+			pp->isp.full = bench_rand() % 2;
+			pp->tsp.full = bench_rand() % 4;
+			pp->tcw.full = bench_rand() % 4;
+		}
+		//not part of the draw state, so these still merge
+		pp->pcw.full = (pp->pcw.full & PCW_DRAW_MASK) | (bench_rand() & ~PCW_DRAW_MASK);
+		pp->first = pvrrc.idx.used();
+		pp->count = count;
+
+		u32 base = pvrrc.verts.used();
+		Vertex* v = pvrrc.verts.Append(count);
+		u16* idx = pvrrc.idx.Append(count);
+
+		for (u32 i = 0; i < count; i++)
+		{
+			memset(&v[i], 0, sizeof(Vertex));
+			u32 r = bench_rand() % 64;
+			v[i].z = r < 4 ? zeroes[r & 1] : (bench_rand() % 256) / 256.0f;
+			idx[i] = base + i;
+		}
+
+		made += count - 2;
+		prev = pp;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	u32 reps = bench_arg(argc, argv, "--reps", 100);
+	static const u32 sizes[] = { 2000, 14000, 42000 };
+
+	static TA_context ctx;
+	ctx.Alloc();
+	_pvrrc = &ctx;
+
+	u32 bad = 0;
+
+	for (u32 s = 0; s < 3; s++)
+	{
+		bench_srand(s + 1);
+		build_list(sizes[s]);
+
+		GenSorted();
+		RefGenSorted();
+
+		bool same = vidx_sort.size() == ref_vidx.size() && pidx_sort.size() == ref_batches.size()
+			&& !memcmp(&vidx_sort[0], &ref_vidx[0], ref_vidx.size() * 2);
+		for (u32 i = 0; same && i < pidx_sort.size(); i++)
+			same = pidx_sort[i].ppid == ref_batches[i].ppid && pidx_sort[i].first == ref_batches[i].first
+				&& pidx_sort[i].count == ref_batches[i].count;
+
+		if (!same)
+		{
+			printf("%u triangles: output differs from the stable_sort version\n", sizes[s]);
+			bad++;
+			continue;
+		}
+
+		double t = bench_now();
+		for (u32 r = 0; r < reps; r++)
+			RefGenSorted();
+		double t_ref = (bench_now() - t) / reps;
+
+		t = bench_now();
+		for (u32 r = 0; r < reps; r++)
+			GenSorted();
+		double t_new = (bench_now() - t) / reps;
+
+		printf("%5u triangles, %5u polys, %4u batches: stable_sort %.3f ms, GenSorted %.3f ms\n",
+			(u32)ref_vidx.size() / 3, pvrrc.global_param_tr.used(), (u32)pidx_sort.size(), t_ref * 1e3, t_new * 1e3);
+	}
+
+	ctx.Free();
+
+	return bad ? 1 : 0;
+}
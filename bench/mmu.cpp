@@ -0,0 +1,182 @@
+/*
+	Full MMU translations, with and without the software TLB
+
+	mmu.cpp is compiled into this program twice, in its own namespaces:
+	once as it is, and once with the software TLB lookups always missing,
+	so every translation scans the UTLB/ITLB like it did before the cache
+	(the misses still fill the slots, so that side is a little slower than
+	the old code). Both run the same WinCE-like trace: shared 1MB and 64KB
+	kernel pages, 1KB and 4KB pages for 4 processes, reads, writes and
+	instruction fetches, ASID switches and remaps of random entries. The
+	results, URC and LRUI have to be the same.
+
+	bench/mmu [--translations N]
+*/
+#include "types.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/modules/mmu_impl.h"
+#include "hw/sh4/modules/ccn.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_interrupts.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/mem/_vmem.h"
+
+//the entries are global types, so the global mmu_match would be found too
+#define mmu_match ns_mmu_match
+
+//mmu.cpp calls these before it defines them, which would bind to the global ones
+namespace cached
+{
+bool UTLB_Sync(u32 entry);
+void ITLB_Sync(u32 entry);
+#include "hw/sh4/modules/mmu.cpp"
+}
+
+static INLINE bool mmu_cache_miss(mmu_cache_entry* cache, const u32* gen, u32 va, u32& idx, u32& rv)
+{
+	return false;
+}
+
+#define mmu_cache_get mmu_cache_miss
+namespace scan
+{
+bool UTLB_Sync(u32 entry);
+void ITLB_Sync(u32 entry);
+#include "hw/sh4/modules/mmu.cpp"
+}
+#undef mmu_cache_get
+#undef mmu_match
+
+#include "bench.h"
+
+struct mmu_version
+{
+	const char* name;
+	TLB_Entry* utlb;
+	void (*init)(void);
+	void (*reset)(void);
+	bool (*utlb_sync)(u32 entry);
+	u32 (*read)(u32 va, u32& rv);
+	u32 (*write)(u32 va, u32& rv);
+	u32 (*ifetch)(u32 va, u32& rv);
+};
+
+#define MMU_VERSION(ns, name) \
+	{ name, ns::UTLB, ns::MMU_init, ns::MMU_reset, ns::UTLB_Sync, \
+	  ns::mmu_data_translation<MMU_TT_DREAD>, ns::mmu_data_translation<MMU_TT_DWRITE>, ns::mmu_instruction_translation }
+
+static const mmu_version versions[2] =
+{
+	MMU_VERSION(scan, "scan"),
+	MMU_VERSION(cached, "software TLB"),
+};
+
+static void map(const mmu_version& m, u32 idx, u32 va, u32 pa, u32 sz, u32 asid, bool shared, u32 prot)
+{
+	TLB_Entry& e = m.utlb[idx];
+
+	e.Address.reg_data = 0;
+	e.Address.VPN = va >> 10;
+	e.Address.ASID = asid;
+	e.Data.reg_data = 0;
+	e.Data.PPN = pa >> 10;
+	e.Data.V = 1;
+	e.Data.SZ0 = sz & 1;
+	e.Data.SZ1 = sz >> 1;
+	e.Data.SH = shared;
+	e.Data.PR = prot;
+	e.Data.D = 1;
+
+	m.utlb_sync(idx);
+}
+
+struct trace_result
+{
+	u32 hash, errors, urc, lrui;
+	double seconds;
+};
+
+static trace_result run(const mmu_version& m, u32 count)
+{
+	m.init();
+	m.reset();
+	CCN_MMUCR.reg_data = 0;
+	CCN_MMUCR.AT = 1;
+	CCN_PTEH.reg_data = 0;
+	sr.MD = 0;
+
+	//shared kernel pages (1MB, 64KB), then 4KB and some 1KB pages for 4 processes
+	map(m, 0, 0x00000000, 0x0C000000, 3, 0, true, 3);
+	map(m, 1, 0x00100000, 0x0C100000, 2, 0, true, 3);
+	for (u32 i = 2; i < 64; i++)
+		map(m, i, 0x01000000 + (i / 4) * 0x1000 + (i % 4) * 0x100000, 0x0C200000 + i * 0x1000, i % 7 == 0 ? 0 : 1, i % 4, false, i % 5 == 0 ? 2 : 3);
+
+	bench_srand(12345);
+	trace_result res = { 0, 0, 0, 0, 0 };
+	u32 asid = 0;
+	double t = bench_now();
+
+	for (u32 i = 0; i < count; i++)
+	{
+		//a process switch every 64k accesses, a page remapped every 256k
+		if ((i & 0xFFFF) == 0)
+		{
+			asid = (asid + 1) & 3;
+			CCN_PTEH.ASID = asid;
+		}
+		if ((i & 0x3FFFF) == 0x1000)
+		{
+			u32 k = 2 + bench_rand() % 62;
+			map(m, k, 0x01000000 + (k / 4) * 0x1000 + (k % 4) * 0x100000, 0x0C400000 + (bench_rand() % 256) * 0x1000, 1, k % 4, false, 3);
+		}
+
+		u32 rnd = bench_rand();
+		u32 va;
+		if ((rnd & 7) == 0)
+			va = (rnd >> 3) & 0xFFFFC;
+		else if ((rnd & 7) == 1)
+			va = 0x00100000 + ((rnd >> 3) & 0xFFFC);
+		else
+			va = 0x01000000 + asid * 0x100000 + ((rnd >> 4) % 16) * 0x1000 + ((rnd >> 10) & 0xFFC);
+
+		u32 rv = 0;
+		u32 err = (i & 1) ? m.read(va, rv) : m.write(va, rv);
+		res.errors += err != MMU_ERROR_NONE;
+		res.hash = res.hash * 31 + err * 7 + rv;
+
+		if ((i & 15) == 3)
+		{
+			err = m.ifetch(va & ~1, rv);
+			res.hash = res.hash * 31 + err * 7 + rv;
+		}
+	}
+
+	res.seconds = bench_now() - t;
+	res.urc = CCN_MMUCR.URC;
+	res.lrui = CCN_MMUCR.LRUI;
+
+	return res;
+}
+
+int main(int argc, char** argv)
+{
+	u32 count = bench_arg(argc, argv, "--translations", 20000000);
+
+	common_libretro_setup();
+	_vmem_reserve();
+	settings.MMUEnabled = 1;
+
+	trace_result res[2];
+	for (int v = 0; v < 2; v++)
+	{
+		res[v] = run(versions[v], count);
+		//and an instruction fetch every 16 data accesses
+		printf("%-12s %.1f M translations/s, hash %08X, %u errors, URC %u, LRUI %u\n", versions[v].name,
+			count * 1.0625 / res[v].seconds / 1e6, res[v].hash, res[v].errors, res[v].urc, res[v].lrui);
+	}
+
+	bool same = res[0].hash == res[1].hash && res[0].errors == res[1].errors && res[0].urc == res[1].urc && res[0].lrui == res[1].lrui;
+	printf("%s\n", same ? "same results" : "the results differ");
+
+	return same ? 0 : 1;
+}
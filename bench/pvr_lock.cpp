@@ -0,0 +1,242 @@
+/*
+	VRAM write locks (pvr_lock.cpp)
+
+	Locks 10k textures of 32 bytes to 4KB at random places in vram, unlocks
+	every other one, then faults a third of the pages, and then the rest.
+	The previous version, a malloc and an mprotect per lock and a vector of
+	blocks per page that unlocks scan, is kept here as the reference. Both
+	have to invalidate the same textures on the first faults.
+
+	bench/pvr_lock [--textures N] [--reps N]
+*/
+#include "bench.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_lock.h"
+
+#include <vector>
+
+bool VramLockedWrite(u8* address);
+
+//the previous lock list
+static std::vector<vram_block*> ref_locks[VRAM_SIZE / PAGE_SIZE];
+static std::vector<u8> ref_invalid;
+
+static void ref_list_remove(vram_block* block)
+{
+	for (u32 i = block->start / PAGE_SIZE; i <= block->end / PAGE_SIZE; i++)
+	{
+		std::vector<vram_block*>* list = &ref_locks[i];
+		for (size_t j = 0; j < list->size(); j++)
+		{
+			if ((*list)[j] == block)
+				(*list)[j] = 0;
+		}
+	}
+}
+
+static void ref_list_add(vram_block* block)
+{
+	for (u32 i = block->start / PAGE_SIZE; i <= block->end / PAGE_SIZE; i++)
+	{
+		std::vector<vram_block*>* list = &ref_locks[i];
+		size_t j = 0;
+		while (j < list->size() && (*list)[j])
+			j++;
+
+		if (j < list->size())
+			(*list)[j] = block;
+		else
+			list->push_back(block);
+	}
+}
+
+static vram_block* ref_Lock(u32 start, u32 end, void* userdata)
+{
+	vram_block* block = (vram_block*)malloc(sizeof(vram_block));
+
+	block->start = start;
+	block->end = end;
+	block->len = end - start + 1;
+	block->userdata = userdata;
+	block->type = 64;
+
+	VArray2_LockRegion(&vram, block->start, block->len);
+	if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
+		VArray2_LockRegion(&vram, block->start + VRAM_SIZE, block->len);
+
+	ref_list_add(block);
+
+	return block;
+}
+
+static void ref_Unlock(vram_block* block)
+{
+	ref_list_remove(block);
+	free(block);
+}
+
+static void ref_LockedWrite(u32 offset)
+{
+	std::vector<vram_block*>* list = &ref_locks[offset / PAGE_SIZE];
+
+	for (size_t i = 0; i < list->size(); i++)
+	{
+		vram_block* block = (*list)[i];
+		if (block)
+		{
+			//what rend_text_invl does, on the bench's own flags
+			ref_invalid[(size_t)block->userdata] = 1;
+			ref_Unlock(block);
+		}
+	}
+	list->clear();
+
+	VArray2_UnLockRegion(&vram, offset & ~(PAGE_SIZE - 1), PAGE_SIZE);
+	if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
+		VArray2_UnLockRegion(&vram, (offset & ~(PAGE_SIZE - 1)) + VRAM_SIZE, PAGE_SIZE);
+}
+
+/*
+	rend_text_invl takes userdata for a TextureCacheData, which is private to
+	gltex.cpp, and sets two of its fields. Each texture gets a filled slot
+	bigger than that, and a slot that changed was invalidated.
+*/
+#define SLOT_SIZE 512
+
+static u8* slots;
+
+static bool slot_invalid(u32 i)
+{
+	for (u32 k = 0; k < SLOT_SIZE; k++)
+		if (slots[i * SLOT_SIZE + k] != 0xFF)
+			return true;
+	return false;
+}
+
+struct timings
+{
+	double lock, unlock, fault;
+};
+
+static std::vector<u32> tex_start, tex_end;
+static std::vector<vram_block*> blocks;
+
+static void random_textures(u32 count)
+{
+	bench_srand(1);
+	tex_start.resize(count);
+	tex_end.resize(count);
+
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 size = 32 << (bench_rand() % 8);
+		tex_start[i] = (bench_rand() % (VRAM_SIZE - size)) & ~31;
+		tex_end[i] = tex_start[i] + size - 1;
+	}
+}
+
+//the faults of one round: a third of the pages, then the rest
+static bool first_fault(u32 page)
+{
+	return page % 3 == 0;
+}
+
+static void run_new(timings& t, std::vector<u8>& invalid)
+{
+	u32 count = tex_start.size();
+	memset(slots, 0xFF, count * SLOT_SIZE);
+
+	double start = bench_now();
+	for (u32 i = 0; i < count; i++)
+		blocks[i] = libCore_vramlock_Lock(tex_start[i], tex_end[i], &slots[i * SLOT_SIZE]);
+	t.lock += bench_now() - start;
+
+	start = bench_now();
+	for (u32 i = 0; i < count; i += 2)
+		libCore_vramlock_Unlock_block(blocks[i]);
+	t.unlock += bench_now() - start;
+
+	start = bench_now();
+	for (u32 page = 0; page < VRAM_SIZE / PAGE_SIZE; page++)
+		if (first_fault(page))
+			VramLockedWrite(vram.data + page * PAGE_SIZE);
+	t.fault += bench_now() - start;
+
+	for (u32 i = 0; i < count; i++)
+		invalid[i] = slot_invalid(i);
+
+	for (u32 page = 0; page < VRAM_SIZE / PAGE_SIZE; page++)
+		if (!first_fault(page))
+			VramLockedWrite(vram.data + page * PAGE_SIZE);
+}
+
+static void run_ref(timings& t)
+{
+	u32 count = tex_start.size();
+	ref_invalid.assign(count, 0);
+
+	double start = bench_now();
+	for (u32 i = 0; i < count; i++)
+		blocks[i] = ref_Lock(tex_start[i], tex_end[i], (void*)(size_t)i);
+	t.lock += bench_now() - start;
+
+	start = bench_now();
+	for (u32 i = 0; i < count; i += 2)
+		ref_Unlock(blocks[i]);
+	t.unlock += bench_now() - start;
+
+	start = bench_now();
+	for (u32 page = 0; page < VRAM_SIZE / PAGE_SIZE; page++)
+		if (first_fault(page))
+			ref_LockedWrite(page * PAGE_SIZE);
+	t.fault += bench_now() - start;
+
+	std::vector<u8> first = ref_invalid;
+	for (u32 page = 0; page < VRAM_SIZE / PAGE_SIZE; page++)
+		if (!first_fault(page))
+			ref_LockedWrite(page * PAGE_SIZE);
+	ref_invalid = first;
+}
+
+int main(int argc, char** argv)
+{
+	u32 count = bench_arg(argc, argv, "--textures", 10000);
+	u32 reps = bench_arg(argc, argv, "--reps", 5);
+
+	bench_init_mem();
+	libCore_vramlock_Init();
+
+	slots = (u8*)malloc(count * SLOT_SIZE);
+	blocks.resize(count);
+	random_textures(count);
+
+	timings t_new = { 0, 0, 0 }, t_ref = { 0, 0, 0 };
+	std::vector<u8> invalid(count);
+	u32 bad = 0;
+
+	for (u32 r = 0; r < reps; r++)
+	{
+		run_ref(t_ref);
+		run_new(t_new, invalid);
+
+		for (u32 i = 0; i < count; i++)
+		{
+			if (invalid[i] != ref_invalid[i])
+			{
+				if (r == 0 && bad < 10)
+					printf("texture %u: invalidated %d, previous version %d\n", i, invalid[i], ref_invalid[i]);
+				bad++;
+			}
+		}
+	}
+
+	u32 invalidated = 0;
+	for (u32 i = 0; i < count; i++)
+		invalidated += invalid[i];
+
+	printf("%u textures, %u invalidated by the first faults, %u differ\n", count, invalidated, bad / reps);
+	printf("previous: lock %.2f ms  unlock %.2f ms  fault %.2f ms\n", t_ref.lock * 1e3 / reps, t_ref.unlock * 1e3 / reps, t_ref.fault * 1e3 / reps);
+	printf("pooled:   lock %.2f ms  unlock %.2f ms  fault %.2f ms\n", t_new.lock * 1e3 / reps, t_new.unlock * 1e3 / reps, t_new.fault * 1e3 / reps);
+
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/*
+	Rewind snapshot cost and ring size
+
+	Each frame writes to a number of random ram, vram and aram pages through
+	the guest views, so they take the same write faults a game does, then
+	takes a snapshot. Reports the time and the bytes written per snapshot,
+	and how many frames of history fit in the ring. Pops are timed at the
+	end.
+
+	bench/rewind [--ring MB] [--frames N] [--pages N] [--noise PERCENT]
+
+	--pages is the number of pages written per frame, over all of memory.
+	--noise is the share of them that get fully random contents (decoded
+	textures, audio), the rest get a few scattered words changed.
+*/
+#include "bench.h"
+#include "rewind.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/aica/aica_if.h"
+#include "hw/arm7/arm7.h"
+
+//mostly zeroes and small values, closer to what games keep in memory than noise
+static void fill_plausible(VArray2& arr)
+{
+	u32* p = (u32*)arr.data;
+	for (u32 i = 0; i < arr.size / 4; i++)
+		p[i] = bench_rand() % 4 ? 0 : bench_rand() % 1024;
+}
+
+static void touch_page(VArray2& arr, bool noise)
+{
+	u32 page = bench_rand() % (arr.size / PAGE_SIZE);
+	u8* p = arr.data + page * PAGE_SIZE;
+
+	if (noise)
+	{
+		bench_fill(p, PAGE_SIZE);
+		return;
+	}
+
+	for (u32 i = 0; i < 16; i++)
+		*(u32*)&p[(bench_rand() % (PAGE_SIZE / 4)) * 4] = bench_rand() % 1024;
+}
+
+int main(int argc, char** argv)
+{
+	u32 ring_mb = bench_arg(argc, argv, "--ring", 64);
+	u32 frames = bench_arg(argc, argv, "--frames", 3600);
+	u32 pages = bench_arg(argc, argv, "--pages", 200);
+	u32 noise = bench_arg(argc, argv, "--noise", 10);
+
+	bench_init_mem();
+	//the snapshots carry the sound state along
+	libAICA_Init();
+	arm_Init();
+
+	fill_plausible(mem_b);
+	fill_plausible(vram);
+	fill_plausible(aica_ram);
+
+	if (!rewind_init(ring_mb << 20))
+		return 1;
+
+	double total = 0, worst = 0;
+
+	for (u32 f = 0; f < frames; f++)
+	{
+		//roughly in proportion to the sizes, 16:8:2
+		for (u32 i = 0; i < pages; i++)
+		{
+			u32 pick = bench_rand() % 26;
+			bool is_noise = bench_rand() % 100 < noise;
+
+			if (pick < 16)
+				touch_page(mem_b, is_noise);
+			else if (pick < 24)
+				touch_page(vram, is_noise);
+			else
+				touch_page(aica_ram, is_noise);
+		}
+
+		double t = bench_now();
+		rewind_push();
+		t = bench_now() - t;
+
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+
+	rewind_stats st;
+	rewind_get_stats(&st);
+
+	printf("%u frames, %u pages written per frame, %u%% noise, %u MB ring\n", frames, pages, noise, ring_mb);
+	printf("snapshot: %.1f us avg, %.1f us worst\n", total / frames * 1e6, worst * 1e6);
+	printf("  %u changed pages, %.1f KB raw, %.1f KB written per snapshot\n",
+		st.pages / st.snapshots, st.raw_bytes / 1024.0 / st.snapshots, st.bytes / 1024.0 / st.snapshots);
+	printf("ring: %u snapshots kept, %.1f s at 60 fps\n", st.entries, st.entries / 60.0);
+
+	u32 pops = 0;
+	double t = bench_now();
+	while (pops < 600 && rewind_pop())
+		pops++;
+	t = bench_now() - t;
+
+	if (pops)
+		printf("pop: %.1f us avg over %u\n", t / pops * 1e6, pops);
+
+	rewind_term();
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+	SH4 interpreter, plain loop against the decode cache (INT_DECODE_CACHE)
+
+	A loop that calls a checksum over a data block, stores a table, and
+	calls a small stub, which it can rewrite first with a different
+	immediate every time. The stub is in another page, or in the page that
+	is running. The plain fetch and OpPtr dispatch loop, as the interpreter
+	runs without the decode cache, is kept here. Each runs the same number
+	of timeslices from the same state, and the registers, the table and pc
+	have to match.
+
+	bench/sh4_interp [--frames N]
+
+	a frame is the 10000 timeslices of one sh4_cpu.Run()
+*/
+#include "bench.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_interpreter.h"
+#include "hw/sh4/sh4_opcode_list.h"
+
+#define SH4_TIMESLICE 448
+#define CPU_RATIO 8
+
+//Sh4_int_Run_execInternal
+static void plain_exec(s32* l)
+{
+	do
+	{
+		u32 addr = next_pc;
+		next_pc += 2;
+		u32 op = ReadMem16(addr);
+
+		OpPtr[op](op);
+		*l -= CPU_RATIO;
+	} while (*l > 0);
+	*l += SH4_TIMESLICE;
+	UpdateSystem_INTC();
+}
+
+static void plain_run(void)
+{
+	s32 l = SH4_TIMESLICE;
+
+	for (int i = 0; i < 10000; i++)
+		plain_exec(&l);
+}
+
+#define MAIN 0x8C010000
+#define SUM  0x8C011000
+#define DATA 0x8C020000
+
+static u32 pcur, litbase, nlits;
+
+static void emit(u16 op)
+{
+	_vmem_WriteMem16(pcur, op);
+	pcur += 2;
+}
+
+static void movl_lit(u32 n, u32 val)
+{
+	u32 a = litbase + nlits * 4;
+	_vmem_WriteMem32(a, val);
+	nlits++;
+	emit(0xD000 | (n << 8) | ((a - ((pcur & ~3) + 4)) / 4));
+}
+
+static void build(bool smc, u32 stub)
+{
+	for (u32 i = 0; i < 0x400; i += 4)
+		_vmem_WriteMem32(DATA + i, (i + 1) * 2654435761u);
+
+	pcur = MAIN;
+	litbase = MAIN + 0x100;
+	nlits = 0;
+	movl_lit(8, DATA);
+	movl_lit(11, stub);
+	movl_lit(9, SUM);
+	emit(0xEC00);	//mov #0,r12
+
+	u32 loop = pcur;
+	emit(0x6183);	//mov r8,r1
+	emit(0xE240);	//mov #64,r2
+	emit(0x490B);	//jsr @r9
+	emit(0x0009);
+	emit(0x3D0C);	//add r0,r13
+	emit(0x6383);	//mov r8,r3
+	movl_lit(4, 0x100);
+	emit(0x334C);	//add r4,r3
+	emit(0xE220);	//mov #32,r2
+
+	u32 st = pcur;
+	emit(0x23D2);	//mov.l r13,@r3
+	emit(0x7304);	//add #4,r3
+	emit(0x2D2A);	//xor r2,r13
+	emit(0x4D00);	//shll r13
+	emit(0x4210);	//dt r2
+	emit(0x8B00 | (((st - (pcur + 4)) / 2) & 0xFF));	//bf st
+
+	if (smc)
+	{
+		//the stub's "mov #imm,r10" gets r12&0x7F
+		emit(0x65C3);	//mov r12,r5
+		emit(0xE77F);	//mov #0x7F,r7
+		emit(0x2579);	//and r7,r5
+		movl_lit(6, 0xEA00);
+		emit(0x256B);	//or r6,r5
+		emit(0x2B51);	//mov.w r5,@r11
+	}
+	emit(0x4B0B);	//jsr @r11
+	emit(0x0009);
+	emit(0x3EAC);	//add r10,r14
+	emit(0x7C01);	//add #1,r12
+	emit(0xA000 | (((loop - (pcur + 4)) / 2) & 0xFFF));	//bra loop
+	emit(0x0009);
+
+	pcur = SUM;
+	emit(0xE000);	//mov #0,r0
+	u32 sl = pcur;
+	emit(0x6316);	//mov.l @r1+,r3
+	emit(0x303C);	//add r3,r0
+	emit(0x643C);	//extu.b r3,r4
+	emit(0x2448);	//tst r4,r4
+	emit(0x8901);	//bt +1
+	emit(0x204A);	//xor r4,r0
+	emit(0x4309);	//shlr2 r3
+	emit(0x3030);	//cmp/eq r3,r0
+	emit(0x4210);	//dt r2
+	emit(0x8B00 | (((sl - (pcur + 4)) / 2) & 0xFF));	//bf sl
+	emit(0x000B);	//rts
+	emit(0x0009);
+
+	pcur = stub;
+	emit(0xEA05);	//mov #5,r10
+	emit(0x000B);	//rts
+	emit(0x0009);
+}
+
+static u32 state_hash(void)
+{
+	u32 h = 0;
+	for (int i = 0; i < 16; i++)
+		h = h * 31 + r[i];
+	for (u32 a = DATA; a < DATA + 0x400; a += 4)
+		h = h * 31 + _vmem_ReadMem32(a);
+	return h * 31 + next_pc;
+}
+
+//from reset, with the scheduler out of the way
+static void start(bool smc, u32 stub)
+{
+	sh4_cpu.Stop();
+	sh4_cpu.Reset(false);
+	build(smc, stub);
+	next_pc = MAIN;
+	Sh4cntx.sh4_sched_next = 0x7FFFFFFF;
+	Sh4cntx.interrupt_pend = 0;
+}
+
+int main(int argc, char** argv)
+{
+	u32 frames = bench_arg(argc, argv, "--frames", 30);
+
+	bench_init_mem();
+	Get_Sh4Interpreter(&sh4_cpu);
+	sh4_cpu.Init();
+
+	static const struct
+	{
+		const char* name;
+		bool smc;
+		u32 stub;
+	} cases[] =
+	{
+		{ "no smc",                  false, 0x8C012000 },
+		{ "smc stub in another page", true, 0x8C012000 },
+		{ "smc in the running page",  true, MAIN + 0x200 },
+	};
+
+	u32 bad = 0;
+	double mops = (double)frames * 10000 * SH4_TIMESLICE / CPU_RATIO / 1e6;
+
+	for (u32 c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+	{
+		start(cases[c].smc, cases[c].stub);
+		double t = bench_now();
+		for (u32 f = 0; f < frames; f++)
+			plain_run();
+		double t_plain = bench_now() - t;
+		u32 h_plain = state_hash();
+
+		start(cases[c].smc, cases[c].stub);
+		t = bench_now();
+		for (u32 f = 0; f < frames; f++)
+			sh4_cpu.Run();
+		double t_cached = bench_now() - t;
+		u32 h_cached = state_hash();
+
+		bool same = h_plain == h_cached;
+		bad += !same;
+
+		printf("%-25s plain %6.1f Mops/s, decode cache %6.1f Mops/s, %.2fx  %s\n", cases[c].name,
+			mops / t_plain, mops / t_cached, t_plain / t_cached, same ? "same state" : "STATE DIFFERS");
+	}
+
+	return bad ? 1 : 0;
+}
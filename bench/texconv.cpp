@@ -0,0 +1,203 @@
+/*
+	SIMD texture converters against the portable ones
+
+	Every converter in texconv_sse2[] and texconv_ssse3[] (planar, twiddled
+	and VQ, YUV, PAL4 and PAL8) runs over textures at random places in
+	random vram, for every size from 8x8 to 1024x1024 and a few odd planar
+	widths. The output, and the padding around it, has to match the
+	pvr_pixfmt.h converter byte for byte. Then the same textures are timed,
+	256x256 and 1024x1024, portable against SIMD.
+
+	bench/texconv [--check] [--reps N]
+
+	--check only compares, "make check" runs it that way
+*/
+#include "bench.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/TexCache.h"
+#include "hw/pvr/pvr_pixfmt.h"
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+//format[] in gltex.cpp, without the bump maps
+static const TexConvTable portable[7] =
+{
+	{ &tex1555_PL,   &tex1555_TW,   &tex1555_VQ   },
+	{ &tex565_PL,    &tex565_TW,    &tex565_VQ    },
+	{ &tex4444_PL,   &tex4444_TW,   &tex4444_VQ   },
+	{ &texYUV422_PL, &texYUV422_TW, &texYUV422_VQ },
+	{ 0, 0, 0 },
+	{ 0, &texPAL4_TW, 0 },
+	{ 0, &texPAL8_TW, 0 },
+};
+
+static const char* format_name[7] = { "1555", "565", "4444", "yuv", "bump", "pal4", "pal8" };
+static const char* kind_name[3] = { "PL", "TW", "VQ" };
+
+enum { PL, TW, VQ };
+
+static TexConvFP* pick(const TexConvTable& t, int kind)
+{
+	return kind == PL ? t.PL : kind == TW ? t.TW : t.VQ;
+}
+
+//bytes of vram a texture takes, the VQ codebook included
+static u32 texture_size(int fmt, int kind, u32 w, u32 h)
+{
+	if (kind == VQ)
+		return 256 * 4 * 2 + w * h / 4;
+	if (fmt == 5)
+		return w * h / 2;
+	if (fmt == 6)
+		return w * h;
+	return w * h * 2;
+}
+
+static u32 palette[1024];
+
+//a texture somewhere in vram, set up like gltex.cpp does
+static u8* place(PixelBuffer* pb, int fmt, int kind, u32 w, u32 h, u16* out)
+{
+	u32 size = texture_size(fmt, kind, w, h);
+	u32 addr = (bench_rand() % (VRAM_SIZE - size)) & ~7;
+
+	pb->p_buffer_start = out;
+	pb->pixels_per_line = w;
+	pb->palette = &palette[fmt == 5 ? (bench_rand() % 64) * 16 : (bench_rand() % 4) * 256];
+	pb->vq_codebook = &vram.data[addr];
+
+	return &vram.data[addr];
+}
+
+#define GUARD 64
+
+//both converters on the same texture, output and padding compared
+static bool same(TexConvFP* ref, TexConvFP* simd, int fmt, int kind, u32 w, u32 h)
+{
+	static u16* a = (u16*)malloc((1024 * 1024 + GUARD * 2) * 2);
+	static u16* b = (u16*)malloc((1024 * 1024 + GUARD * 2) * 2);
+	u32 count = w * h + GUARD * 2;
+
+	memset(a, 0xCD, count * 2);
+	memset(b, 0xCD, count * 2);
+
+	PixelBuffer pa, pb;
+	u8* p_in = place(&pa, fmt, kind, w, h, a + GUARD);
+	pb = pa;
+	pb.p_buffer_start = b + GUARD;
+
+	ref(&pa, p_in, w, h);
+	simd(&pb, p_in, w, h);
+
+	return memcmp(a, b, count * 2) == 0;
+}
+
+static u32 check(const char* name, const TexConvTable* table)
+{
+	static const u32 pl_widths[] = { 8, 12, 20, 320, 324, 640 };
+	u32 tested = 0, bad = 0;
+
+	for (int fmt = 0; fmt < 7; fmt++)
+	{
+		for (int kind = PL; kind <= VQ; kind++)
+		{
+			TexConvFP* simd = pick(table[fmt], kind);
+			if (!simd)
+				continue;
+			TexConvFP* ref = pick(portable[fmt], kind);
+
+			for (u32 sw = 3; sw <= 10; sw++)
+			{
+				for (u32 sh = 3; sh <= 10; sh++)
+				{
+					u32 w = 1 << sw, h = 1 << sh;
+					if (kind == PL && sw < 6)
+						w = pl_widths[sw - 3 + (sh & 1) * 3];
+
+					tested++;
+					if (!same(ref, simd, fmt, kind, w, h))
+					{
+						printf("%s %s %s %ux%u differs\n", name, format_name[fmt], kind_name[kind], w, h);
+						bad++;
+					}
+				}
+			}
+		}
+	}
+
+	printf("%s: %u textures, %u differ\n", name, tested, bad);
+	return bad;
+}
+
+//Mpixels/s over the same textures for both
+static void bench(const char* name, const TexConvTable* table, u32 w, u32 h, u32 reps)
+{
+	static u16* out = (u16*)malloc(1024 * 1024 * 2);
+
+	for (int fmt = 0; fmt < 7; fmt++)
+	{
+		for (int kind = PL; kind <= VQ; kind++)
+		{
+			TexConvFP* simd = pick(table[fmt], kind);
+			if (!simd)
+				continue;
+			TexConvFP* ref = pick(portable[fmt], kind);
+			double t[2];
+
+			for (int i = 0; i < 2; i++)
+			{
+				TexConvFP* fn = i ? simd : ref;
+				bench_srand(fmt * 3 + kind + 1);
+				double start = bench_now();
+
+				for (u32 r = 0; r < reps; r++)
+				{
+					PixelBuffer pb;
+					u8* p_in = place(&pb, fmt, kind, w, h, out);
+					fn(&pb, p_in, w, h);
+				}
+				t[i] = bench_now() - start;
+			}
+
+			double mpix = (double)w * h * reps / 1e6;
+			printf("%-6s %-4s %s %4ux%-4u  portable %7.1f  %s %7.1f Mpixels/s  %.1fx\n",
+				name, format_name[fmt], kind_name[kind], w, h, mpix / t[0], name, mpix / t[1], t[0] / t[1]);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool check_only = bench_flag(argc, argv, "--check");
+	u32 reps = bench_arg(argc, argv, "--reps", 200);
+
+	bench_init_mem();
+	bench_fill(vram.data, VRAM_SIZE);
+	bench_fill(palette, sizeof(palette));
+
+	bool ssse3 = __builtin_cpu_supports("ssse3");
+	u32 bad = check("sse2", texconv_sse2);
+	if (ssse3)
+		bad += check("ssse3", texconv_ssse3);
+	else
+		printf("ssse3: not supported by this cpu, skipped\n");
+
+	if (!check_only && !bad)
+	{
+		bench("sse2", texconv_sse2, 256, 256, reps);
+		bench("sse2", texconv_sse2, 1024, 1024, reps / 16);
+		if (ssse3)
+		{
+			bench("ssse3", texconv_ssse3, 256, 256, reps);
+			bench("ssse3", texconv_ssse3, 1024, 1024, reps / 16);
+		}
+	}
+
+	return bad ? 1 : 0;
+}
+#else
+int main()
+{
+	printf("no SIMD texture converters on this host\n");
+	return 0;
+}
+#endif
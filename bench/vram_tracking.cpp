@@ -0,0 +1,133 @@
+/*
+	VRAM write tracking, faults against settings.pvr.VramSoftTracking
+
+	5000 textures of 2KB to 32KB are locked at random places in vram. Each
+	frame looks every texture up, relocks the ones that were invalidated,
+	then writes 1MB of vram with 32-bit stores scattered over 256 pages,
+	through the area 1 64-bit mapping like the game would. The mode is fixed
+	when the address space is reserved, so each one runs in its own process.
+	Both have to invalidate the same textures.
+
+	bench/vram_tracking [--frames N] [--textures N]
+*/
+#include "bench.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_lock.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct tracking_result
+{
+	double ms;
+	u32 invalidated;
+	u32* per_texture;
+};
+
+/*
+	rend_text_invl takes userdata for a TextureCacheData, which is private to
+	gltex.cpp, and sets two of its fields. Each texture gets a filled slot
+	bigger than that, and a slot that changed was invalidated.
+*/
+#define SLOT_SIZE 512
+
+static void run(bool soft, u32 frames, u32 count, tracking_result* res)
+{
+	settings.pvr.VramSoftTracking = soft;
+	bench_init_mem();
+	libCore_vramlock_Init();
+
+	u8* slots = (u8*)malloc(count * SLOT_SIZE);
+	vram_block** live = (vram_block**)calloc(count, sizeof(vram_block*));
+	u32* start = (u32*)malloc(count * 4);
+	u32* size = (u32*)malloc(count * 4);
+
+	bench_srand(1);
+	for (u32 i = 0; i < count; i++)
+	{
+		size[i] = 2048 << (bench_rand() % 5);
+		start[i] = (bench_rand() % (VRAM_SIZE - size[i])) & ~31;
+	}
+
+	u32 invalidated = 0;
+	double t = bench_now();
+
+	for (u32 f = 0; f < frames; f++)
+	{
+		//the render side: every texture looked up, the invalidated ones locked again
+		for (u32 i = 0; i < count; i++)
+		{
+			u8* slot = &slots[i * SLOT_SIZE];
+
+			if (live[i])
+			{
+				libCore_vramlock_Check(live[i]);
+
+				for (u32 k = 0; k < SLOT_SIZE; k++)
+				{
+					if (slot[k] != 0xFF)
+					{
+						live[i] = 0;
+						res->per_texture[i]++;
+						invalidated++;
+						break;
+					}
+				}
+			}
+
+			if (!live[i])
+			{
+				memset(slot, 0xFF, SLOT_SIZE);
+				live[i] = libCore_vramlock_Lock(start[i], start[i] + size[i] - 1, slot);
+			}
+		}
+
+		//the game side: 1MB of stores over 256 pages
+		u32 base = (bench_rand() % (VRAM_SIZE / PAGE_SIZE - 256)) * PAGE_SIZE;
+		for (u32 o = 0; o < 256 * PAGE_SIZE; o += 64)
+			_vmem_WriteMem32(0xA4000000 | (base + o), o);
+	}
+
+	res->ms = (bench_now() - t) * 1e3 / frames;
+	res->invalidated = invalidated;
+}
+
+int main(int argc, char** argv)
+{
+	u32 frames = bench_arg(argc, argv, "--frames", 200);
+	u32 count = bench_arg(argc, argv, "--textures", 5000);
+
+	//shared with the children
+	size_t shared = sizeof(tracking_result) * 2 + count * 4 * 2;
+	tracking_result* res = (tracking_result*)mmap(0, shared, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	res[0].per_texture = (u32*)&res[2];
+	res[1].per_texture = res[0].per_texture + count;
+	static const char* name[2] = { "faults", "software" };
+
+	for (int soft = 0; soft < 2; soft++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			run(soft, frames, count, &res[soft]);
+			exit(0);
+		}
+
+		int status = 1;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			printf("%s: failed\n", name[soft]);
+			return 1;
+		}
+	}
+
+	for (int soft = 0; soft < 2; soft++)
+		printf("%-8s %.2f ms/frame, %u textures invalidated\n", name[soft], res[soft].ms, res[soft].invalidated);
+
+	bool same = !memcmp(res[0].per_texture, res[1].per_texture, count * 4);
+	printf("%s\n", same ? "both modes invalidated the same textures" : "the modes invalidated different textures");
+
+	return same ? 0 : 1;
+}
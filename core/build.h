@@ -200,13 +200,17 @@
 #if defined(TARGET_NO_REC)
 #define FEAT_SHREC DYNAREC_NONE
 #define FEAT_AREC DYNAREC_NONE
-#define FEAT_DSPREC DYNAREC_NONE
+#define FEAT_DSPREC DYNAREC_CPP
 #endif
 
 #if defined(TARGET_NO_AREC)
 #define FEAT_SHREC DYNAREC_JIT
 #define FEAT_AREC DYNAREC_NONE
-#define FEAT_DSPREC DYNAREC_NONE
+#if HOST_CPU == CPU_X64
+#define FEAT_DSPREC DYNAREC_JIT
+#else
+#define FEAT_DSPREC DYNAREC_CPP
+#endif
 #endif
 
 //defaults
@@ -220,7 +224,7 @@
 #endif
 
 #ifndef FEAT_AREC
-	#if HOST_CPU == CPU_ARM || HOST_CPU == CPU_X86
+	#if HOST_CPU == CPU_X64
 		#define FEAT_AREC DYNAREC_JIT
 	#else
 		#define FEAT_AREC DYNAREC_NONE
@@ -228,10 +232,10 @@
 #endif
 
 #ifndef FEAT_DSPREC
-	#if HOST_CPU == CPU_X86
+	#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
 		#define FEAT_DSPREC DYNAREC_JIT
 	#else
-		#define FEAT_DSPREC DYNAREC_NONE
+		#define FEAT_DSPREC DYNAREC_CPP
 	#endif
 #endif
 
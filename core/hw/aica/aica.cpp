@@ -4,6 +4,7 @@
 #include <math.h>
 #include "hw/holly/holly_intc.h"
 #include "hw/holly/sb.h"
+#include "serialize.h"
 
 #define SH4_IRQ_BIT (1<<(holly_SPU_IRQ&255))
 
@@ -297,3 +298,13 @@ void libAICA_Term(void)
 {
 	sgc_Term();
 }
+
+void aica_serialize(Serializer& s)
+{
+	//data points into aica_reg, only the step counters live here
+	for (int i=0;i<3;i++)
+	{
+		s.value(timers[i].c_step);
+		s.value(timers[i].m_step);
+	}
+}
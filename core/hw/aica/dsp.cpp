@@ -21,52 +21,10 @@
 
 DECL_ALIGN(4096) dsp_t dsp;
 
-#if HOST_CPU == CPU_X86 && FEAT_DSPREC == DYNAREC_JIT
-#include "emitter/x86_emitter.h"
-
-const bool SUPPORT_NOFL=false;
-
-
-#define assert verify
-
-#pragma warning(disable:4311)
-
-struct _INST
-{
-	unsigned int TRA;
-	unsigned int TWT;
-	unsigned int TWA;
-	
-	unsigned int XSEL;
-	unsigned int YSEL;
-	unsigned int IRA;
-	unsigned int IWT;
-	unsigned int IWA;
-
-	unsigned int EWT;
-	unsigned int EWA;
-	unsigned int ADRL;
-	unsigned int FRCL;
-	unsigned int SHIFT;
-	unsigned int YRL;
-	unsigned int NEGB;
-	unsigned int ZERO;
-	unsigned int BSEL;
-
-	unsigned int NOFL;  //MRQ set
-	unsigned int TABLE; //MRQ set
-	unsigned int MWT;   //MRQ set
-	unsigned int MRD;   //MRQ set
-	unsigned int MASA;  //MRQ set
-	unsigned int ADREB; //MRQ set
-	unsigned int NXADR; //MRQ set
-};
-
-
-#define DYNBUF  0x10000
+#if FEAT_DSPREC != DYNAREC_NONE
 
 //float format is ?
-static u16 DYNACALL PACK(s32 val)
+u16 DYNACALL PACK(s32 val)
 {
 	int k;
 	int sign = (val >> 23) & 0x1;
@@ -91,7 +49,7 @@ static u16 DYNACALL PACK(s32 val)
 	return (u16)val;
 }
 
-static s32 DYNACALL UNPACK(u16 val)
+s32 DYNACALL UNPACK(u16 val)
 {
 	int sign     = (val >> 15) & 0x1;
 	int exponent = (val >> 11) & 0xF;
@@ -121,11 +79,11 @@ void dsp_init(void)
 	dsp.regs.MDEC_CT=1;
 
 
+#if FEAT_DSPREC == DYNAREC_JIT
 	os_MakeExecutable(dsp.DynCode,sizeof(dsp.DynCode));
+#endif
 }
 
-void dsp_recompile(void);
-
 void DecodeInst(u32 *IPtr,_INST *i)
 {
 	i->TRA=(IPtr[0]>>9)&0x7F;
@@ -159,12 +117,6 @@ void DecodeInst(u32 *IPtr,_INST *i)
 	i->NXADR=(IPtr[3]>>7)&0x1;
 }
 
-
-void* dyna_realloc(void*ptr,u32 oldsize,u32 newsize)
-{
-	return dsp.DynCode;
-}
-
 void _dsp_debug_step_start(void)
 {
 	memset(&dsp.regs_init,0,sizeof(dsp.regs_init));
@@ -190,8 +142,85 @@ void _dsp_debug_step_end(void)
 	verify(dsp.regs_init.TEMPS);
 	verify(dsp.regs_init.EFREG);
 }
-#define nwtn(x) verify(!dsp.regs_init.##x)
-#define wtn(x) nwtn(x);dsp.regs_init.##x=true;
+
+void dsp_print_mame();
+void dsp_step_mame();
+void dsp_emu_grandia();
+void dsp_step(void)
+{
+	//clear output reg
+	memset(DSPData->EFREG,0,sizeof(DSPData->EFREG));
+
+	if (dsp.dyndirty)
+	{
+		dsp.dyndirty=false;
+		//dsp_print_mame();
+		dsp_recompile();
+	}
+	//dsp_step_mame();
+	//dsp_emu_grandia();
+	
+	//run the code :p
+#if FEAT_DSPREC == DYNAREC_JIT
+	((void (*)())&dsp.DynCode)();
+#else
+	dsp_interp_run();
+#endif
+
+	dsp.regs.MDEC_CT--;
+	if (dsp.regs.MDEC_CT==0)
+		dsp.regs.MDEC_CT=dsp.RBL;
+	//here ? or before ?
+	//memset(DSP->MIXS,0,4*16);
+}
+
+void dsp_writenmem(u32 addr)
+{
+	addr-=0x3000;
+	//COEF : native
+	//MEMS : native
+	//MPRO : native
+	if (addr>=0x400 && addr<0xC00)
+	{
+		dsp.dyndirty=true;
+	}
+
+	/*
+	//buffered DSP state
+	//24 bit wide
+	u32 TEMP[128];
+	//24 bit wide
+	u32 MEMS[32];
+	//20 bit wide
+	s32 MIXS[16];
+	*/
+}
+
+void dsp_readmem(u32 addr)
+{
+	//nothing ? :p
+}
+#else
+
+void dsp_init() { }
+void dsp_term() { }
+void dsp_step() { }
+void dsp_writenmem(u32 addr) { }
+#endif
+
+#if HOST_CPU == CPU_X86 && FEAT_DSPREC == DYNAREC_JIT
+#include "emitter/x86_emitter.h"
+
+#define assert verify
+
+#pragma warning(disable:4311)
+
+#define DYNBUF  0x10000
+
+void* dyna_realloc(void*ptr,u32 oldsize,u32 newsize)
+{
+	return dsp.DynCode;
+}
 
 //sign extend to 32 bits
 void dsp_rec_se(x86_block& x86e,x86_gpr_reg reg,u32 src_sz,u32 dst_sz=0xFF)
@@ -357,13 +386,13 @@ void dsp_rec_MEMS_WRITE(x86_block& x86e,_INST& op,u32 step,x86_gpr_reg INPUTS)
 }
 //Reads : MEM_RD_DATA_NV (Wire)
 //Writes : MEM_RD_DATA
-void dsp_rec_MEM_RD_DATA_WRITE(x86_block& x86e,_INST& op,u32 step,x86_gpr_reg MEM_RD_DATA_NV)
+void dsp_rec_MEM_RD_DATA_WRITE(x86_block& x86e,_INST& prev_op,u32 step,x86_gpr_reg MEM_RD_DATA_NV)
 {
 	//Request : step x (odd step)
 	//Operation : x+1   (even step)
 	//Data avail : x+2   (odd step, can request again)
-	//The MEM_RD_DATA_NV wire exists only on even steps
-	if (!(step&1))
+	//The MEM_RD_DATA_NV wire exists only on even steps, after a read
+	if (!(step&1) && prev_op.MRD)
 	{
 		x86e.Emit(op_mov32,&dsp.regs.MEM_RD_DATA,MEM_RD_DATA_NV);
 	}
@@ -632,6 +661,9 @@ void dsp_recompile()
 	x86e.Emit(op_push32,ESI);
 	x86e.Emit(op_push32,EDI);
 
+	//INPUTS keeps its value on steps that don't select one
+	x86e.Emit(op_xor32,ESI,ESI);
+
 	//OK.
 	//Input comes from mems, mixs and exts, as well as possible memory reads and writes
 	//mems is read/write (memory loads go there), mixs and exts are read only.
@@ -683,7 +715,7 @@ void dsp_recompile()
 		
 		//Write the MEM_RD_DATA regiter
 		//Last use of MEM_RD_DATA_NV(EDI)
-		dsp_rec_MEM_RD_DATA_WRITE(x86e,op,step,EDI);
+		dsp_rec_MEM_RD_DATA_WRITE(x86e,prev_op,step,EDI);
 		//EDI is now free :D
 		
 		//EDI is used for MAD_OUT_NV
@@ -746,64 +778,4 @@ void dsp_recompile()
 	x86e.Emit(op_ret);
 	x86e.Generate();
 }
-
-void dsp_print_mame();
-void dsp_step_mame();
-void dsp_emu_grandia();
-void dsp_step(void)
-{
-	//clear output reg
-	memset(DSPData->EFREG,0,sizeof(DSPData->EFREG));
-
-	if (dsp.dyndirty)
-	{
-		dsp.dyndirty=false;
-		//dsp_print_mame();
-		dsp_recompile();
-	}
-	//dsp_step_mame();
-	//dsp_emu_grandia();
-	
-	//run the code :p
-	((void (*)())&dsp.DynCode)();
-
-	dsp.regs.MDEC_CT--;
-	if (dsp.regs.MDEC_CT==0)
-		dsp.regs.MDEC_CT=dsp.RBL;
-	//here ? or before ?
-	//memset(DSP->MIXS,0,4*16);
-}
-
-void dsp_writenmem(u32 addr)
-{
-	addr-=0x3000;
-	//COEF : native
-	//MEMS : native
-	//MPRO : native
-	if (addr>=0x400 && addr<0xC00)
-	{
-		dsp.dyndirty=true;
-	}
-
-	/*
-	//buffered DSP state
-	//24 bit wide
-	u32 TEMP[128];
-	//24 bit wide
-	u32 MEMS[32];
-	//20 bit wide
-	s32 MIXS[16];
-	*/
-}
-
-void dsp_readmem(u32 addr)
-{
-	//nothing ? :p
-}
-#else
-
-void dsp_init() { }
-void dsp_term() { }
-void dsp_step() { }
-void dsp_writenmem(u32 addr) { }
 #endif
@@ -93,3 +93,54 @@ void dsp_init();
 void dsp_term();
 void dsp_step();
 void dsp_writenmem(u32 addr);
+
+//Shared by the recompilers
+const bool SUPPORT_NOFL=false;
+
+struct _INST
+{
+	unsigned int TRA;
+	unsigned int TWT;
+	unsigned int TWA;
+	
+	unsigned int XSEL;
+	unsigned int YSEL;
+	unsigned int IRA;
+	unsigned int IWT;
+	unsigned int IWA;
+
+	unsigned int EWT;
+	unsigned int EWA;
+	unsigned int ADRL;
+	unsigned int FRCL;
+	unsigned int SHIFT;
+	unsigned int YRL;
+	unsigned int NEGB;
+	unsigned int ZERO;
+	unsigned int BSEL;
+
+	unsigned int NOFL;  //MRQ set
+	unsigned int TABLE; //MRQ set
+	unsigned int MWT;   //MRQ set
+	unsigned int MRD;   //MRQ set
+	unsigned int MASA;  //MRQ set
+	unsigned int ADREB; //MRQ set
+	unsigned int NXADR; //MRQ set
+};
+
+void DecodeInst(u32 *IPtr,_INST *i);
+
+u16 DYNACALL PACK(s32 val);
+s32 DYNACALL UNPACK(u16 val);
+
+//Debug checks that every register is read before it is written, in step order
+void _dsp_debug_step_start(void);
+void _dsp_debug_step_end(void);
+#define nwtn(x) verify(!dsp.regs_init.x)
+#define wtn(x) nwtn(x);dsp.regs_init.x=true;
+
+//Host specific, fills dsp.DynCode (or the interpreter's step table) from MPRO
+void dsp_recompile(void);
+
+//FEAT_DSPREC == DYNAREC_CPP, runs the 128 steps once
+void dsp_interp_run(void);
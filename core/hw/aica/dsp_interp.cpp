@@ -0,0 +1,357 @@
+#include "types.h"
+
+#if FEAT_DSPREC == DYNAREC_CPP
+#include "dsp.h"
+#include "aica_mem.h"
+#include "hw/aica/aica_if.h"
+
+/*
+	DSP interpreter
+
+	Portable fallback for hosts without a DSP recompiler, following the
+	same model as the emitters step for step.
+
+	MPRO is decoded once (when it, RBL or RBP change) into a table with one
+	array per field, so a sample only touches the few bytes each step needs.
+	Most steps don't go to memory, so each step is tagged with the memory
+	work it does and the loop dispatches to a version of the step built for
+	exactly that.
+
+	TEMP, MEMS and MIXS sit next to each other in dsp_t, right after the
+	(page aligned) code buffer.
+*/
+
+enum
+{
+	DSP_AGU   = 1,	//odd step that requests a read or write: MEM_ADDR
+	DSP_READ  = 2,	//even step, previous step requested a read
+	DSP_WRITE = 4,	//even step, previous step requested a write
+};
+
+enum
+{
+	DSP_TWT   = 1 << 0,
+	DSP_USE_TEMP = 1 << 1,
+	DSP_XSEL  = 1 << 2,
+	DSP_ADD_B = 1 << 3,		//!ZERO
+	DSP_BSEL  = 1 << 4,
+	DSP_NEGB  = 1 << 5,
+	DSP_FRCL  = 1 << 6,
+	DSP_ADRL  = 1 << 7,
+	DSP_YRL   = 1 << 8,
+	DSP_ADREB = 1 << 9,
+	DSP_TABLE = 1 << 10,
+};
+
+struct dsp_program_t
+{
+	u8 kind[128];
+	u16 flags[128];
+
+	u8 tra[128];
+	u8 twa[128];
+	u8 ysel[128];
+	u8 shift[128];
+	s8 iwa[128];		//-1 when IWT is clear
+	s8 ewa[128];		//-1 when EWT is clear
+
+	//INPUTS=(s32)(*src<<in_shl)>>8, src=0 keeps the last value
+	u32* in_src[128];
+	u8 in_shl[128];
+
+	u8 masa[128];
+	u8 nxadr[128];
+
+	//the last step, propagated once per sample
+	u32 NOFL_1;
+	u32 NOFL_2;
+	u32 MWT_1;
+	u32 MRD_1;
+};
+
+static dsp_program_t prog;
+
+void dsp_recompile(void)
+{
+	dsp.dyndirty=false;
+
+	for (int step=0;step<128;step++)
+	{
+		u32* mpro=DSPData->MPRO+step*4;
+		u32 prev_step=(step-1)&127;
+		u32* prev_mpro=DSPData->MPRO+prev_step*4;
+
+		_INST op;
+		_INST prev_op;
+		DecodeInst(mpro,&op);
+		DecodeInst(prev_mpro,&prev_op);
+
+		u8 kind=0;
+		if (step&1)
+		{
+			if (op.MRD || op.MWT)
+				kind|=DSP_AGU;
+		}
+		else
+		{
+			if (prev_op.MRD)
+				kind|=DSP_READ;
+			if (prev_op.MWT)
+				kind|=DSP_WRITE;
+		}
+		prog.kind[step]=kind;
+
+		u16 flags=0;
+		if (op.TWT) flags|=DSP_TWT;
+		if (op.XSEL==0 || (op.BSEL==0 && op.ZERO==0)) flags|=DSP_USE_TEMP;
+		if (op.XSEL) flags|=DSP_XSEL;
+		if (!op.ZERO) flags|=DSP_ADD_B;
+		if (op.BSEL) flags|=DSP_BSEL;
+		if (op.NEGB) flags|=DSP_NEGB;
+		if (op.FRCL) flags|=DSP_FRCL;
+		if (op.ADRL) flags|=DSP_ADRL;
+		if (op.YRL) flags|=DSP_YRL;
+		if (op.ADREB) flags|=DSP_ADREB;
+		if (op.TABLE) flags|=DSP_TABLE;
+		prog.flags[step]=flags;
+
+		prog.tra[step]=op.TRA;
+		prog.twa[step]=op.TWA;
+		prog.ysel[step]=op.YSEL;
+		prog.shift[step]=op.SHIFT;
+		prog.iwa[step]=op.IWT ? op.IWA : -1;
+		prog.ewa[step]=op.EWT ? op.EWA : -1;
+
+		if (op.IRA<0x20)
+		{
+			prog.in_src[step]=&dsp.MEMS[op.IRA];
+			prog.in_shl[step]=8;
+		}
+		else if (op.IRA<0x30)
+		{
+			prog.in_src[step]=(u32*)&dsp.MIXS[op.IRA-0x20];
+			prog.in_shl[step]=12;
+		}
+		else if (op.IRA<0x32)
+		{
+			prog.in_src[step]=&DSPData->EXTS[op.IRA-0x30];
+			prog.in_shl[step]=16;
+		}
+		else
+		{
+			prog.in_src[step]=0;
+			prog.in_shl[step]=0;
+		}
+
+		prog.masa[step]=op.MASA;
+		prog.nxadr[step]=op.NXADR;
+
+		if (step==126)
+			prog.NOFL_2=op.NOFL;
+		if (step==127)
+		{
+			prog.NOFL_1=op.NOFL;
+			prog.MWT_1=op.MWT;
+			prog.MRD_1=op.MRD;
+		}
+	}
+}
+
+//the registers that live across steps, kept out of dsp_t while running
+struct dsp_state_t
+{
+	s32 INPUTS;
+	s32 MAD_OUT;
+	s32 MEM_ADDR;
+	s32 MEM_RD_DATA;
+	s32 MEM_WT_DATA;
+	s32 FRC_REG;
+	s32 ADRS_REG;
+	s32 Y_REG;
+	u32 MDEC_CT;
+};
+
+//sign extend from the low bits
+#define SE(x,bits) (((s32)((u32)(x)<<(32-(bits))))>>(32-(bits)))
+
+template<u32 kind>
+static INLINE void dsp_interp_step(dsp_state_t& st, u32 step)
+{
+	u32 flags=prog.flags[step];
+	s32 MEM_RD_DATA_NV=0;
+
+	//DRAM access, for the request of the previous step
+	if (kind & (DSP_READ|DSP_WRITE))
+	{
+		u32 addr=st.MEM_ADDR & AICA_RAM_MASK;
+
+		if (kind & DSP_READ)
+			MEM_RD_DATA_NV=*(s16*)&aica_ram.data[addr];
+		if (kind & DSP_WRITE)
+			*(u16*)&aica_ram.data[addr]=st.MEM_WT_DATA;
+	}
+
+	//address generation
+	if (kind & DSP_AGU)
+	{
+		u32 addr=DSPData->MADRS[prog.masa[step]];
+
+		if (flags & DSP_ADREB)
+			addr+=st.ADRS_REG;
+		addr+=prog.nxadr[step];
+
+		if (!(flags & DSP_TABLE))
+		{
+			addr+=st.MDEC_CT;
+			addr&=dsp.RBL;
+		}
+		else
+			addr&=0xFFFF;
+
+		st.MEM_ADDR=addr*2+dsp.RBP;
+	}
+
+	//INPUTS
+	u32* in_src=prog.in_src[step];
+	if (in_src)
+		st.INPUTS=((s32)(*in_src<<prog.in_shl[step]))>>8;
+
+	//MEMS write, from the MEM_RD_DATA of the last read
+	s32 iwa=prog.iwa[step];
+	if (iwa>=0)
+		dsp.MEMS[iwa]=SE((u32)st.MEM_RD_DATA<<8,24);
+
+	if (kind & DSP_READ)
+		st.MEM_RD_DATA=MEM_RD_DATA_NV;
+
+	//MAD
+	s32 temp=0;
+	if (flags & DSP_USE_TEMP)
+		temp=SE(dsp.TEMP[(st.MDEC_CT+prog.tra[step])&127],24);
+
+	s32 x=(flags & DSP_XSEL) ? st.INPUTS : temp;
+	s32 y;
+
+	switch (prog.ysel[step])
+	{
+	case 0:
+		y=SE(st.FRC_REG,13);
+		break;
+	case 1:
+		y=SE(DSPData->COEF[step],16)>>3;
+		break;
+	case 2:
+		y=SE(st.Y_REG,19)>>6;
+		break;
+	default:
+		y=st.Y_REG&0xFFF;
+		break;
+	}
+
+	s32 MAD_OUT_NV=SE((s64)x*y>>10,26);
+
+	if (flags & DSP_ADD_B)
+	{
+		u32 b=(flags & DSP_BSEL) ? st.MAD_OUT : temp*4;
+		if (flags & DSP_NEGB)
+			b=-b;
+		MAD_OUT_NV=SE(MAD_OUT_NV+b,26);
+	}
+
+	//EFO/FB, from the MAD_OUT of the previous step
+	s32 shifted=st.MAD_OUT;
+
+	switch (prog.shift[step])
+	{
+	case 0:
+		shifted>>=2;
+		if (shifted<-524288) shifted=-524288;
+		if (shifted>524288) shifted=524288;
+		break;
+	case 1:
+		shifted>>=1;
+		if (shifted<-524288) shifted=-524288;
+		if (shifted>524287) shifted=524287;
+		break;
+	case 2:
+		shifted=SE(shifted>>1,24);
+		break;
+	default:
+		shifted=SE((u32)(shifted>>1)<<2,24);
+		break;
+	}
+
+	s32 ewa=prog.ewa[step];
+	if (ewa>=0)
+		DSPData->EFREG[ewa]=(DSPData->EFREG[ewa]&0xFFFF0000) | (u16)(shifted>>4);
+
+	if (flags & DSP_TWT)
+		dsp.TEMP[(st.MDEC_CT+prog.twa[step])&127]=shifted;
+
+	if (flags & DSP_FRCL)
+		st.FRC_REG=prog.shift[step]==3 ? shifted>>11 : shifted&0xFFF;
+
+	if (flags & DSP_ADRL)
+		st.ADRS_REG=prog.shift[step]==3 ? SE(shifted>>16,8) : (shifted>>12)&0xFFF;
+
+	st.MEM_WT_DATA=shifted>>8;
+
+	st.MAD_OUT=MAD_OUT_NV;
+
+	if (flags & DSP_YRL)
+	{
+		st.INPUTS>>=4;
+		st.Y_REG=st.INPUTS;
+	}
+}
+
+void dsp_interp_run(void)
+{
+	dsp_state_t st;
+
+	st.INPUTS=0;
+	st.MAD_OUT=dsp.regs.MAD_OUT;
+	st.MEM_ADDR=dsp.regs.MEM_ADDR;
+	st.MEM_RD_DATA=dsp.regs.MEM_RD_DATA;
+	st.MEM_WT_DATA=dsp.regs.MEM_WT_DATA;
+	st.FRC_REG=dsp.regs.FRC_REG;
+	st.ADRS_REG=dsp.regs.ADRS_REG;
+	st.Y_REG=dsp.regs.Y_REG;
+	st.MDEC_CT=dsp.regs.MDEC_CT;
+
+	for (u32 step=0;step<128;step++)
+	{
+		switch (prog.kind[step])
+		{
+		case 0:
+			dsp_interp_step<0>(st,step);
+			break;
+		case DSP_AGU:
+			dsp_interp_step<DSP_AGU>(st,step);
+			break;
+		case DSP_READ:
+			dsp_interp_step<DSP_READ>(st,step);
+			break;
+		case DSP_WRITE:
+			dsp_interp_step<DSP_WRITE>(st,step);
+			break;
+		default:
+			dsp_interp_step<DSP_READ|DSP_WRITE>(st,step);
+			break;
+		}
+	}
+
+	dsp.regs.MAD_OUT=st.MAD_OUT;
+	dsp.regs.MEM_ADDR=st.MEM_ADDR;
+	dsp.regs.MEM_RD_DATA=st.MEM_RD_DATA;
+	dsp.regs.MEM_WT_DATA=st.MEM_WT_DATA;
+	dsp.regs.FRC_REG=st.FRC_REG;
+	dsp.regs.ADRS_REG=st.ADRS_REG;
+	dsp.regs.Y_REG=st.Y_REG;
+
+	dsp.regs.NOFL_1=prog.NOFL_1;
+	dsp.regs.NOFL_2=prog.NOFL_2;
+	dsp.regs.MWT_1=prog.MWT_1;
+	dsp.regs.MRD_1=prog.MRD_1;
+}
+#endif
@@ -0,0 +1,537 @@
+#include "deps/xbyak/xbyak.h"
+
+#include "types.h"
+
+#if HOST_CPU == CPU_X64 && FEAT_DSPREC == DYNAREC_JIT
+#include "dsp.h"
+#include "aica_mem.h"
+#include "hw/aica/aica_if.h"
+
+/*
+	DSP rec_v1, x64
+
+	A port of the x86 emitter in dsp.cpp, step for step, on top of xbyak.
+
+	rbx points to dsp.regs, so the registers touched every step fit in a
+	disp8. rbp points to DSPData and r12 to aica ram. The wires the x86
+	version kept in ESI/EDI live in r14d (INPUTS) and r13d (MEM_RD_DATA_NV,
+	then MAD_OUT_NV). eax, ecx and edx are scratch.
+
+	The whole program is unrolled, so this only runs again when MPRO,
+	RBL or RBP change.
+*/
+
+#ifdef _WIN32
+	#define DSP_ARG0 ecx
+#else
+	#define DSP_ARG0 edi
+#endif
+
+class DSPAssembler : public Xbyak::CodeGenerator
+{
+public:
+	DSPAssembler(u8* code_buffer, size_t size) : Xbyak::CodeGenerator(size, code_buffer) { }
+
+	void dsp_recompile();
+
+private:
+	//dsp_t fields, relative to rbx
+	Xbyak::Address dsp_mem(size_t offs)
+	{
+		return dword[rbx + (int)(offs - offsetof(dsp_t, regs))];
+	}
+
+	Xbyak::Address DSPData_mem(size_t offs)
+	{
+		return dword[rbp + (int)offs];
+	}
+
+	//helpers are only called for the NOFL conversions
+	void dsp_rec_call(const void* fn)
+	{
+#ifdef _WIN32
+		sub(rsp, 32);
+#endif
+		call(fn);
+#ifdef _WIN32
+		add(rsp, 32);
+#endif
+	}
+
+	//sign extend to 32 bits
+	void dsp_rec_se(const Xbyak::Reg32& reg, u32 src_sz, u32 dst_sz = 0xFF)
+	{
+		if (dst_sz == 0xFF)
+			dst_sz = src_sz;
+		//24 -> 32 (pad to 32 bits)
+		shl(reg, 32 - src_sz);
+		//32 -> 24 (MSB propagation)
+		sar(reg, 32 - dst_sz);
+	}
+
+	//Reads : MWT_1,MRD_1,MEM_ADDR
+	//Writes : Wire MEM_RD_DATA_NV
+	void dsp_rec_DRAM_CI(_INST& prev_op, u32 step, const Xbyak::Reg32& MEM_RD_DATA_NV)
+	{
+		nwtn(MWT_1);
+		nwtn(MRD_1);
+		nwtn(MEM_ADDR);
+		nwtn(MEM_WT_DATA);
+
+		//Request : step x (odd step)
+		//Operation : x+1   (even step)
+		//Data avail : x+2   (odd step, can request again)
+		if (!(step & 1) && (prev_op.MRD || prev_op.MWT))
+		{
+			//Get and mask ram address :)
+			mov(eax, dsp_mem(offsetof(dsp_t, regs.MEM_ADDR)));
+			and_(eax, AICA_RAM_MASK);
+
+			//prev. opcode did a mem read request ?
+			if (prev_op.MRD)
+			{
+				//Do the read [MEM_ADDRS] -> MEM_RD_DATA_NV
+				movsx(MEM_RD_DATA_NV, word[r12 + rax]);
+			}
+			//prev. opcode did a mem write request ?
+			if (prev_op.MWT)
+			{
+				//Do the write [MEM_ADDRS] <-MEM_WT_DATA
+				mov(edx, dsp_mem(offsetof(dsp_t, regs.MEM_WT_DATA)));
+				mov(word[r12 + rax], dx);
+			}
+		}
+	}
+
+	//Reads : ADRS_REG,MADRS,MDEC_CT
+	//Writes : MEM_ADDR
+	void dsp_rec_MEM_AGU(_INST& op, u32 step)
+	{
+		nwtn(ADRS_REG);
+		nwtn(MEM_ADDR);
+
+		//These opcode fields are valid on odd steps (mem req. is only allowed then)
+		//MEM Request : step x
+		//Mem operation : step x+1 (address is available at this point)
+		if (step & 1)
+		{
+			//Addrs is 16:1
+			mov(eax, DSPData_mem(offsetof(DSPData_struct, MADRS) + op.MASA * 4));
+
+			//Added if ADREB
+			if (op.ADREB)
+				add(eax, dsp_mem(offsetof(dsp_t, regs.ADRS_REG)));
+
+			//+1 if NXADR is set
+			if (op.NXADR)
+				add(eax, 1);
+
+			//MDEC_CT is added if !TABLE
+			if (!op.TABLE)
+				add(eax, dsp_mem(offsetof(dsp_t, regs.MDEC_CT)));
+
+			//RBL/RBP are constants for the program
+			//Apply RBL if !TABLE
+			//Else limit to 16 bit add
+			if (!op.TABLE)
+				and_(eax, dsp.RBL);
+			else
+				and_(eax, 0xFFFF);
+
+			//EAX*2 b/c it points to sample (16:1 of the address)
+			lea(edx, ptr[rax * 2 + (int)dsp.RBP]);
+
+			//Save the result to MEM_ADDR
+			mov(dsp_mem(offsetof(dsp_t, regs.MEM_ADDR)), edx);
+		}
+		wtn(MEM_ADDR);
+	}
+
+	//Reads : MEMS,MIXS,EXTS
+	//Writes : INPUTS (Wire)
+	void dsp_rec_INPUTS(_INST& op, const Xbyak::Reg32& INPUTS)
+	{
+		nwtn(MEMS);
+
+		//INPUTS is 24 bit, we convert everything to that
+		if (op.IRA < 0x20)
+		{
+			mov(INPUTS, dsp_mem(offsetof(dsp_t, MEMS) + op.IRA * 4));
+			dsp_rec_se(INPUTS, 24);
+		}
+		else if (op.IRA < 0x30)
+		{
+			mov(INPUTS, dsp_mem(offsetof(dsp_t, MIXS) + (op.IRA - 0x20) * 4));
+			dsp_rec_se(INPUTS, 20, 24);
+		}
+		else if (op.IRA < 0x32)
+		{
+			mov(INPUTS, DSPData_mem(offsetof(DSPData_struct, EXTS) + (op.IRA - 0x30) * 4));
+			dsp_rec_se(INPUTS, 16, 24);
+		}
+	}
+
+	//Reads : MEM_RD_DATA,NO_FLT2
+	//Writes : MEMS
+	void dsp_rec_MEMS_WRITE(_INST& op, u32 step, const Xbyak::Reg32& INPUTS)
+	{
+		nwtn(MEM_RD_DATA);
+		nwtn(NOFL_2);
+
+		//MEMS write reads from MEM_RD_DATA register (MEM_RD_DATA -> Converter -> MEMS).
+		//The converter's nofl flag has 2 steps delay (so that it can be set with the MRQ).
+		if (op.IWT)
+		{
+			movsx(ecx, word[rbx + (int)(offsetof(dsp_t, regs.MEM_RD_DATA) - offsetof(dsp_t, regs))]);
+			mov(eax, ecx);
+
+			//Pad and signed extend EAX
+			shl(eax, 8);
+
+			if (SUPPORT_NOFL)
+			{
+				Xbyak::Label no_fl;
+
+				//Do we have to convert ?
+				cmp(dsp_mem(offsetof(dsp_t, regs.NOFL_2)), 1);
+				je(no_fl);
+				{
+					//Convert !
+					mov(DSP_ARG0, ecx);
+					dsp_rec_call((const void*)UNPACK);
+				}
+				L(no_fl);
+			}
+			mov(dsp_mem(offsetof(dsp_t, MEMS) + op.IWA * 4), eax);
+		}
+
+		wtn(MEMS);
+	}
+
+	//Reads : MEM_RD_DATA_NV (Wire)
+	//Writes : MEM_RD_DATA
+	void dsp_rec_MEM_RD_DATA_WRITE(_INST& prev_op, u32 step, const Xbyak::Reg32& MEM_RD_DATA_NV)
+	{
+		//The MEM_RD_DATA_NV wire exists only on even steps, after a read
+		if (!(step & 1) && prev_op.MRD)
+		{
+			mov(dsp_mem(offsetof(dsp_t, regs.MEM_RD_DATA)), MEM_RD_DATA_NV);
+		}
+
+		wtn(MEM_RD_DATA);
+	}
+
+	//TEMP[(MDEC_CT+TEMPS_NUM)&127], the index goes in ecx
+	Xbyak::Address dsp_reg_GenerateTempsAddrs(u32 TEMPS_NUM)
+	{
+		mov(ecx, dsp_mem(offsetof(dsp_t, regs.MDEC_CT)));
+		add(ecx, TEMPS_NUM);
+		and_(ecx, 127);
+		return dword[rbx + rcx * 4 + (int)(offsetof(dsp_t, TEMP) - offsetof(dsp_t, regs))];
+	}
+
+	//Reads : INPUTS,TEMP,FRC_REG,COEF,Y_REG
+	//Writes : MAD_OUT_NV (Wire)
+	void dsp_rec_MAD(_INST& op, u32 step, const Xbyak::Reg32& INPUTS, const Xbyak::Reg32& MAD_OUT_NV)
+	{
+		bool use_TEMP = op.XSEL == 0 || (op.BSEL == 0 && op.ZERO == 0);
+
+		//TEMPS (if used) on ECX
+		if (use_TEMP)
+		{
+			//read temps
+			mov(ecx, dsp_reg_GenerateTempsAddrs(op.TRA));
+			dsp_rec_se(ecx, 24);
+		}
+
+		//X : 24 bits, either INPUTS or TEMPS
+		const Xbyak::Reg32& mul_x_input = op.XSEL == 1 ? INPUTS : ecx;
+
+		//MUL Y in : EAX
+		//Y : 13 bits
+		switch (op.YSEL)
+		{
+		case 0:
+			//Y=FRC_REG[13]
+			mov(eax, dsp_mem(offsetof(dsp_t, regs.FRC_REG)));
+			dsp_rec_se(eax, 13);
+			break;
+
+		case 1:
+			//Y=COEF[13]
+			mov(eax, DSPData_mem(offsetof(DSPData_struct, COEF) + step * 4));
+			dsp_rec_se(eax, 16, 13);
+			break;
+
+		case 2:
+			//Y=Y_REG[23:11] (Y_REG is 19 bits, INPUTS[23:4], so that is realy 19:7)
+			mov(eax, dsp_mem(offsetof(dsp_t, regs.Y_REG)));
+			dsp_rec_se(eax, 19, 13);
+			break;
+
+		case 3:
+			//Y=0'Y_REG[15:4] (Y_REG is 19 bits, INPUTS[23:4], so that is realy 11:0)
+			mov(eax, dsp_mem(offsetof(dsp_t, regs.Y_REG)));
+			and_(eax, 0xFFF);//Clear bit 13+
+			break;
+		}
+
+		//Do the mul -- maby it has overflow protection ?
+		//24+13=37, -11 = 26
+		//that can be >>1 or >>2 on the shifter after the mul
+		imul(mul_x_input);
+		//shrd is unsigned, but we may only shift up to 11 bits from the signed EDX
+		shrd(eax, edx, 10);
+
+		//cut the upper bits so that it is 26 bits signed
+		dsp_rec_se(eax, 26);
+
+		//Adder, takes MUL_OUT at EAX, adds B (EDX)
+		if (!op.ZERO)	//if zero is set the adder has no effect
+		{
+			if (op.BSEL == 1)
+			{
+				//B=MAD_OUT[??]
+				//mad out is stored on s32 format, so no need for sign extension
+				mov(edx, dsp_mem(offsetof(dsp_t, regs.MAD_OUT)));
+			}
+			else
+			{
+				//B=TEMP[??]
+				//TEMPS is already sign extended, just converting 24 -> 26 bits using lea
+				lea(edx, ptr[rcx * 4]);
+			}
+			//(~X)+1 = -X , and (~0)+1=0 so the +1 of NEGB is skipped
+			if (op.NEGB)
+				neg(edx);
+
+			add(eax, edx);
+		}
+
+		//cut the upper bits so that it is 26 bits signed
+		dsp_rec_se(eax, 26);
+
+		//Write to MAD_OUT_NV wire :)
+		mov(MAD_OUT_NV, eax);
+	}
+
+	//Reads  : INPUTS,MAD_OUT
+	//Writes : EFREG,TEMP,FRC_REG,ADRS_REG,MEM_WT_DATA
+	void dsp_rec_EFO_FB(_INST& op, u32 step, const Xbyak::Reg32& INPUTS)
+	{
+		nwtn(MAD_OUT);
+		//MAD_OUT is s32, no sign extension needed
+		mov(eax, dsp_mem(offsetof(dsp_t, regs.MAD_OUT)));
+
+		switch (op.SHIFT)
+		{
+		case 0:
+			//x1 Protected
+			sar(eax, 2);
+			mov(edx, (u32)-524288);
+			cmp(eax, edx);
+			cmovl(eax, edx);
+			neg(edx);
+			cmp(eax, edx);
+			cmovg(eax, edx);
+			break;
+		case 1:
+			//x2 Protected
+			sar(eax, 1);
+			mov(edx, (u32)-524288);
+			cmp(eax, edx);
+			cmovl(eax, edx);
+			not_(edx);
+			cmp(eax, edx);
+			cmovg(eax, edx);
+			break;
+		case 2:
+			//x2 Not protected
+			sar(eax, 1);
+			dsp_rec_se(eax, 24);
+			break;
+		case 3:
+			//x1 Not protected
+			sar(eax, 1);
+			shl(eax, 2);
+			dsp_rec_se(eax, 24);
+			break;
+		}
+
+		//Write EFREG ?
+		if (op.EWT)
+		{
+			//top 16 bits, following the same rule as the input
+			mov(edx, eax);
+			sar(edx, 4);
+			mov(word[rbp + (int)(offsetof(DSPData_struct, EFREG) + op.EWA * 4)], dx);
+		}
+
+		//Write TEMPS ?
+		if (op.TWT)
+		{
+			//Temps is 24 bit, stored as s32 (no conversion required)
+			mov(dsp_reg_GenerateTempsAddrs(op.TWA), eax);
+		}
+
+		//Write to FRC_REG ?
+		if (op.FRCL)
+		{
+			mov(ecx, eax);
+			if (op.SHIFT == 3)
+			{
+				//FRC_REG[12:0]=Shift[23:11]
+				sar(ecx, 11);
+			}
+			else
+			{
+				//FRC_REG[12:0]=0'Shift[11:0]
+				and_(ecx, (1 << 12) - 1);
+			}
+			mov(dsp_mem(offsetof(dsp_t, regs.FRC_REG)), ecx);
+		}
+
+		//Write to ADDRS_REG ?
+		if (op.ADRL)
+		{
+			mov(ecx, eax);
+			if (op.SHIFT == 3)
+			{
+				//ADRS_REG[11:0]=Shift[23,23,23,23,23,22:16]
+				shl(ecx, 8);
+				sar(ecx, 24);
+			}
+			else
+			{
+				//ADRS_REG[11:0]=0'Shift[23:12]
+				sar(ecx, 12);
+				and_(ecx, (1 << 12) - 1);
+			}
+			mov(dsp_mem(offsetof(dsp_t, regs.ADRS_REG)), ecx);
+		}
+
+		//MEM_WT_DATA write
+		if (!op.NOFL && SUPPORT_NOFL)
+		{
+			mov(DSP_ARG0, eax);
+			dsp_rec_call((const void*)PACK);
+		}
+		else
+		{
+			sar(eax, 8);
+		}
+		mov(dsp_mem(offsetof(dsp_t, regs.MEM_WT_DATA)), eax);
+
+		wtn(EFREG);
+		wtn(TEMPS);
+		wtn(FRC_REG);
+		wtn(ADRS_REG);
+		wtn(MEM_WT_DATA);
+	}
+};
+
+void DSPAssembler::dsp_recompile()
+{
+	//rsp ends up 16 byte aligned, for the helper calls
+	push(rbx);
+	push(rbp);
+	push(r12);
+	push(r13);
+	push(r14);
+
+	mov(rbx, (size_t)&dsp.regs);
+	mov(rbp, (size_t)DSPData);
+	mov(r12, (size_t)aica_ram.data);
+
+	//INPUTS keeps its value on steps that don't select one
+	xor_(r14d, r14d);
+
+	//MRD, MWT, NOFL, TABLE, NXADR, ADREB, and MASA[4:0]
+	//Only allowed on odd steps, when counting from 1 (2,4,6, ...).That is even steps when counting from 0 (1,3,5, ...)
+	for (int step = 0; step < 128; ++step)
+	{
+		u32* mpro = DSPData->MPRO + step * 4;
+		u32 prev_step = (step - 1) & 127;
+		u32* prev_mpro = DSPData->MPRO + prev_step * 4;
+
+		_INST op;
+		_INST prev_op;
+		DecodeInst(mpro, &op);
+		DecodeInst(prev_mpro, &prev_op);
+
+		_dsp_debug_step_start();
+
+		//r13d=MEM_RD_DATA_NV
+		dsp_rec_DRAM_CI(prev_op, step, r13d);
+
+		dsp_rec_MEM_AGU(op, step);
+
+		//r14d : INPUTS
+		dsp_rec_INPUTS(op, r14d);
+
+		dsp_rec_MEMS_WRITE(op, step, r14d);
+
+		//Last use of MEM_RD_DATA_NV
+		dsp_rec_MEM_RD_DATA_WRITE(prev_op, step, r13d);
+
+		//r13d is now MAD_OUT_NV
+		dsp_rec_MAD(op, step, r14d, r13d);
+
+		dsp_rec_EFO_FB(op, step, r14d);
+
+		//Write MAD_OUT_NV
+		{
+			mov(dsp_mem(offsetof(dsp_t, regs.MAD_OUT)), r13d);
+			wtn(MAD_OUT);
+		}
+
+		//Inputs -> Y reg
+		{
+			if (op.YRL)
+			{
+				sar(r14d, 4);//[23:4]
+				mov(dsp_mem(offsetof(dsp_t, regs.Y_REG)), r14d);
+			}
+			wtn(Y_REG);
+		}
+
+		//NOFL delay propagation :)
+		{
+			//NOFL_2=NOFL_1
+			mov(eax, dsp_mem(offsetof(dsp_t, regs.NOFL_1)));
+			mov(dsp_mem(offsetof(dsp_t, regs.NOFL_2)), eax);
+			//NOFL_1 = NOFL
+			mov(dsp_mem(offsetof(dsp_t, regs.NOFL_1)), op.NOFL);
+
+			wtn(NOFL_2);
+			wtn(NOFL_1);
+		}
+
+		//MWT_1/MRD_1 propagation
+		{
+			mov(dsp_mem(offsetof(dsp_t, regs.MWT_1)), op.MWT);
+			mov(dsp_mem(offsetof(dsp_t, regs.MRD_1)), op.MRD);
+
+			wtn(MWT_1);
+			wtn(MRD_1);
+		}
+
+		_dsp_debug_step_end();
+	}
+
+	pop(r14);
+	pop(r13);
+	pop(r12);
+	pop(rbp);
+	pop(rbx);
+	ret();
+}
+
+void dsp_recompile(void)
+{
+	dsp.dyndirty=false;
+
+	DSPAssembler assembler(dsp.DynCode, sizeof(dsp.DynCode));
+	assembler.dsp_recompile();
+}
+#endif
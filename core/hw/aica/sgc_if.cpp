@@ -2,6 +2,7 @@
 #include "dsp.h"
 #include "aica_mem.h"
 #include "hw/aica/aica_if.h"
+#include "serialize.h"
 #include <math.h>
 
 #include "../libretro/libretro.h"
@@ -1532,3 +1533,58 @@ void term_mem()
 
 }
 
+void sgc_serialize(Serializer& s)
+{
+	for (int i = 0; i < AICA_NUM_CHANNELS; i++)
+	{
+		ChannelEx& ch = Chans[i];
+
+		//pointers are saved as offsets, and re-derived on load
+		u32 sa_offs = ch.SA - aica_ram.data;
+		u32 dspout_idx = ch.VolMix.DSPOut - dsp.MIXS;
+
+		s.value(sa_offs);
+		s.value(ch.CA);
+		s.value(ch.step);
+		s.value(ch.update_rate);
+		s.value(ch.s0);
+		s.value(ch.s1);
+		s.value(ch.loop);
+		s.value(ch.adpcm.last_quant);
+		s.value(ch.noise_state);
+		s.value(ch.VolMix.DLAtt);
+		s.value(ch.VolMix.DRAtt);
+		s.value(ch.VolMix.DSPAtt);
+		s.value(dspout_idx);
+		s.value(ch.AEG.val);
+		s.value(ch.AEG.state);
+		s.value(ch.AEG.AttackRate);
+		s.value(ch.AEG.Decay1Rate);
+		s.value(ch.AEG.Decay2Value);
+		s.value(ch.AEG.Decay2Rate);
+		s.value(ch.AEG.ReleaseRate);
+		s.value(ch.FEG);
+		s.value(ch.lfo.counter);
+		s.value(ch.lfo.start_value);
+		s.value(ch.lfo.state);
+		s.value(ch.lfo.alfo);
+		s.value(ch.lfo.alfo_shft);
+		s.value(ch.lfo.plfo);
+		s.value(ch.lfo.plfo_shft);
+		s.value(ch.enabled);
+
+		if (s.loading)
+		{
+			ch.SA = &aica_ram.data[sa_offs & ARAM_MASK];
+			ch.VolMix.DSPOut = &dsp.MIXS[dspout_idx & 15];
+			ch.StepAEG = AEG_STEP_LUT[ch.AEG.state];
+			ch.StepFEG = FEG_STEP_LUT[ch.FEG.state];
+			ch.UpdateStreamStep();
+			ch.lfo.alfo_calc = ALFOWS_CALC[ch.ccd->ALFOWS];
+			ch.lfo.plfo_calc = PLFOWS_CALC[ch.ccd->PLFOWS];
+		}
+	}
+
+	s.array(cdda_sector, CDDA_SIZE);
+	s.value(cdda_index);
+}
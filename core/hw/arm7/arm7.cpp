@@ -261,12 +261,19 @@ static void CPUUndefinedException(void)
 //	reg[15].I += 4;  
 }
 
+#if FEAT_AREC == DYNAREC_JIT
+void armt_init(void);
+void armt_run(u32 CycleCount);
+#endif
 
 void arm_Run_(u32 CycleCount)
 {
 	if (!Arm7Enabled)
 		return;
 
+#if FEAT_AREC == DYNAREC_JIT
+	armt_run(CycleCount);
+#else
 	u32 clockTicks=0;
 	while (clockTicks<CycleCount)
 	{
@@ -278,12 +285,14 @@ void arm_Run_(u32 CycleCount)
 		reg[15].I = armNextPC + 8;
 		#include "arm-new.h"
 	}
+#endif
 }
 
-void armt_init(void);
-
 void arm_Init()
 {
+#if FEAT_AREC == DYNAREC_JIT
+	armt_init();
+#endif
 	arm_Reset();
 
 	for (int i = 0; i < 256; i++)
@@ -297,10 +306,11 @@ void arm_Init()
 	}
 }
 
-static void FlushCache(void);
-
 void arm_Reset()
 {
+#if FEAT_AREC == DYNAREC_JIT
+	arm_FlushCache();
+#endif
 	Arm7Enabled = false;
 	// clean registers
 	memset(&arm_Reg[0], 0, sizeof(arm_Reg));
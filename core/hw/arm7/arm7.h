@@ -93,3 +93,10 @@ void arm_Init();
 void arm_Reset();
 void arm_Run(u32 uNumCycles);
 void arm_SetEnabled(bool enabled);
+
+#if FEAT_AREC == DYNAREC_JIT
+//drops every compiled block
+void arm_FlushCache(void);
+//drops the blocks on the page of aica ram that holds addr
+void arm_RamWritten(u32 addr);
+#endif
@@ -0,0 +1,986 @@
+#include "deps/xbyak/xbyak.h"
+
+#include "types.h"
+
+#if HOST_CPU == CPU_X64 && FEAT_AREC == DYNAREC_JIT
+#include "arm7.h"
+#include "arm_mem.h"
+#include "stdclass.h"
+
+/*
+	ARM7 recompiler, x64
+
+	Blocks are straight runs of up to ARMT_BLOCK_MAX opcodes that stop at a
+	branch or at the end of a 4 KB page, and are looked up by address from
+	the dispatcher loop in armt_run.
+
+	Data processing, ldr/str(b) with an immediate (or lsl'd register)
+	offset, mul/mla, ldm/stm that don't load the pc or use the user bank and
+	b/bl are emitted natively. Everything else goes through arm_single_op,
+	the interpreter for a single opcode, after which the block exits if the
+	opcode changed the pc.
+
+	Guest registers stay in arm_Reg, so mode switches done by the
+	interpreter just work. rbx points to arm_Reg, r12 to aica ram and r13 to
+	the code page map, r14 holds the address while ldm/stm walk the register
+	list. Cycles are counted the same way as the interpreter does, in
+	arm_Reg[CYCL_CNT].
+
+	Stores to a page that has blocks drop all blocks on that page, be it
+	from the arm7 (checked inline) or from the sh4. aica ram is mapped read
+	only in the sh4 address space, so sh4 stores (fastmem ones included)
+	fault into the handlers and reach arm_RamWritten from WriteMem_area0.
+	The cache is also flushed every time the arm7 is taken out of reset,
+	which is how drivers get loaded.
+
+	A block that drops its own page stops after that store, so the rest of
+	it isn't run from the stale code.
+*/
+
+u32 DYNACALL arm_single_op(u32 opcode);
+extern "C" void CPUFiq();
+
+#define ARMT_BLOCK_MAX 32
+#define ARMT_CODE_SIZE (2*1024*1024)
+//worst case for a block, with room to spare
+#define ARMT_BLOCK_SIZE (64*1024)
+
+#define ARM_FLAG_N (1u<<31)
+#define ARM_FLAG_Z (1u<<30)
+#define ARM_FLAG_C (1u<<29)
+#define ARM_FLAG_V (1u<<28)
+
+typedef void ArmBlock(void);
+
+static ArmBlock* EntryPoints[ARAM_SIZE/4];
+static u8 CodePages[ARAM_SIZE/PAGE_SIZE];
+
+static DECL_ALIGN(4096) u8 ArmCodeBuffer[ARMT_CODE_SIZE];
+static u32 ArmCodeUsed;
+
+//page of the running block, and whether a store has dropped it
+static u32 BlockPage;
+static u8 BlockDropped;
+
+static u32 DYNACALL armt_read8(u32 addr) { return arm_ReadMem8(addr); }
+static u32 DYNACALL armt_read32(u32 addr) { return arm_ReadMem32(addr); }
+static void DYNACALL armt_write8(u32 addr, u32 data) { arm_WriteMem8(addr, data); }
+static void DYNACALL armt_write32(u32 addr, u32 data) { arm_WriteMem32(addr, data); }
+
+static void DYNACALL armt_code_written(u32 addr)
+{
+	arm_RamWritten(addr);
+}
+
+class ArmAssembler : public Xbyak::CodeGenerator
+{
+public:
+	ArmAssembler(u8* code_buffer, size_t size) : Xbyak::CodeGenerator(size, code_buffer)
+	{
+#ifdef _WIN32
+		call_regs.push_back(ecx);
+		call_regs.push_back(edx);
+#else
+		call_regs.push_back(edi);
+		call_regs.push_back(esi);
+#endif
+	}
+
+	void compile(u32 block_pc);
+
+private:
+	vector<Xbyak::Reg32> call_regs;
+	u32 cycles;
+
+	Xbyak::Address arm_reg(u32 r)
+	{
+		return dword[rbx + r * 4];
+	}
+
+	//r15 reads as the address of the opcode + 8
+	void load_reg(const Xbyak::Reg32& dst, u32 r, u32 pc)
+	{
+		if (r == 15)
+			mov(dst, pc + 8);
+		else
+			mov(dst, arm_reg(r));
+	}
+
+	void prologue()
+	{
+		push(rbx);
+		push(r12);
+		push(r13);
+		push(r14);
+		//keep rsp 16 byte aligned for the calls
+#ifdef _WIN32
+		sub(rsp, 40);
+#else
+		sub(rsp, 8);
+#endif
+		mov(rbx, (size_t)arm_Reg);
+		mov(r12, (size_t)aica_ram.data);
+		mov(r13, (size_t)CodePages);
+	}
+
+	//leaves the block, armNextPC must already be set
+	void exit_block(u32 cycl)
+	{
+		sub(arm_reg(CYCL_CNT), cycl);
+#ifdef _WIN32
+		add(rsp, 40);
+#else
+		add(rsp, 8);
+#endif
+		pop(r14);
+		pop(r13);
+		pop(r12);
+		pop(rbx);
+		ret();
+	}
+
+	void exit_block(u32 cycl, u32 next_pc)
+	{
+		mov(arm_reg(R15_ARM_NEXT), next_pc);
+		exit_block(cycl);
+	}
+
+	//jumps to skip unless cond holds
+	void emit_cond(u32 cond, const Xbyak::Label& skip)
+	{
+		mov(eax, arm_reg(RN_PSR_FLAGS));
+
+		switch (cond)
+		{
+		case 0x0: bt(eax, 30); jnc(skip, T_NEAR); break;	//EQ
+		case 0x1: bt(eax, 30); jc(skip, T_NEAR); break;		//NE
+		case 0x2: bt(eax, 29); jnc(skip, T_NEAR); break;	//CS
+		case 0x3: bt(eax, 29); jc(skip, T_NEAR); break;		//CC
+		case 0x4: bt(eax, 31); jnc(skip, T_NEAR); break;	//MI
+		case 0x5: bt(eax, 31); jc(skip, T_NEAR); break;		//PL
+		case 0x6: bt(eax, 28); jnc(skip, T_NEAR); break;	//VS
+		case 0x7: bt(eax, 28); jc(skip, T_NEAR); break;		//VC
+
+		case 0x8:	//HI: C && !Z
+		case 0x9:	//LS: !C || Z
+			and_(eax, ARM_FLAG_C | ARM_FLAG_Z);
+			cmp(eax, ARM_FLAG_C);
+			if (cond == 0x8)
+				jne(skip, T_NEAR);
+			else
+				je(skip, T_NEAR);
+			break;
+
+		case 0xA:	//GE: N == V
+		case 0xB:	//LT: N != V
+			mov(ecx, eax);
+			shr(ecx, 3);
+			xor_(ecx, eax);
+			bt(ecx, 28);
+			if (cond == 0xA)
+				jc(skip, T_NEAR);
+			else
+				jnc(skip, T_NEAR);
+			break;
+
+		case 0xC:	//GT: !Z && N == V
+		case 0xD:	//LE: Z || N != V
+			mov(ecx, eax);
+			shr(ecx, 3);
+			xor_(ecx, eax);
+			shr(eax, 2);
+			or_(ecx, eax);
+			bt(ecx, 28);
+			if (cond == 0xC)
+				jc(skip, T_NEAR);
+			else
+				jnc(skip, T_NEAR);
+			break;
+
+		default:
+			die("armt: bad condition");
+		}
+	}
+
+	//NZCV from the host flags of the last operation
+	void store_nzcv(bool sub_carry)
+	{
+		sets(r8b);
+		setz(r9b);
+		if (sub_carry)
+			setnc(r10b);
+		else
+			setc(r10b);
+		seto(r11b);
+
+		mov(edx, arm_reg(RN_PSR_FLAGS));
+		and_(edx, ~(ARM_FLAG_N | ARM_FLAG_Z | ARM_FLAG_C | ARM_FLAG_V));
+		movzx(r8d, r8b);
+		shl(r8d, 31);
+		or_(edx, r8d);
+		movzx(r9d, r9b);
+		shl(r9d, 30);
+		or_(edx, r9d);
+		movzx(r10d, r10b);
+		shl(r10d, 29);
+		or_(edx, r10d);
+		movzx(r11d, r11b);
+		shl(r11d, 28);
+		or_(edx, r11d);
+		mov(arm_reg(RN_PSR_FLAGS), edx);
+	}
+
+	enum
+	{
+		CARRY_KEEP = -1,	//shifter doesn't touch C
+		CARRY_RUNTIME = 2,	//in r10b
+	};
+
+	//N and Z from res, C from the shifter, V unchanged
+	void store_nz(const Xbyak::Reg32& res, int carry)
+	{
+		mov(edx, arm_reg(RN_PSR_FLAGS));
+		and_(edx, carry == CARRY_KEEP ? ~(ARM_FLAG_N | ARM_FLAG_Z) : ~(ARM_FLAG_N | ARM_FLAG_Z | ARM_FLAG_C));
+
+		if (carry == 1)
+			or_(edx, ARM_FLAG_C);
+		else if (carry == CARRY_RUNTIME)
+		{
+			movzx(r10d, r10b);
+			shl(r10d, 29);
+			or_(edx, r10d);
+		}
+
+		mov(r8d, res);
+		and_(r8d, ARM_FLAG_N);
+		or_(edx, r8d);
+		test(res, res);
+		setz(r8b);
+		movzx(r8d, r8b);
+		shl(r8d, 30);
+		or_(edx, r8d);
+		mov(arm_reg(RN_PSR_FLAGS), edx);
+	}
+
+	//operand 2 of data processing ops in ecx, returns where the shifter carry is
+	int emit_shifter(u32 opcode, u32 pc, bool want_carry)
+	{
+		if (opcode & (1 << 25))
+		{
+			u32 rot = (opcode >> 7) & 0x1E;
+			u32 imm = opcode & 0xFF;
+
+			if (rot)
+				imm = (imm >> rot) | (imm << (32 - rot));
+
+			mov(ecx, imm);
+
+			return rot ? (int)(imm >> 31) : CARRY_KEEP;
+		}
+
+		u32 shift = (opcode >> 7) & 0x1F;
+		u32 type = (opcode >> 5) & 3;
+
+		if (opcode & 0x10)
+			return emit_shifter_reg(opcode, pc, want_carry);
+
+		load_reg(ecx, opcode & 15, pc);
+
+		switch (type)
+		{
+		case 0:	//LSL
+			if (!shift)
+				return CARRY_KEEP;
+			shl(ecx, shift);
+			break;
+
+		case 1:	//LSR, #0 is #32
+			if (!shift)
+			{
+				bt(ecx, 31);
+				if (want_carry)
+					setc(r10b);
+				xor_(ecx, ecx);
+				return want_carry ? CARRY_RUNTIME : CARRY_KEEP;
+			}
+			shr(ecx, shift);
+			break;
+
+		case 2:	//ASR, #0 is #32
+			if (!shift)
+			{
+				bt(ecx, 31);
+				if (want_carry)
+					setc(r10b);
+				sar(ecx, 31);
+				return want_carry ? CARRY_RUNTIME : CARRY_KEEP;
+			}
+			sar(ecx, shift);
+			break;
+
+		case 3:	//ROR, #0 is RRX
+			if (!shift)
+			{
+				mov(eax, arm_reg(RN_PSR_FLAGS));
+				bt(eax, 29);
+				rcr(ecx, 1);
+			}
+			else
+				ror(ecx, shift);
+			break;
+		}
+
+		if (!want_carry)
+			return CARRY_KEEP;
+
+		setc(r10b);
+		return CARRY_RUNTIME;
+	}
+
+	//Shift by register, same results as the interpreter for the odd amounts
+	int emit_shifter_reg(u32 opcode, u32 pc, bool want_carry)
+	{
+		Xbyak::Label rotate, big, done;
+
+		load_reg(r8d, opcode & 15, pc);
+		load_reg(ecx, (opcode >> 8) & 15, pc);
+		movzx(ecx, cl);
+
+		//the carry is left alone by a zero shift
+		mov(edx, arm_reg(RN_PSR_FLAGS));
+		bt(edx, 29);
+		setc(r10b);
+
+		switch ((opcode >> 5) & 3)
+		{
+		case 0:	//LSL
+		case 1:	//LSR
+			{
+				Xbyak::Label eq32;
+				bool lsl = !((opcode >> 5) & 3);
+
+				test(ecx, ecx);
+				jz(done);
+				cmp(ecx, 32);
+				ja(big);
+				je(eq32);
+				if (lsl)
+					shl(r8d, cl);
+				else
+					shr(r8d, cl);
+				setc(r10b);
+				jmp(done);
+
+				L(eq32);
+				bt(r8d, lsl ? 0 : 31);
+				setc(r10b);
+				xor_(r8d, r8d);
+				jmp(done);
+
+				L(big);
+				xor_(r8d, r8d);
+				xor_(r10d, r10d);
+			}
+			break;
+
+		case 2:	//ASR
+			test(ecx, ecx);
+			jz(done);
+			cmp(ecx, 32);
+			jae(big);
+			sar(r8d, cl);
+			setc(r10b);
+			jmp(done);
+
+			L(big);
+			bt(r8d, 31);
+			setc(r10b);
+			sar(r8d, 31);
+			break;
+
+		case 3:	//ROR, multiples of 32 (and 0) set C to bit 31
+			and_(ecx, 31);
+			jnz(rotate);
+			bt(r8d, 31);
+			setc(r10b);
+			jmp(done);
+
+			L(rotate);
+			ror(r8d, cl);
+			setc(r10b);
+			break;
+		}
+
+		L(done);
+		mov(ecx, r8d);
+
+		return want_carry ? CARRY_RUNTIME : CARRY_KEEP;
+	}
+
+	//Data processing, with an immediate or shifted register operand
+	static bool can_dp(u32 opcode)
+	{
+		if ((opcode >> 26) & 3)
+			return false;
+
+		//multiplies, swaps and halfword transfers
+		if (!(opcode & (1 << 25)) && (opcode & 0x90) == 0x90)
+			return false;
+
+		u32 op = (opcode >> 21) & 15;
+		u32 S = (opcode >> 20) & 1;
+		u32 rd = (opcode >> 12) & 15;
+
+		//tst/teq/cmp/cmn without S are mrs/msr
+		if (op >= 8 && op <= 11 && !S)
+			return false;
+
+		//RSC, and anything writing the pc
+		return op != 7 && rd != 15;
+	}
+
+	void emit_dp(u32 opcode, u32 pc)
+	{
+		u32 op = (opcode >> 21) & 15;
+		bool S = (opcode >> 20) & 1;
+		u32 rn = (opcode >> 16) & 15;
+		u32 rd = (opcode >> 12) & 15;
+
+		bool logical = op == 0 || op == 1 || op == 8 || op == 9 || op >= 12;
+
+		int carry = emit_shifter(opcode, pc, S && logical);
+
+		//MOV and MVN have no first operand
+		if (op != 13 && op != 15)
+			load_reg(eax, rn, pc);
+
+		bool store = op < 8 || op > 11;
+
+		switch (op)
+		{
+		case 0: case 8: and_(eax, ecx); break;	//AND, TST
+		case 1: case 9: xor_(eax, ecx); break;	//EOR, TEQ
+		case 12: or_(eax, ecx); break;			//ORR
+		case 13: mov(eax, ecx); break;			//MOV
+		case 14: not_(ecx); and_(eax, ecx); break;	//BIC
+		case 15: not_(ecx); mov(eax, ecx); break;	//MVN
+
+		case 2: case 10: sub(eax, ecx); break;	//SUB, CMP
+		case 3: sub(ecx, eax); break;			//RSB
+		case 4: case 11: add(eax, ecx); break;	//ADD, CMN
+
+		case 5:	//ADC
+			mov(edx, arm_reg(RN_PSR_FLAGS));
+			bt(edx, 29);
+			adc(eax, ecx);
+			break;
+
+		case 6:	//SBC, borrow is !C
+			mov(edx, arm_reg(RN_PSR_FLAGS));
+			bt(edx, 29);
+			cmc();
+			sbb(eax, ecx);
+			break;
+		}
+
+		if (S)
+		{
+			if (logical)
+				store_nz(eax, carry);
+			else
+				store_nzcv(op == 2 || op == 3 || op == 6 || op == 10);
+		}
+
+		if (op == 3)
+			mov(eax, ecx);
+
+		if (store)
+			mov(arm_reg(rd), eax);
+	}
+
+	//LDR/STR/LDRB/STRB with an immediate or lsl'd register offset
+	static bool can_mem(u32 opcode)
+	{
+		if (((opcode >> 26) & 3) != 1)
+			return false;
+
+		bool I = (opcode >> 25) & 1;
+		bool P = (opcode >> 24) & 1;
+		bool W = (opcode >> 21) & 1;
+		bool L = (opcode >> 20) & 1;
+		u32 rn = (opcode >> 16) & 15;
+		u32 rd = (opcode >> 12) & 15;
+
+		//T versions
+		if (!P && W)
+			return false;
+
+		if (L && rd == 15)
+			return false;
+
+		if ((!P || W) && (rn == 15 || rn == rd))
+			return false;
+
+		if (I)
+		{
+			//undefined, and the register offset forms other than [Rn, Rm, lsl #]
+			if ((opcode & 0x10) || ((opcode >> 5) & 3) || !P || W || (opcode & 15) == 15)
+				return false;
+		}
+
+		return true;
+	}
+
+	//address in eax, result in edx
+	void emit_read(bool byte)
+	{
+		Xbyak::Label slow, done;
+
+		test(eax, 0x800000);
+		jnz(slow);
+
+		mov(ecx, eax);
+		if (byte)
+		{
+			and_(ecx, ARAM_MASK);
+			movzx(edx, Xbyak::util::byte[r12 + rcx]);
+		}
+		else
+		{
+			and_(ecx, ARAM_MASK - 3);
+			mov(edx, dword[r12 + rcx]);
+			//unaligned reads rotate
+			mov(ecx, eax);
+			and_(ecx, 3);
+			shl(ecx, 3);
+			ror(edx, cl);
+		}
+		jmp(done);
+
+		L(slow);
+		mov(call_regs[0], eax);
+		call((const void*)(byte ? armt_read8 : armt_read32));
+		mov(edx, eax);
+
+		L(done);
+	}
+
+	//address in eax, data in edx
+	void emit_write(bool byte)
+	{
+		Xbyak::Label slow, done;
+
+		test(eax, 0x800000);
+		jnz(slow);
+
+		mov(ecx, eax);
+		if (byte)
+		{
+			and_(ecx, ARAM_MASK);
+			mov(Xbyak::util::byte[r12 + rcx], dl);
+		}
+		else
+		{
+			and_(ecx, ARAM_MASK - 3);
+			mov(dword[r12 + rcx], edx);
+		}
+
+		//any blocks on the page?
+		shr(ecx, 12);
+		cmp(Xbyak::util::byte[r13 + rcx], 0);
+		je(done);
+		mov(call_regs[0], eax);
+		call((const void*)armt_code_written);
+		jmp(done);
+
+		L(slow);
+		mov(call_regs[1], edx);
+		mov(call_regs[0], eax);
+		call((const void*)(byte ? armt_write8 : armt_write32));
+
+		L(done);
+	}
+
+	void emit_mem(u32 opcode, u32 pc)
+	{
+		bool I = (opcode >> 25) & 1;
+		bool P = (opcode >> 24) & 1;
+		bool U = (opcode >> 23) & 1;
+		bool B = (opcode >> 22) & 1;
+		bool W = (opcode >> 21) & 1;
+		bool L = (opcode >> 20) & 1;
+		u32 rn = (opcode >> 16) & 15;
+		u32 rd = (opcode >> 12) & 15;
+		u32 offset = opcode & 0xFFF;
+
+		load_reg(eax, rn, pc);
+
+		if (P)
+		{
+			if (I)
+			{
+				load_reg(ecx, opcode & 15, pc);
+				shl(ecx, (opcode >> 7) & 31);
+				if (U)
+					add(eax, ecx);
+				else
+					sub(eax, ecx);
+			}
+			else if (offset)
+			{
+				if (U)
+					add(eax, offset);
+				else
+					sub(eax, offset);
+			}
+
+			//stores write the base back first
+			if (W && !L)
+				mov(arm_reg(rn), eax);
+		}
+
+		if (L)
+		{
+			if (P && W)
+				mov(arm_reg(rn), eax);
+			emit_read(B);
+			mov(arm_reg(rd), edx);
+		}
+		else
+		{
+			load_reg(edx, rd, pc);
+			emit_write(B);
+		}
+
+		//post indexed
+		if (!P && offset)
+		{
+			if (U)
+				add(arm_reg(rn), offset);
+			else
+				sub(arm_reg(rn), offset);
+		}
+	}
+
+	//MUL/MLA
+	static bool can_mul(u32 opcode)
+	{
+		return (opcode & 0x0FC000F0) == 0x00000090 && ((opcode >> 16) & 15) != 15;
+	}
+
+	void emit_mul(u32 opcode)
+	{
+		bool A = (opcode >> 21) & 1;
+		bool S = (opcode >> 20) & 1;
+
+		mov(eax, arm_reg(opcode & 15));
+		mov(ecx, arm_reg((opcode >> 8) & 15));
+		imul(eax, ecx);
+		if (A)
+			add(eax, arm_reg((opcode >> 12) & 15));
+		mov(arm_reg((opcode >> 16) & 15), eax);
+
+		if (S)
+			store_nz(eax, CARRY_KEEP);
+
+		//5 cycles (6 for mla), one less for each of the top bytes of rs that is all sign
+		mov(edx, ecx);
+		sar(edx, 31);
+		xor_(ecx, edx);
+		mov(edx, A ? 6 : 5);
+		for (u32 bits = 8; bits < 32; bits += 8)
+		{
+			cmp(ecx, 1u << bits);
+			sbb(edx, 0);
+		}
+		sub(arm_reg(CYCL_CNT), edx);
+	}
+
+	//LDM/STM, unless they load the pc, use the user bank or write back a base that is in the list
+	static bool can_block(u32 opcode)
+	{
+		if (((opcode >> 25) & 7) != 4)
+			return false;
+
+		bool S = (opcode >> 22) & 1;
+		bool W = (opcode >> 21) & 1;
+		bool L = (opcode >> 20) & 1;
+		u32 rn = (opcode >> 16) & 15;
+		u32 list = opcode & 0xFFFF;
+
+		if (S || rn == 15 || !list)
+			return false;
+
+		if (L && (list & 0x8000))
+			return false;
+
+		return !(W && (list & (1 << rn)));
+	}
+
+	static u32 block_count(u32 opcode)
+	{
+		u32 count = 0;
+		for (u32 r = 0; r < 16; r++)
+			count += (opcode >> r) & 1;
+		return count;
+	}
+
+	void emit_block(u32 opcode, u32 pc)
+	{
+		bool P = (opcode >> 24) & 1;
+		bool U = (opcode >> 23) & 1;
+		bool W = (opcode >> 21) & 1;
+		bool L = (opcode >> 20) & 1;
+		u32 rn = (opcode >> 16) & 15;
+		u32 count = block_count(opcode);
+
+		//the lowest register always goes to the lowest address
+		s32 start = U ? (P ? 4 : 0) : (P ? -4 * (s32)count : -4 * (s32)count + 4);
+
+		mov(r14d, arm_reg(rn));
+		if (start)
+			add(r14d, start);
+		and_(r14d, ~3);
+
+		for (u32 r = 0; r < 16; r++)
+		{
+			if (!(opcode & (1 << r)))
+				continue;
+
+			mov(eax, r14d);
+			if (L)
+			{
+				emit_read(false);
+				mov(arm_reg(r), edx);
+			}
+			else
+			{
+				//the pc is stored as the address of the opcode + 12
+				if (r == 15)
+					mov(edx, pc + 12);
+				else
+					mov(edx, arm_reg(r));
+				emit_write(false);
+			}
+			add(r14d, 4);
+		}
+
+		if (W)
+		{
+			if (U)
+				add(arm_reg(rn), 4 * count);
+			else
+				sub(arm_reg(rn), 4 * count);
+		}
+	}
+
+	//leaves the block if a store dropped the page it runs from
+	void check_dropped(u32 next_pc)
+	{
+		Xbyak::Label cont;
+		mov(rax, (size_t)&BlockDropped);
+		cmp(byte[rax], 0);
+		je(cont, T_NEAR);
+		exit_block(cycles, next_pc);
+		L(cont);
+	}
+
+	void emit_fallback(u32 opcode, u32 pc)
+	{
+		mov(arm_reg(15), pc + 8);
+		mov(arm_reg(R15_ARM_NEXT), pc + 4);
+		mov(call_regs[0], opcode);
+		call((const void*)arm_single_op);
+		sub(arm_reg(CYCL_CNT), eax);
+	}
+};
+
+void ArmAssembler::compile(u32 block_pc)
+{
+	prologue();
+
+	u32 pc = block_pc;
+	cycles = 0;
+
+	for (u32 i = 0; ; i++)
+	{
+		u32 opcode = *(u32*)&aica_ram.data[pc & ARAM_MASK];
+		u32 cond = opcode >> 28;
+
+		//every opcode costs 6 cycles, executed or not
+		cycles += 6;
+
+		if (cond == 0xF)
+		{
+			//never executed
+		}
+		else if (((opcode >> 25) & 7) == 5)
+		{
+			//B, BL
+			s32 offset = (s32)(opcode << 8) >> 6;
+			u32 target = pc + 8 + offset;
+			Xbyak::Label not_taken;
+
+			if (cond != 0xE)
+				emit_cond(cond, not_taken);
+
+			if (opcode & (1 << 24))
+				mov(arm_reg(14), pc + 4);
+			exit_block(cycles + 3, target);
+
+			if (cond != 0xE)
+			{
+				L(not_taken);
+				exit_block(cycles, pc + 4);
+			}
+			return;
+		}
+		else if (can_dp(opcode) || can_mem(opcode) || can_mul(opcode) || can_block(opcode))
+		{
+			//on top of the 6: ldr 3+1, str 2+1, ldm/stm 2 and 2 per register,
+			//shift by register 1, mul counts its own
+			u32 extra = 0;
+			if (can_mem(opcode))
+				extra = (opcode & (1 << 20)) ? 4 : 3;
+			else if (can_block(opcode))
+				extra = 2 + 2 * block_count(opcode);
+			else if (!(opcode & (1 << 25)) && (opcode & 0x10))
+				extra = 1;
+
+			Xbyak::Label skip;
+
+			if (cond != 0xE)
+				emit_cond(cond, skip);
+
+			if (can_mem(opcode))
+				emit_mem(opcode, pc);
+			else if (can_mul(opcode))
+				emit_mul(opcode);
+			else if (can_block(opcode))
+				emit_block(opcode, pc);
+			else
+				emit_dp(opcode, pc);
+
+			if (cond != 0xE)
+			{
+				if (extra)
+					sub(arm_reg(CYCL_CNT), extra);
+				L(skip);
+			}
+			else
+				cycles += extra;
+
+			bool store = (can_mem(opcode) || can_block(opcode)) && !(opcode & (1 << 20));
+			if (store)
+				check_dropped(pc + 4);
+		}
+		else
+		{
+			//arm_single_op counts the whole opcode
+			cycles -= 6;
+			emit_fallback(opcode, pc);
+
+			//msr may have changed the mode or unmasked the fiq
+			bool msr = (opcode & 0x0DB0F000) == 0x0120F000;
+
+			if (msr)
+			{
+				exit_block(cycles);
+				return;
+			}
+
+			Xbyak::Label cont;
+			cmp(arm_reg(R15_ARM_NEXT), pc + 4);
+			je(cont, T_NEAR);
+			exit_block(cycles);
+			L(cont);
+
+			check_dropped(pc + 4);
+		}
+
+		pc += 4;
+
+		if (i + 1 >= ARMT_BLOCK_MAX || !(pc & PAGE_MASK))
+		{
+			exit_block(cycles, pc);
+			return;
+		}
+	}
+}
+
+void arm_FlushCache(void)
+{
+	memset(EntryPoints, 0, sizeof(EntryPoints));
+	memset(CodePages, 0, sizeof(CodePages));
+	ArmCodeUsed = 0;
+}
+
+void arm_RamWritten(u32 addr)
+{
+	u32 page = (addr & ARAM_MASK) / PAGE_SIZE;
+
+	if (!CodePages[page])
+		return;
+
+	CodePages[page] = 0;
+	memset(&EntryPoints[page * PAGE_SIZE / 4], 0, PAGE_SIZE / 4 * sizeof(EntryPoints[0]));
+
+	if (page == BlockPage)
+		BlockDropped = 1;
+}
+
+static ArmBlock* armt_compile(u32 pc)
+{
+	if (ArmCodeUsed + ARMT_BLOCK_SIZE > ARMT_CODE_SIZE)
+		arm_FlushCache();
+
+	ArmAssembler assembler(ArmCodeBuffer + ArmCodeUsed, ARMT_CODE_SIZE - ArmCodeUsed);
+	assembler.compile(pc);
+
+	ArmBlock* block = (ArmBlock*)(ArmCodeBuffer + ArmCodeUsed);
+	ArmCodeUsed += (assembler.getSize() + 15) & ~15;
+
+	EntryPoints[pc / 4] = block;
+	CodePages[pc / PAGE_SIZE] = 1;
+
+	return block;
+}
+
+void armt_init(void)
+{
+	os_MakeExecutable(ArmCodeBuffer, sizeof(ArmCodeBuffer));
+	arm_FlushCache();
+}
+
+void armt_run(u32 CycleCount)
+{
+	//overshoot is carried over to the next slice
+	arm_Reg[CYCL_CNT].I += CycleCount;
+
+	while ((s32)arm_Reg[CYCL_CNT].I > 0)
+	{
+		if (arm_Reg[INTR_PEND].I)
+			CPUFiq();
+
+		u32 pc = arm_Reg[R15_ARM_NEXT].I;
+
+		if (unlikely(pc & ~ARAM_MASK))
+		{
+			//not in aica ram, step the interpreter
+			arm_Reg[15].I = pc + 8;
+			arm_Reg[R15_ARM_NEXT].I = pc + 4;
+			arm_Reg[CYCL_CNT].I -= arm_single_op(arm_ReadMem32(pc));
+			continue;
+		}
+
+		ArmBlock* block = EntryPoints[pc / 4];
+
+		if (unlikely(!block))
+			block = armt_compile(pc);
+
+		BlockPage = pc / PAGE_SIZE;
+		BlockDropped = 0;
+		block();
+	}
+}
+#endif
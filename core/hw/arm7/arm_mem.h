@@ -2,6 +2,7 @@
 
 #include "types.h"
 #include "hw/aica/aica_if.h"
+#include "arm7.h"
 
 #define REG_L (0x2D00)
 #define REG_M (0x2D04)
@@ -90,6 +91,9 @@ static INLINE void DYNACALL WriteMemArm1(u32 addr,u8 data)
 	if (addr<0x800000)
    {
 		*(u8*)&aica_ram.data[addr&(ARAM_MASK)]=data;
+#if FEAT_AREC == DYNAREC_JIT
+		arm_RamWritten(addr);
+#endif
       return;
    }
 
@@ -102,6 +106,9 @@ static INLINE void DYNACALL WriteMemArm2(u32 addr,u16 data)
 	if (addr<0x800000)
    {
 		*(u16*)&aica_ram.data[addr&(ARAM_MASK-(1))]=data;
+#if FEAT_AREC == DYNAREC_JIT
+		arm_RamWritten(addr);
+#endif
       return;
    }
 
@@ -114,6 +121,9 @@ static INLINE void DYNACALL WriteMemArm4(u32 addr,u32 data)
 	if (addr<0x800000)
    {
 		*(u32*)&aica_ram.data[addr&(ARAM_MASK-(3))]=data;
+#if FEAT_AREC == DYNAREC_JIT
+		arm_RamWritten(addr);
+#endif
       return;
    }
 
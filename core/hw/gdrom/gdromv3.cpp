@@ -11,6 +11,7 @@
 #include "hw/sh4/modules/dmac.h"
 #include "hw/sh4/sh4_core.h"
 #include "hw/holly/holly_intc.h"
+#include "serialize.h"
 
 #include "hw/sh4/sh4_mmr.h"
 #include "hw/sh4/sh4_sched.h"
@@ -1231,3 +1232,31 @@ void gdrom_reg_Reset(bool Manual)
 	SB_GDST = 0;
 	SB_GDEN = 0;
 }
+
+void gdrom_serialize(Serializer& s)
+{
+	s.value(sns_asc);
+	s.value(sns_ascq);
+	s.value(sns_key);
+
+	s.value(read_params);
+	s.value(packet_cmd);
+	s.value(read_buff);
+	s.value(pio_buff);
+	s.value(set_mode_offset);
+	s.value(ata_cmd);
+	s.value(cdda);
+
+	s.value(gd_state);
+	s.value(gd_disk_type);
+	s.value(data_write_mode);
+
+	s.value(DriveSel);
+	s.value(Error);
+	s.value(IntReason);
+	s.value(Features);
+	s.value(SecCount);
+	s.value(SecNumber);
+	s.value(GDStatus);
+	s.value(ByteCount);
+}
@@ -4,6 +4,7 @@
 #include "hw/sh4/sh4_interrupts.h"
 #include "hw/holly/sb.h"
 #include "hw/maple/maple_if.h"
+#include "serialize.h"
 
 /*
 	ASIC Interrupt controller
@@ -299,3 +300,9 @@ void asic_reg_Reset(bool Manual)
 {
 }
 
+void asic_serialize(Serializer& s)
+{
+	s.value(dmatmp1);
+	s.value(dmatmp2);
+	s.value(OldDmaId);
+}
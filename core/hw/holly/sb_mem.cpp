@@ -13,6 +13,7 @@
 #include "hw/pvr/pvr_regs.h"
 #include "hw/gdrom/gdrom_if.h"
 #include "hw/aica/aica_if.h"
+#include "hw/arm7/arm7.h"
 #include "hw/naomi/naomi.h"
 
 #include "hw/flashrom/flashrom.h"
@@ -308,6 +309,9 @@ void  DYNACALL WriteMem_area0(u32 addr,T data)
             *(u32*)&aica_ram.data[addr & ARAM_MASK] = data;
             break;
       }
+#if FEAT_AREC == DYNAREC_JIT
+		arm_RamWritten(addr);
+#endif
 		return;
 	}
 	//map 0x0100 to 0x01FF
@@ -771,7 +771,8 @@ bool _vmem_reserve(void)
 
 	verify((sizeof(Sh4RCB)%PAGE_SIZE)==0);
 
-	if (settings.dynarec.disable_nvmem)
+	//fastmem code would write vram directly, past the handlers that track it
+	if (settings.dynarec.disable_nvmem || settings.pvr.VramSoftTracking)
 		return _vmem_reserve_nonvmem();
 
 	virt_ram_base=(u8*)_nvmem_alloc_mem();
@@ -872,6 +873,39 @@ bool _vmem_reserve(void)
 }
 #endif
 
+//Lists every host mapping of a ram block, the block itself first.
+//Write protection has to cover all of them, or writes through a mirror go unnoticed
+u32 _vmem_get_views(VArray2& arr, u8** views)
+{
+	u32 cnt=0;
+
+	views[cnt++]=arr.data;
+
+	if (!_nvmem_enabled())
+		return cnt;
+
+	if (&arr==&mem_b)
+	{
+		//[0x0C000000,0x10000000)
+		for (u32 i=1;i<0x04000000/RAM_SIZE;i++)
+			views[cnt++]=arr.data+i*RAM_SIZE;
+	}
+	else if (&arr==&vram)
+	{
+		//[0x04000000,0x05000000) and [0x06000000,0x07000000)
+		for (u32 i=0;i<0x02000000/VRAM_SIZE;i++)
+		{
+			u8* view=virt_ram_base+0x04000000+(i/(0x01000000/VRAM_SIZE))*0x02000000+(i%(0x01000000/VRAM_SIZE))*VRAM_SIZE;
+			if (view!=arr.data)
+				views[cnt++]=view;
+		}
+	}
+
+	//aica ram is only writable through aica_ram.data, the rest go through the handlers
+
+	return cnt;
+}
+
 void _vmem_release(void)
 {
 	//TODO
@@ -64,6 +64,9 @@ void _vmem_get_ptrs(u32 sz,bool write,void*** vmap,void*** func);
 void* _vmem_get_ptr2(u32 addr,u32& mask);
 void* _vmem_read_const(u32 addr,bool& ismem,u32 sz);
 
+#define VMEM_MAX_VIEWS 8
+u32 _vmem_get_views(VArray2& arr, u8** views);
+
 extern u8* virt_ram_base;
 
 static inline bool _nvmem_enabled() {
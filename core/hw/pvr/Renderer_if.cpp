@@ -56,7 +56,7 @@
 
 
 	rendv2x hacks
-	- Only a single pending render. Any renders while still pending are dropped (before parsing)
+	- Up to settings.pvr.RenderQueueDepth pending renders, see QueueRender for what happens past that
 	- wait and block for parse/texcache. Render is async
 */
 
@@ -73,7 +73,7 @@ sthread_t *rthd;
 
 bool pend_rend = false;
 
-int max_idx,max_mvo,max_op,max_pt,max_tr,max_vtx,max_modt, ovrn;
+int ovrn;
 
 TA_context* _pvrrc;
 void SetREP(TA_context* cntx);
@@ -138,7 +138,9 @@ void rend_term(void)
 static bool rend_single_frame(void)
 {
    //wait render start only if no frame pending
-   do
+   _pvrrc = DequeueRender();
+
+   while (!_pvrrc)
    {
 #if !defined(TARGET_NO_THREADS)
       slock_lock(rs.mutx);
@@ -149,7 +151,6 @@ static bool rend_single_frame(void)
 #endif
       _pvrrc = DequeueRender();
    }
-   while (!_pvrrc);
    bool do_swp = rend_frame(_pvrrc, true);
 
    //clear up & free data ..
@@ -228,18 +229,7 @@ void rend_start_render(void)
    ctx->rend.fb_X_CLIP  = FB_X_CLIP;
    ctx->rend.fb_Y_CLIP  = FB_Y_CLIP;
 
-   max_idx              = max(max_idx,  ctx->rend.idx.used());
-   max_vtx              = max(max_vtx,  ctx->rend.verts.used());
-   max_op               = max(max_op,   ctx->rend.global_param_op.used());
-   max_pt               = max(max_pt,   ctx->rend.global_param_pt.used());
-   max_tr               = max(max_tr,   ctx->rend.global_param_tr.used());
-
-   max_mvo              = max(max_mvo,  ctx->rend.global_param_mvo.used());
-   max_modt             = max(max_modt, ctx->rend.modtrig.used());
-
-#if 0
-   printf("max: idx: %d, vtx: %d, op: %d, pt: %d, tr: %d, mvo: %d, modt: %d, ov: %d\n", max_idx, max_vtx, max_op, max_pt, max_tr, max_mvo, max_modt, ovrn);
-#endif
+   //the lists are only complete once parsed, FinishRender tracks their high-water marks
    if (QueueRender(ctx) || !settings.QueueRender)
    {
       palette_update();
@@ -259,6 +249,8 @@ bool rend_init(void)
 {
 #ifdef NO_REND
 	renderer	 = rend_norend();
+#elif defined(HAVE_SOFTREND)
+	renderer = settings.pvr.rend == 2 ? rend_softrend() : rend_GLES2();
 #else
 	renderer = rend_GLES2();
 #endif
@@ -51,3 +51,6 @@ extern Renderer* renderer;
 Renderer* rend_GLES2();
 Renderer* rend_norend();
 Renderer* rend_softrend();
+//640x480 XRGB8888 frame last presented by the soft renderer, stays
+//untouched until the next call
+u32* rend_softrend_fb();
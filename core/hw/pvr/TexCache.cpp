@@ -5,8 +5,6 @@
 
 bool pal_needs_update=true;
 
-u8* vq_codebook;
-u32 palette_index;
 u32 _pal_rev_256[4]={0};
 u32 _pal_rev_16[64]={0};
 u32 pal_rev_256[4]={0};
@@ -100,3 +98,91 @@ void palette_update(void)
    }
 
 }
+
+/*
+	XXH64, used to tell if a dirty texture really changed.
+	Fast enough to run over every texture a frame rewrites.
+*/
+static const u64 XXH_P1=11400714785074694791ULL;
+static const u64 XXH_P2=14029467366897019727ULL;
+static const u64 XXH_P3=1609587929392839161ULL;
+static const u64 XXH_P4=9650029242287828579ULL;
+static const u64 XXH_P5=2870177450012600261ULL;
+
+static INLINE u64 xxh_rotl(u64 v,int r) { return (v<<r)|(v>>(64-r)); }
+static INLINE u64 xxh_read64(const u8* p) { u64 v; memcpy(&v,p,8); return v; }
+static INLINE u32 xxh_read32(const u8* p) { u32 v; memcpy(&v,p,4); return v; }
+
+static INLINE u64 xxh_round(u64 acc,u64 input)
+{
+	acc+=input*XXH_P2;
+	acc=xxh_rotl(acc,31);
+	return acc*XXH_P1;
+}
+
+static INLINE u64 xxh_merge(u64 acc,u64 v)
+{
+	acc^=xxh_round(0,v);
+	return acc*XXH_P1+XXH_P4;
+}
+
+u64 XXH64(const void* data,u32 len,u64 seed)
+{
+	const u8* p=(const u8*)data;
+	const u8* end=p+len;
+	u64 h;
+
+	if (len>=32)
+	{
+		u64 v1=seed+XXH_P1+XXH_P2;
+		u64 v2=seed+XXH_P2;
+		u64 v3=seed;
+		u64 v4=seed-XXH_P1;
+
+		do
+		{
+			v1=xxh_round(v1,xxh_read64(p));
+			v2=xxh_round(v2,xxh_read64(p+8));
+			v3=xxh_round(v3,xxh_read64(p+16));
+			v4=xxh_round(v4,xxh_read64(p+24));
+			p+=32;
+		} while (p<=end-32);
+
+		h=xxh_rotl(v1,1)+xxh_rotl(v2,7)+xxh_rotl(v3,12)+xxh_rotl(v4,18);
+		h=xxh_merge(h,v1);
+		h=xxh_merge(h,v2);
+		h=xxh_merge(h,v3);
+		h=xxh_merge(h,v4);
+	}
+	else
+		h=seed+XXH_P5;
+
+	h+=len;
+
+	for (;p+8<=end;p+=8)
+	{
+		h^=xxh_round(0,xxh_read64(p));
+		h=xxh_rotl(h,27)*XXH_P1+XXH_P4;
+	}
+
+	if (p+4<=end)
+	{
+		h^=(u64)xxh_read32(p)*XXH_P1;
+		h=xxh_rotl(h,23)*XXH_P2+XXH_P3;
+		p+=4;
+	}
+
+	for (;p<end;p++)
+	{
+		h^=(*p)*XXH_P5;
+		h=xxh_rotl(h,11)*XXH_P1;
+	}
+
+	h^=h>>33;
+	h*=XXH_P2;
+	h^=h>>29;
+	h*=XXH_P3;
+	h^=h>>32;
+
+	return h;
+}
@@ -1,7 +1,5 @@
 #pragma once
 
-extern u8* vq_codebook;
-extern u32 palette_index;
 extern u32 palette_ram[1024];
 extern bool pal_needs_update,fog_needs_update;
 extern u32 pal_rev_256[4];
@@ -28,3 +26,5 @@ extern u32 detwiddle[2][8][1024];
 #define ARGB8888( word ) ( (((word>>4)&0xF)<<4) | (((word>>12)&0xF)<<8) | (((word>>20)&0xF)<<12) | (((word>>28)&0xF)<<0) )
 
 void palette_update(void);
+
+u64 XXH64(const void* data,u32 len,u64 seed);
@@ -48,6 +48,7 @@ s32 libPvr_Init(void)
 //called when exiting from sh4 thread , from the new thread context (for any thread specific de init) :P
 void libPvr_Term(void)
 {
+	ta_stream_term();
 	rend_term();
 	spg_Term();
    ta_ctx_free();
@@ -7,6 +7,7 @@ struct List
 	int avail;
 
 	int size;
+	int max_size;	//reserved behind daty, size grows up to it in place
 	bool* overrun;
 
 	__forceinline int used() const { return size-avail; }
@@ -21,6 +22,23 @@ struct List
 		return daty;
 	}
 
+	//the storage doesn't move, so the pointers held by the ta decoder stay valid
+	NOINLINE
+	T* grow(int n)
+	{
+		int need=used()+n;
+
+		if (need>max_size)
+			return sig_overrun();
+
+		int grown=min(max(size*2,need),max_size);
+
+		avail+=grown-size;
+		size=grown;
+
+		return Append(n);
+	}
+
 	__forceinline 
 	T* Append(int n=1)
 	{
@@ -34,7 +52,7 @@ struct List
 			return rv;
 		}
 		else
-			return sig_overrun();
+			return grow(n);
 	}
 
 	__forceinline 
@@ -45,33 +63,22 @@ struct List
 
 	T* head() const { return daty-used(); }
 
-	void InitBytes(int maxbytes,bool* ovrn)
+	//storage is owned by the caller (the TA_context arena)
+	void Init(T* base,int initsize,int maxsize,bool* ovrn)
 	{
-		maxbytes-=maxbytes%sizeof(T);
+		daty=base;
 
-		daty=(T*)malloc(maxbytes);
-		
-		avail=size=maxbytes/sizeof(T);
+		avail=size=initsize;
+		max_size=maxsize;
 
 		overrun=ovrn;
 
 		Clear();
 	}
 
-	void Init(int maxsize,bool* ovrn)
-	{
-		InitBytes(maxsize*sizeof(T),ovrn);
-	}
-
 	void Clear()
 	{
 		daty=head();
 		avail=size;
 	}
-
-	void Free()
-	{
-		Clear();
-		free(daty);
-	}
 };
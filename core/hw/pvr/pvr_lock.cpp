@@ -1,30 +1,93 @@
 #include "pvr_regs.h"
+#include "pvr_lock.h"
 #include "hw/mem/_vmem.h"
 
 #include <rthreads/rthreads.h>
 
 using namespace std;
 
-vector<vram_block*> VramLocks[VRAM_SIZE/PAGE_SIZE];
 //vram 32-64b
 VArray2 vram;
 
+//A block is linked on every page it covers, so unlocking and faulting only touch its own pages
+struct vram_lock_link
+{
+	vram_block* block;
+	vram_lock_link* next;         //on the page
+	vram_lock_link** pprev;
+	vram_lock_link* block_next;   //the block's next page
+};
+
+//Fixed size objects, carved from slabs that are kept for reuse
+template<typename T, u32 slab_items=512>
+struct vramlock_pool
+{
+	void* free_list;
+	vector<T*> slabs;
+
+	T* alloc()
+	{
+		if (!free_list)
+		{
+			T* slab=(T*)malloc(sizeof(T)*slab_items);
+			verify(slab!=0);
+			slabs.push_back(slab);
+
+			for (u32 i=0;i<slab_items;i++)
+				release(&slab[i]);
+		}
+
+		T* rv=(T*)free_list;
+		free_list=*(void**)rv;
+		return rv;
+	}
+
+	void release(T* obj)
+	{
+		*(void**)obj=free_list;
+		free_list=obj;
+	}
+};
+
+static vramlock_pool<vram_block> block_pool;
+static vramlock_pool<vram_lock_link> link_pool;
+
+static vram_lock_link* VramLocks[VRAM_SIZE/PAGE_SIZE];
+//write protected and not written since, so new locks there need no mprotect
+static u8 VramProtected[VRAM_SIZE/PAGE_SIZE];
+
+u64 vram_gen=1;
+u64 VramPageGen[VRAM_SIZE/PAGE_SIZE];
+u64 VramChunkGen[VRAM_SIZE/VRAM_GEN_CHUNK];
+
+static void vramlock_protect(u32 page,u32 count)
+{
+   VArray2_LockRegion(&vram, page*PAGE_SIZE, count*PAGE_SIZE);
+
+   //TODO: Fix this for 32M wrap as well
+   if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
+      VArray2_LockRegion(&vram, page*PAGE_SIZE + VRAM_SIZE, count*PAGE_SIZE);
+}
+
 //List functions
 //
 void vramlock_list_remove(vram_block* block)
 {
-	u32 base = block->start/PAGE_SIZE;
-	u32 end  = block->end/PAGE_SIZE;
+	vram_lock_link* link=block->links;
 
-	for (u32 i=base;i<=end;i++)
+	while (link)
 	{
-		vector<vram_block*>* list=&VramLocks[i];
-		for (size_t j=0;j<list->size();j++)
-		{
-			if ((*list)[j]==block)
-				(*list)[j]=0;
-		}
+		vram_lock_link* next=link->block_next;
+
+		*link->pprev=link->next;
+		if (link->next)
+			link->next->pprev=link->pprev;
+
+		link_pool.release(link);
+		link=next;
 	}
+
+	block->links=0;
 }
  
 void vramlock_list_add(vram_block* block)
@@ -32,23 +95,40 @@ void vramlock_list_add(vram_block* block)
 	u32 base = block->start/PAGE_SIZE;
 	u32 end = block->end/PAGE_SIZE;
 
-
-	for (u32 i=base;i<=end;i++)
+	//protect the pages that aren't yet, a run at a time
+	for (u32 i=base;i<=end && !settings.pvr.VramSoftTracking;)
 	{
-		vector<vram_block*>* list=&VramLocks[i];
-		for (u32 j=0;j<list->size();j++)
+		if (VramProtected[i])
 		{
-			if ((*list)[j]==0)
-			{
-				(*list)[j]=block;
-				goto added_it;
-			}
+			i++;
+			continue;
 		}
 
-		list->push_back(block);
-added_it:
-		i=i;
+		u32 run=i;
+		while (i<=end && !VramProtected[i])
+			VramProtected[i++]=1;
+
+		vramlock_protect(run,i-run);
 	}
+
+	vram_lock_link** tail=&block->links;
+
+	for (u32 i=base;i<=end;i++)
+	{
+		vram_lock_link* link=link_pool.alloc();
+
+		link->block=block;
+		link->next=VramLocks[i];
+		link->pprev=&VramLocks[i];
+		if (link->next)
+			link->next->pprev=&link->next;
+		VramLocks[i]=link;
+
+		*tail=link;
+		tail=&link->block_next;
+	}
+
+	*tail=0;
 }
  
 #ifndef TARGET_NO_THREADS
@@ -64,8 +144,6 @@ static inline bool IsInRange(vram_block* block,u32 offset)
 
 vram_block* libCore_vramlock_Lock(u32 start_offset64,u32 end_offset64,void* userdata)
 {
-	vram_block* block=(vram_block* )malloc(sizeof(vram_block));
-
 	if (end_offset64>(VRAM_SIZE-1))
 	{
 		msgboxf("vramlock_Lock_64: end_offset64>(VRAM_SIZE-1) \n Tried to lock area out of vram , possibly bug on the pvr plugin",MBX_OK);
@@ -78,23 +156,18 @@ vram_block* libCore_vramlock_Lock(u32 start_offset64,u32 end_offset64,void* user
 		start_offset64=0;
 	}
 
-	
+#ifndef TARGET_NO_THREADS
+   slock_lock(vramlist_lock);
+#endif
+
+	vram_block* block=block_pool.alloc();
 
 	block->end=end_offset64;
 	block->start=start_offset64;
 	block->len=end_offset64-start_offset64+1;
 	block->userdata=userdata;
 	block->type=64;
-
-#ifndef TARGET_NO_THREADS
-   slock_lock(vramlist_lock);
-#endif
-
-   VArray2_LockRegion(&vram, block->start,block->len);
-
-   //TODO: Fix this for 32M wrap as well
-   if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
-      VArray2_LockRegion(&vram, block->start + VRAM_SIZE, block->len);
+	block->gen=++vram_gen;
 
    vramlock_list_add(block);
 
@@ -114,33 +187,36 @@ bool VramLockedWrite(u8* address)
    {
 
       size_t addr_hash = offset/PAGE_SIZE;
-      vector<vram_block*>* list=&VramLocks[addr_hash];
+      vram_lock_link** list=&VramLocks[addr_hash];
 
 #ifndef TARGET_NO_THREADS
       slock_lock(vramlist_lock);
 #endif
 
-      for (size_t i=0;i<list->size();i++)
+      while (*list)
       {
-         if ((*list)[i])
-         {
-            libPvr_LockedBlockWrite((*list)[i],(u32)offset);
+         vram_block* block=(*list)->block;
 
-            if ((*list)[i])
-            {
-               msgboxf("Error : pvr is supposed to remove lock",MBX_OK);
-               dbgbreak;
-            }
+         libPvr_LockedBlockWrite(block,(u32)offset);
 
+         if (*list && (*list)->block==block)
+         {
+            msgboxf("Error : pvr is supposed to remove lock",MBX_OK);
+            dbgbreak;
+            libCore_vramlock_Unlock_block_wb(block);
          }
       }
-      list->clear();
 
-      VArray2_UnLockRegion(&vram, (u32)offset&(~(PAGE_SIZE-1)),PAGE_SIZE);
+      if (VramProtected[addr_hash])
+      {
+         VramProtected[addr_hash]=0;
 
-      //TODO: Fix this for 32M wrap as well
-      if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
-         VArray2_UnLockRegion(&vram, (u32)offset&(~(PAGE_SIZE-1)) + VRAM_SIZE,PAGE_SIZE);
+         VArray2_UnLockRegion(&vram, (u32)offset&(~(PAGE_SIZE-1)),PAGE_SIZE);
+
+         //TODO: Fix this for 32M wrap as well
+         if (_nvmem_enabled() && VRAM_SIZE == 0x800000)
+            VArray2_UnLockRegion(&vram, (u32)offset&(~(PAGE_SIZE-1)) + VRAM_SIZE,PAGE_SIZE);
+      }
 
 #ifndef TARGET_NO_THREADS
       slock_unlock(vramlist_lock);
@@ -152,6 +228,39 @@ bool VramLockedWrite(u8* address)
    return false;
 }
 
+//Soft tracking: hands the block to the pvr like a fault would, if any of its pages was written since it was locked
+void libCore_vramlock_Check(vram_block* block)
+{
+	if (!settings.pvr.VramSoftTracking)
+		return;
+
+	u64 gen=block->gen;
+	u32 end=block->end/PAGE_SIZE;
+
+	for (u32 i=block->start/PAGE_SIZE;i<=end;)
+	{
+		if (VramChunkGen[i*PAGE_SIZE/VRAM_GEN_CHUNK]<gen)
+		{
+			i=(i*PAGE_SIZE/VRAM_GEN_CHUNK+1)*(VRAM_GEN_CHUNK/PAGE_SIZE);
+			continue;
+		}
+
+		if (VramPageGen[i]>=gen)
+		{
+#ifndef TARGET_NO_THREADS
+			slock_lock(vramlist_lock);
+#endif
+			libPvr_LockedBlockWrite(block,i*PAGE_SIZE);
+#ifndef TARGET_NO_THREADS
+			slock_unlock(vramlist_lock);
+#endif
+			return;
+		}
+
+		i++;
+	}
+}
+
 #ifdef TARGET_NO_THREADS
 void libCore_vramlock_Free(void) { }
 void libCore_vramlock_Init(void) { }
@@ -189,7 +298,6 @@ void libCore_vramlock_Unlock_block_wb(vram_block* block)
 	if (block->end <= VRAM_SIZE)
 	{
 		vramlock_list_remove(block);
-		//more work needed
-		free(block);
+		block_pool.release(block);
 	}
 }
@@ -2,3 +2,32 @@
 
 void libCore_vramlock_Free(void);
 void libCore_vramlock_Init(void);
+
+/*
+	settings.pvr.VramSoftTracking: locked pages aren't write protected. Instead, every
+	vram write stamps its pages with the current generation, which each new lock
+	bumps, and libCore_vramlock_Check compares a block against its pages on lookup.
+	Stamps are kept per page, and per chunk so big untouched ranges are skipped.
+*/
+#define VRAM_GEN_CHUNK 0x10000
+
+extern u64 vram_gen;
+extern u64 VramPageGen[VRAM_SIZE/PAGE_SIZE];
+extern u64 VramChunkGen[VRAM_SIZE/VRAM_GEN_CHUNK];
+
+static INLINE void vramlock_mark_written(u32 offset,u32 len)
+{
+	if (!settings.pvr.VramSoftTracking)
+		return;
+
+	u32 last=(offset+len-1)/PAGE_SIZE;
+
+	if (last>=VRAM_SIZE/PAGE_SIZE)
+		last=VRAM_SIZE/PAGE_SIZE-1;
+
+	for (u32 i=offset/PAGE_SIZE;i<=last;i++)
+		VramPageGen[i]=vram_gen;
+
+	for (u32 i=offset/VRAM_GEN_CHUNK;i<=last*PAGE_SIZE/VRAM_GEN_CHUNK;i++)
+		VramChunkGen[i]=vram_gen;
+}
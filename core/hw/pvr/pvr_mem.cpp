@@ -8,6 +8,7 @@
 #include "pvr_mem.h"
 #include "ta.h"
 #include "pvr_regs.h"
+#include "pvr_lock.h"
 #include "Renderer_if.h"
 #include "hw/mem/_vmem.h"
 
@@ -115,6 +116,8 @@ static INLINE void YUV_ConvertMacroBlock(u8* datap)
    ta_yuv_process_block(inuv+32,iny+128,p_out+YUV_x_size*8*2);     /* (0,8) */
    ta_yuv_process_block(inuv+36,iny+192,p_out+YUV_x_size*8*2+8*2); /* (8,8) */
 
+   vramlock_mark_written(YUV_dest,YUV_x_size*16*2);
+
    YUV_dest   += 32;
    YUV_x_curr += 16;
 
@@ -188,12 +191,46 @@ void DYNACALL pvr_write_area1_8(u32 addr,u8 data)
 
 void DYNACALL pvr_write_area1_16(u32 addr,u16 data)
 {
-   *(u16*)&vram.data[pvr_map32(addr) & VRAM_MASK]=data;
+   u32 offset = pvr_map32(addr) & VRAM_MASK;
+   *(u16*)&vram.data[offset]=data;
+   vramlock_mark_written(offset,2);
 }
 
 void DYNACALL pvr_write_area1_32(u32 addr,u32 data)
 {
-   *(u32*)&vram.data[pvr_map32(addr) & VRAM_MASK] = data;
+   u32 offset = pvr_map32(addr) & VRAM_MASK;
+   *(u32*)&vram.data[offset] = data;
+   vramlock_mark_written(offset,4);
+}
+
+//64b interface, only through handlers with settings.pvr.VramSoftTracking, see map_area1
+u8 DYNACALL pvr_read_area1_64_8(u32 addr)
+{
+   return vram.data[addr & VRAM_MASK];
+}
+u16 DYNACALL pvr_read_area1_64_16(u32 addr)
+{
+   return *(u16*)&vram.data[addr & VRAM_MASK];
+}
+u32 DYNACALL pvr_read_area1_64_32(u32 addr)
+{
+   return *(u32*)&vram.data[addr & VRAM_MASK];
+}
+
+void DYNACALL pvr_write_area1_64_8(u32 addr,u8 data)
+{
+   vram.data[addr & VRAM_MASK]=data;
+   vramlock_mark_written(addr & VRAM_MASK,1);
+}
+void DYNACALL pvr_write_area1_64_16(u32 addr,u16 data)
+{
+   *(u16*)&vram.data[addr & VRAM_MASK]=data;
+   vramlock_mark_written(addr & VRAM_MASK,2);
+}
+void DYNACALL pvr_write_area1_64_32(u32 addr,u32 data)
+{
+   *(u32*)&vram.data[addr & VRAM_MASK]=data;
+   vramlock_mark_written(addr & VRAM_MASK,4);
 }
 
 void TAWrite(u32 address,u32* data,u32 count)
@@ -213,6 +250,7 @@ void TAWrite(u32 address,u32* data,u32 count)
       //shouldn't really get here (?) -> works on dc :D need to handle lmmodes
       //printf("Vram Write 0x%X , size %d\n",address,count*32);
       memcpy(&vram.data[address & VRAM_MASK],data,count*32);
+      vramlock_mark_written(address & VRAM_MASK,count*32);
    }
 }
 
@@ -241,6 +279,7 @@ extern "C" void DYNACALL TAWriteSQ(u32 address,u8* sqb)
       //printf("Vram Write 0x%X , size %d\n",address,count*32);
       u8* vram=sqb + TA_YUV422_MACROBLOCK_SIZE + 0x04000000;
       MemWrite32(&vram[address_w&(VRAM_MASK-0x1F)],sq);
+      vramlock_mark_written(address_w&(VRAM_MASK-0x1F),32);
    }
 }
 #endif
@@ -251,7 +290,14 @@ extern "C" void DYNACALL TAWriteSQ(u32 address,u8* sqb)
 void pvr_Reset(bool Manual)
 {
    if (!Manual)
+   {
+      //the textures on it are stale, and zeroing drops the write protection
+      bool VramLockedWrite(u8* address);
+      for (u32 p=0;p<VRAM_SIZE;p+=PAGE_SIZE)
+         VramLockedWrite(vram.data+p);
+
       VArray2_Zero(&vram);
+   }
 }
 
 u32 pvr_map32(u32 offset32)
@@ -14,6 +14,14 @@ void DYNACALL pvr_write_area1_8(u32 addr,u8 data);
 void DYNACALL pvr_write_area1_16(u32 addr,u16 data);
 void DYNACALL pvr_write_area1_32(u32 addr,u32 data);
 
+//64b interface, see map_area1
+u8 DYNACALL pvr_read_area1_64_8(u32 addr);
+u16 DYNACALL pvr_read_area1_64_16(u32 addr);
+u32 DYNACALL pvr_read_area1_64_32(u32 addr);
+void DYNACALL pvr_write_area1_64_8(u32 addr,u8 data);
+void DYNACALL pvr_write_area1_64_16(u32 addr,u16 data);
+void DYNACALL pvr_write_area1_64_32(u32 addr,u32 data);
+
 //regs
 void pvr_WriteReg(u32 paddr,u32 data);
 
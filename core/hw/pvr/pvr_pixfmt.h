@@ -7,8 +7,27 @@ struct PixelBuffer
 	u16* p_current_pixel;
 
 	u32 pixels_per_line;
+
+	//decode context, so several textures can be converted at once
+	u32* palette;		//&palette_ram[palette index], paletted textures
+	u8* vq_codebook;	//VQ textures
 };
 
+typedef void TexConvFP(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height);
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+struct TexConvTable
+{
+	TexConvFP *PL;
+	TexConvFP *TW;
+	TexConvFP *VQ;
+};
+
+//SIMD converters indexed by PixelFmt, NULL entries keep the portable ones (texconv_simd.h)
+extern const TexConvTable texconv_sse2[7];
+extern const TexConvTable texconv_ssse3[7];
+#endif
+
 __forceinline u32 YUV422(s32 Y,s32 Yu,s32 Yv)
 {
 	Yu-=128;
@@ -172,7 +191,7 @@ pixelcvt_end;
 pixelcvt_start(convPAL4_TW,4,4)
 {
 	u8* p_in=(u8*)data;
-	u32* pal=&palette_ram[palette_index];
+	u32* pal=pb->palette;
 
    pb->p_current_pixel[0]=pal[p_in[0]&0xF];
    pb->p_current_pixel[1*pb->pixels_per_line]=pal[(p_in[0]>>4)&0xF];
@@ -205,7 +224,7 @@ pixelcvt_start(convPAL4_TW,4,4)
 pixelcvt_next(convPAL8_TW,2,4)
 {
 	u8* p_in=(u8*)data;
-	u32* pal=&palette_ram[palette_index];
+	u32* pal=pb->palette;
 
    pb->p_current_pixel[0]=pal[p_in[0]];
    p_in++;
@@ -305,7 +324,7 @@ void texture_VQ(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
 #else
 			u8 p = p_in[(twop(x,y,bcx,bcy)/divider)];
 #endif
-			PixelConvertor::Convert(pb,&vq_codebook[p*8]);
+			PixelConvertor::Convert(pb,&pb->vq_codebook[p*8]);
 
          pb->p_current_pixel += PixelConvertor::xpp;
 		}
@@ -107,6 +107,9 @@ static int spg_line_sched(int tag, int cycl, int jit)
 			/* Vblank counter */
 			vblk_cnt++;
 
+			sh4_sched_frame_dispatches = sh4_sched_dispatches;
+			sh4_sched_dispatches       = 0;
+
          /* HBlank in */
 			asic_RaiseInterrupt(holly_HBLank);
 			rend_vblank();//notify for vblank :)
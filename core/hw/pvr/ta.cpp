@@ -199,6 +199,7 @@ static NOINLINE void DYNACALL ta_handle_cmd(u32 trans)
             //printf("List %d ended\n",ta_fsm_cl);
 
             asic_RaiseInterrupt( ListEndInterrupt[ta_fsm_cl]);
+            ta_stream_list_end();
             ta_fsm_cl=7;
             trans=TAS_NS;
             break;
@@ -239,6 +240,7 @@ void ta_vtx_ListCont(void)
 void ta_vtx_ListInit(void)
 {
 	SetCurrentTARC(TA_ISP_BASE);
+   ta_stream_cancel(ta_ctx);
 
    /* Clear partial */
    ta_tad.thd_old_data = ta_tad.thd_data;
@@ -20,4 +20,8 @@ void ta_vtx_data(u32* data, u32 size);
 
 bool ta_parse_vdrc(TA_context* ctx);
 
+void ta_stream_list_end(void);
+void ta_stream_cancel(TA_context* ctx);
+void ta_stream_term(void);
+
 #define STRIPS_AS_PPARAMS 1
@@ -2,6 +2,15 @@
 #include "ta_ctx.h"
 
 #include "hw/sh4/sh4_sched.h"
+#include "serialize.h"
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 extern u32 FrameCount;
 
@@ -12,12 +21,56 @@ TA_context*  vd_ctx;
 rend_context vd_rc;
 
 #if !defined(TARGET_NO_THREADS)
-slock_t *mtx_rqueue;
 slock_t *mtx_pool;
 cResetEvent frame_finished;
 #endif
 
-TA_context* rqueue;
+TAHighWater tactx_high;
+
+//the lists grow in place, so the whole of their reservation is mapped up front
+u8* tactx_ArenaAlloc(size_t size)
+{
+#ifdef _WIN32
+	void* rv = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* rv = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+	if (rv == MAP_FAILED)
+		rv = 0;
+#ifdef MADV_HUGEPAGE
+	else
+		madvise(rv, size, MADV_HUGEPAGE);
+#endif
+#endif
+
+	if (!rv)
+		die("tactx: failed to allocate the context arena\n");
+
+	return (u8*)rv;
+}
+
+void tactx_ArenaFree(u8* ptr, size_t size)
+{
+#ifdef _WIN32
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, size);
+#endif
+}
+
+static void tactx_HighWater(TA_context* ctx)
+{
+	rend_context& rc = ctx->rend;
+
+	tactx_high.ta_data = max(tactx_high.ta_data, (u32)(TAD_END(ctx->tad) - ctx->tad.thd_root));
+	tactx_high.verts   = max(tactx_high.verts, (u32)rc.verts.used());
+	tactx_high.idx     = max(tactx_high.idx,   (u32)rc.idx.used());
+	tactx_high.op      = max(tactx_high.op,    (u32)rc.global_param_op.used());
+	tactx_high.pt      = max(tactx_high.pt,    (u32)rc.global_param_pt.used());
+	tactx_high.tr      = max(tactx_high.tr,    (u32)rc.global_param_tr.used());
+	tactx_high.mvo     = max(tactx_high.mvo,   (u32)rc.global_param_mvo.used());
+	tactx_high.modt    = max(tactx_high.modt,  (u32)rc.modtrig.used());
+}
 
 /* texture cache entry pool. */
 vector<TA_context*> ctx_pool;
@@ -121,141 +174,199 @@ static void VDecEnd(void)
 	vd_ctx->rend = vd_rc;
 	vd_ctx = 0;
 }
-
-bool QueueRender(TA_context* ctx)
+#else
+static void VDecEnd(void)
 {
-	if (rqueue)
-   {
-		tactx_Recycle(ctx);
-		return false;
-	}
+	vd_ctx->rend = vd_rc;
 
-	TA_context* old = rqueue;
-	rqueue=ctx;
+   slock_unlock(vd_ctx->rend_inuse);
 
-	return true;
+	vd_ctx = 0;
 }
+#endif
 
-TA_context* DequeueRender(void)
+/*
+	Render queue
+
+	A ring of up to settings.pvr.RenderQueueDepth contexts, filled by the sh4
+	(QueueRender) and drained by the renderer (DequeueRender). Only the sh4
+	writes rqueue_tail. rqueue_head is advanced with a CAS, by the renderer
+	and by the sh4 when it drops the oldest frame, so neither side locks.
+
+	When the queue is full, settings.pvr.RenderQueuePolicy picks between
+	latency and throughput:
+	  RQ_DROP_OLDEST  never stalls the sh4, the oldest queued frame is dropped
+	  RQ_BLOCK        the sh4 waits until every queued frame is rendered
+	  RQ_PIPELINE     the sh4 only waits for a free slot
+	Without a render thread frames are rendered as soon as they are queued,
+	so the queue never fills up.
+*/
+static TA_context* rqueue[RQUEUE_MAX_DEPTH];
+static std::atomic<u32> rqueue_head;
+static std::atomic<u32> rqueue_tail;
+static std::atomic<u32> rqueue_done;	//frames rendered or dropped
+
+RenderQueueStats rqueue_stats;
+
+static u32 rqueue_depth(void)
 {
-	TA_context* rv = rqueue;
-
-	if (rv)
-		FrameCount++;
-
-	return rv;
+	return min(max(settings.pvr.RenderQueueDepth, 1u), (u32)RQUEUE_MAX_DEPTH);
 }
 
-bool rend_framePending(void)
+//contexts kept allocated: the queued ones, the one rendering and two being built
+static u32 tactx_pool_size(void)
 {
-	TA_context* rv = rqueue;
-	return rv != 0;
+	return rqueue_depth() + 3;
 }
 
-void FinishRender(TA_context* ctx)
+static void rqueue_frame_done(void)
 {
-	rqueue = 0;
+	rqueue_done++;
 
-	tactx_Recycle(ctx);
+#if !defined(TARGET_NO_THREADS)
+   slock_lock(frame_finished.mutx);
+   frame_finished.state = true;
+   scond_signal(frame_finished.cond);
+   slock_unlock(frame_finished.mutx);
+#endif
 }
 
-void ta_ctx_free(void) { }
-void ta_ctx_init(void) { }
-
-void tactx_Recycle(TA_context* poped_ctx)
-{
-   if (ctx_pool.size()>2)
-   {
-      poped_ctx->Free();
-      delete poped_ctx;
-   }
-   else
-   {
-      poped_ctx->Reset();
-      ctx_pool.push_back(poped_ctx);
-   }
-}
-#else
-static void VDecEnd(void)
+static bool rqueue_full(u32 tail)
 {
-	vd_ctx->rend = vd_rc;
+	if (settings.pvr.RenderQueuePolicy == RQ_BLOCK)
+		return tail != rqueue_done;
 
-   slock_unlock(vd_ctx->rend_inuse);
-
-	vd_ctx = 0;
+	return tail - rqueue_head.load(std::memory_order_acquire) >= rqueue_depth();
 }
 
 bool QueueRender(TA_context* ctx)
 {
-	if (rqueue)
-   {
-		tactx_Recycle(ctx);
-		return false;
+	u32 tail = rqueue_tail.load(std::memory_order_relaxed);
+
+	if (rqueue_full(tail) && settings.pvr.RenderQueuePolicy == RQ_DROP_OLDEST)
+	{
+		u32 head = rqueue_head.load(std::memory_order_acquire);
+
+		while (tail - head >= rqueue_depth())
+		{
+			TA_context* old = rqueue[head % RQUEUE_MAX_DEPTH];
+
+			//fails if the renderer took it first, head is reloaded then
+			if (rqueue_head.compare_exchange_weak(head, head + 1))
+			{
+				tactx_Recycle(old);
+				rqueue_stats.dropped++;
+				rqueue_frame_done();
+				head++;
+			}
+		}
 	}
+#if !defined(TARGET_NO_THREADS)
+	else if (rqueue_full(tail))
+	{
+		rqueue_stats.blocked++;
 
-   slock_lock(frame_finished.mutx);
-   frame_finished.state = false;
-   slock_unlock(frame_finished.mutx);
-   slock_lock(mtx_rqueue);
-	TA_context* old = rqueue;
-	rqueue=ctx;
-   slock_unlock(mtx_rqueue);
+		slock_lock(frame_finished.mutx);
+		while (rqueue_full(tail))
+			scond_wait(frame_finished.cond, frame_finished.mutx);
+		frame_finished.state = false;
+		slock_unlock(frame_finished.mutx);
+	}
+#endif
+
+	rqueue[tail % RQUEUE_MAX_DEPTH] = ctx;
+	rqueue_tail.store(tail + 1, std::memory_order_release);
+
+	u32 depth = tail + 1 - rqueue_head.load(std::memory_order_acquire);
+
+	rqueue_stats.queued++;
+	rqueue_stats.depth_sum += depth;
+	rqueue_stats.max_depth = max(rqueue_stats.max_depth, depth);
 
 	return true;
 }
 
 TA_context* DequeueRender(void)
 {
-   slock_lock(mtx_rqueue);
-	TA_context* rv = rqueue;
-   slock_unlock(mtx_rqueue);
+	u32 head = rqueue_head.load(std::memory_order_acquire);
+	TA_context* rv;
 
-	if (rv)
-		FrameCount++;
+	do
+	{
+		if (head == rqueue_tail.load(std::memory_order_acquire))
+			return 0;
+
+		rv = rqueue[head % RQUEUE_MAX_DEPTH];
+	}
+	while (!rqueue_head.compare_exchange_weak(head, head + 1));
+
+	FrameCount++;
 
 	return rv;
 }
 
 bool rend_framePending(void)
 {
-   slock_lock(mtx_rqueue);
-	TA_context* rv = rqueue;
-   slock_unlock(mtx_rqueue);
-
-	return rv != 0;
+	return rqueue_head.load(std::memory_order_acquire) != rqueue_tail.load(std::memory_order_acquire);
 }
 
 void FinishRender(TA_context* ctx)
 {
-   slock_lock(mtx_rqueue);
-	rqueue = 0;
-   slock_unlock(mtx_rqueue);
-
+	tactx_HighWater(ctx);
 	tactx_Recycle(ctx);
-   slock_lock(frame_finished.mutx);
-   frame_finished.state = true;
-   scond_signal(frame_finished.cond);
-   slock_unlock(frame_finished.mutx);
+	rqueue_frame_done();
 }
 
 void ta_ctx_free(void)
 {
-   slock_free(mtx_rqueue);
+	while (TA_context* ctx = DequeueRender())
+		FinishRender(ctx);
+
+	for (size_t i=0; i<ctx_pool.size(); i++)
+	{
+		ctx_pool[i]->Free();
+		delete ctx_pool[i];
+	}
+	ctx_pool.clear();
+
+#if !defined(TARGET_NO_THREADS)
+   slock_free(frame_finished.mutx);
+   scond_free(frame_finished.cond);
    slock_free(mtx_pool);
-   mtx_rqueue = NULL;
+   frame_finished.mutx = NULL;
+   frame_finished.cond = NULL;
    mtx_pool   = NULL;
+#endif
 }
 
 void ta_ctx_init(void)
 {
-   mtx_rqueue = slock_new();
+#if !defined(TARGET_NO_THREADS)
    mtx_pool   = slock_new();
+   frame_finished.mutx = slock_new();
+   frame_finished.cond = scond_new();
+#endif
+
+	rqueue_head = rqueue_tail = rqueue_done = 0;
+	memset(&rqueue_stats, 0, sizeof(rqueue_stats));
+
+	//allocate the pool up front, rather than on the first frames
+	while (ctx_pool.size() < tactx_pool_size())
+	{
+		TA_context* ctx = new TA_context();
+		ctx->Alloc();
+		ctx_pool.push_back(ctx);
+	}
 }
 
 void tactx_Recycle(TA_context* poped_ctx)
 {
+   ta_stream_cancel(poped_ctx);
+
+#if !defined(TARGET_NO_THREADS)
    slock_lock(mtx_pool);
-   if (ctx_pool.size()>2)
+#endif
+   if (ctx_pool.size() >= tactx_pool_size())
    {
       poped_ctx->Free();
       delete poped_ctx;
@@ -265,9 +376,10 @@ void tactx_Recycle(TA_context* poped_ctx)
       poped_ctx->Reset();
       ctx_pool.push_back(poped_ctx);
    }
+#if !defined(TARGET_NO_THREADS)
    slock_unlock(mtx_pool);
-}
 #endif
+}
 
 TA_context* tactx_Pop(u32 addr)
 {
@@ -289,4 +401,44 @@ TA_context* tactx_Pop(u32 addr)
 	return 0;
 }
 
+/*
+	Only the list being built is kept. Contexts that are complete but not
+	yet rendered are dropped, which at worst skips a frame after loading.
+	The buffer is always reserved in full so the state size stays fixed.
+*/
+void tactx_serialize(Serializer& s)
+{
+	u32 addr = ta_ctx ? ta_ctx->Address : TACTX_NONE;
+	u32 data_offs = ta_ctx ? ta_tad.thd_data - ta_tad.thd_root : 0;
+	u32 old_offs = ta_ctx ? ta_tad.thd_old_data - ta_tad.thd_root : 0;
+
+	s.value(addr);
+	s.value(data_offs);
+	s.value(old_offs);
+
+	u32 used = min(max(data_offs, old_offs), (u32)TA_DATA_SIZE);
+
+	if (s.loading)
+	{
+		ta_stream_cancel(NULL);
+
+		if (ta_ctx)
+			SetCurrentTARC(TACTX_NONE);
 
+		if (addr != TACTX_NONE)
+		{
+			SetCurrentTARC(addr);
+			ta_ctx->Reset();
+
+			ta_tad = ta_ctx->tad;
+			ta_tad.thd_data = ta_tad.thd_root + min(data_offs, used);
+			ta_tad.thd_old_data = ta_tad.thd_root + min(old_offs, used);
+		}
+		else
+			used = 0;
+	}
+
+	if (used)
+		s.raw(ta_tad.thd_root, used);
+	s.skip(TA_DATA_SIZE - used);
+}
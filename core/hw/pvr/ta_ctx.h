@@ -95,6 +95,28 @@ struct rend_context
 	}
 };
 
+//raw TA data buffer, per context
+#define TA_DATA_SIZE (2*1024*1024)
+
+/*
+	List sizes, the capacity to start with and the most a list can grow to.
+	Dreamcast games stay well within the initial ones (tactx_HighWater logs
+	when they don't). Vertices are capped at what u16 indices can address.
+*/
+#define TA_VERTS_INIT  (1024*1024/sizeof(Vertex))	//~ 37k vtx/frame
+#define TA_VERTS_MAX   65536
+#define TA_IDX_INIT    (60*1024)						//idx have stripification overhead
+#define TA_IDX_MAX     (240*1024)
+#define TA_PARAMS_INIT 4096
+#define TA_PARAMS_MAX  16384
+
+#define TA_ARENA_SIZE (TA_DATA_SIZE + TA_VERTS_MAX*sizeof(Vertex) + TA_IDX_MAX*sizeof(u16) \
+		+ TA_PARAMS_MAX*(3*sizeof(PolyParam) + sizeof(ISP_Modvol) + sizeof(ModTriangle)))
+
+//reserves size bytes, pages are only backed once touched
+u8* tactx_ArenaAlloc(size_t size);
+void tactx_ArenaFree(u8* ptr, size_t size);
+
 //vertex lists
 struct TA_context
 {
@@ -109,46 +131,41 @@ struct TA_context
 	tad_context tad;
 	rend_context rend;
 
-	
-	/*
-		Dreamcast games use up to 20k vtx, 30k idx, 1k (in total) parameters.
-		at 30 fps, thats 600kvtx (900 stripped)
-		at 20 fps thats 1.2M vtx (~ 1.8M stripped)
-
-		allocations allow much more than that !
-
-		some stats:
-			recv:   idx: 33528, vtx: 23451, op: 128, pt: 4, tr: 133, mvo: 14, modt: 342
-			sc:     idx: 26150, vtx: 17417, op: 162, pt: 12, tr: 244, mvo: 6, modt: 2044
-			doa2le: idx: 47178, vtx: 34046, op: 868, pt: 0, tr: 354, mvo: 92, modt: 976 (overruns)
-			ika:    idx: 46748, vtx: 33818, op: 984, pt: 9, tr: 234, mvo: 10, modt: 16, ov: 0  
-			ct:     idx: 30920, vtx: 21468, op: 752, pt: 0, tr: 360, mvo: 101, modt: 732, ov: 0
-			sa2:    idx: 36094, vtx: 24520, op: 1330, pt: 10, tr: 177, mvo: 39, modt: 360, ov: 0
-	*/
+	template<class T>
+	static T* Carve(u8*& ptr, int count)
+	{
+		T* rv = (T*)ptr;
+		ptr  += count*sizeof(T);
+		return rv;
+	}
 
 	void MarkRend()
 	{
 		rend.proc_start = tad.thd_root;
 		rend.proc_end   = TAD_END(tad);
 	}
+
+	//the TA data and every list share one arena, allocated once per context
 	void Alloc()
 	{
 #if !defined(TARGET_NO_THREADS)
       thd_inuse  = slock_new();
       rend_inuse = slock_new();
 #endif
-      u8 *ptr = (u8*)malloc(2*1024*1024);
-      tad.thd_data = tad.thd_root = tad.thd_old_data = ptr;
-
-		rend.verts.InitBytes(1024*1024,&rend.Overrun); //up to 1 mb of vtx data/frame = ~ 38k vtx/frame
-		rend.idx.Init(60*1024,&rend.Overrun);			//up to 60K indexes ( idx have stripification overhead )
-		rend.global_param_op.Init(4096,&rend.Overrun);
-		rend.global_param_pt.Init(4096,&rend.Overrun);
-		rend.global_param_mvo.Init(4096,&rend.Overrun);
-		rend.global_param_tr.Init(4096,&rend.Overrun);
-
-		rend.modtrig.Init(4096,&rend.Overrun);
-		
+      u8 *ptr = tactx_ArenaAlloc(TA_ARENA_SIZE);
+      tad.thd_data = tad.thd_root = tad.thd_old_data = Carve<u8>(ptr, TA_DATA_SIZE);
+
+		rend.verts.Init(Carve<Vertex>(ptr,TA_VERTS_MAX),TA_VERTS_INIT,TA_VERTS_MAX,&rend.Overrun);
+		rend.idx.Init(Carve<u16>(ptr,TA_IDX_MAX),TA_IDX_INIT,TA_IDX_MAX,&rend.Overrun);
+		rend.global_param_op.Init(Carve<PolyParam>(ptr,TA_PARAMS_MAX),TA_PARAMS_INIT,TA_PARAMS_MAX,&rend.Overrun);
+		rend.global_param_pt.Init(Carve<PolyParam>(ptr,TA_PARAMS_MAX),TA_PARAMS_INIT,TA_PARAMS_MAX,&rend.Overrun);
+		rend.global_param_tr.Init(Carve<PolyParam>(ptr,TA_PARAMS_MAX),TA_PARAMS_INIT,TA_PARAMS_MAX,&rend.Overrun);
+		rend.global_param_mvo.Init(Carve<ISP_Modvol>(ptr,TA_PARAMS_MAX),TA_PARAMS_INIT,TA_PARAMS_MAX,&rend.Overrun);
+
+		rend.modtrig.Init(Carve<ModTriangle>(ptr,TA_PARAMS_MAX),TA_PARAMS_INIT,TA_PARAMS_MAX,&rend.Overrun);
+
+		verify(ptr == tad.thd_root + TA_ARENA_SIZE);
+
 		Reset();
 	}
 
@@ -174,14 +191,7 @@ struct TA_context
       thd_inuse  = NULL;
       rend_inuse = NULL;
 #endif
-		free(tad.thd_root);
-		rend.verts.Free();
-		rend.idx.Free();
-		rend.global_param_op.Free();
-		rend.global_param_pt.Free();
-		rend.global_param_tr.Free();
-		rend.modtrig.Free();
-		rend.global_param_mvo.Free();
+		tactx_ArenaFree(tad.thd_root, TA_ARENA_SIZE);
 	}
 };
 
@@ -204,11 +214,48 @@ void tactx_Recycle(TA_context* poped_ctx);
 
 #define TACTX_NONE (0xFFFFFFFF)
 
+#define RQUEUE_MAX_DEPTH 8
+
+//settings.pvr.RenderQueuePolicy, what a full render queue does to a new frame
+enum RenderQueuePolicy
+{
+	RQ_DROP_OLDEST = 0,	//drop the oldest queued frame
+	RQ_BLOCK       = 1,	//wait for all queued frames to render
+	RQ_PIPELINE    = 2,	//wait for a free slot
+};
+
+//counted since ta_ctx_init, for a debugger to look at
+struct RenderQueueStats
+{
+	u32 queued;
+	u32 dropped;
+	u32 blocked;
+	u32 depth_sum;	//frames in the queue after each QueueRender
+	u32 max_depth;
+};
+
+extern RenderQueueStats rqueue_stats;
+
 void SetCurrentTARC(u32 addr);
 bool QueueRender(TA_context* ctx);
 TA_context* DequeueRender();
 void FinishRender(TA_context* ctx);
 
+//largest lists and TA data seen in a rendered frame
+struct TAHighWater
+{
+	u32 ta_data;	//bytes
+	u32 verts;
+	u32 idx;
+	u32 op;
+	u32 pt;
+	u32 tr;
+	u32 mvo;
+	u32 modt;
+};
+
+extern TAHighWater tactx_high;
+
 //must be moved to proper header
 void FillBGP(TA_context* ctx);
 bool UsingAutoSort(void);
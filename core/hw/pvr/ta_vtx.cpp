@@ -881,9 +881,6 @@ public:
                      d_pp->tileclip=tileclip_val;
 
                      d_pp->texid = -1;
-
-                     if (d_pp->pcw.Texture)
-                        d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
                   }
 
                   data += append_data;
@@ -1129,10 +1126,6 @@ public:
 		d_pp->tileclip=tileclip_val;
 
 		d_pp->texid = -1;
-		
-		if (d_pp->pcw.Texture) {
-			d_pp->texid = renderer->GetTexture(d_pp->tsp,d_pp->tcw);
-		}
 
 		SFaceBaseColor=spr->BaseCol;
 		SFaceOffsColor=spr->OffsCol;
@@ -1270,31 +1263,261 @@ FifoSplitter<0> TAFifo0;
 int ta_parse_cnt = 0;
 
 
+static void ta_parse_range(u8* start, u8* end)
+{
+	Ta_Dma* ta_data=(Ta_Dma*)start;
+	Ta_Dma* ta_data_end=((Ta_Dma*)end)-1;
+
+	do
+	{
+		ta_data =TaCmd(ta_data,ta_data_end);
+	}while(ta_data<=ta_data_end);
+}
+
+//the lists flag overruns through a pointer to their rend_context
+static void rc_set_overrun(rend_context& rc, bool* ovrn)
+{
+	rc.verts.overrun=ovrn;
+	rc.idx.overrun=ovrn;
+	rc.modtrig.overrun=ovrn;
+	rc.global_param_mvo.overrun=ovrn;
+	rc.global_param_op.overrun=ovrn;
+	rc.global_param_pt.overrun=ovrn;
+	rc.global_param_tr.overrun=ovrn;
+}
+
+/*
+	TA list streaming
+
+	With settings.pvr.TAStreaming, the lists of the context being built are
+	decoded by a worker as the TA ends them, while the sh4 keeps running.
+	ta_parse_vdrc then only has the last lists left to wait for.
+
+	The decoder state is global, so one context decodes at a time: stream_ctx
+	owns it, whether it is streamed or parsed in one go by ta_parse_vdrc. A
+	context losing it starts over from the root at its next list end.
+*/
+#if !defined(TARGET_NO_THREADS) || defined(HAVE_SOFTREND)
+static sthread_t* stream_thread;
+static slock_t* stream_mtx;
+static scond_t* stream_cond;
+
+static TA_context* stream_ctx;  //owner of the decoder state
+static u8* stream_pos;          //decoded up to here
+static u8* stream_end;          //the TA ended lists up to here
+static bool stream_busy;        //decoder running outside of stream_mtx
+static bool stream_exit;
+
+static void StreamWorker(void* p)
+{
+	slock_lock(stream_mtx);
+
+	for (;;)
+	{
+		while (!stream_exit && (stream_busy || !stream_ctx || stream_pos >= stream_end))
+			scond_wait(stream_cond, stream_mtx);
+
+		if (stream_exit)
+			break;
+
+		u8* start = stream_pos;
+		u8* end   = stream_end;
+		stream_busy = true;
+
+		slock_unlock(stream_mtx);
+		ta_parse_range(start, end);
+		slock_lock(stream_mtx);
+
+		stream_pos  = end;
+		stream_busy = false;
+		scond_broadcast(stream_cond);
+	}
+
+	slock_unlock(stream_mtx);
+}
+
+//called by the TA on every end of list
+void ta_stream_list_end(void)
+{
+	if (!settings.pvr.TAStreaming || settings.pvr.ta_skip || !ta_ctx)
+		return;
+
+	slock_lock(stream_mtx);
+
+	if (!stream_thread)
+	{
+		stream_exit   = false;
+		stream_thread = sthread_create(StreamWorker, 0);
+	}
+
+	if (!stream_ctx)
+	{
+		stream_ctx = ta_ctx;
+		stream_pos = stream_end = ta_tad.thd_root;
+
+		//start_render fills in the rest of ctx->rend later, the BG poly data included
+		vd_ctx = ta_ctx;
+		vd_rc  = ta_ctx->rend;
+		rc_set_overrun(vd_rc, &vd_rc.Overrun);
+		TAFifo0.vdec_init();
+	}
+
+	if (stream_ctx == ta_ctx)
+	{
+		stream_end = ta_tad.thd_data;
+		scond_broadcast(stream_cond);
+	}
+
+	slock_unlock(stream_mtx);
+}
+
+//drops what was streamed for ctx (any context if NULL), before its data is rewritten
+void ta_stream_cancel(TA_context* ctx)
+{
+	slock_lock(stream_mtx);
+
+	if (stream_ctx && (!ctx || stream_ctx == ctx))
+	{
+		while (stream_busy)
+			scond_wait(stream_cond, stream_mtx);
+
+		stream_ctx = 0;
+		vd_ctx     = 0;
+	}
+
+	slock_unlock(stream_mtx);
+}
+
+void ta_stream_term(void)
+{
+	if (!stream_thread)
+		return;
+
+	slock_lock(stream_mtx);
+	stream_exit = true;
+	scond_broadcast(stream_cond);
+	slock_unlock(stream_mtx);
+
+	sthread_join(stream_thread);
+	stream_thread = NULL;
+
+	ta_stream_cancel(NULL);
+}
+
+//true if all of ctx was streamed, else the caller owns the decoder to parse it
+static bool ta_stream_take(TA_context* ctx)
+{
+	slock_lock(stream_mtx);
+
+	bool streamed = stream_ctx == ctx && ctx->rend.proc_start == ctx->tad.thd_root
+		&& stream_pos <= ctx->rend.proc_end;
+
+	if (streamed)
+	{
+		stream_end = ctx->rend.proc_end;
+		scond_broadcast(stream_cond);
+
+		while (stream_busy || stream_pos < stream_end)
+			scond_wait(stream_cond, stream_mtx);
+	}
+	else
+	{
+		while (stream_busy)
+			scond_wait(stream_cond, stream_mtx);
+
+		stream_ctx  = ctx;
+		stream_pos  = stream_end;
+		stream_busy = true;
+	}
+
+	slock_unlock(stream_mtx);
+
+	return streamed;
+}
+
+static void ta_stream_release(void)
+{
+	slock_lock(stream_mtx);
+	stream_ctx  = 0;
+	stream_busy = false;
+	scond_broadcast(stream_cond);
+	slock_unlock(stream_mtx);
+}
+
+static void ta_stream_init(void)
+{
+	stream_mtx  = slock_new();
+	stream_cond = scond_new();
+}
+
+static OnLoad ol_stream(&ta_stream_init);
+#else
+void ta_stream_list_end(void) { }
+void ta_stream_cancel(TA_context* ctx) { }
+void ta_stream_term(void) { }
+
+static bool ta_stream_take(TA_context* ctx) { return false; }
+static void ta_stream_release(void) { }
+#endif
+
+//the parse leaves texid at -1, textures are looked up once the lists are complete
+static void ta_lookup_textures(List<PolyParam>& list, int first)
+{
+	PolyParam* pp=list.head();
+
+	for (int i=first;i<list.used();i++)
+	{
+		if (pp[i].pcw.Texture)
+			pp[i].texid = renderer->GetTexture(pp[i].tsp,pp[i].tcw);
+	}
+}
+
 /*
 	Also: gotta stage textures here
 */
 bool ta_parse_vdrc(TA_context* ctx)
 {
-	vd_ctx = ctx;
-	vd_rc  = vd_ctx->rend;
-
 	ta_parse_cnt++;
 
-	if ((ta_parse_cnt %  ( settings.pvr.ta_skip + 1)) == 0)
+	if (ta_stream_take(ctx))
 	{
-		TAFifo0.vdec_init();
-		
-		Ta_Dma* ta_data=(Ta_Dma*)vd_rc.proc_start;
-		Ta_Dma* ta_data_end=((Ta_Dma*)vd_rc.proc_end)-1;
+		//start_render set up the rest of ctx->rend after the decoder copied it
+		rend_context& rc=ctx->rend;
+
+		rc.fZ_min=vd_rc.fZ_min;
+		rc.fZ_max=vd_rc.fZ_max;
+
+		rc.verts=vd_rc.verts;
+		rc.idx=vd_rc.idx;
+		rc.modtrig=vd_rc.modtrig;
+		rc.global_param_mvo=vd_rc.global_param_mvo;
+		rc.global_param_op=vd_rc.global_param_op;
+		rc.global_param_pt=vd_rc.global_param_pt;
+		rc.global_param_tr=vd_rc.global_param_tr;
+		rc_set_overrun(rc, &rc.Overrun);
+	}
+	else
+	{
+		vd_ctx = ctx;
+		vd_rc  = vd_ctx->rend;
 
-		do
+		if ((ta_parse_cnt %  ( settings.pvr.ta_skip + 1)) == 0)
 		{
-			ta_data =TaCmd(ta_data,ta_data_end);
-		}while(ta_data<=ta_data_end);
+			TAFifo0.vdec_init();
+			ta_parse_range(vd_rc.proc_start, vd_rc.proc_end);
+		}
+
+		vd_ctx->rend = vd_rc;
 	}
 
-	vd_ctx->rend = vd_rc;
 	vd_ctx = 0;
+	ta_stream_release();
+
+	//op[0] is the BG poly, FillBGP leaves it untextured
+	ta_lookup_textures(ctx->rend.global_param_op, 1);
+	ta_lookup_textures(ctx->rend.global_param_pt, 0);
+	ta_lookup_textures(ctx->rend.global_param_tr, 0);
+
 #if !defined(TARGET_NO_THREADS)
    slock_unlock(ctx->rend_inuse);
 #endif
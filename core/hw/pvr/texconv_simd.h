@@ -0,0 +1,272 @@
+#pragma once
+/*
+	SIMD texture converters, shared by texconv_sse2.cpp and texconv_ssse3.cpp.
+	The ssse3 one is built with -mssse3 and picks up the pshufb paths below.
+	gltex.cpp swaps these into its format table depending on what the host supports.
+
+	Output has to match pvr_pixfmt.h bit for bit.
+
+	Twiddled data is handled in 4x4 blocks. Both texture sides are >= 8, so the low
+	4 bits of the pixel index always interleave as y0 x0 y1 x1 and the 16 pixels of
+	a block are contiguous. Two blocks side by side make 8x4, so each row is one store.
+*/
+#include "types.h"
+#include "TexCache.h"
+#include "pvr_pixfmt.h"
+
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+//Everything is local to the including file, so the sse2 and ssse3 builds
+//of the same template never get merged by the linker
+namespace {
+
+//8 pixels per call, same bit shuffles as ARGB565/1555/4444
+struct simd565
+{
+	static INLINE __m128i cvt(__m128i w) { return w; }
+};
+
+struct simd1555
+{
+	static INLINE __m128i cvt(__m128i w) { return _mm_or_si128(_mm_slli_epi16(w,1),_mm_srli_epi16(w,15)); }
+};
+
+struct simd4444
+{
+	static INLINE __m128i cvt(__m128i w) { return _mm_or_si128(_mm_slli_epi16(w,4),_mm_srli_epi16(w,12)); }
+};
+
+//signed division by 1<<shift rounding towards zero, like the C '/' in YUV422()
+static INLINE __m128i sdiv_pow2(__m128i v,int shift)
+{
+	__m128i bias=_mm_and_si128(_mm_srai_epi16(v,15),_mm_set1_epi16((1<<shift)-1));
+	return _mm_srai_epi16(_mm_add_epi16(v,bias),shift);
+}
+
+//Pixel pairs as Y<<8|U, Y<<8|V, same as convYUV_PL/TW
+struct simdYUV
+{
+	static INLINE __m128i cvt(__m128i w)
+	{
+		const __m128i lo16=_mm_set1_epi32(0xFFFF);
+		const __m128i zero=_mm_setzero_si128();
+		const __m128i max8=_mm_set1_epi16(255);
+
+		__m128i Y=_mm_srli_epi16(w,8);
+		__m128i uv=_mm_sub_epi16(_mm_and_si128(w,_mm_set1_epi16(0xFF)),_mm_set1_epi16(128));
+		__m128i Yu=_mm_or_si128(_mm_and_si128(uv,lo16),_mm_slli_epi32(uv,16));
+		__m128i Yv=_mm_or_si128(_mm_srli_epi32(uv,16),_mm_andnot_si128(lo16,uv));
+
+		__m128i R=_mm_add_epi16(Y,sdiv_pow2(_mm_mullo_epi16(Yv,_mm_set1_epi16(11)),3));
+		__m128i G=_mm_sub_epi16(Y,sdiv_pow2(_mm_add_epi16(_mm_mullo_epi16(Yu,_mm_set1_epi16(11)),_mm_mullo_epi16(Yv,_mm_set1_epi16(22))),5));
+		__m128i B=_mm_add_epi16(Y,sdiv_pow2(_mm_mullo_epi16(Yu,_mm_set1_epi16(110)),6));
+
+		R=_mm_min_epi16(_mm_max_epi16(R,zero),max8);
+		G=_mm_min_epi16(_mm_max_epi16(G,zero),max8);
+		B=_mm_min_epi16(_mm_max_epi16(B,zero),max8);
+
+		return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(R,3),11),_mm_slli_epi16(_mm_srli_epi16(G,2),5)),_mm_srli_epi16(B,3));
+	}
+};
+
+//a/b hold a 4x4 block in twiddled order, returns rows 0,2 in r02 and 1,3 in r13
+static INLINE void detwiddle4x4(__m128i a,__m128i b,__m128i& r02,__m128i& r13)
+{
+	//split the even and odd pixels (y0=0 / y0=1) into the low/high halves
+#ifdef __SSSE3__
+	const __m128i eo=_mm_setr_epi8(0,1,4,5,8,9,12,13,2,3,6,7,10,11,14,15);
+	a=_mm_shuffle_epi8(a,eo);
+	b=_mm_shuffle_epi8(b,eo);
+#else
+	a=_mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(a,_MM_SHUFFLE(3,1,2,0)),_MM_SHUFFLE(3,1,2,0)),_MM_SHUFFLE(3,1,2,0));
+	b=_mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_shufflelo_epi16(b,_MM_SHUFFLE(3,1,2,0)),_MM_SHUFFLE(3,1,2,0)),_MM_SHUFFLE(3,1,2,0));
+#endif
+	r02=_mm_unpacklo_epi32(a,b);
+	r13=_mm_unpackhi_epi32(a,b);
+}
+
+//Two detwiddled 4x4 blocks (left, right) to an 8x4 area
+template<class Cvt>
+static INLINE void store8x4(u16* dst,u32 ppl,__m128i l02,__m128i l13,__m128i r02,__m128i r13)
+{
+	_mm_storeu_si128((__m128i*)(dst+ppl*0),Cvt::cvt(_mm_unpacklo_epi64(l02,r02)));
+	_mm_storeu_si128((__m128i*)(dst+ppl*1),Cvt::cvt(_mm_unpacklo_epi64(l13,r13)));
+	_mm_storeu_si128((__m128i*)(dst+ppl*2),Cvt::cvt(_mm_unpackhi_epi64(l02,r02)));
+	_mm_storeu_si128((__m128i*)(dst+ppl*3),Cvt::cvt(_mm_unpackhi_epi64(l13,r13)));
+}
+
+//Like texture_PL, Width pixels per line, the input is packed
+template<class Cvt>
+void simd_PL(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	u16* line=pb->p_buffer_start;
+
+	for (u32 y=0;y<Height;y++)
+	{
+		u32 x=0;
+		for (;x+8<=Width;x+=8)
+		{
+			__m128i v=_mm_loadu_si128((__m128i*)p_in);
+			_mm_storeu_si128((__m128i*)(line+x),Cvt::cvt(v));
+			p_in+=16;
+		}
+		if (x<Width)
+		{
+			__m128i v=_mm_loadl_epi64((__m128i*)p_in);
+			_mm_storel_epi64((__m128i*)(line+x),Cvt::cvt(v));
+			p_in+=8;
+		}
+		line+=pb->pixels_per_line;
+	}
+}
+
+//16 bit twiddled, a 4x4 block is 32 bytes
+struct twblock16
+{
+	twblock16(PixelBuffer* pb) { }
+
+	INLINE void load(u8* p_in,u32 tw,__m128i& r02,__m128i& r13) const
+	{
+		u8* p=&p_in[tw*2];
+		detwiddle4x4(_mm_loadu_si128((__m128i*)p),_mm_loadu_si128((__m128i*)(p+16)),r02,r13);
+	}
+};
+
+//VQ, a 4x4 block is 4 codebook indices, each a twiddled 2x2 block
+struct vqblock16
+{
+	u8* cb;
+
+	vqblock16(PixelBuffer* pb) : cb(pb->vq_codebook) { }
+
+	INLINE void load(u8* p_in,u32 tw,__m128i& r02,__m128i& r13) const
+	{
+		u8* p=&p_in[tw/4];
+		__m128i a=_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)&cb[p[0]*8]),_mm_loadl_epi64((__m128i*)&cb[p[1]*8]));
+		__m128i b=_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i*)&cb[p[2]*8]),_mm_loadl_epi64((__m128i*)&cb[p[3]*8]));
+		detwiddle4x4(a,b,r02,r13);
+	}
+};
+
+//8 bpp palette, a 4x4 block is 16 bytes
+struct palblock8
+{
+	u32* pal;
+
+	palblock8(PixelBuffer* pb) : pal(pb->palette) { }
+
+	INLINE void load(u8* p_in,u32 tw,__m128i& r02,__m128i& r13) const
+	{
+		u8* p=&p_in[tw];
+		DECL_ALIGN(16) u16 px[16];
+
+		for (int i=0;i<16;i++)
+			px[i]=pal[p[i]];
+
+		detwiddle4x4(_mm_load_si128((__m128i*)&px[0]),_mm_load_si128((__m128i*)&px[8]),r02,r13);
+	}
+};
+
+#ifdef __SSSE3__
+//4 bpp palette, a 4x4 block is 8 bytes, low nibble first.
+//Needs pshufb, the plain sse2 version is no faster than convPAL4_TW
+struct palblock4
+{
+	//low/high bytes of the 16 palette entries
+	__m128i lut_lo,lut_hi;
+
+	palblock4(PixelBuffer* pb)
+	{
+		u32* pal=pb->palette;
+		DECL_ALIGN(16) u8 lo[16];
+		DECL_ALIGN(16) u8 hi[16];
+
+		for (int i=0;i<16;i++)
+		{
+			lo[i]=pal[i];
+			hi[i]=pal[i]>>8;
+		}
+		lut_lo=_mm_load_si128((__m128i*)lo);
+		lut_hi=_mm_load_si128((__m128i*)hi);
+	}
+
+	INLINE void load(u8* p_in,u32 tw,__m128i& r02,__m128i& r13) const
+	{
+		const __m128i mask=_mm_set1_epi8(0xF);
+		__m128i raw=_mm_loadl_epi64((__m128i*)&p_in[tw/2]);
+		__m128i idx=_mm_unpacklo_epi8(_mm_and_si128(raw,mask),_mm_and_si128(_mm_srli_epi16(raw,4),mask));
+		__m128i lo=_mm_shuffle_epi8(lut_lo,idx);
+		__m128i hi=_mm_shuffle_epi8(lut_hi,idx);
+
+		detwiddle4x4(_mm_unpacklo_epi8(lo,hi),_mm_unpackhi_epi8(lo,hi),r02,r13);
+	}
+};
+#endif
+
+//Like texture_TW/texture_VQ, in 8x4 steps
+template<class Block,class Cvt>
+static INLINE void simd_twiddled(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	const Block blk(pb);
+	u32 bcx=bitscanrev(Width)-3;
+	u32 bcy=bitscanrev(Height)-3;
+	u32 ppl=pb->pixels_per_line;
+	u16* line=pb->p_buffer_start;
+
+	for (u32 y=0;y<Height;y+=4)
+	{
+		for (u32 x=0;x<Width;x+=8)
+		{
+			__m128i l02,l13,r02,r13;
+
+			blk.load(p_in,twop(x,y,bcx,bcy),l02,l13);
+			blk.load(p_in,twop(x+4,y,bcx,bcy),r02,r13);
+			store8x4<Cvt>(line+x,ppl,l02,l13,r02,r13);
+		}
+		line+=ppl*4;
+	}
+}
+
+template<class Cvt>
+void simd_TW(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	simd_twiddled<twblock16,Cvt>(pb,p_in,Width,Height);
+}
+
+template<class Cvt>
+void simd_VQ(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	simd_twiddled<vqblock16,Cvt>(pb,p_in+256*4*2,Width,Height);
+}
+
+#ifdef __SSSE3__
+void simd_PAL4_TW(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	simd_twiddled<palblock4,simd565>(pb,p_in,Width,Height);
+}
+#define simd_PAL4_TW_fp &simd_PAL4_TW
+#else
+#define simd_PAL4_TW_fp 0
+#endif
+
+void simd_PAL8_TW(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height)
+{
+	simd_twiddled<palblock8,simd565>(pb,p_in,Width,Height);
+}
+
+}
+
+//Indexed by PixelFmt like format[] in gltex.cpp, bump maps are left to the portable code
+#define TEXCONV_SIMD_TABLE \
+{ \
+	{ &simd_PL<simd1555>, &simd_TW<simd1555>, &simd_VQ<simd1555> }, \
+	{ &simd_PL<simd565>,  &simd_TW<simd565>,  &simd_VQ<simd565>  }, \
+	{ &simd_PL<simd4444>, &simd_TW<simd4444>, &simd_VQ<simd4444> }, \
+	{ &simd_PL<simdYUV>,  &simd_TW<simdYUV>,  &simd_VQ<simdYUV>  }, \
+	{ 0, 0, 0 }, \
+	{ 0, simd_PAL4_TW_fp, 0 }, \
+	{ 0, &simd_PAL8_TW, 0 }, \
+}
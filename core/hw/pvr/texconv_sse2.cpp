@@ -0,0 +1,3 @@
+#include "texconv_simd.h"
+
+const TexConvTable texconv_sse2[7]=TEXCONV_SIMD_TABLE;
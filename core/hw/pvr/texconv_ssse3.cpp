@@ -0,0 +1,4 @@
+//Built with -mssse3, only used when the host reports SSSE3
+#include "texconv_simd.h"
+
+const TexConvTable texconv_ssse3[7]=TEXCONV_SIMD_TABLE;
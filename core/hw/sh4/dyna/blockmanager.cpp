@@ -22,9 +22,16 @@
 
 typedef vector<RuntimeBlockInfo*> bm_List;
 
-#define BLOCKS_IN_PAGE_LIST_COUNT (RAM_SIZE/4096)
+#define BLOCKS_IN_PAGE_LIST_COUNT (RAM_SIZE/PAGE_SIZE)
 bm_List blocks_page[BLOCKS_IN_PAGE_LIST_COUNT];
 
+//Ram pages with blocks on them are write protected, the first write drops
+//just those blocks. Pages written more often than this in a second hold data
+//as well, they stay unprotected until the next second, and the blocks
+//compiled on them check their code instead (bm_BlockUnprotected)
+#define BM_MAX_PAGE_WRITES 64
+static u8 bm_page_writes[BLOCKS_IN_PAGE_LIST_COUNT];
+
 bm_List all_blocks;
 bm_List del_blocks;
 #include <set>
@@ -68,6 +75,49 @@ struct BlockMapCMP
 
 typedef std::set<RuntimeBlockInfo*,BlockMapCMP> blkmap_t;
 blkmap_t blkmap;
+
+/*
+	With the mmu, the fpcb slots would alias between translations, so the blocks
+	are kept by (physical pc, virtual pc) instead, behind a small direct mapped
+	cache. The caller translates the pc on each lookup, so a TLB change can't
+	reach a stale block, it only stops finding it.
+*/
+#include <map>
+#define BM_MMU_CACHE_SIZE 4096
+
+struct bm_mmu_slot
+{
+	u32 addr;
+	u32 paddr;
+	RuntimeBlockInfo* block;
+};
+
+typedef std::map<u64,RuntimeBlockInfo*> blkmap_mmu_t;
+blkmap_mmu_t blkmap_mmu;
+bm_mmu_slot bm_mmu_cache[BM_MMU_CACHE_SIZE];
+
+static u64 bm_mmu_key(u32 addr,u32 paddr)
+{
+	return ((u64)paddr<<32) | addr;
+}
+
+DynarecCodeEntryPtr bm_GetCodeMMU(u32 addr,u32 paddr)
+{
+	bm_mmu_slot* slot=&bm_mmu_cache[(addr>>1)&(BM_MMU_CACHE_SIZE-1)];
+
+	if (slot->block && slot->addr==addr && slot->paddr==paddr)
+		return slot->block->code;
+
+	blkmap_mmu_t::iterator iter=blkmap_mmu.find(bm_mmu_key(addr,paddr));
+	if (iter==blkmap_mmu.end())
+		return 0;
+
+	slot->addr=addr;
+	slot->paddr=paddr;
+	slot->block=iter->second;
+
+	return slot->block->code;
+}
 u32 bm_gc_luc,bm_gcf_luc;
 
 bool BM_LockedWrite(u8* address);
@@ -100,7 +150,8 @@ RuntimeBlockInfo* bm_GetBlock(void* dynarec_code)
 
 RuntimeBlockInfo* bm_GetStaleBlock(void* dynarec_code)
 {
-	for(u32 i=0;i<del_blocks.size();i++)
+	//the code space gets reused, the block dropped last is the one still running there
+	for(size_t i=del_blocks.size();i-->0;)
 	{
 		if (del_blocks[i]->contains_code((u8*)dynarec_code))
 			return del_blocks[i];
@@ -109,6 +160,38 @@ RuntimeBlockInfo* bm_GetStaleBlock(void* dynarec_code)
 	return 0;
 }
 
+//the ram pages the block's opcodes were read from
+static bool bm_GetBlockPages(RuntimeBlockInfo* blk,u32& first,u32& last)
+{
+	if (!IsOnRam(blk->paddr))
+		return false;
+
+	u32 start=blk->paddr&RAM_MASK;
+	u32 end=start+blk->sh4_code_size-1;
+	if (end>=RAM_SIZE)
+		end=RAM_SIZE-1;
+
+	first=start/PAGE_SIZE;
+	last=end/PAGE_SIZE;
+
+	return true;
+}
+
+bool bm_BlockUnprotected(RuntimeBlockInfo* blk)
+{
+	u32 first,last;
+	if (!bm_GetBlockPages(blk,first,last))
+		return false;
+
+	for (u32 page=first;page<=last;page++)
+	{
+		if (bm_page_writes[page]>=BM_MAX_PAGE_WRITES)
+			return true;
+	}
+
+	return false;
+}
+
 void bm_AddBlock(RuntimeBlockInfo* blk)
 {
 	all_blocks.push_back(blk);
@@ -119,6 +202,22 @@ void bm_AddBlock(RuntimeBlockInfo* blk)
 	}
 	blkmap.insert(blk);
 
+	u32 first,last;
+	if (bm_GetBlockPages(blk,first,last))
+	{
+		for (u32 page=first;page<=last;page++)
+		{
+			if (blocks_page[page].empty() && bm_page_writes[page]<BM_MAX_PAGE_WRITES)
+				ram_LockCodePage(page);
+			blocks_page[page].push_back(blk);
+		}
+	}
+
+	if (settings.MMUEnabled)
+	{
+		blkmap_mmu[bm_mmu_key(blk->addr,blk->paddr)]=blk;
+		return;
+	}
 
    verify((void*)(DynarecCodeEntryPtr)FPCA(blk->addr)==(void*)ngen_FailedToFindBlock);
 	FPCA(blk->addr)=blk->code;
@@ -219,6 +318,8 @@ static void FindPath(u32 start)
 #include <map>
 u32 rebuild_counter=20;
 
+static void bm_DiscardPage(u32 page);
+
 void bm_Periodical_1s(void)
 {
 	for (u32 i=0;i<del_blocks.size();i++)
@@ -226,6 +327,15 @@ void bm_Periodical_1s(void)
 
 	del_blocks.clear();
 
+	//the blocks on the pages that went unprotected might be stale by now,
+	//drop them so the pages get locked again
+	for (u32 page=0;page<BLOCKS_IN_PAGE_LIST_COUNT;page++)
+	{
+		if (bm_page_writes[page]>=BM_MAX_PAGE_WRITES)
+			bm_DiscardPage(page);
+		bm_page_writes[page]=0;
+	}
+
 	if (rebuild_counter>0)
       rebuild_counter--;
 }
@@ -277,6 +387,7 @@ void bm_Reset(void)
 	ngen_ResetBlocks();
 	for (u32 i=0; i<BLOCKS_IN_PAGE_LIST_COUNT; i++)
 		blocks_page[i].clear();
+	memset(bm_page_writes,0,sizeof(bm_page_writes));
 
 	_vmem_bm_reset();
 
@@ -288,10 +399,127 @@ void bm_Reset(void)
 		all_blocks[i]->Relink();
 	}
 
-	del_blocks.insert(del_blocks.begin(),all_blocks.begin(),all_blocks.end());
+	del_blocks.insert(del_blocks.end(),all_blocks.begin(),all_blocks.end());
 
 	all_blocks.clear();
 	blkmap.clear();
+
+	blkmap_mmu.clear();
+	memset(bm_mmu_cache,0,sizeof(bm_mmu_cache));
+}
+
+//Unlinks the block and takes it out of the lookups, the caller removes it from all_blocks
+static void bm_DropBlock(RuntimeBlockInfo* blk)
+{
+	blk->Discard();
+
+	if (settings.MMUEnabled)
+	{
+		blkmap_mmu.erase(bm_mmu_key(blk->addr,blk->paddr));
+
+		bm_mmu_slot* slot=&bm_mmu_cache[(blk->addr>>1)&(BM_MMU_CACHE_SIZE-1)];
+		if (slot->block==blk)
+			slot->block=0;
+	}
+	else if (FPCA(blk->addr)==blk->code)
+		FPCA(blk->addr)=ngen_FailedToFindBlock;
+
+	blkmap.erase(blk);
+
+	u32 first,last;
+	if (bm_GetBlockPages(blk,first,last))
+	{
+		for (u32 page=first;page<=last;page++)
+		{
+			bm_List& list=blocks_page[page];
+			bm_List::iterator iter=std::find(list.begin(),list.end(),blk);
+			if (iter!=list.end())
+			{
+				*iter=list.back();
+				list.pop_back();
+			}
+		}
+	}
+
+	//a link stub might still be returning from it
+	del_blocks.push_back(blk);
+}
+
+//Drops the blocks whose code lies in [start,end), so the space can be reused.
+//Nothing outside is flushed, the blocks linked to them go back to their link stubs
+u32 bm_DiscardCode(u8* start,u8* end)
+{
+	u32 count=0;
+
+	for (size_t i=0; i<all_blocks.size();)
+	{
+		RuntimeBlockInfo* blk=all_blocks[i];
+
+		if ((u8*)blk->code<start || (u8*)blk->code>=end)
+		{
+			i++;
+			continue;
+		}
+
+		bm_DropBlock(blk);
+
+		//order doesn't matter here
+		all_blocks[i]=all_blocks.back();
+		all_blocks.pop_back();
+
+		count++;
+	}
+
+	return count;
+}
+
+static void bm_DiscardPage(u32 page)
+{
+	bm_List blocks;
+	blocks.swap(blocks_page[page]);
+
+	if (blocks.empty())
+		return;
+
+	for (size_t i=0; i<blocks.size(); i++)
+	{
+		bm_DropBlock(blocks[i]);
+
+		//it might be the one writing to its own page, it has to leave through the stubs
+		blocks[i]->Relink();
+	}
+
+	std::sort(blocks.begin(),blocks.end());
+
+	size_t kept=0;
+	for (size_t i=0; i<all_blocks.size(); i++)
+	{
+		if (!std::binary_search(blocks.begin(),blocks.end(),all_blocks[i]))
+			all_blocks[kept++]=all_blocks[i];
+	}
+	all_blocks.resize(kept);
+}
+
+//A locked ram page was written to, called from the fault handler
+void bm_RamPageWritten(u32 page)
+{
+	if (blocks_page[page].empty())
+		return;
+
+	if (bm_page_writes[page]<BM_MAX_PAGE_WRITES)
+		bm_page_writes[page]++;
+
+	bm_DiscardPage(page);
+}
+
+void bm_DiscardBlockPages(RuntimeBlockInfo* blk)
+{
+	u32 first,last;
+	if (bm_GetBlockPages(blk,first,last))
+	{
+		for (u32 page=first;page<=last;page++)
+			bm_DiscardPage(page);
+	}
 }
 
 void bm_Init(void)
@@ -447,6 +675,31 @@ void RuntimeBlockInfo::RemRef(RuntimeBlockInfo* other)
 	pre_refs.erase(find(pre_refs.begin(),pre_refs.end(),other)); 
 }
 
+//Unlinks the block both ways, the blocks jumping to it relink to their stubs
+void RuntimeBlockInfo::Discard()
+{
+	for (size_t i=0; i<pre_refs.size(); i++)
+	{
+		RuntimeBlockInfo* pred=pre_refs[i];
+
+		if (pred->pBranchBlock==this)
+			pred->pBranchBlock=0;
+		if (pred->pNextBlock==this)
+			pred->pNextBlock=0;
+
+		pred->Relink();
+	}
+	pre_refs.clear();
+
+	//both exits to the same block only took one ref
+	if (pBranchBlock)
+		pBranchBlock->RemRef(this);
+	if (pNextBlock && pNextBlock!=pBranchBlock)
+		pNextBlock->RemRef(this);
+
+	pBranchBlock=pNextBlock=0;
+}
+
 bool print_stats;
 
 void fprint_hex(FILE* d,const char* init,u8* ptr, u32& ofs, u32 limit)
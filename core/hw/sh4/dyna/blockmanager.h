@@ -16,9 +16,11 @@ struct RuntimeBlockInfo_Core
 
 struct RuntimeBlockInfo: RuntimeBlockInfo_Core
 {
-	void Setup(u32 pc,fpscr_t fpu_cfg);
+	void Setup(u32 pc,u32 ppc,fpscr_t fpu_cfg);
 	const char* hash(bool full=true, bool reloc=false);
 
+	u32 paddr;              /* addr as the mmu translated it, same as addr without it */
+
 	u32 host_code_size;	   /* in bytes */
 	u32 sh4_code_size;      /* in bytes */
 
@@ -79,12 +81,22 @@ void bm_WriteBlockMap(const string& file);
 
 
 DynarecCodeEntryPtr DYNACALL bm_GetCode(u32 addr);
+//with the mmu, blocks are found by virtual and physical pc, 0 if there is none
+DynarecCodeEntryPtr bm_GetCodeMMU(u32 addr,u32 paddr);
 
 RuntimeBlockInfo* bm_GetBlock(void* dynarec_code);
 RuntimeBlockInfo* bm_GetStaleBlock(void* dynarec_code);
 RuntimeBlockInfo* DYNACALL bm_GetBlock(u32 addr);
 
+//true if blk is on a ram page that is written too often to be write protected
+bool bm_BlockUnprotected(RuntimeBlockInfo* blk);
 void bm_AddBlock(RuntimeBlockInfo* blk);
+//drops the blocks with code in [start,end), returns how many
+u32 bm_DiscardCode(u8* start,u8* end);
+//drops the blocks on the ram pages blk was read from
+void bm_DiscardBlockPages(RuntimeBlockInfo* blk);
+//a write protected ram page holding blocks was written to
+void bm_RamPageWritten(u32 page);
 void bm_Reset();
 void bm_Periodical_1s();
 void bm_Periodical_14k();
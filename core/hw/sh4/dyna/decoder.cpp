@@ -145,6 +145,7 @@ static void Emit(shilop op,
 	sp.rs2=(rs2);
 	sp.rs3=(rs3);
 	sp.guest_offs=state.cpu.rpc-blk->addr;
+	sp.delay_slot=state.cpu.is_delayslot;
 
 	blk->oplist.push_back(sp);
 }
@@ -153,6 +154,8 @@ static void dec_fallback(u32 op)
 {
 	shil_opcode opcd;
 	opcd.op=shop_ifb;
+	opcd.guest_offs=state.cpu.rpc-blk->addr;
+	opcd.delay_slot=state.cpu.is_delayslot;
 
 	opcd.rs1=shil_param(FMT_IMM,OPCODE_NEEDPC(OpDesc[op]->type));
 
@@ -180,6 +183,19 @@ static void dec_DynamicSet(u32 regbase,u32 offs=0)
 		Emit(shop_jdyn,reg_pc_dyn,mk_reg((Sh4RegType)regbase),mk_imm(offs));
 }
 
+//With the mmu, blocks stay in the 1KB page their start was translated in, and
+//are read from its physical address. Outside of it this returns an invalid opcode.
+static u16 dec_ReadOpcode(u32 pc)
+{
+	if (!settings.MMUEnabled)
+		return ReadMem16(pc);
+
+	if ((pc^blk->addr)&~0x3FF)
+		return 0xFFFF;
+
+	return _vmem_ReadMem16(blk->paddr+(pc-blk->addr));
+}
+
 static void dec_End(u32 dst,BlockEndType flags,bool delay)
 {
 	if (state.ngen.OnlyDynamicEnds && flags == BET_StaticJump)
@@ -652,7 +668,7 @@ static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &r
    u32 match=1;
    for (int i=0;i<32;i++)
    {
-      u16 opcode=ReadMem16(v_pc);
+      u16 opcode=dec_ReadOpcode(v_pc);
       v_pc+=2;
       if ((opcode&MASK_N)==ROTCL_KEY)
       {
@@ -668,7 +684,7 @@ static u32 MatchDiv32(u32 pc , Sh4RegType &reg1,Sh4RegType &reg2 , Sh4RegType &r
          break;
       }
 
-      opcode=ReadMem16(v_pc);
+      opcode=dec_ReadOpcode(v_pc);
       v_pc+=2;
       if ((opcode&MASK_N_M)==DIV1_KEY)
       {
@@ -845,7 +861,8 @@ static bool dec_generic(u32 op)
 			bool update_after=false;
 			if ((s32)e<0)
 			{
-				if (rs1._reg!=rs2._reg) //reg shouldn't be updated if its written
+				//with the mmu the write can fault, and must not leave the reg updated
+				if (rs1._reg!=rs2._reg && !settings.MMUEnabled) //reg shouldn't be updated if its written
 				{
 					Emit(shop_sub,rs1,rs1,mk_imm(-e));
 				}
@@ -1026,7 +1043,8 @@ void dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 		case NDO_NextOp:
 			{
 				if ( 
-					( (blk->oplist.size() >= BLOCK_MAX_SH_OPS_SOFT) || (blk->guest_cycles >= max_cycles) )
+					( (blk->oplist.size() >= BLOCK_MAX_SH_OPS_SOFT) || (blk->guest_cycles >= max_cycles) ||
+					  (settings.MMUEnabled && ((state.cpu.rpc^blk->addr)&~0x3FF)) )
 					&& !state.cpu.is_delayslot
 					)
 				{
@@ -1034,7 +1052,7 @@ void dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 				}
 				else
 				{
-					u32 op=ReadMem16(state.cpu.rpc);
+					u32 op=dec_ReadOpcode(state.cpu.rpc);
 					if (op==0 && state.cpu.is_delayslot)
 					{
 						printf("Delayslot 0 hack!\n");
@@ -1048,7 +1066,17 @@ void dec_DecodeBlock(RuntimeBlockInfo* rbi,u32 max_cycles)
 							blk->guest_cycles+=CPU_RATIO;
 
 						verify(!(state.cpu.is_delayslot && OPCODE_SETPC(OpDesc[op]->type)));
-						if (state.ngen.OnlyDynamicEnds || !OpDesc[op]->rec_oph)
+
+						//a delay slot in the next page is left to the interpreter, which fetches it through the mmu
+						bool page_end=settings.MMUEnabled && (state.cpu.rpc&0x3FF)==0x3FE && (OpDesc[op]->type&Delayslot);
+
+						if (page_end)
+						{
+							dec_fallback(op);
+							dec_DynamicSet(reg_nextpc);
+							dec_End(0xFFFFFFFF,BET_DynamicJump,false);
+						}
+						else if (state.ngen.OnlyDynamicEnds || !OpDesc[op]->rec_oph)
 						{
 							if (state.ngen.InterpreterFallback || !dec_generic(op))
 							{
@@ -16,12 +16,14 @@
 #include "hw/sh4/sh4_interrupts.h"
 
 #include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu_impl.h"
 #include "hw/pvr/pvr_mem.h"
 #include "hw/aica/aica_if.h"
 #include "hw/gdrom/gdrom_if.h"
 
 #include <time.h>
 #include <float.h>
+#include <chrono>
 
 #include "blockmanager.h"
 #include "ngen.h"
@@ -50,6 +52,32 @@ u32 LastAddr;
 u32 LastAddr_min;
 u32* emit_ptr=0;
 
+/*
+	Past LastAddr_min the cache is split in CODE_REGIONS regions, filled in turn.
+	When the current one runs out the next one is emptied and reused, so only
+	the oldest code gets dropped, and the blocks linked to it are unlinked
+	through their pre_refs. rec_cpp keeps its blocks in its own table, which
+	can only be emptied as a whole.
+*/
+#define CODE_REGIONS 8
+
+static u32 code_region;
+static u32 code_region_end=CODE_SIZE;
+
+static rdv_stats stats;
+
+static u32 region_start(u32 region)
+{
+	return LastAddr_min+(u32)((u64)(CODE_SIZE-LastAddr_min)*region/CODE_REGIONS);
+}
+
+static void region_select(u32 region)
+{
+	code_region=region;
+	LastAddr=region_start(region);
+	code_region_end=region_start(region+1);
+}
+
 void* emit_GetCCPtr(void)
 {
    if (emit_ptr)
@@ -60,6 +88,7 @@ void* emit_GetCCPtr(void)
 void emit_SetBaseAddr(void)
 {
    LastAddr_min = LastAddr;
+   region_select(0);
 }
 
 void RASDASD()
@@ -70,12 +99,37 @@ void RASDASD()
 
 static void recSh4_ClearCache(void)
 {
-	LastAddr=LastAddr_min;
+	region_select(0);
 	bm_Reset();
 
+	stats.flushes++;
 	printf("recSh4:Dynarec Cache clear at %08X\n",curr_pc);
 }
 
+//makes room for the next block by emptying the oldest region
+static void rdv_NextRegion(void)
+{
+#ifdef TARGET_NO_JIT
+	if (settings.dynarec.Type == 1)
+	{
+		recSh4_ClearCache();
+		return;
+	}
+#endif
+
+	region_select((code_region+1)%CODE_REGIONS);
+
+	u32 count=bm_DiscardCode(&CodeCache[LastAddr],&CodeCache[code_region_end]);
+
+	stats.evictions++;
+	stats.evicted_blocks+=count;
+}
+
+void rdv_GetStats(rdv_stats* st)
+{
+	*st=stats;
+}
+
 #if (FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64)
 extern int cycle_counter;
 extern bool inside_loop;
@@ -84,14 +138,42 @@ static void ngen_mainloop(void* v_cntx)
 {
 	Sh4RCB* ctx = (Sh4RCB*)((u8*)v_cntx - sizeof(Sh4RCB));
 
+   if (settings.dynarec.Type == 0)
+   {
+      //generated loop, blocks link to each other and only come back here to exit
+      extern void ngen_mainloop_x64(void* v_cntx);
+      ngen_mainloop_x64(v_cntx);
+      return;
+   }
+
    while (inside_loop)
    {
       cycle_counter = SH4_TIMESLICE;
 
-      do {
-         DynarecCodeEntryPtr rcb = (DynarecCodeEntryPtr)FPCA(ctx->cntx.pc);
-         rcb();
-      } while (cycle_counter > 0);
+      if (settings.MMUEnabled)
+      {
+         //mmu exceptions are thrown from the blocks, as in the interpreter
+         do {
+            try {
+               do {
+                  DynarecCodeEntryPtr rcb = rdv_FindOrCompileMMU();
+                  rcb();
+               } while (cycle_counter > 0);
+            }
+            catch (SH4ThrownException ex)
+            {
+               Do_Exception(ex.epc, ex.expEvn, ex.callVect);
+               cycle_counter -= CPU_RATIO * 5;
+            }
+         } while (cycle_counter > 0);
+      }
+      else
+      {
+         do {
+            DynarecCodeEntryPtr rcb = (DynarecCodeEntryPtr)FPCA(ctx->cntx.pc);
+            rcb();
+         } while (cycle_counter > 0);
+      }
 
       if (UpdateSystem())
          rdv_DoInterrupts_pc(ctx->cntx.pc);
@@ -129,7 +211,7 @@ void emit_Skip(u32 sz)
 }
 u32 emit_FreeSpace()
 {
-	return CODE_SIZE-LastAddr;
+	return code_region_end-LastAddr;
 }
 
 
@@ -174,7 +256,7 @@ const char* RuntimeBlockInfo::hash(bool full, bool relocable)
 	sha1_ctx ctx;
 	sha1_init(&ctx);
 
-	u8* ptr = GetMemPtr(this->addr,this->guest_opcodes*2);
+	u8* ptr = GetMemPtr(this->paddr,this->guest_opcodes*2);
 
 	if (ptr)
 	{
@@ -207,7 +289,7 @@ const char* RuntimeBlockInfo::hash(bool full, bool relocable)
 	return block_hash;
 }
 
-void RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
+void RuntimeBlockInfo::Setup(u32 rpc,u32 rppc,fpscr_t rfpu_cfg)
 {
 	staging_runs=addr=lookups=runs=host_code_size=0;
 	guest_cycles=guest_opcodes=host_opcodes=0;
@@ -218,6 +300,7 @@ void RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	BlockType=BET_SCL_Intr;
 	
 	addr=rpc;
+	paddr=rppc;
 	fpu_cfg=rfpu_cfg;
 	
 	oplist.clear();
@@ -226,12 +309,32 @@ void RuntimeBlockInfo::Setup(u32 rpc,fpscr_t rfpu_cfg)
 	AnalyseBlock(this);
 }
 
+//Translates pc as an instruction fetch, raising the ITLB exceptions
+static u32 rdv_TranslatePC(u32 pc)
+{
+	u32 ppc;
+	u32 err=(pc&1)?MMU_ERROR_BADADDR:mmu_instruction_translation(pc,ppc);
+
+	if (err!=MMU_ERROR_NONE)
+	{
+		next_pc=pc+2;
+		mmu_raise_exception(err,pc,MMU_TT_IREAD);
+	}
+
+	return ppc;
+}
+
 DynarecCodeEntryPtr rdv_CompilePC(void)
 {
 	u32 pc=next_pc;
+	u32 ppc=settings.MMUEnabled?rdv_TranslatePC(pc):pc;
 
-	if (emit_FreeSpace()<16*1024 || pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
+	if (pc==0x8c0000e0 || pc==0xac010000 || pc==0xac008300)
 		recSh4_ClearCache();
+	else if (emit_FreeSpace()<16*1024)
+		rdv_NextRegion();
+
+	std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
 
 	RuntimeBlockInfo* rv=0;
 	do
@@ -240,11 +343,14 @@ DynarecCodeEntryPtr rdv_CompilePC(void)
 		if (rv==0)
          rv=rbi;
 
-		rbi->Setup(pc,fpscr);
+		rbi->Setup(pc,ppc,fpscr);
 
-		bool do_opts=((rbi->addr&0x3FFFFFFF)>0x0C010100);
+		//the optimiser can move register writes past memory ops, which the mmu needs in order
+		bool do_opts=((rbi->addr&0x3FFFFFFF)>0x0C010100) && !settings.MMUEnabled;
 		rbi->staging_runs=do_opts?100:-100;
-		ngen_Compile(rbi,DoCheck(rbi->addr),(pc&0xFFFFFF)==0x08300 || (pc&0xFFFFFF)==0x10000,false,do_opts);
+		//nothing catches writes to an unprotected page, whatever unstable_opt says
+		bool check=DoCheck(rbi->addr) || bm_BlockUnprotected(rbi);
+		ngen_Compile(rbi,check,(pc&0xFFFFFF)==0x08300 || (pc&0xFFFFFF)==0x10000,false,do_opts);
 		verify(rbi->code!=0);
 
 		bm_AddBlock(rbi);
@@ -261,6 +367,9 @@ DynarecCodeEntryPtr rdv_CompilePC(void)
       }
 	} while(false && pc);
 
+	stats.blocks++;
+	stats.compile_us+=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start).count();
+
 	return rv->code;
 }
 
@@ -293,7 +402,14 @@ u32 DYNACALL rdv_DoInterrupts(void* block_cpde)
 DynarecCodeEntryPtr DYNACALL rdv_BlockCheckFail(u32 pc)
 {
 	next_pc=pc;
-	recSh4_ClearCache();
+
+	//only the blocks read from the same ram pages can be stale
+	RuntimeBlockInfo* rbi=settings.MMUEnabled?0:bm_GetBlock(pc);
+	if (rbi && IsOnRam(rbi->paddr))
+		bm_DiscardBlockPages(rbi);
+	else
+		recSh4_ClearCache();
+
 	return rdv_CompilePC();
 }
 
@@ -306,6 +422,15 @@ DynarecCodeEntryPtr rdv_FindCode(void)
 	return rv;
 }
 
+DynarecCodeEntryPtr rdv_FindOrCompileMMU(void)
+{
+	DynarecCodeEntryPtr rv=bm_GetCodeMMU(next_pc,rdv_TranslatePC(next_pc));
+	if (!rv)
+		rv=rdv_CompilePC();
+
+	return rv;
+}
+
 DynarecCodeEntryPtr rdv_FindOrCompile(void)
 {
 	DynarecCodeEntryPtr rv= (DynarecCodeEntryPtr)FPCA(next_pc);
@@ -414,6 +539,15 @@ static void recSh4_Reset(bool Manual)
 static void recSh4_Init(void)
 {
 	printf("recSh4 Init\n");
+
+#ifdef TARGET_NO_JIT
+	//mmu exceptions unwind through the generic recompiler's blocks, not through native code
+	if (settings.MMUEnabled && settings.dynarec.Type == 0)
+	{
+		printf("recSh4: MMU enabled, using the generic recompiler\n");
+		settings.dynarec.Type = 1;
+	}
+#endif
 	Sh4_int_Init();
 	bm_Init();
 	bm_Reset();
@@ -472,6 +606,9 @@ static void recSh4_Init(void)
 
 #endif
 	ngen_init();
+
+	//ngen_init may have replaced ngen_FailedToFindBlock, refill the fpcb table
+	bm_Reset();
 }
 
 static void recSh4_Term(void)
@@ -74,9 +74,24 @@ DynarecCodeEntryPtr rdv_FindCode();
 //Finds or compiles code @pc
 DynarecCodeEntryPtr rdv_FindOrCompile();
 
+//Same, translating pc through the mmu first
+DynarecCodeEntryPtr rdv_FindOrCompileMMU();
+
 //code -> pointer to code of block, dpc -> if dynamic block, pc. if cond, 0 for next, 1 for branch
 void* DYNACALL rdv_LinkBlock(u8* code,u32 dpc);
 
+//Code cache counters, since startup
+struct rdv_stats
+{
+	u32 blocks;            //compiled
+	u64 compile_us;        //host time spent decoding and compiling them
+	u32 flushes;           //the whole cache
+	u32 evictions;         //a single code region, when it's reused
+	u32 evicted_blocks;
+};
+
+void rdv_GetStats(rdv_stats* stats);
+
 u32 DYNACALL rdv_DoInterrupts(void* block_cpde);
 u32 DYNACALL rdv_DoInterrupts_pc(u32 pc);
 
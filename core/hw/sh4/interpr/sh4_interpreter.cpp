@@ -6,6 +6,7 @@
 
 #include "../sh4_interpreter.h"
 #include "../sh4_opcode_list.h"
+#include "sh4_opcodes.h"
 #include "../sh4_core.h"
 #include "../sh4_rom.h"
 #include "../sh4_if.h"
@@ -66,6 +67,442 @@ static inline void Sh4_int_Run_execInternal(s32 *l)
    UpdateSystem_INTC();
 }
 
+static void sh4_int_resetcache(void);
+
+//Pre-decoded ram code, run with threaded dispatch (needs labels as values).
+//Every 4 KB ram page is decoded once into one record per opcode, the simple
+//ops run inline off their record and the rest call their handler.
+//Decoded pages are write protected, the first write drops them.
+#if defined(__GNUC__) && !defined(TARGET_NO_EXCEPTIONS)
+	#define INT_DECODE_CACHE 1
+#else
+	#define INT_DECODE_CACHE 0
+#endif
+
+#if INT_DECODE_CACHE
+enum int_kind
+{
+	ik_call,
+	ik_leave,
+	ik_nop,
+	ik_mov,
+	ik_movi,
+	ik_add,
+	ik_addi,
+	ik_sub,
+	ik_and,
+	ik_or,
+	ik_xor,
+	ik_tst,
+	ik_tsti,
+	ik_cmpeq,
+	ik_cmpeqi,
+	ik_dt,
+	ik_shll,
+	ik_shlr,
+	ik_shll2,
+	ik_shlr2,
+	ik_extub,
+	ik_extuw,
+	ik_extsb,
+	ik_extsw,
+	ik_bt,
+	ik_bf,
+	ik_movl_ld,
+	ik_movl_ldinc,
+	ik_movl_st,
+
+	ik_count
+};
+
+static const struct { OpCallFP* oph; u8 kind; } int_inline_ops[]=
+{
+	{ i0000_0000_0000_1001, ik_nop },
+	{ i0110_nnnn_mmmm_0011, ik_mov },
+	{ i1110_nnnn_iiii_iiii, ik_movi },
+	{ i0011_nnnn_mmmm_1100, ik_add },
+	{ i0111_nnnn_iiii_iiii, ik_addi },
+	{ i0011_nnnn_mmmm_1000, ik_sub },
+	{ i0010_nnnn_mmmm_1001, ik_and },
+	{ i0010_nnnn_mmmm_1011, ik_or },
+	{ i0010_nnnn_mmmm_1010, ik_xor },
+	{ i0010_nnnn_mmmm_1000, ik_tst },
+	{ i1100_1000_iiii_iiii, ik_tsti },
+	{ i0011_nnnn_mmmm_0000, ik_cmpeq },
+	{ i1000_1000_iiii_iiii, ik_cmpeqi },
+	{ i0100_nnnn_0001_0000, ik_dt },
+	{ i0100_nnnn_0000_0000, ik_shll },
+	{ i0100_nnnn_0000_0001, ik_shlr },
+	{ i0100_nnnn_0000_1000, ik_shll2 },
+	{ i0100_nnnn_0000_1001, ik_shlr2 },
+	{ i0110_nnnn_mmmm_1100, ik_extub },
+	{ i0110_nnnn_mmmm_1101, ik_extuw },
+	{ i0110_nnnn_mmmm_1110, ik_extsb },
+	{ i0110_nnnn_mmmm_1111, ik_extsw },
+	{ i1000_1001_iiii_iiii, ik_bt },
+	{ i1000_1011_iiii_iiii, ik_bf },
+	{ i0110_nnnn_mmmm_0010, ik_movl_ld },
+	{ i0110_nnnn_mmmm_0110, ik_movl_ldinc },
+	{ i0010_nnnn_mmmm_0010, ik_movl_st },
+	//pc relative loads from the page itself are turned into ik_movi, see int_DecodePage
+};
+
+struct int_op
+{
+	OpCallFP* oph;
+	u32 imm;	//the opcode itself for handler calls
+	u8 kind;
+	u8 n;
+	u8 m;
+};
+
+#define INT_PAGE_OPS (PAGE_SIZE/2)
+#define INT_MAX_PAGES 1024	//32 MB of records, the whole cache is dropped past that
+#define INT_MAX_WRITES 8	//pages rewritten more often hold data too, they run uncached
+
+struct int_page
+{
+	int_op ops[INT_PAGE_OPS+1];	//the extra one leaves the page
+	bool valid;
+	int_page* next_free;
+};
+
+static u8 int_kinds[0x10000];
+static int_page* int_pages[RAM_SIZE/PAGE_SIZE];
+static u8 int_writes[RAM_SIZE/PAGE_SIZE];
+static int_page* int_free;
+static u32 int_allocated;
+
+static void int_BuildKinds(void)
+{
+	for (u32 op=0;op<0x10000;op++)
+	{
+		int_kinds[op]=ik_call;
+
+		for (u32 i=0;i<sizeof(int_inline_ops)/sizeof(int_inline_ops[0]);i++)
+		{
+			if (OpPtr[op]==int_inline_ops[i].oph)
+				int_kinds[op]=int_inline_ops[i].kind;
+		}
+	}
+}
+
+static int_page* int_AllocPage(void)
+{
+	if (!int_free)
+	{
+		if (int_allocated<INT_MAX_PAGES)
+		{
+			int_page* rv=(int_page*)malloc(sizeof(int_page));
+			verify(rv!=0);
+			int_allocated++;
+			return rv;
+		}
+
+		sh4_int_resetcache();
+	}
+
+	int_page* rv=int_free;
+	int_free=rv->next_free;
+	return rv;
+}
+
+static int_page* int_DecodePage(u32 page)
+{
+	int_page* rv=int_AllocPage();
+
+	//lock first, the page must not change after it's been read
+	ram_LockCodePage(page);
+
+	u8* code=&mem_b.data[page*PAGE_SIZE];
+
+	for (u32 i=0;i<INT_PAGE_OPS;i++)
+	{
+		u32 op=*(u16*)&code[i*2];
+		int_op& o=rv->ops[i];
+
+		o.oph=OpPtr[op];
+		o.kind=int_kinds[op];
+		o.n=GetN(op);
+		o.m=GetM(op);
+
+		//the literal can't change without dropping the page
+		if (OpPtr[op]==i1101_nnnn_iiii_iiii)
+		{
+			u32 lit=((i*2+4)&~3)+(op&0xFF)*4;
+			if (lit<PAGE_SIZE)
+			{
+				o.kind=ik_movi;
+				o.imm=*(u32*)&code[lit];
+				continue;
+			}
+		}
+		else if (OpPtr[op]==i1001_nnnn_iiii_iiii)
+		{
+			u32 lit=i*2+4+(op&0xFF)*2;
+			if (lit<PAGE_SIZE)
+			{
+				o.kind=ik_movi;
+				o.imm=(u32)(s32)*(s16*)&code[lit];
+				continue;
+			}
+		}
+
+		switch(o.kind)
+		{
+		case ik_movi:
+		case ik_addi:
+		case ik_cmpeqi:
+			o.imm=(u32)(s32)(s8)op;
+			break;
+
+		case ik_tsti:
+			o.imm=op&0xFF;
+			break;
+
+		case ik_bt:
+		case ik_bf:
+			o.imm=(s8)op*2+4;	//from the branch
+			break;
+
+		default:
+			o.imm=op;
+			break;
+		}
+	}
+
+	rv->ops[INT_PAGE_OPS].kind=ik_leave;
+	rv->valid=true;
+
+	int_pages[page]=rv;
+
+	return rv;
+}
+
+static INLINE int_page* int_GetPage(u32 pc)
+{
+	if ((pc&1) || !IsOnRam(pc))
+		return 0;
+
+	u32 page=(pc&RAM_MASK)/PAGE_SIZE;
+	int_page* rv=int_pages[page];
+
+	if (rv)
+		return rv;
+
+	return int_writes[page]<INT_MAX_WRITES?int_DecodePage(page):0;
+}
+
+static void Sh4_int_Run_execCached(s32 *l)
+{
+	static void* const dispatch[ik_count]=
+	{
+		&&k_call, &&k_leave, &&k_nop, &&k_mov, &&k_movi, &&k_add, &&k_addi, &&k_sub,
+		&&k_and, &&k_or, &&k_xor, &&k_tst, &&k_tsti, &&k_cmpeq, &&k_cmpeqi, &&k_dt,
+		&&k_shll, &&k_shlr, &&k_shll2, &&k_shlr2, &&k_extub, &&k_extuw, &&k_extsb, &&k_extsw,
+		&&k_bt, &&k_bf, &&k_movl_ld, &&k_movl_ldinc, &&k_movl_st,
+	};
+
+	#define INT_DISPATCH() goto *dispatch[o->kind]
+	#define INT_NEXT() { cycles-=CPU_RATIO; pc+=2; o++; if (cycles<=0) goto leave; INT_DISPATCH(); }
+
+	s32 cycles=*l;
+	u32 pc;
+	int_page* page;
+	int_op* o;
+
+	for (;;)
+	{
+		pc=next_pc;
+		page=int_GetPage(pc);
+
+		if (!page)
+		{
+			//bios, flash, pages that keep getting written
+			next_pc=pc+2;
+			u32 op=ReadMem16(pc);
+			OpPtr[op](op);
+
+			cycles-=CPU_RATIO;
+			if (cycles<=0)
+				break;
+			continue;
+		}
+
+		o=&page->ops[(pc&PAGE_MASK)/2];
+		INT_DISPATCH();
+
+	k_call:
+		next_pc=pc+2;
+		o->oph(o->imm);
+		cycles-=CPU_RATIO;
+
+		//branches, exceptions and writes to this page go through the lookup again
+		if (next_pc!=pc+2 || !page->valid)
+		{
+			if (cycles<=0)
+				break;
+			continue;
+		}
+
+		pc+=2;
+		o++;
+		if (cycles<=0)
+			goto leave;
+		INT_DISPATCH();
+
+	k_nop:
+		INT_NEXT();
+
+	k_mov:
+		r[o->n]=r[o->m];
+		INT_NEXT();
+
+	k_movi:
+		r[o->n]=o->imm;
+		INT_NEXT();
+
+	k_add:
+		r[o->n]+=r[o->m];
+		INT_NEXT();
+
+	k_addi:
+		r[o->n]+=o->imm;
+		INT_NEXT();
+
+	k_sub:
+		r[o->n]-=r[o->m];
+		INT_NEXT();
+
+	k_and:
+		r[o->n]&=r[o->m];
+		INT_NEXT();
+
+	k_or:
+		r[o->n]|=r[o->m];
+		INT_NEXT();
+
+	k_xor:
+		r[o->n]^=r[o->m];
+		INT_NEXT();
+
+	k_tst:
+		sr.T=(r[o->n]&r[o->m])==0;
+		INT_NEXT();
+
+	k_tsti:
+		sr.T=(r[0]&o->imm)==0;
+		INT_NEXT();
+
+	k_cmpeq:
+		sr.T=r[o->n]==r[o->m];
+		INT_NEXT();
+
+	k_cmpeqi:
+		sr.T=r[0]==o->imm;
+		INT_NEXT();
+
+	k_dt:
+		r[o->n]-=1;
+		sr.T=r[o->n]==0;
+		INT_NEXT();
+
+	k_shll:
+		sr.T=r[o->n]>>31;
+		r[o->n]<<=1;
+		INT_NEXT();
+
+	k_shlr:
+		sr.T=r[o->n]&1;
+		r[o->n]>>=1;
+		INT_NEXT();
+
+	k_shll2:
+		r[o->n]<<=2;
+		INT_NEXT();
+
+	k_shlr2:
+		r[o->n]>>=2;
+		INT_NEXT();
+
+	k_extub:
+		r[o->n]=(u8)r[o->m];
+		INT_NEXT();
+
+	k_extuw:
+		r[o->n]=(u16)r[o->m];
+		INT_NEXT();
+
+	k_extsb:
+		r[o->n]=(u32)(s32)(s8)r[o->m];
+		INT_NEXT();
+
+	k_extsw:
+		r[o->n]=(u32)(s32)(s16)r[o->m];
+		INT_NEXT();
+
+	//the mmu is off here, and the handlers only need next_pc to report it
+	k_movl_ld:
+		next_pc=pc+2;
+		r[o->n]=ReadMem32_nommu(r[o->m]);
+		INT_NEXT();
+
+	k_movl_ldinc:
+		next_pc=pc+2;
+		r[o->n]=ReadMem32_nommu(r[o->m]);
+		if (o->n!=o->m)
+			r[o->m]+=4;
+		INT_NEXT();
+
+	k_movl_st:
+		next_pc=pc+2;
+		WriteMem32_nommu(r[o->n],r[o->m]);
+		if (!page->valid)
+		{
+			cycles-=CPU_RATIO;
+			pc+=2;
+			goto leave;
+		}
+		INT_NEXT();
+
+	k_bt:
+		if (sr.T!=0)
+			goto branch;
+		INT_NEXT();
+
+	k_bf:
+		if (sr.T==0)
+			goto branch;
+		INT_NEXT();
+
+	branch:
+		{
+			u32 offs=(pc&PAGE_MASK)+o->imm;
+
+			cycles-=CPU_RATIO;
+			pc+=o->imm;
+			if (cycles<=0 || offs>=PAGE_SIZE)
+				goto leave;
+
+			o=&page->ops[offs/2];
+			INT_DISPATCH();
+		}
+
+	k_leave:
+	leave:
+		next_pc=pc;
+		if (cycles<=0)
+			break;
+	}
+
+	#undef INT_DISPATCH
+	#undef INT_NEXT
+
+	*l=cycles+SH4_TIMESLICE;
+	UpdateSystem_INTC();
+}
+#endif
+
 static inline void Sh4_int_Run_exec(s32 *l)
 {
    if (settings.MMUEnabled)
@@ -81,7 +518,11 @@ static inline void Sh4_int_Run_exec(s32 *l)
       }
    }
    else
+#if INT_DECODE_CACHE
+      Sh4_int_Run_execCached(l);
+#else
       Sh4_int_Run_execInternal(l);
+#endif
 }
 
 void Sh4_int_Stop(void)
@@ -142,6 +583,8 @@ void Sh4_int_Reset(bool Manual)
    old_fpscr=fpscr;
    UpdateFPSCR();
 
+   sh4_int_resetcache();
+
    //Any more registers have default value ?
    printf("Sh4 Reset\n");
 }
@@ -242,6 +685,32 @@ static int DreamcastSecond(int tag, int c, int j)
 
 static void sh4_int_resetcache(void)
 {
+#if INT_DECODE_CACHE
+	//the pages stay locked, their next write is just a spurious fault
+	for (u32 i=0;i<RAM_SIZE/PAGE_SIZE;i++)
+		sh4_int_CodePageWritten(i);
+
+	memset(int_writes,0,sizeof(int_writes));
+#endif
+}
+
+//called from the fault handler, the running page only gets marked
+void sh4_int_CodePageWritten(u32 page)
+{
+#if INT_DECODE_CACHE
+	int_page* p=int_pages[page];
+
+	if (p)
+	{
+		int_pages[page]=0;
+		p->valid=false;
+		p->next_free=int_free;
+		int_free=p;
+
+		if (int_writes[page]<INT_MAX_WRITES)
+			int_writes[page]++;
+	}
+#endif
 }
 
 //Get an interface to sh4 interpreter
@@ -269,10 +738,26 @@ void Sh4_int_Init()
 	rtc_sched=sh4_sched_register(0,&DreamcastSecond);
 	sh4_sched_request(rtc_sched,SH4_MAIN_CLOCK);
 	memset(&p_sh4rcb->cntx, 0, sizeof(p_sh4rcb->cntx));
+
+#if INT_DECODE_CACHE
+	int_BuildKinds();
+#endif
 }
 
 void Sh4_int_Term(void)
 {
 	Sh4_int_Stop();
+
+#if INT_DECODE_CACHE
+	sh4_int_resetcache();
+
+	while (int_free)
+	{
+		int_page* next=int_free->next_free;
+		free(int_free);
+		int_free=next;
+	}
+	int_allocated=0;
+#endif
 	printf("Sh4 Term\n");
 }
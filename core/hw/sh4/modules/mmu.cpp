@@ -62,10 +62,59 @@ u32 ITLB_LRU_USE[64];
 //max 64MB can be remapped on SQ
 u32 sq_remap[64];
 
+//Software TLB, see mmu_impl.h
+mmu_cache_entry utlb_cache[MMU_CACHE_SIZE];
+static mmu_cache_entry itlb_cache[MMU_CACHE_SIZE];
+u32 utlb_gen[64];
+static u32 itlb_gen[4];
+
+static INLINE void mmu_cache_set(mmu_cache_entry* cache, const u32* gen, u32 va, u32 idx, u32 rv)
+{
+	u32 key = mmu_cache_key();
+	mmu_cache_entry* slot = mmu_cache_slot(cache, va >> 10, key);
+
+	slot->vpn = va >> 10;
+	slot->key = key;
+	slot->ppn = rv >> 10;
+	slot->entry = idx;
+	slot->gen = gen[idx];
+}
+
+static void mmu_cache_invalidate(const TLB_Entry* tlb, u32* gen, u32 count, u32 idx)
+{
+	gen[idx]++;
+
+	if (!tlb[idx].Data.V)
+		return;
+
+	u32 mask = mmu_mask[tlb[idx].Data.SZ1 * 2 + tlb[idx].Data.SZ0] >> 10;
+
+	//a cached va lies in its entry's page, so only overlapping pages can hold one
+	for (u32 i = 0; i < count; i++)
+	{
+		if (i == idx || !tlb[i].Data.V)
+			continue;
+
+		u32 both = mask & (mmu_mask[tlb[i].Data.SZ1 * 2 + tlb[i].Data.SZ0] >> 10);
+		if ((tlb[i].Address.VPN & both) == (tlb[idx].Address.VPN & both))
+			gen[i]++;
+	}
+}
+
+void mmu_flush_cache(void)
+{
+	for (u32 i = 0; i < MMU_CACHE_SIZE; i++)
+	{
+		utlb_cache[i].vpn = MMU_CACHE_EMPTY;
+		itlb_cache[i].vpn = MMU_CACHE_EMPTY;
+	}
+}
+
 void MMU_reset(void)
 {
 	memset(UTLB, 0, sizeof(UTLB));
 	memset(ITLB, 0, sizeof(ITLB));
+	mmu_flush_cache();
 }
 
 void MMU_term(void)
@@ -186,6 +235,8 @@ u32 mmu_full_lookup(u32 va, u32& idx, u32& rv)
 	if (CCN_MMUCR.URB == CCN_MMUCR.URC)
 		CCN_MMUCR.URC = 0;
 
+	if (mmu_cache_get(utlb_cache, utlb_gen, va, idx, rv))
+		return MMU_ERROR_NONE;
 
 	u32 entry = 0;
 	u32 nom = 0;
@@ -213,6 +264,7 @@ u32 mmu_full_lookup(u32 va, u32& idx, u32& rv)
 	}
 
 	idx = entry;
+	mmu_cache_set(utlb_cache, utlb_gen, va, idx, rv);
 
 	return MMU_ERROR_NONE;
 }
@@ -357,9 +409,15 @@ u32 mmu_instruction_translation(u32 va, u32& rv)
 	}
 
 	bool mmach = false;
-retry_ITLB_Match:
 	u32 entry = 4;
 	u32 nom = 0;
+
+	if (mmu_cache_get(itlb_cache, itlb_gen, va, entry, rv))
+		goto ITLB_Match;
+
+retry_ITLB_Match:
+	entry = 4;
+	nom = 0;
 	for (u32 i = 0; i<4; i++)
 	{
 		if (ITLB[i].Data.V == 0)
@@ -404,6 +462,9 @@ retry_ITLB_Match:
       return MMU_ERROR_TLB_MISS;
 	}
 
+	mmu_cache_set(itlb_cache, itlb_gen, va, entry, rv);
+
+ITLB_Match:
 	CCN_MMUCR.LRUI &= ITLB_LRU_AND[entry];
 	CCN_MMUCR.LRUI |= ITLB_LRU_OR[entry];
 
@@ -422,6 +483,8 @@ void MMU_init(void)
    if (!settings.MMUEnabled)
       return;
 
+   mmu_flush_cache();
+
    memset(ITLB_LRU_USE, 0xFF, sizeof(ITLB_LRU_USE));
    for (u32 e = 0; e<4; e++)
    {
@@ -443,6 +506,8 @@ bool UTLB_Sync(u32 entry)
 {	
    if (settings.MMUEnabled)
    {
+      mmu_cache_invalidate(UTLB, utlb_gen, 64, entry);
+
       printf_mmu("UTLB MEM remap %d : 0x%X to 0x%X : %d\n", entry, UTLB[entry].Address.VPN << 10, UTLB[entry].Data.PPN << 10, UTLB[entry].Data.V);
       if (UTLB[entry].Data.V == 0)
          return true;
@@ -486,6 +551,9 @@ bool UTLB_Sync(u32 entry)
 //Sync memory mapping to MMU, suspend compiled blocks if needed.entry is a ITLB entry # , -1 is for full sync
 void ITLB_Sync(u32 entry)
 {
+   if (settings.MMUEnabled)
+      mmu_cache_invalidate(ITLB, itlb_gen, 4, entry);
+
    if (settings.MMUEnabled)
       printf_mmu("ITLB MEM remap %d : 0x%X to 0x%X : %d\n", entry, ITLB[entry].Address.VPN << 10, ITLB[entry].Data.PPN << 10, ITLB[entry].Data.V);
    else
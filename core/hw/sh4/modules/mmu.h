@@ -17,6 +17,8 @@ bool UTLB_Sync(u32 entry);
 void ITLB_Sync(u32 entry);
 
 bool mmu_match(u32 va, CCN_PTEH_type Address, CCN_PTEL_type Data);
+//drops the software TLB, after the TLBs were changed without UTLB_Sync/ITLB_Sync
+void mmu_flush_cache(void);
 
 u8 DYNACALL mmu_ReadMem8(u32 addr);
 u16 DYNACALL mmu_ReadMem16(u32 addr);
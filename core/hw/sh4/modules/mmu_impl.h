@@ -2,6 +2,7 @@
 #include "types.h"
 #include "ccn.h"
 #include "mmu.h"
+#include "hw/sh4/sh4_core.h"
 
 
 //Do a full lookup on the UTLB entry's
@@ -32,6 +33,99 @@
 
 extern u32 mmu_error_TT;
 
+u32 mmu_instruction_translation(u32 va, u32& rv);
+void mmu_raise_exception(u32 mmu_error, u32 address, u32 am);
+
+/*
+	Software TLB
+
+	Successful UTLB and ITLB lookups are cached per 1KB page, for every page
+	size. Slots are keyed on all that mmu_match reads besides the entries
+	(the ASID, and whether MD=1 with SV=1 ignores it), so ASID switches need
+	no flush. A slot also holds the generation of the entry it hit, and
+	UTLB_Sync/ITLB_Sync bump the generation of the changed entry and of any
+	entry its new page overlaps, as their slots could now multi-hit.
+*/
+#define MMU_CACHE_SIZE 1024
+#define MMU_CACHE_EMPTY 0xFFFFFFFF
+
+struct mmu_cache_entry
+{
+	u32 vpn;	//va>>10
+	u32 key;	//mmu_cache_key() at the lookup
+	u32 ppn;	//pa>>10
+	u32 entry;	//TLB entry that matched
+	u32 gen;	//its generation at the lookup
+};
+
+extern mmu_cache_entry utlb_cache[MMU_CACHE_SIZE];
+extern u32 utlb_gen[64];
+
+static INLINE u32 mmu_cache_key(void)
+{
+	return CCN_PTEH.ASID | ((sr.MD & CCN_MMUCR.SV) << 8);
+}
+
+static INLINE mmu_cache_entry* mmu_cache_slot(mmu_cache_entry* cache, u32 vpn, u32 key)
+{
+	return &cache[(vpn ^ (key << 2)) & (MMU_CACHE_SIZE - 1)];
+}
+
+static INLINE bool mmu_cache_get(mmu_cache_entry* cache, const u32* gen, u32 va, u32& idx, u32& rv)
+{
+	u32 key = mmu_cache_key();
+	mmu_cache_entry* slot = mmu_cache_slot(cache, va >> 10, key);
+
+	if (slot->vpn != (va >> 10) || slot->key != key || slot->gen != gen[slot->entry])
+		return false;
+
+	idx = slot->entry;
+	rv = (slot->ppn << 10) | (va & 0x3FF);
+
+	return true;
+}
+
+//Inline data translation for the recompilers. Only handles software TLB hits
+//that need no fault checks and untranslated P1/P2, everything else returns
+//false and goes through mmu_data_translation, which raises the exceptions.
+template<u32 translation_type>
+static INLINE bool mmu_data_probe(u32 va, u32& rv)
+{
+	if (va & 0x80000000)
+	{
+		if (sr.MD == 0 || (va >> 30) != 2)
+			return false;
+
+		rv = va;
+		return true;
+	}
+
+	if (CCN_MMUCR.AT == 0)
+	{
+		rv = va;
+		return true;
+	}
+
+	u32 entry;
+	if ((va & 0xFC000000) == 0x7C000000 || !mmu_cache_get(utlb_cache, utlb_gen, va, entry, rv))
+		return false;
+
+	//0X & User mode -> protection violation
+	if ((UTLB[entry].Data.PR >> 1) == 0 && sr.MD == 0)
+		return false;
+
+	//write protection (Lock or FW)
+	if (translation_type == MMU_TT_DWRITE && ((UTLB[entry].Data.PR & 1) == 0 || UTLB[entry].Data.D == 0))
+		return false;
+
+	//as mmu_full_lookup does
+	CCN_MMUCR.URC++;
+	if (CCN_MMUCR.URB == CCN_MMUCR.URC)
+		CCN_MMUCR.URC = 0;
+
+	return true;
+}
+
 void MMU_Init();
 void MMU_Reset(bool Manual);
 void MMU_Term();
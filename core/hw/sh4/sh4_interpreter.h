@@ -50,6 +50,9 @@ void Sh4_int_SetRegister(Sh4RegType reg,u32 regdata);
 void ExecuteDelayslot(void);
 void ExecuteDelayslot_RTE(void);
 
+/* Drops the pre-decoded code of a ram page, see ram_LockCodePage */
+void sh4_int_CodePageWritten(u32 page);
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,6 +12,10 @@
 #include "hw/sh4/sh4_core.h"
 #include "hw/mem/_vmem.h"
 #include "modules/mmu.h"
+#include "sh4_interpreter.h"
+#if FEAT_SHREC != DYNAREC_NONE
+#include "dyna/blockmanager.h"
+#endif
 
 //main system mem
 VArray2 mem_b;
@@ -98,6 +102,7 @@ void _vmem_term(void);
 
 //AREA 1
 _vmem_handler area1_32b;
+_vmem_handler area1_64b;
 void map_area1_init(void)
 {
 	area1_32b = _vmem_register_handler(
@@ -107,6 +112,15 @@ void map_area1_init(void)
          pvr_write_area1_8,
          pvr_write_area1_16,
          pvr_write_area1_32);
+
+	//vram writes have to be seen when they aren't caught by write protection
+	area1_64b = _vmem_register_handler(
+         pvr_read_area1_64_8,
+         pvr_read_area1_64_16,
+         pvr_read_area1_64_32,
+         pvr_write_area1_64_8,
+         pvr_write_area1_64_16,
+         pvr_write_area1_64_32);
 }
 
 void map_area1(u32 base)
@@ -115,7 +129,10 @@ void map_area1(u32 base)
 	
 	//Lower 32 mb map
 	//64b interface
-	_vmem_map_block(vram.data,0x04 | base,0x04 | base,VRAM_SIZE-1);
+	if (settings.pvr.VramSoftTracking)
+		_vmem_map_handler(area1_64b,0x04 | base,0x04 | base);
+	else
+		_vmem_map_block(vram.data,0x04 | base,0x04 | base,VRAM_SIZE-1);
 	//32b interface
 	_vmem_map_handler(area1_32b,0x05 | base,0x05 | base);
 	
@@ -275,6 +292,7 @@ void mem_Reset(bool Manual)
 	{
 		//fill mem w/ 0's
 		VArray2_Zero(&mem_b);
+		ram_UnlockCodePages();
 	}
 
 	//Reset registers
@@ -411,3 +429,78 @@ u32 GetRamPageFromAddress(u32 RamAddress)
 	verify(IsOnRam(RamAddress));
 	return (RamAddress & RAM_MASK)/PAGE_SIZE;
 }
+
+static u8 ram_code_locked[RAM_SIZE/PAGE_SIZE];
+
+//both the interpreter's decoded pages and the recompiler's blocks go stale
+static void ram_CodePageWritten(u32 page)
+{
+	sh4_int_CodePageWritten(page);
+#if FEAT_SHREC != DYNAREC_NONE
+	bm_RamPageWritten(page);
+#endif
+}
+
+static void ram_ProtectPage(u32 page,bool writable)
+{
+	u8* views[VMEM_MAX_VIEWS];
+	u32 nviews=_vmem_get_views(mem_b,views);
+
+	for (u32 i=0;i<nviews;i++)
+	{
+		VArray2 view={ views[i], RAM_SIZE };
+
+		if (writable)
+			VArray2_UnLockRegion(&view,page*PAGE_SIZE,PAGE_SIZE);
+		else
+			VArray2_LockRegion(&view,page*PAGE_SIZE,PAGE_SIZE);
+	}
+}
+
+void ram_LockCodePage(u32 page)
+{
+	//always reprotect, VArray2_Zero and the rewind buffer unlock pages behind our back
+	ram_code_locked[page]=1;
+	ram_ProtectPage(page,false);
+}
+
+void ram_UnlockCodePages(void)
+{
+	for (u32 page=0;page<RAM_SIZE/PAGE_SIZE;page++)
+	{
+		if (ram_code_locked[page])
+		{
+			ram_code_locked[page]=0;
+			ram_ProtectPage(page,true);
+			ram_CodePageWritten(page);
+		}
+	}
+}
+
+//called from the fault handler
+bool RamLockedWrite(u8* address)
+{
+	u8* views[VMEM_MAX_VIEWS];
+	u32 nviews=_vmem_get_views(mem_b,views);
+
+	for (u32 i=0;i<nviews;i++)
+	{
+		size_t offset=address-views[i];
+
+		if (offset<RAM_SIZE)
+		{
+			u32 page=offset/PAGE_SIZE;
+
+			if (!ram_code_locked[page])
+				return false;
+
+			ram_code_locked[page]=0;
+			ram_ProtectPage(page,true);
+			ram_CodePageWritten(page);
+
+			return true;
+		}
+	}
+
+	return false;
+}
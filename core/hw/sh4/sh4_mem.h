@@ -69,6 +69,12 @@ bool IsOnRam(u32 addr);
 
 u32 GetRamPageFromAddress(u32 RamAddress);
 
+//Write protection for ram pages holding pre-decoded or compiled code, through every
+//mirror. The first write to a locked page unlocks it and reports it to the cpu cores
+void ram_LockCodePage(u32 page);
+void ram_UnlockCodePages(void);
+bool RamLockedWrite(u8* address);
+
 
 bool LoadRomFiles(const string& root);
 void SaveRomFiles(const string& root);
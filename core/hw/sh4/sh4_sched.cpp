@@ -3,6 +3,7 @@
 #include "sh4_interrupts.h"
 #include "sh4_core.h"
 #include "sh4_sched.h"
+#include "serialize.h"
 
 
 //sh4 scheduler
@@ -19,9 +20,16 @@
 
 	sh4_sched_now()
 
+	The pending events are kept in an indexed min-heap ordered by end
+	time, so finding the next one is O(1) and (re)scheduling is O(log n).
+	end times are u32 and wrap, but pending ones are never more than
+	SH4_MAIN_CLOCK apart, so their signed difference orders them.
+
 */
 u64 sh4_sched_ffb;
 u32 sh4_sched_intr;
+u32 sh4_sched_dispatches;
+u32 sh4_sched_frame_dispatches;
 
 struct sched_list
 {
@@ -29,12 +37,88 @@ struct sched_list
 	int tag;
 	int start;
 	int end;
+	int heap_idx;	//position in heap, -1 when not pending
 };
 
 vector<sched_list> list;
+vector<int> heap;
 
 int sh4_sched_next_id=-1;
 
+//orders by end time, then by id
+static bool sched_before(int a, int b)
+{
+	s32 diff = (u32)list[a].end - (u32)list[b].end;
+	return diff < 0 || (diff == 0 && a < b);
+}
+
+static void heap_set(int idx, int id)
+{
+	heap[idx] = id;
+	list[id].heap_idx = idx;
+}
+
+static void heap_up(int idx)
+{
+	int id = heap[idx];
+
+	while (idx > 0)
+	{
+		int parent = (idx - 1) / 2;
+		if (!sched_before(id, heap[parent]))
+			break;
+		heap_set(idx, heap[parent]);
+		idx = parent;
+	}
+	heap_set(idx, id);
+}
+
+static void heap_down(int idx)
+{
+	int id = heap[idx];
+	int count = heap.size();
+
+	for (;;)
+	{
+		int child = idx * 2 + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && sched_before(heap[child + 1], heap[child]))
+			child++;
+		if (!sched_before(heap[child], id))
+			break;
+		heap_set(idx, heap[child]);
+		idx = child;
+	}
+	heap_set(idx, id);
+}
+
+static void heap_remove(int id)
+{
+	int idx = list[id].heap_idx;
+
+	if (idx == -1)
+		return;
+
+	list[id].heap_idx = -1;
+
+	int last = heap.back();
+	heap.pop_back();
+
+	if (last != id)
+	{
+		heap_set(idx, last);
+		heap_up(idx);
+		heap_down(list[last].heap_idx);
+	}
+}
+
+static void heap_insert(int id)
+{
+	heap.push_back(id);
+	heap_up(heap.size() - 1);
+}
+
 u32 sh4_sched_remaining(int id, u32 reference)
 {
 	if (list[id].end == -1)
@@ -52,13 +136,10 @@ void sh4_sched_ffts(void)
 	u32 diff=-1;
 	int slot=-1;
 
-	for (size_t i=0;i<list.size();i++)
+	if (!heap.empty())
 	{
-		if (sh4_sched_remaining(i)<diff)
-		{
-			slot=i;
-			diff=sh4_sched_remaining(i);
-		}
+		slot=heap[0];
+		diff=sh4_sched_remaining(slot);
 	}
 
 	sh4_sched_ffb-=Sh4cntx.sh4_sched_next;
@@ -71,7 +152,9 @@ void sh4_sched_ffts(void)
 
 int sh4_sched_register(int tag, sh4_sched_callback* ssc)
 {
-	sched_list t={ssc,tag,-1,-1};
+	sched_list t={ssc,tag,-1,-1,-1};
+
+	verify(list.size()<SH4_SCHED_SLOTS);
 
 	list.push_back(t);
 
@@ -97,6 +180,8 @@ void sh4_sched_request(int id, int cycles)
 {
 	verify(cycles== -1 || (cycles >= 0 && cycles <= SH4_MAIN_CLOCK));
 
+	heap_remove(id);
+
 	list[id].start = sh4_sched_now();
    list[id].end   = -1;
 
@@ -105,6 +190,8 @@ void sh4_sched_request(int id, int cycles)
 		list[id].end = list[id].start + cycles;
 		if (list[id].end == -1)
 			list[id].end++;
+
+		heap_insert(id);
 	}
 
 	sh4_sched_ffts();
@@ -128,11 +215,42 @@ static void handle_cb(int id)
 	int jitter=elapsd-remain;
 
 	list[id].end=-1;
+	sh4_sched_dispatches++;
 	int re_sch=list[id].cb(list[id].tag,remain,jitter);
 
 	if (re_sch>0)	sh4_sched_request(id,re_sch-jitter);
 }
 
+//takes the events that are due this slice off the heap, as a mask of ids.
+//the ones not in keep go back on the heap, for the next slice
+static u32 heap_take_expired(u32 fztime, int cycles, u32 keep)
+{
+	u32 taken=0;
+	u32 left=0;
+
+	while (!heap.empty())
+	{
+		int id=heap[0];
+		int remaining = sh4_sched_remaining(id, fztime);
+		verify(remaining >= 0);
+		if (remaining > (u32)cycles)
+			break;
+		heap_remove(id);
+		if (keep & (1u<<id))
+			taken|=1u<<id;
+		else
+			left|=1u<<id;
+	}
+
+	for (int id=0;left!=0;id++,left>>=1)
+	{
+		if (left&1)
+			heap_insert(id);
+	}
+
+	return taken;
+}
+
 void sh4_sched_tick(int cycles)
 {
 	/*
@@ -144,17 +262,59 @@ void sh4_sched_tick(int cycles)
 	{
 		u32 fztime=sh4_sched_now()-cycles;
 		sh4_sched_intr++;
-		if (sh4_sched_next_id!=-1)
+
+		//run the events that expired this slice in id order, like the old
+		//linear scan did
+		u32 expired=heap_take_expired(fztime, cycles, ~0u);
+
+		for (int id=0;expired!=0;id++)
 		{
-         unsigned i;
-			for (i=0;i<list.size();i++)
+			u32 bit=1u<<id;
+			if (!(expired&bit))
+				continue;
+			expired&=~bit;
+
+			//an earlier callback might have rescheduled or cancelled it
+			int remaining = sh4_sched_remaining(id, fztime);
+			if (remaining >= 0 && remaining <= (u32)cycles)
 			{
-				int remaining = sh4_sched_remaining(i, fztime);
-				verify(remaining >= 0 || remaining == -1);
-				if (remaining >= 0 && remaining <= (u32)cycles)
-					handle_cb(i);
+				heap_remove(id);
+				handle_cb(id);
 			}
+
+			//events the callback requested for now: the scan still reached the
+			//ones after this id in the same slice, the rest waited for the next
+			expired|=heap_take_expired(fztime, cycles, ~(bit*2-1));
 		}
+
 		sh4_sched_ffts();
 	}
 }
+
+void sh4_sched_serialize(Serializer& s)
+{
+	s.value(sh4_sched_ffb);
+	s.value(sh4_sched_intr);
+	s.value(sh4_sched_next_id);
+
+	//the callbacks are registered at init, in the same order every time.
+	//the slot count is fixed so the size doesn't depend on init having run
+	verify(list.size()<=SH4_SCHED_SLOTS);
+	for (size_t i=0;i<list.size();i++)
+	{
+		s.value(list[i].start);
+		s.value(list[i].end);
+	}
+	s.skip((SH4_SCHED_SLOTS-list.size())*2*sizeof(int));
+
+	if (s.loading && s.ptr)
+	{
+		heap.clear();
+		for (size_t i=0;i<list.size();i++)
+		{
+			list[i].heap_idx=-1;
+			if (list[i].end!=-1)
+				heap_insert(i);
+		}
+	}
+}
@@ -40,3 +40,10 @@ void sh4_sched_request(int id, int cycles);
 void sh4_sched_tick(int cycles);
 
 extern u32 sh4_sched_intr;
+
+/*
+	Callbacks dispatched since the last vblank, and during the
+	previous frame. Used to measure the scheduler overhead
+*/
+extern u32 sh4_sched_dispatches;
+extern u32 sh4_sched_frame_dispatches;
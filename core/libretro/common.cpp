@@ -40,6 +40,8 @@
 #define UNW_FLAG_UHANDLER 0x02
 
 bool VramLockedWrite(u8* address);
+bool RewindLockedWrite(u8* address);
+bool RamLockedWrite(u8* address);
 bool ngen_Rewrite(size_t &addr, size_t retadr, size_t acc);
 bool BM_LockedWrite(u8* address);
 
@@ -59,8 +61,12 @@ static LONG ExceptionHandler(EXCEPTION_POINTERS *ExceptionInfo)
 
    //printf("[EXC] During access to : 0x%X\n", address);
 
+   if (RewindLockedWrite(address))
+      return EXCEPTION_CONTINUE_EXECUTION;
    if (VramLockedWrite(address))
       return EXCEPTION_CONTINUE_EXECUTION;
+   if (RamLockedWrite(address))
+      return EXCEPTION_CONTINUE_EXECUTION;
 #ifndef TARGET_NO_NVMEM
    if (BM_LockedWrite(address))
       return EXCEPTION_CONTINUE_EXECUTION;
@@ -74,6 +80,9 @@ static LONG ExceptionHandler(EXCEPTION_POINTERS *ExceptionInfo)
       ep->ContextRecord->Ecx=ep->ContextRecord->Eax;
       return EXCEPTION_CONTINUE_EXECUTION;
    }
+#elif FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+   if ( ngen_Rewrite((size_t&)ep->ContextRecord->Rip, 0, 0) )
+      return EXCEPTION_CONTINUE_EXECUTION;
 #endif
    else
    {
@@ -86,7 +95,7 @@ static LONG ExceptionHandler(EXCEPTION_POINTERS *ExceptionInfo)
 void os_MakeExecutable(void* ptr, u32 sz)
 {
    DWORD old;
-   VirtualProtect(ptr,sizeof(sz),PAGE_EXECUTE_READWRITE,&old);
+   VirtualProtect(ptr,sz,PAGE_EXECUTE_READWRITE,&old);
 }
 
 #ifdef _WIN64
@@ -270,6 +279,8 @@ static void context_to_segfault(rei_host_context_t* reictx, void* segfault_ctx)
 bool ngen_Rewrite(size_t& addr,size_t retadr,size_t acc);
 u32* ngen_readm_fail_v2(u32* ptr,u32* regs,u32 saddr);
 bool VramLockedWrite(u8* address);
+bool RewindLockedWrite(u8* address);
+bool RamLockedWrite(u8* address);
 bool BM_LockedWrite(u8* address);
 
 #ifdef __MACH__
@@ -310,8 +321,12 @@ printf("mprot hit @ ptr 0x%08X @@ code: %08X, %d\n", ctx.pc, dyna_cde);
 #endif
 
 
+   if (RewindLockedWrite((u8*)si->si_addr))
+      return;
    if (VramLockedWrite((u8*)si->si_addr))
       return;
+   if (RamLockedWrite((u8*)si->si_addr))
+      return;
 #ifndef TARGET_NO_NVMEM
    if (BM_LockedWrite((u8*)si->si_addr))
       return;
@@ -335,7 +350,11 @@ printf("mprot hit @ ptr 0x%08X @@ code: %08X, %d\n", ctx.pc, dyna_cde);
       context_to_segfault(&ctx, segfault_ctx);
    }
 #elif HOST_CPU == CPU_X64
-   //x64 has no rewrite support
+   if (dyna_cde && ngen_Rewrite((size_t&)ctx.pc, 0, 0))
+   {
+      //the access was patched to a slow path call, run it again
+      context_to_segfault(&ctx, segfault_ctx);
+   }
 #else
 #error JIT: Not supported arch
 #endif
@@ -466,6 +485,18 @@ void VArray2_UnLockRegion(VArray2 *varr, u32 offset,u32 size)
 #endif
 }
 
+#ifndef _WIN32
+void os_MakeExecutable(void* ptr, u32 sz)
+{
+   u32 inpage=(size_t)ptr & PAGE_MASK;
+   if (mprotect((u8*)ptr-inpage, sz+inpage, PROT_READ | PROT_WRITE | PROT_EXEC))
+   {
+      printf("mprotect(%p,%08X,RWX) failed: %d\n",(u8*)ptr-inpage,sz+inpage,errno);
+      die("mprotect  failed ..\n");
+   }
+}
+#endif
+
 static void ReserveBottomMemory(void)
 {
 #if defined(_WIN64) && defined(_DEBUG)
@@ -11,6 +11,8 @@
 #include <glsm/glsm.h>
 #endif
 #include "../rend/rend.h"
+#include "../serialize.h"
+#include "../rewind.h"
 
 #include "libretro.h"
 
@@ -29,6 +31,9 @@ bool enable_purupuru = true;
 bool inside_loop     = true;
 static bool first_run = true;
 
+static u32 rewind_buffer_mb = 0;
+static unsigned rewind_button = RETRO_DEVICE_ID_JOYPAD_SELECT;
+
 enum DreamcastController
 {
 	DC_BTN_C       = 1,
@@ -126,6 +131,12 @@ void retro_set_environment(retro_environment_t cb)
 #endif
             ,
       },
+#endif
+#ifdef HAVE_SOFTREND
+      {
+         "reicast_renderer",
+         "Renderer (restart); opengl|software",
+      },
 #endif
       {
          "reicast_boot_to_bios",
@@ -139,6 +150,32 @@ void retro_set_environment(retro_environment_t cb)
          "reicast_mipmapping",
          "Mipmapping; enabled|disabled",
       },
+#ifndef TARGET_NO_EXCEPTIONS
+      {
+         "reicast_vram_write_tracking",
+         "VRAM write tracking (restart); page_faults|software",
+      },
+#endif
+      {
+         "reicast_texture_cache_size",
+         "Texture cache size; 256MB|128MB|64MB|512MB|unlimited",
+      },
+#if !defined(TARGET_NO_THREADS) || defined(HAVE_SOFTREND)
+      {
+         "reicast_ta_streaming",
+         "TA list streaming; disabled|enabled",
+      },
+#endif
+#if !defined(TARGET_NO_THREADS)
+      {
+         "reicast_render_queue_depth",
+         "Render queue depth; 1|2|3|4",
+      },
+      {
+         "reicast_render_queue_policy",
+         "Render queue policy; drop_oldest|block|pipeline",
+      },
+#endif
       {
          "reicast_volume_modifier_mode",
          "Volume modifier mode; disabled|debug|on|full",
@@ -179,6 +216,20 @@ void retro_set_environment(retro_environment_t cb)
          "reicast_enable_purupuru",
          "Purupuru Pack (restart); enabled|disabled"
       },
+#if FEAT_DSPREC != DYNAREC_NONE
+      {
+         "reicast_enable_dsp",
+         "Enable AICA DSP; enabled|disabled"
+      },
+#endif
+      {
+         "reicast_rewind",
+         "Rewind buffer; disabled|32MB|64MB|128MB|256MB"
+      },
+      {
+         "reicast_rewind_button",
+         "Rewind hotkey (port 1); Select|L3|R3"
+      },
       { NULL, NULL },
    };
 
@@ -217,6 +268,7 @@ void retro_deinit(void)
 
 bool enable_rtt                 = true;
 static bool is_dupe             = false;
+static bool can_dupe            = false;
 static bool initialize_renderer = false;
 static bool resize_renderer     = false;
 static unsigned old_width       = 0;
@@ -276,6 +328,28 @@ static void update_variables(bool first_boot)
          settings.dynarec.Type = 1;
    }
 
+#ifdef HAVE_SOFTREND
+   var.key = "reicast_renderer";
+
+   if (first_boot)
+   {
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value && !strcmp(var.value, "software"))
+         settings.pvr.rend = 2;
+      else
+         settings.pvr.rend = 0;
+
+      // softrend.cpp is built with -msse4.1
+      unsigned cpu = perf_get_cpu_features_cb ? perf_get_cpu_features_cb() : 0;
+
+      if (settings.pvr.rend == 2 && !(cpu & RETRO_SIMD_SSE4))
+      {
+         if (log_cb)
+            log_cb(RETRO_LOG_WARN, "Software renderer needs SSE4.1, using the OpenGL renderer\n");
+         settings.pvr.rend = 0;
+      }
+   }
+#endif
+
    var.key = "reicast_boot_to_bios";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -300,6 +374,56 @@ static void update_variables(bool first_boot)
    else
       settings.rend.UseMipmaps		= 1;
 
+#ifdef TARGET_NO_EXCEPTIONS
+   /* no fault handler to catch writes to protected pages */
+   settings.pvr.VramSoftTracking = true;
+#else
+   var.key = "reicast_vram_write_tracking";
+
+   if (first_boot)
+      settings.pvr.VramSoftTracking = environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value
+         && !strcmp(var.value, "software");
+#endif
+
+   var.key = "reicast_texture_cache_size";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.rend.TexCacheBudget = strtoul(var.value, NULL, 0) << 20;
+   else
+      settings.rend.TexCacheBudget = 256 << 20;
+
+#if !defined(TARGET_NO_THREADS) || defined(HAVE_SOFTREND)
+   var.key = "reicast_ta_streaming";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.pvr.TAStreaming = !strcmp(var.value, "enabled");
+   else
+      settings.pvr.TAStreaming = false;
+#endif
+
+#if !defined(TARGET_NO_THREADS)
+   var.key = "reicast_render_queue_depth";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.pvr.RenderQueueDepth = atoi(var.value);
+   else
+      settings.pvr.RenderQueueDepth = 1;
+
+   var.key = "reicast_render_queue_policy";
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "block"))
+         settings.pvr.RenderQueuePolicy = RQ_BLOCK;
+      else if (!strcmp(var.value, "pipeline"))
+         settings.pvr.RenderQueuePolicy = RQ_PIPELINE;
+      else
+         settings.pvr.RenderQueuePolicy = RQ_DROP_OLDEST;
+   }
+   else
+      settings.pvr.RenderQueuePolicy = RQ_DROP_OLDEST;
+#endif
+
    var.key = "reicast_volume_modifier_mode";
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -416,6 +540,42 @@ static void update_variables(bool first_boot)
    var.key = "reicast_enable_purupuru";
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
       enable_purupuru = (strcmp("enabled", var.value) == 0);
+
+#if FEAT_DSPREC != DYNAREC_NONE
+   var.key = "reicast_enable_dsp";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      settings.aica.DSPEnabled = (strcmp("enabled", var.value) == 0);
+#endif
+
+   var.key = "reicast_rewind";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      rewind_buffer_mb = strtoul(var.value, NULL, 0);
+
+   var.key = "reicast_rewind_button";
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp("L3", var.value))
+         rewind_button = RETRO_DEVICE_ID_JOYPAD_L3;
+      else if (!strcmp("R3", var.value))
+         rewind_button = RETRO_DEVICE_ID_JOYPAD_R3;
+      else
+         rewind_button = RETRO_DEVICE_ID_JOYPAD_SELECT;
+   }
+}
+
+static void update_rewind(void)
+{
+   // A failed allocation isn't retried until the option changes
+   static u32 rewind_tried_mb = 0;
+   static bool rewind_failed = false;
+
+   if (rewind_buffer_mb == rewind_tried_mb &&
+         (rewind_enabled() || rewind_failed || !rewind_buffer_mb))
+      return;
+
+   rewind_term();
+   rewind_tried_mb = rewind_buffer_mb;
+   rewind_failed   = rewind_buffer_mb && !rewind_init(rewind_buffer_mb << 20);
 }
 
 
@@ -428,6 +588,11 @@ void retro_run (void)
    if (first_run)
    {
       dc_init(co_argc,co_argv);
+      if (initialize_renderer)
+      {
+         rend_initialization();
+         initialize_renderer = false;
+      }
       dc_run();
       first_run = false;
       return;
@@ -451,12 +616,27 @@ void retro_run (void)
                &new_av_info);
    }
 
+   update_rewind();
+
+   // While rewinding, frames only get shown, not recorded
+   bool rewound = rewind_enabled() &&
+      input_cb(0, RETRO_DEVICE_JOYPAD, 0, rewind_button) &&
+      rewind_pop();
+
    dc_run();
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 2)
+      video_cb(is_dupe && can_dupe ? NULL : rend_softrend_fb(), 640, 480, 640 * sizeof(u32));
+   else
+#endif
 #if defined(HAVE_OPENGL) || defined(HAVE_OPENGLES)
    video_cb(is_dupe ? 0 : RETRO_HW_FRAME_BUFFER_VALID, screen_width, screen_height, 0);
 #endif
    is_dupe     = true;
    inside_loop = true;
+
+   if (rewind_enabled() && !rewound)
+      rewind_push();
 }
 
 void retro_reset (void)
@@ -616,6 +796,18 @@ bool retro_load_game(const struct retro_game_info *game)
       }
    }
 
+#ifdef HAVE_SOFTREND
+   if (settings.pvr.rend == 2)
+   {
+      /* No hw context, retro_run hands the soft renderer's frames to video_cb */
+      environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe);
+#ifdef TARGET_NO_THREADS
+      initialize_renderer = true;
+#endif
+      return true;
+   }
+#endif
+
 #if defined(HAVE_OPENGL) || defined(HAVE_OPENGLES)
    params.context_reset         = context_reset;
    params.context_destroy       = context_destroy;
@@ -658,17 +850,24 @@ size_t retro_get_memory_size(unsigned type)
 
 size_t retro_serialize_size (void)
 {
-   return 0; //TODO
+   return dc_serialize_size();
 }
 
+// The machine only exists after the first retro_run
 bool retro_serialize(void *data, size_t size)
 {
-   return false; //TODO
+   if (first_run)
+      return false;
+
+   return dc_serialize(data, size);
 }
 
 bool retro_unserialize(const void * data, size_t size)
 {
-   return false; //TODO
+   if (first_run)
+      return false;
+
+   return dc_unserialize(data, size);
 }
 
 // Cheats
@@ -711,6 +910,17 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
    info->geometry.max_height   = screen_height;
    info->geometry.aspect_ratio = 4.0 / 3.0;
 
+#ifdef HAVE_SOFTREND
+   /* The soft renderer ignores the internal resolution */
+   if (settings.pvr.rend == 2)
+   {
+      info->geometry.base_width   = 640;
+      info->geometry.base_height  = 480;
+      info->geometry.max_width    = 640;
+      info->geometry.max_height   = 480;
+   }
+#endif
+
    switch (pixel_clock)
    {
       case 26944080:
@@ -807,7 +1017,13 @@ void UpdateInputState(u32 port)
    for (id = RETRO_DEVICE_ID_JOYPAD_B; id < RETRO_DEVICE_ID_JOYPAD_R3+1; ++id)
    {
       uint16_t dc_key = joymap[id];
-      bool is_down = input_cb(port, RETRO_DEVICE_JOYPAD, 0, id);
+      bool is_down;
+
+      // The rewind hotkey never reaches the guest
+      if (port == 0 && id == rewind_button && rewind_enabled())
+         continue;
+
+      is_down = input_cb(port, RETRO_DEVICE_JOYPAD, 0, id);
 
       switch (id)
       {
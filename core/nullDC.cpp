@@ -14,6 +14,7 @@
 #include "hw/naomi/naomi_cart.h"
 
 #include "reios/reios.h"
+#include "rewind.h"
 
 settings_t settings;
 
@@ -110,7 +111,12 @@ void plugins_Reset(bool Manual)
 static void LoadSpecialSettingsCPU(void)
 {
 #if FEAT_SHREC != DYNAREC_NONE
+#ifdef TARGET_NO_JIT
 	if(settings.dynarec.Enable)
+#else
+	//only the generic recompiler can raise mmu exceptions
+	if(settings.dynarec.Enable && !settings.MMUEnabled)
+#endif
 	{
 		Get_Sh4Recompiler(&sh4_cpu);
 		printf("Using Recompiler\n");
@@ -238,6 +244,7 @@ void dc_run(void)
 
 void dc_term(void)
 {
+	rewind_term();
 	sh4_cpu.Term();
 	plugins_Term();
 	_vmem_release();
@@ -262,13 +269,12 @@ void LoadSettings(void)
    settings.aica.NoSound			= 0;
 	settings.pvr.subdivide_transp	= 0;
 	settings.pvr.ta_skip			   = 0;
-	settings.pvr.rend				   = 0;
    settings.QueueRender          = 0;
    settings.pvr.Emulation.AlphaSortMode = 0;
    settings.pvr.Emulation.zMin         = 0.f;
    settings.pvr.Emulation.zMax         = 1.0f;
 
-	settings.pvr.MaxThreads			      = 3;
+	settings.pvr.MaxThreads			      = 0;	//soft renderer threads, 0 is one per core
 	settings.pvr.SynchronousRendering	= 0;
 
 	settings.debug.SerialConsole        = 0;
@@ -11,6 +11,8 @@
 #include "hw/sh4/sh4_core.h"
 #include "hw/sh4/dyna/ngen.h"
 #include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu_impl.h"
+#include "hw/mem/_vmem.h"
 #include "hw/sh4/dyna/regalloc.h"
 
 #define SHIL_MODE 2
@@ -681,6 +683,92 @@ struct opcode_writem_offs_imm : public opcodeExec {
 	}
 };
 
+//With the mmu, the address is *base + *offs + imm, with unused regs pointing at mmu_zero.
+//Software TLB hits go straight to _vmem, the rest sets next_pc for the exception
+//and takes the mmu_ReadMem/mmu_WriteMem path.
+static u32 mmu_zero;
+
+struct opcode_mem_mmu_base : public opcodeExec {
+	u32* base;
+	u32* offs;
+	u32 imm;
+	u32* data;
+	u32 pc;
+};
+
+template <int sz, u32 translation_type>
+struct opcode_mem_mmu : public opcode_mem_mmu_base {
+	void execute()  {
+		u32 a = *base + *offs + imm;
+		u32 pa;
+
+		if (mmu_data_probe<translation_type>(a, pa))
+		{
+			if (translation_type == MMU_TT_DREAD)
+			{
+				if (sz == 1) *data = (s32)(s8)_vmem_ReadMem8(pa);
+				else if (sz == 2) *data = (s32)(s16)_vmem_ReadMem16(pa);
+				else if (sz == 4) *data = _vmem_ReadMem32(pa);
+				else if (sz == 8) *(u64*)data = _vmem_ReadMem64(pa);
+			}
+			else
+			{
+				if (sz == 1) _vmem_WriteMem8(pa, *data);
+				else if (sz == 2) _vmem_WriteMem16(pa, *data);
+				else if (sz == 4) _vmem_WriteMem32(pa, *data);
+				else if (sz == 8) _vmem_WriteMem64(pa, *(u64*)data);
+			}
+		}
+		else
+		{
+			next_pc = pc;
+
+			if (translation_type == MMU_TT_DREAD)
+			{
+				if (sz == 1) *data = (s32)(s8)mmu_ReadMem8(a);
+				else if (sz == 2) *data = (s32)(s16)mmu_ReadMem16(a);
+				else if (sz == 4) *data = mmu_ReadMem32(a);
+				else if (sz == 8) *(u64*)data = mmu_ReadMem64(a);
+			}
+			else
+			{
+				if (sz == 1) mmu_WriteMem8(a, *data);
+				else if (sz == 2) mmu_WriteMem16(a, *data);
+				else if (sz == 4) mmu_WriteMem32(a, *data);
+				else if (sz == 8) mmu_WriteMem64(a, *(u64*)data);
+			}
+		}
+	}
+};
+
+//Sets next_pc as the interpreter has it for ops that can raise exceptions. In a delay
+//slot, the exception is reported at the branch, as ExecuteDelayslot does.
+struct opcode_mmu_pc : public opcodeExec {
+	opcodeExec* op;
+	u32 pc;
+	bool delay_slot;
+
+	void execute()  {
+		next_pc = pc;
+
+		if (!delay_slot)
+		{
+			op->execute();
+			return;
+		}
+
+		try
+		{
+			op->execute();
+		}
+		catch (SH4ThrownException ex)
+		{
+			ex.epc -= 2;
+			throw ex;
+		}
+	}
+};
+
 template<int end_type>
 struct opcode_blockend : public opcodeExec {
 	int next_pc_value;
@@ -1090,6 +1178,42 @@ public:
 
 	size_t opcode_index;
 	opcodeExec** ptrsg;
+
+	template <u32 translation_type>
+	static opcode_mem_mmu_base* new_mem_mmu(u32 size)
+	{
+		switch (size)
+		{
+			case 1: return new opcode_mem_mmu<1, translation_type>();
+			case 2: return new opcode_mem_mmu<2, translation_type>();
+			case 4: return new opcode_mem_mmu<4, translation_type>();
+			case 8: return new opcode_mem_mmu<8, translation_type>();
+		}
+
+		die("Invalid memory op size");
+		return 0;
+	}
+
+	opcodeExec* compile_mem_mmu(RuntimeBlockInfo* block, shil_opcode& op)
+	{
+		u32 size = op.flags & 0x7f;
+		bool write = op.op == shop_writem;
+
+		opcode_mem_mmu_base* opc = write ? new_mem_mmu<MMU_TT_DWRITE>(size) : new_mem_mmu<MMU_TT_DREAD>(size);
+
+		opc->base = op.rs1.is_imm() ? &mmu_zero : op.rs1.reg_ptr();
+		opc->imm = op.rs1.is_imm() ? op.rs1.imm_value() : 0;
+		opc->offs = op.rs3.is_reg() ? op.rs3.reg_ptr() : &mmu_zero;
+		if (op.rs3.is_imm())
+			opc->imm += op.rs3.imm_value();
+
+		opc->data = write ? op.rs2.reg_ptr() : op.rd.reg_ptr();
+
+		//exceptions are raised at next_pc - 2, which is the branch for a delay slot
+		opc->pc = block->addr + op.guest_offs + (op.delay_slot ? 0 : 2);
+
+		return opc;
+	}
 	void compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool staging, bool optimise) {
 		
 		//we need an extra one for the end opcode
@@ -1109,6 +1233,13 @@ public:
       {
 			opcode_index = i;
 			shil_opcode& op = block->oplist[i];
+
+			if (settings.MMUEnabled && (op.op == shop_readm || op.op == shop_writem))
+			{
+				ptrs.ptrs[i] = compile_mem_mmu(block, op);
+				continue;
+			}
+
 			switch (op.op) {
 
 			case shop_ifb:
@@ -1546,6 +1677,17 @@ public:
 				shil_chf[op.op](&op);
 				break;
 			}
+
+			if (settings.MMUEnabled && (op.op == shop_ifb || op.op == shop_pref))
+			{
+				opcode_mmu_pc* opc = new opcode_mmu_pc();
+
+				opc->op = ptrs.ptrs[i];
+				opc->pc = block->addr + op.guest_offs + 2;
+				opc->delay_slot = op.delay_slot;
+
+				ptrs.ptrs[i] = opc;
+			}
 		}
 
 		//Block end opcode
@@ -11,9 +11,84 @@
 #include "hw/sh4/dyna/ngen.h"
 #include "hw/sh4/sh4_mem.h"
 #include "hw/sh4/dyna/regalloc.h"
+#include "hw/mem/_vmem.h"
 #include "emitter/x86_emitter.h"
 
 extern int cycle_counter;
+extern bool inside_loop;
+
+//Runtime helpers, generated once by ngen_init_x64 below LastAddr_min
+static void (*mainloop)(void* v_cntx);
+static const void* no_update;		//dispatch on next_pc
+static const void* dispatch_ecx;	//dispatch on ecx, next_pc is updated
+static const void* intc_sched;		//end of timeslice, next_pc must be set
+static const void* ngen_LinkBlock_Generic_stub;
+static const void* ngen_LinkBlock_cond_Branch_stub;
+static const void* ngen_LinkBlock_cond_Next_stub;
+static const void* ngen_FailedToFindBlock_;
+
+/*
+	Fastmem
+
+	With the _vmem address space reserved, readm/writem access the guest
+	memory directly at virt_ram_base + (addr & 0x1FFFFFFF). Everything that
+	isn't RAM, VRAM or ARAM is left unmapped there, so MMIO accesses fault.
+	ngen_Rewrite then patches the access into a call to the matching
+	mem_slow handler, which goes through the _vmem handlers.
+
+	mem_slot holds the bytes of each access so the fault handler can tell
+	which one it hit, indexed as [write][log2(size)].
+*/
+#define FASTMEM_SLOT_SIZE 5
+static const void* mem_slow[2][4];
+static u8 mem_slot[2][4][FASTMEM_SLOT_SIZE];
+
+/*
+	Register allocation
+
+	Guest r32 registers are kept in the callee saved host registers for the
+	span the allocator gives them, so they survive every call out of the block.
+	Floats live in xmm8 and up. No xmm is callee saved on SysV, so the live
+	ones get spilled to the frame around each call. On win64 xmm6-15 are
+	callee saved, so the mainloop saves the ones we use on entry instead.
+
+	Blocks don't have a frame of their own, they run on the one set up by
+	the generated mainloop and jump to each other directly once linked.
+*/
+static const Xbyak::Operand::Code alloc_regs[] = {
+	Xbyak::Operand::RBX, Xbyak::Operand::RBP,
+	Xbyak::Operand::R12, Xbyak::Operand::R13,
+	Xbyak::Operand::R14, Xbyak::Operand::R15,
+	(Xbyak::Operand::Code)-1
+};
+
+static const s8 alloc_fpu[] = { 8, 9, 10, 11, 12, 13, 14, 15, -1 };
+
+#define ALLOC_FPU_COUNT 8
+
+//mainloop frame layout, relative to rsp inside blocks
+#define STACK_SHADOW 0x20	//win64 home space, harmless elsewhere
+#define STACK_XMM_SPILL STACK_SHADOW	//4 bytes per alloc_fpu reg, spilled around calls
+#ifdef _WIN32
+#define STACK_XMM_SAVE (STACK_XMM_SPILL + ALLOC_FPU_COUNT * 4)	//16 bytes per alloc_fpu reg
+#define STACK_SIZE (STACK_XMM_SAVE + ALLOC_FPU_COUNT * 16 + 8)
+#else
+#define STACK_SIZE (STACK_XMM_SPILL + ALLOC_FPU_COUNT * 4 + 8)
+#endif
+
+class BlockCompilerx64;
+
+struct x64_reg_alloc : RegAlloc<Xbyak::Operand::Code, s8, false>
+{
+	BlockCompilerx64* compiler;
+
+	x64_reg_alloc(BlockCompilerx64* compiler) : compiler(compiler) { }
+
+	virtual void Preload(u32 reg, Xbyak::Operand::Code nreg);
+	virtual void Writeback(u32 reg, Xbyak::Operand::Code nreg);
+	virtual void Preload_FPU(u32 reg, s8 nreg);
+	virtual void Writeback_FPU(u32 reg, s8 nreg);
+};
 
 class BlockCompilerx64 : public Xbyak::CodeGenerator{
 public:
@@ -22,7 +97,9 @@ public:
 	vector<Xbyak::Reg64> call_regs64;
 	vector<Xbyak::Xmm> call_regsxmm;
 
-	BlockCompilerx64() : Xbyak::CodeGenerator(64 * 1024, emit_GetCCPtr()) {
+	x64_reg_alloc regalloc;
+
+	BlockCompilerx64(void* code_ptr = emit_GetCCPtr()) : Xbyak::CodeGenerator(64 * 1024, code_ptr), regalloc(this) {
 #ifdef _WIN32
       call_regs.push_back(ecx);
       call_regs.push_back(edx);
@@ -65,173 +142,609 @@ public:
 			} \
 		} while (0)
 
-#define sh_to_reg_noimm(prm, op, rd) \
-		do {							\
-			if (prm.is_reg()) {							\
-				mov(rax, (size_t)prm.reg_ptr());	\
-				op(rd, dword[rax]);				\
-				}										\
-						else { \
-				verify(prm.is_null()); \
-				} \
-				} while (0)
-
-
-
-
 #define reg_to_sh(prm, rs) \
 		 do {	\
 				 mov(rax, (size_t)prm.reg_ptr());	\
 				 mov(dword[rax], rs);				\
 		 } while (0)
 
-#define reg_to_sh_ss(prm, rs) \
-		 do {	\
-				 mov(rax, (size_t)prm.reg_ptr());	\
-				 movss(dword[rax], rs);				\
-		 		 } while (0)
+	typedef void (BlockCompilerx64::*X64BinaryOp)(const Xbyak::Operand&, const Xbyak::Operand&);
+	typedef void (BlockCompilerx64::*X64BinaryOpImm)(const Xbyak::Operand&, u32);
+	typedef void (BlockCompilerx64::*X64BinaryFOp)(const Xbyak::Xmm&, const Xbyak::Operand&);
 
-	void compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool staging, bool optimise)
-   {
-		mov(rax, (size_t)&cycle_counter);
+	Xbyak::Reg32 mapg(const shil_param& prm) { return Xbyak::Reg32(regalloc.mapg(prm)); }
+	Xbyak::Xmm mapf(const shil_param& prm) { return Xbyak::Xmm(regalloc.mapf(prm)); }
 
-		sub(dword[rax], block->guest_cycles);
+	//true if every single register operand of the op lives in a host register
+	bool allocated(const shil_param& prm)
+	{
+		return !prm.is_reg() || (prm.is_r32() && regalloc.IsAllocAny(prm));
+	}
 
-		sub(rsp, 0x28);
+	bool can_native(shil_opcode& op)
+	{
+		return allocated(op.rd) && allocated(op.rd2) && allocated(op.rs1) && allocated(op.rs2) && allocated(op.rs3);
+	}
 
-		for (size_t i = 0; i < block->oplist.size(); i++) {
-			shil_opcode& op  = block->oplist[i];
-			switch (op.op) {
+	//load any r32 param (imm, host gpr, host xmm or memory) into a gpr
+	void load_u32(const Xbyak::Reg32& rd, const shil_param& prm)
+	{
+		if (prm.is_imm())
+			mov(rd, prm._imm);
+		else if (regalloc.IsAllocg(prm))
+		{
+			Xbyak::Reg32 rs = mapg(prm);
+			if (rs.getIdx() != rd.getIdx())
+				mov(rd, rs);
+		}
+		else if (regalloc.IsAllocf(prm))
+			movd(rd, mapf(prm));
+		else
+		{
+			verify(prm.is_reg());
+			mov(rax, (size_t)prm.reg_ptr());
+			mov(rd, dword[rax]);
+		}
+	}
 
-			case shop_ifb:
-				if (op.rs1._imm)
-				{
-					mov(rax, (size_t)&next_pc);
-					mov(dword[rax], op.rs2._imm);
-				}
+	//load any r32 param into an xmm
+	void load_f32(const Xbyak::Xmm& rd, const shil_param& prm)
+	{
+		if (prm.is_imm())
+		{
+			mov(eax, prm._imm);
+			movd(rd, eax);
+		}
+		else if (regalloc.IsAllocf(prm))
+		{
+			Xbyak::Xmm rs = mapf(prm);
+			if (rs.getIdx() != rd.getIdx())
+				movaps(rd, rs);
+		}
+		else if (regalloc.IsAllocg(prm))
+			movd(rd, mapg(prm));
+		else
+		{
+			verify(prm.is_reg());
+			mov(rax, (size_t)prm.reg_ptr());
+			movss(rd, dword[rax]);
+		}
+	}
 
-				mov(call_regs[0], op.rs3._imm);
+	//store a gpr into any r32 param. rax is clobbered for memory params
+	void store_u32(const shil_param& prm, const Xbyak::Reg32& rs)
+	{
+		if (regalloc.IsAllocg(prm))
+		{
+			Xbyak::Reg32 rd = mapg(prm);
+			if (rs.getIdx() != rd.getIdx())
+				mov(rd, rs);
+		}
+		else if (regalloc.IsAllocf(prm))
+			movd(mapf(prm), rs);
+		else
+		{
+			verify(rs.getIdx() != Xbyak::Operand::RAX);
+			reg_to_sh(prm, rs);
+		}
+	}
 
-				call((void*)OpDesc[op.rs3._imm]->oph);
-				break;
+	void store_f32(const shil_param& prm, const Xbyak::Xmm& rs)
+	{
+		if (regalloc.IsAllocf(prm))
+		{
+			Xbyak::Xmm rd = mapf(prm);
+			if (rs.getIdx() != rd.getIdx())
+				movaps(rd, rs);
+		}
+		else if (regalloc.IsAllocg(prm))
+			movd(mapg(prm), rs);
+		else
+		{
+			mov(rax, (size_t)prm.reg_ptr());
+			movss(dword[rax], rs);
+		}
+	}
 
-			case shop_jcond:
-			case shop_jdyn:
-				{
-					mov(rax, (size_t)op.rs1.reg_ptr());
+	//rd = rs1 op rs2, for allocated params
+	void GenBinaryOp(shil_opcode& op, X64BinaryOp natop, X64BinaryOpImm natopimm)
+	{
+		Xbyak::Reg32 rd = mapg(op.rd);
 
-					mov(ecx, dword[rax]);
+		if (op.rs2.is_reg() && mapg(op.rs2).getIdx() == rd.getIdx()
+			&& !(op.rs1.is_reg() && mapg(op.rs1).getIdx() == rd.getIdx()))
+		{
+			//rd aliases rs2, go through a scratch reg
+			load_u32(eax, op.rs1);
+			(this->*natop)(eax, rd);
+			mov(rd, eax);
+			return;
+		}
 
-					if (op.rs2.is_imm()) {
-						add(ecx, op.rs2._imm);
-					}
+		load_u32(rd, op.rs1);
+		if (op.rs2.is_imm())
+			(this->*natopimm)(rd, op.rs2._imm);
+		else
+			(this->*natop)(rd, mapg(op.rs2));
+	}
 
-					mov(rdx, (size_t)op.rd.reg_ptr());
-					mov(dword[rdx], ecx);
-				}
-				break;
+	void GenBinaryFOp(shil_opcode& op, X64BinaryFOp natop)
+	{
+		Xbyak::Xmm rd = mapf(op.rd);
+		Xbyak::Xmm rs1 = mapf(op.rs1);
+		Xbyak::Xmm rs2 = mapf(op.rs2);
+
+		if (rd.getIdx() == rs1.getIdx())
+			(this->*natop)(rd, rs2);
+		else if (rd.getIdx() != rs2.getIdx())
+		{
+			movaps(rd, rs1);
+			(this->*natop)(rd, rs2);
+		}
+		else
+		{
+			movaps(xmm0, rs1);
+			(this->*natop)(xmm0, rs2);
+			movaps(rd, xmm0);
+		}
+	}
+
+	//compare rs1 to rs2, then rd = condition
+	void GenSetCC(shil_opcode& op, void (BlockCompilerx64::*setcc)(const Xbyak::Operand&), bool test_op = false)
+	{
+		Xbyak::Reg32 rs1 = eax;
+		if (op.rs1.is_reg())
+			rs1 = mapg(op.rs1);
+		else
+			load_u32(eax, op.rs1);
+
+		if (test_op)
+		{
+			if (op.rs2.is_imm())
+				test(rs1, op.rs2._imm);
+			else
+				test(rs1, mapg(op.rs2));
+		}
+		else
+		{
+			if (op.rs2.is_imm())
+				cmp(rs1, op.rs2._imm);
+			else
+				cmp(rs1, mapg(op.rs2));
+		}
+
+		(this->*setcc)(al);
+		movzx(eax, al);
+		store_u32(op.rd, eax);
+	}
+
+	//The xmm regs that hold a live guest value at the current op
+	u32 LiveXmmMask()
+	{
+		u32 rv = 0;
+		for (size_t sid = 0; sid < regalloc.all_spans.size(); sid++)
+		{
+			x64_reg_alloc::RegSpan* spn = regalloc.all_spans[sid];
+			if (spn->fpr && spn->contains(regalloc.current_opid))
+				rv |= 1 << (spn->nregf - alloc_fpu[0]);
+		}
+		return rv;
+	}
+
+	void GenCall(const void* function)
+	{
+#ifndef _WIN32
+		u32 live = LiveXmmMask();
+
+		for (int i = 0; i < ALLOC_FPU_COUNT; i++)
+			if (live & (1 << i))
+				movss(dword[rsp + STACK_XMM_SPILL + i * 4], Xbyak::Xmm(alloc_fpu[i]));
+#endif
+
+		call(function);
+
+#ifndef _WIN32
+		for (int i = 0; i < ALLOC_FPU_COUNT; i++)
+			if (live & (1 << i))
+				movss(Xbyak::Xmm(alloc_fpu[i]), dword[rsp + STACK_XMM_SPILL + i * 4]);
+#endif
+	}
+
+	/*
+		The faulting access, r10 = virt_ram_base and rax = masked address.
+		r10 is scratch on both ABIs and never an argument register, so the
+		guest address is still in call_regs[0] when the slow path is called.
+		Reads leave the (sign extended) value in ecx or rcx, writes take it
+		from call_regs[1]. Padded so the call to the slow path fits over it.
+	*/
+	void GenFastmemSlot(bool write, u32 size)
+	{
+		size_t start = getSize();
+		if (!write)
+		{
+			switch (size)
+			{
+			case 1: movsx(ecx, byte[r10 + rax]); break;
+			case 2: movsx(ecx, word[r10 + rax]); break;
+			case 4: mov(ecx, dword[r10 + rax]); break;
+			case 8: mov(rcx, qword[r10 + rax]); break;
+			}
+		}
+		else
+		{
+			switch (size)
+			{
+			case 1: mov(byte[r10 + rax], call_regs[1].cvt8()); break;
+			case 2: mov(word[r10 + rax], call_regs[1].cvt16()); break;
+			case 4: mov(dword[r10 + rax], call_regs[1]); break;
+			case 8: mov(qword[r10 + rax], call_regs64[1]); break;
+			}
+		}
+
+		verify(getSize() - start <= FASTMEM_SLOT_SIZE);
+		while (getSize() - start < FASTMEM_SLOT_SIZE)
+			nop();
+	}
+
+	//address in call_regs[0], data in call_regs[1] for writes
+	void GenFastmem(bool write, u32 size)
+	{
+		mov(eax, call_regs[0]);
+		and_(eax, 0x1FFFFFFF);
 
-			case shop_mov32:
+		//mov r10, virt_ram_base, always the imm64 form, ngen_Rewrite checks for it
+		db(0x49);
+		db(0xBA);
+		db((size_t)virt_ram_base, 8);
+
+		GenFastmemSlot(write, size);
+	}
+
+	//Slow paths for faulting fastmem accesses, called with the block frame
+	void compile_mem_handlers()
+	{
+		static void* const handlers[2][4] =
+		{
+			{ (void*)ReadMem8, (void*)ReadMem16, (void*)ReadMem32, (void*)ReadMem64 },
+			{ (void*)WriteMem8, (void*)WriteMem16, (void*)WriteMem32, (void*)WriteMem64 },
+		};
+
+		for (int w = 0; w < 2; w++)
+		{
+			for (int i = 0; i < 4; i++)
 			{
-				verify(op.rd.is_reg());
+				mem_slow[w][i] = getCurr();
 
-				verify(op.rs1.is_reg() || op.rs1.is_imm());
+				sub(rsp, STACK_SIZE);
 
-				sh_to_reg(op.rs1, mov, ecx);
+#ifndef _WIN32
+				//the block can't tell this is a call, keep all its floats
+				for (int j = 0; j < ALLOC_FPU_COUNT; j++)
+					movss(dword[rsp + STACK_XMM_SPILL + j * 4], Xbyak::Xmm(alloc_fpu[j]));
+#endif
+
+				call(handlers[w][i]);
+
+				if (w == 0)
+				{
+					switch (i)
+					{
+					case 0: movsx(ecx, al); break;
+					case 1: movsx(ecx, ax); break;
+					case 2: mov(ecx, eax); break;
+					case 3: mov(rcx, rax); break;
+					}
+				}
+
+#ifndef _WIN32
+				for (int j = 0; j < ALLOC_FPU_COUNT; j++)
+					movss(Xbyak::Xmm(alloc_fpu[j]), dword[rsp + STACK_XMM_SPILL + j * 4]);
+#endif
 
-				reg_to_sh(op.rd, ecx);
+				add(rsp, STACK_SIZE);
+				ret();
 			}
+		}
+	}
+
+	void GenMemRewrite(u32 w, u32 i)
+	{
+		call(mem_slow[w][i]);
+		ready();
+	}
+
+	/*
+		The mainloop owns the only frame, and everything below is entered
+		with rsp 16 byte aligned.
+
+		no_update / dispatch_ecx look up the fpcb table and jump to the block.
+		intc_sched runs UpdateSystem and interrupts at the end of a timeslice,
+		then either dispatches next_pc or leaves the loop.
+	*/
+	void compile_mainloop()
+	{
+		Xbyak::Label lookup, check_loop, exit_loop;
+
+		mainloop = (void (*)(void*))getCurr();
+
+		push(rbx);
+		push(rbp);
+		push(r12);
+		push(r13);
+		push(r14);
+		push(r15);
+		sub(rsp, STACK_SIZE);
+
+#ifdef _WIN32
+		for (int i = 0; i < ALLOC_FPU_COUNT; i++)
+			movdqu(ptr[rsp + STACK_XMM_SAVE + i * 16], Xbyak::Xmm(alloc_fpu[i]));
+#endif
+
+		mov(rax, (size_t)&cycle_counter);
+		mov(dword[rax], SH4_TIMESLICE);
+		jmp(check_loop, T_NEAR);
+
+		intc_sched = getCurr();
+		mov(rax, (size_t)&cycle_counter);
+		add(dword[rax], SH4_TIMESLICE);
+		call((void*)UpdateSystem);
+		test(eax, eax);
+		jz(check_loop, T_NEAR);
+		mov(rax, (size_t)&next_pc);
+		mov(call_regs[0], dword[rax]);
+		call((void*)rdv_DoInterrupts_pc);
+
+		L(check_loop);
+		mov(rax, (size_t)&inside_loop);
+		cmp(byte[rax], 0);
+		je(exit_loop, T_NEAR);
+
+		no_update = getCurr();
+		mov(rax, (size_t)&next_pc);
+		mov(ecx, dword[rax]);
+		jmp(lookup, T_NEAR);
+
+		dispatch_ecx = getCurr();
+		mov(rax, (size_t)&next_pc);
+		mov(dword[rax], ecx);
+
+		L(lookup);
+		//FPCA(pc)
+		shr(ecx, 1);
+		and_(ecx, FPCB_MASK);
+		mov(rax, (size_t)&p_sh4rcb);
+		mov(rax, qword[rax]);
+		jmp(qword[rax + rcx * 8]);
+
+		L(exit_loop);
+#ifdef _WIN32
+		for (int i = 0; i < ALLOC_FPU_COUNT; i++)
+			movdqu(Xbyak::Xmm(alloc_fpu[i]), ptr[rsp + STACK_XMM_SAVE + i * 16]);
+#endif
+		add(rsp, STACK_SIZE);
+		pop(r15);
+		pop(r14);
+		pop(r13);
+		pop(r12);
+		pop(rbp);
+		pop(rbx);
+		ret();
+
+		//jumped to from the fpcb table
+		ngen_FailedToFindBlock_ = getCurr();
+		mov(rax, (size_t)&next_pc);
+		mov(call_regs[0], dword[rax]);
+		call((void*)rdv_FailedToFindBlock);
+		jmp(rax);
+
+		//called from the block exits, the return address identifies the block
+		Xbyak::Label link_shared;
+
+		ngen_LinkBlock_Generic_stub = getCurr();
+		mov(call_regs[1], ecx);		//dynamic target pc, if any
+		jmp(link_shared);
+
+		ngen_LinkBlock_cond_Branch_stub = getCurr();
+		mov(call_regs[1], 1);
+		jmp(link_shared);
+
+		ngen_LinkBlock_cond_Next_stub = getCurr();
+		mov(call_regs[1], 0);
+
+		L(link_shared);
+		pop(call_regs64[0]);
+		sub(call_regs64[0], 5);		//go before the call
+		call((void*)rdv_LinkBlock);
+		jmp(rax);
+
+		ready();
+	}
+
+	//Fixed size of the relinkable block tail, every variant is padded to it
+	static u32 relink_size(BlockEndType bt)
+	{
+		switch (bt)
+		{
+		case BET_StaticJump:
+		case BET_StaticCall:
+			return 5;
+		case BET_Cond_0:
+		case BET_Cond_1:
+			return 10 + 3 + 2 + 5 + 5;
+		case BET_DynamicJump:
+		case BET_DynamicCall:
+		case BET_DynamicRet:
+			return 10 + 2 + 6 + 6 + 5;
+		default:
+			return 10 + 2 + 10 + 2 + 5 + 5;
+		}
+	}
+
+	/*
+		The block tail, re-emitted in place by Relink().
+
+		Static and conditional exits call a link stub until the target is
+		known, then become direct jumps. Dynamic exits cache the first target
+		seen, and fall back to the fpcb table once a second one shows up.
+	*/
+	void compile_relink(RuntimeBlockInfo* block)
+	{
+		size_t start = getSize();
+
+		switch (block->BlockType) {
+
+		case BET_StaticJump:
+		case BET_StaticCall:
+			if (block->pBranchBlock)
+				jmp((const void*)block->pBranchBlock->code, T_NEAR);
+			else
+				call(ngen_LinkBlock_Generic_stub);
 			break;
 
-			case shop_mov64:
+		case BET_Cond_0:
+		case BET_Cond_1:
 			{
-				verify(op.rd.is_reg());
+				Xbyak::Label next;
+
+				if (block->has_jcond)
+					mov(rax, (size_t)&Sh4cntx.jdyn);
+				else
+					mov(rax, (size_t)&sr.T);
 
-				verify(op.rs1.is_reg() || op.rs1.is_imm());
+				cmp(dword[rax], block->BlockType & 1);
+				jne(next, T_SHORT);
 
-				sh_to_reg(op.rs1, mov, rcx);
+				if (block->pBranchBlock)
+					jmp((const void*)block->pBranchBlock->code, T_NEAR);
+				else
+					call(ngen_LinkBlock_cond_Branch_stub);
 
-				reg_to_sh(op.rd, rcx);
+				L(next);
+				if (block->pNextBlock)
+					jmp((const void*)block->pNextBlock->code, T_NEAR);
+				else
+					call(ngen_LinkBlock_cond_Next_stub);
 			}
 			break;
 
-			case shop_readm:
+		case BET_DynamicJump:
+		case BET_DynamicCall:
+		case BET_DynamicRet:
+			mov(rax, (size_t)&Sh4cntx.jdyn);
+			mov(ecx, dword[rax]);
+
+			if (block->relink_data != 0)
+			{
+				//more than one target seen, always go through the table
+				jmp(dispatch_ecx, T_NEAR);
+			}
+			else
 			{
-				sh_to_reg(op.rs1, mov, call_regs[0]);
-				sh_to_reg(op.rs3, add, call_regs[0]);
+				if (block->pBranchBlock)
+				{
+					cmp(ecx, block->pBranchBlock->addr);
+					je((const void*)block->pBranchBlock->code);
+				}
 
-				u32 size = op.flags & 0x7f;
+				while (getSize() - start < relink_size(block->BlockType) - 5)
+					nop();
+				call(ngen_LinkBlock_Generic_stub);
+			}
+			break;
 
-            switch (size)
-            {
-               case 1:
-                  call((void*)ReadMem8);
-                  movsx(rcx, al);
-
-                  reg_to_sh(op.rd, ecx);
-                  break;
-               case 2:
-                  call((void*)ReadMem16);
-                  movsx(rcx, ax);
-
-                  reg_to_sh(op.rd, ecx);
-                  break;
-               case 4:
-                  call((void*)ReadMem32);
-                  mov(rcx, rax);
-
-                  reg_to_sh(op.rd, ecx);
-                  break;
-               case 8:
-                  call((void*)ReadMem64);
-                  mov(rcx, rax);
-
-                  reg_to_sh(op.rd, rcx);
-                  break;
-               default:
-                  die("1..8 bytes");
-                  break;
-            }
+		case BET_DynamicIntr:
+		case BET_StaticIntr:
+			if (block->BlockType == BET_DynamicIntr) {
+				//next_pc = *jdyn;
+				mov(rax, (size_t)&Sh4cntx.jdyn);
+				mov(ecx, dword[rax]);
+				mov(rax, (size_t)&next_pc);
+				mov(dword[rax], ecx);
+			}
+			else {
+				//next_pc = next_pc_value;
+				mov(rax, (size_t)&next_pc);
+				mov(dword[rax], block->NextBlock);
 			}
+
+			call((void*)UpdateINTC);
+			jmp(no_update, T_NEAR);
 			break;
 
-			case shop_writem:
+		default:
+			die("Invalid block end type");
+		}
+
+		verify(getSize() - start <= relink_size(block->BlockType));
+		while (getSize() - start < relink_size(block->BlockType))
+			nop();
+	}
+
+	//Compares the guest code with what it was when compiled, and recompiles on
+	//a difference. Like CheckBlock in the x86 backend
+	void check_block(RuntimeBlockInfo* block)
+	{
+		Xbyak::Label fail, body;
+		s32 sz = block->sh4_code_size;
+		u32 sa = block->addr;
+
+		while (sz > 0)
+		{
+			void* ptr = (void*)GetMemPtr(sa, 4);
+			if (ptr)
 			{
-				u32 size = op.flags & 0x7f;
-				sh_to_reg(op.rs1, mov, call_regs[0]);
-				sh_to_reg(op.rs3, add, call_regs[0]);
-
-            switch (size)
-            {
-               case 1:
-                  sh_to_reg(op.rs2, mov, call_regs[1]);
-                  call((void*)WriteMem8);
-                  break;
-               case 2:
-                  sh_to_reg(op.rs2, mov, call_regs[1]);
-                  call((void*)WriteMem16);
-                  break;
-               case 4:
-                  sh_to_reg(op.rs2, mov, call_regs[1]);
-                  call((void*)WriteMem32);
-                  break;
-               case 8:
-                  sh_to_reg(op.rs2, mov, call_regs64[1]);
-                  call((void*)WriteMem64);
-                  break;
-               default:
-                  die("1..8 bytes");
-                  break;
-            }
+				mov(rax, (size_t)ptr);
+				if (sz == 2)
+					cmp(word[rax], *(u16*)ptr);
+				else
+					cmp(dword[rax], *(u32*)ptr);
+				jne(fail, T_NEAR);
 			}
-			break;
+			sz -= 4;
+			sa += 4;
+		}
+		jmp(body, T_NEAR);
+
+		L(fail);
+		mov(call_regs[0], block->addr);
+		call((void*)rdv_BlockCheckFail);
+		jmp(rax);
 
-			default:
+		L(body);
+	}
+
+	void compile(RuntimeBlockInfo* block, bool force_checks, bool reset, bool staging, bool optimise)
+   {
+		regalloc.DoAlloc(block, alloc_regs, alloc_fpu);
+
+		//The blocks on write protected pages are dropped by the first write.
+		//Pages written too often for that aren't protected, the blocks there
+		//check their code, whatever force_checks (unstable_opt) says
+		if (bm_BlockUnprotected(block))
+			check_block(block);
+
+		for (size_t i = 0; i < block->oplist.size(); i++) {
+			shil_opcode& op  = block->oplist[i];
+
+			regalloc.OpBegin(&op, i);
+
+			if (!can_native(op) && op.op != shop_ifb && op.op != shop_mov64
+				&& op.op != shop_readm && op.op != shop_writem)
 				shil_chf[op.op](&op);
-				break;
-			}
+			else
+				compile_opcode(op);
+
+			regalloc.OpEnd(&op);
 		}
 
+		//the cycle check is folded into the exit, linked blocks only leave
+		//for the mainloop once the timeslice is over
+		Xbyak::Label link;
+
+		mov(rax, (size_t)&cycle_counter);
+		sub(dword[rax], block->guest_cycles);
+		jg(link, T_NEAR);
+
 		mov(rax, (size_t)&next_pc);
 
 		switch (block->BlockType) {
@@ -294,15 +807,525 @@ public:
 			die("Invalid block end type");
 		}
 
+		jmp(intc_sched, T_NEAR);
 
-		add(rsp, 0x28);
-		ret();
+		L(link);
+		block->relink_offset = getSize();
+		block->relink_data = 0;
+		compile_relink(block);
 
 		ready();
 
 		block->code = (DynarecCodeEntryPtr)getCode();
+		block->host_code_size = getSize();
 
 		emit_Skip(getSize());
+
+		regalloc.Cleanup();
+	}
+
+	void compile_opcode(shil_opcode& op)
+	{
+		switch (op.op) {
+
+		case shop_ifb:
+			if (op.rs1._imm)
+			{
+				mov(rax, (size_t)&next_pc);
+				mov(dword[rax], op.rs2._imm);
+			}
+
+			mov(call_regs[0], op.rs3._imm);
+
+			GenCall((void*)OpDesc[op.rs3._imm]->oph);
+			break;
+
+		case shop_jcond:
+		case shop_jdyn:
+			load_u32(ecx, op.rs1);
+			if (op.rs2.is_imm())
+				add(ecx, op.rs2._imm);
+			store_u32(op.rd, ecx);
+			break;
+
+		case shop_mov32:
+			verify(op.rd.is_reg());
+			verify(op.rs1.is_reg() || op.rs1.is_imm());
+
+			if (regalloc.IsAllocf(op.rd))
+				load_f32(mapf(op.rd), op.rs1);
+			else
+				load_u32(mapg(op.rd), op.rs1);
+			break;
+
+		case shop_mov64:
+			verify(op.rd.is_reg());
+			verify(op.rs1.is_reg());
+
+			mov(rax, (size_t)op.rs1.reg_ptr());
+			mov(rcx, qword[rax]);
+			mov(rax, (size_t)op.rd.reg_ptr());
+			mov(qword[rax], rcx);
+			break;
+
+		case shop_readm:
+			{
+				load_u32(call_regs[0], op.rs1);
+				if (!op.rs3.is_null())
+				{
+					if (op.rs3.is_imm())
+						add(call_regs[0], op.rs3._imm);
+					else
+					{
+						load_u32(eax, op.rs3);
+						add(call_regs[0], eax);
+					}
+				}
+
+				u32 size = op.flags & 0x7f;
+
+				if (_nvmem_enabled())
+					GenFastmem(false, size);
+				else switch (size)
+				{
+				case 1:
+					GenCall((void*)ReadMem8);
+					movsx(ecx, al);
+					break;
+				case 2:
+					GenCall((void*)ReadMem16);
+					movsx(ecx, ax);
+					break;
+				case 4:
+					GenCall((void*)ReadMem32);
+					mov(ecx, eax);
+					break;
+				case 8:
+					GenCall((void*)ReadMem64);
+					mov(rcx, rax);
+					break;
+				default:
+					die("1..8 bytes");
+					break;
+				}
+
+				if (size != 8)
+					store_u32(op.rd, ecx);
+				else
+					reg_to_sh(op.rd, rcx);
+			}
+			break;
+
+		case shop_writem:
+			{
+				u32 size = op.flags & 0x7f;
+
+				load_u32(call_regs[0], op.rs1);
+				if (!op.rs3.is_null())
+				{
+					if (op.rs3.is_imm())
+						add(call_regs[0], op.rs3._imm);
+					else
+					{
+						load_u32(eax, op.rs3);
+						add(call_regs[0], eax);
+					}
+				}
+
+				if (size == 8)
+				{
+					mov(rax, (size_t)op.rs2.reg_ptr());
+					mov(call_regs64[1], qword[rax]);
+				}
+				else
+					load_u32(call_regs[1], op.rs2);
+
+				if (_nvmem_enabled())
+					GenFastmem(true, size);
+				else switch (size)
+				{
+				case 1:
+					GenCall((void*)WriteMem8);
+					break;
+				case 2:
+					GenCall((void*)WriteMem16);
+					break;
+				case 4:
+					GenCall((void*)WriteMem32);
+					break;
+				case 8:
+					GenCall((void*)WriteMem64);
+					break;
+				default:
+					die("1..8 bytes");
+					break;
+				}
+			}
+			break;
+
+		case shop_and:
+			GenBinaryOp(op, &BlockCompilerx64::and_, &BlockCompilerx64::and_);
+			break;
+		case shop_or:
+			GenBinaryOp(op, &BlockCompilerx64::or_, &BlockCompilerx64::or_);
+			break;
+		case shop_xor:
+			GenBinaryOp(op, &BlockCompilerx64::xor_, &BlockCompilerx64::xor_);
+			break;
+		case shop_add:
+			GenBinaryOp(op, &BlockCompilerx64::add, &BlockCompilerx64::add);
+			break;
+		case shop_sub:
+			GenBinaryOp(op, &BlockCompilerx64::sub, &BlockCompilerx64::sub);
+			break;
+
+		case shop_not:
+		case shop_neg:
+			{
+				Xbyak::Reg32 rd = mapg(op.rd);
+				load_u32(rd, op.rs1);
+				if (op.op == shop_not)
+					not_(rd);
+				else
+					neg(rd);
+			}
+			break;
+
+		case shop_shl:
+		case shop_shr:
+		case shop_sar:
+		case shop_ror:
+			{
+				Xbyak::Reg32 rd = mapg(op.rd);
+
+				if (op.rs2.is_imm())
+				{
+					load_u32(rd, op.rs1);
+					switch (op.op)
+					{
+					case shop_shl: shl(rd, op.rs2._imm & 0x1F); break;
+					case shop_shr: shr(rd, op.rs2._imm & 0x1F); break;
+					case shop_sar: sar(rd, op.rs2._imm & 0x1F); break;
+					default:       ror(rd, op.rs2._imm & 0x1F); break;
+					}
+				}
+				else
+				{
+					//the amount has to go through cl, load it before rd is overwritten
+					load_u32(ecx, op.rs2);
+					load_u32(rd, op.rs1);
+					switch (op.op)
+					{
+					case shop_shl: shl(rd, cl); break;
+					case shop_shr: shr(rd, cl); break;
+					case shop_sar: sar(rd, cl); break;
+					default:       ror(rd, cl); break;
+					}
+				}
+			}
+			break;
+
+		case shop_adc:
+		case shop_sbc:
+			//64 bit math on zero extended values gives the carry in the high word
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			load_u32(edx, op.rs3);
+			if (op.op == shop_adc)
+			{
+				add(rax, rcx);
+				add(rax, rdx);
+			}
+			else
+			{
+				sub(rax, rcx);
+				sub(rax, rdx);
+			}
+			mov(rcx, rax);
+			shr(rcx, 32);
+			if (op.op == shop_sbc)
+				and_(ecx, 1);
+			store_u32(op.rd, eax);
+			store_u32(op.rd2, ecx);
+			break;
+
+		case shop_rocl:
+			load_u32(eax, op.rs1);
+			load_u32(edx, op.rs2);
+			mov(ecx, eax);
+			shr(ecx, 31);
+			add(eax, eax);
+			or_(eax, edx);
+			store_u32(op.rd, eax);
+			store_u32(op.rd2, ecx);
+			break;
+
+		case shop_rocr:
+			load_u32(eax, op.rs1);
+			load_u32(edx, op.rs2);
+			mov(ecx, eax);
+			and_(ecx, 1);
+			shl(edx, 31);
+			shr(eax, 1);
+			or_(eax, edx);
+			store_u32(op.rd, eax);
+			store_u32(op.rd2, ecx);
+			break;
+
+		case shop_swaplb:
+			load_u32(eax, op.rs1);
+			ror(ax, 8);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_shld:
+		case shop_shad:
+			{
+				Xbyak::Label negative, zero, done;
+
+				load_u32(eax, op.rs1);
+				load_u32(ecx, op.rs2);
+
+				test(ecx, ecx);
+				js(negative, T_SHORT);
+				shl(eax, cl);
+				jmp(done, T_SHORT);
+
+				L(negative);
+				and_(ecx, 0x1F);
+				jz(zero, T_SHORT);
+				neg(ecx);	//(~r2 & 0x1F) + 1, modulo 32
+				if (op.op == shop_shld)
+					shr(eax, cl);
+				else
+					sar(eax, cl);
+				jmp(done, T_SHORT);
+
+				L(zero);
+				if (op.op == shop_shld)
+					xor_(eax, eax);
+				else
+					sar(eax, 31);
+
+				L(done);
+				store_u32(op.rd, eax);
+			}
+			break;
+
+		case shop_ext_s8:
+			load_u32(eax, op.rs1);
+			movsx(eax, al);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_ext_s16:
+			load_u32(eax, op.rs1);
+			movsx(eax, ax);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_mul_u16:
+		case shop_mul_s16:
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			if (op.op == shop_mul_u16)
+			{
+				movzx(eax, ax);
+				movzx(ecx, cx);
+			}
+			else
+			{
+				movsx(eax, ax);
+				movsx(ecx, cx);
+			}
+			imul(eax, ecx);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_mul_i32:
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			imul(eax, ecx);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_mul_u64:
+		case shop_mul_s64:
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			if (op.op == shop_mul_s64)
+			{
+				movsxd(rax, eax);
+				movsxd(rcx, ecx);
+			}
+			imul(rax, rcx);
+			mov(rcx, rax);
+			shr(rcx, 32);
+			store_u32(op.rd, eax);
+			store_u32(op.rd2, ecx);
+			break;
+
+		case shop_div32u:
+		case shop_div32s:
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			if (op.op == shop_div32u)
+			{
+				xor_(edx, edx);
+				div(ecx);
+			}
+			else
+			{
+				cdq();
+				idiv(ecx);
+			}
+			mov(ecx, edx);
+			store_u32(op.rd, eax);
+			store_u32(op.rd2, ecx);
+			break;
+
+		case shop_div32p2:
+			//if (!T) a-=b;
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			load_u32(edx, op.rs3);
+			mov(r8d, eax);
+			sub(r8d, ecx);
+			test(edx, edx);
+			cmovz(eax, r8d);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_test:
+			GenSetCC(op, &BlockCompilerx64::setz, true);
+			break;
+		case shop_seteq:
+			GenSetCC(op, &BlockCompilerx64::sete);
+			break;
+		case shop_setge:
+			GenSetCC(op, &BlockCompilerx64::setge);
+			break;
+		case shop_setgt:
+			GenSetCC(op, &BlockCompilerx64::setg);
+			break;
+		case shop_setae:
+			GenSetCC(op, &BlockCompilerx64::setae);
+			break;
+		case shop_setab:
+			GenSetCC(op, &BlockCompilerx64::seta);
+			break;
+
+		case shop_setpeq:
+			//any byte of rs1^rs2 zero: (v - 0x01010101) & ~v & 0x80808080
+			load_u32(eax, op.rs1);
+			load_u32(ecx, op.rs2);
+			xor_(eax, ecx);
+			mov(ecx, eax);
+			not_(ecx);
+			sub(eax, 0x01010101);
+			and_(eax, ecx);
+			test(eax, 0x80808080);
+			setnz(al);
+			movzx(eax, al);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_fadd:
+			GenBinaryFOp(op, &BlockCompilerx64::addss);
+			break;
+		case shop_fsub:
+			GenBinaryFOp(op, &BlockCompilerx64::subss);
+			break;
+		case shop_fmul:
+			GenBinaryFOp(op, &BlockCompilerx64::mulss);
+			break;
+		case shop_fdiv:
+			GenBinaryFOp(op, &BlockCompilerx64::divss);
+			break;
+
+		case shop_fabs:
+		case shop_fneg:
+			load_u32(eax, op.rs1);
+			if (op.op == shop_fabs)
+				and_(eax, 0x7FFFFFFF);
+			else
+				xor_(eax, 0x80000000);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_fsqrt:
+			load_f32(xmm0, op.rs1);
+			sqrtss(xmm0, xmm0);
+			store_f32(op.rd, xmm0);
+			break;
+
+		case shop_fsrra:
+			load_f32(xmm0, op.rs1);
+			sqrtss(xmm0, xmm0);
+			mov(eax, 0x3F800000);	//1.f
+			movd(xmm1, eax);
+			divss(xmm1, xmm0);
+			store_f32(op.rd, xmm1);
+			break;
+
+		case shop_fmac:
+			//rd = rs1 + rs2 * rs3, unfused like the canonical version
+			load_f32(xmm0, op.rs2);
+			load_f32(xmm1, op.rs3);
+			mulss(xmm0, xmm1);
+			load_f32(xmm1, op.rs1);
+			addss(xmm0, xmm1);
+			store_f32(op.rd, xmm0);
+			break;
+
+		case shop_fseteq:
+			load_f32(xmm0, op.rs1);
+			load_f32(xmm1, op.rs2);
+			ucomiss(xmm0, xmm1);
+			sete(al);
+			setnp(cl);	//unordered compares set ZF too
+			and_(al, cl);
+			movzx(eax, al);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_fsetgt:
+			load_f32(xmm0, op.rs1);
+			load_f32(xmm1, op.rs2);
+			ucomiss(xmm0, xmm1);
+			seta(al);
+			movzx(eax, al);
+			store_u32(op.rd, eax);
+			break;
+
+		case shop_cvt_f2i_t:
+			{
+				//positive overflow clamps to 0x7FFFFF80, the rest (NaN too) is cvttss2si
+				Xbyak::Label no_clamp;
+
+				load_f32(xmm0, op.rs1);
+				cvttss2si(eax, xmm0);
+				mov(ecx, 0x4EFFFFFF);	//(float)0x7FFFFFBF
+				movd(xmm1, ecx);
+				ucomiss(xmm0, xmm1);
+				jbe(no_clamp, T_SHORT);
+				mov(eax, 0x7FFFFF80);
+				L(no_clamp);
+				store_u32(op.rd, eax);
+			}
+			break;
+
+		case shop_cvt_i2f_n:
+		case shop_cvt_i2f_z:
+			load_u32(eax, op.rs1);
+			cvtsi2ss(xmm0, eax);
+			store_f32(op.rd, xmm0);
+			break;
+
+		default:
+			shil_chf[op.op](&op);
+			break;
+		}
 	}
 
 	struct CC_PS
@@ -335,17 +1358,17 @@ public:
 		case CPT_u64rvL:
 		case CPT_u32rv:
 			mov(rcx, rax);
-			reg_to_sh(prm, ecx);
+			store_u32(prm, ecx);
 			break;
 
 		case CPT_u64rvH:
 			shr(rcx, 32);
-			reg_to_sh(prm, ecx);
+			store_u32(prm, ecx);
 			break;
 
-			//Store from ST(0)
+			//Store from xmm0
 		case CPT_f32rv:
-			reg_to_sh_ss(prm, xmm0);
+			store_f32(prm, xmm0);
 			break;
 		}
 	}
@@ -364,11 +1387,12 @@ public:
             //push the contents
 
             case CPT_u32:
-               sh_to_reg(prm, mov, call_regs[regused++]);
+               load_u32(call_regs[regused++], prm);
                break;
 
             case CPT_f32:
-               sh_to_reg_noimm(prm, movss, call_regsxmm[xmmused++]);
+               verify(prm.is_reg());
+               load_f32(call_regsxmm[xmmused++], prm);
                break;
 
                //push the ptr itself
@@ -377,16 +1401,38 @@ public:
 
                mov(call_regs64[regused++], (size_t)prm.reg_ptr());
 
-               //die("FAIL");
-
                break;
          }
 		}
-		call(function);
+		GenCall(function);
 	}
 
 };
 
+void x64_reg_alloc::Preload(u32 reg, Xbyak::Operand::Code nreg)
+{
+	compiler->mov(compiler->rax, (size_t)GetRegPtr(reg));
+	compiler->mov(Xbyak::Reg32(nreg), compiler->dword[compiler->rax]);
+}
+
+void x64_reg_alloc::Writeback(u32 reg, Xbyak::Operand::Code nreg)
+{
+	compiler->mov(compiler->rax, (size_t)GetRegPtr(reg));
+	compiler->mov(compiler->dword[compiler->rax], Xbyak::Reg32(nreg));
+}
+
+void x64_reg_alloc::Preload_FPU(u32 reg, s8 nreg)
+{
+	compiler->mov(compiler->rax, (size_t)GetRegPtr(reg));
+	compiler->movss(Xbyak::Xmm(nreg), compiler->dword[compiler->rax]);
+}
+
+void x64_reg_alloc::Writeback_FPU(u32 reg, s8 nreg)
+{
+	compiler->mov(compiler->rax, (size_t)GetRegPtr(reg));
+	compiler->movss(compiler->dword[compiler->rax], Xbyak::Xmm(nreg));
+}
+
 void ngen_Compile_x64(RuntimeBlockInfo* block, bool force_checks, bool reset, bool staging, bool optimise)
 {
 	verify(emit_FreeSpace() >= 16 * 1024);
@@ -394,12 +1440,82 @@ void ngen_Compile_x64(RuntimeBlockInfo* block, bool force_checks, bool reset, bo
 	compiler_data = static_cast<void*>(new BlockCompilerx64());
 
    BlockCompilerx64 *compiler = (BlockCompilerx64*)compiler_data;
-	
+
 	compiler->compile(block, force_checks, reset, staging, optimise);
 
 	delete compiler;
 }
 
+u32 ngen_Relink_x64(RuntimeBlockInfo* block)
+{
+	BlockCompilerx64 compiler((u8*)block->code + block->relink_offset);
+
+	compiler.compile_relink(block);
+	compiler.ready();
+
+	return compiler.getSize();
+}
+
+bool ngen_Rewrite(size_t& addr, size_t retadr, size_t acc)
+{
+	u8* code = (u8*)addr;
+
+	if (!_nvmem_enabled() || code < CodeCache + 10 || code + FASTMEM_SLOT_SIZE > CodeCache + CODE_SIZE)
+		return false;
+
+	//mov r10, virt_ram_base
+	if (code[-10] != 0x49 || code[-9] != 0xBA || *(u64*)(code - 8) != (u64)(size_t)virt_ram_base)
+		return false;
+
+	for (int w = 0; w < 2; w++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if (memcmp(code, mem_slot[w][i], FASTMEM_SLOT_SIZE) == 0)
+			{
+				//call the slow path from the same spot, registers are still intact
+				BlockCompilerx64 compiler(code);
+				compiler.GenMemRewrite(w, i);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void ngen_mainloop_x64(void* v_cntx)
+{
+	mainloop(v_cntx);
+}
+
+void ngen_init_x64(void)
+{
+	BlockCompilerx64 compiler;
+
+	compiler.compile_mainloop();
+	compiler.compile_mem_handlers();
+	compiler.ready();
+
+	emit_Skip(compiler.getSize());
+	emit_SetBaseAddr();
+
+	//scratch, overwritten by the first block
+	BlockCompilerx64 slot;
+
+	for (int w = 0; w < 2; w++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			slot.resetSize();
+			slot.GenFastmemSlot(w, 1 << i);
+			memcpy(mem_slot[w][i], slot.getCode(), FASTMEM_SLOT_SIZE);
+		}
+	}
+
+	ngen_FailedToFindBlock = (void (*)())ngen_FailedToFindBlock_;
+}
+
 void ngen_CC_Call_x64(shil_opcode*op, void* function)
 {
    BlockCompilerx64 *compiler = (BlockCompilerx64*)compiler_data;
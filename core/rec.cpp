@@ -18,6 +18,13 @@ struct DynaRBI : RuntimeBlockInfo
     * errors */
 	virtual u32 Relink()
    {
+#if FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+      if (settings.dynarec.Type == 0)
+      {
+         extern u32 ngen_Relink_x64(RuntimeBlockInfo* block);
+         return ngen_Relink_x64(this);
+      }
+#endif
 		return 0;
 	}
 
@@ -36,6 +43,9 @@ void ngen_init(void)
 #elif FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_ARM
          extern void ngen_init_arm(void);
          ngen_init_arm();
+#elif FEAT_SHREC == DYNAREC_JIT && HOST_CPU == CPU_X64
+         extern void ngen_init_x64(void);
+         ngen_init_x64();
 #endif
          break;
       case 1: /* rec_cpp */
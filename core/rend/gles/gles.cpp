@@ -130,21 +130,8 @@ const static u32 SrcBlendGL[] =
 
 Vertex* vtx_sort_base;
 
-struct IndexTrig
-{
-	u16 id[3];
-	u16 pid;
-	f32 z;
-};
-
-struct SortTrigDrawParam
-{
-	PolyParam* ppid;
-	u16 first;
-	u16 count;
-};
-
-static vector<SortTrigDrawParam>	pidx_sort;
+vector<SortTrigDrawParam>	pidx_sort;
+vector<u16>	vidx_sort;
 PipelineShader* CurrentShader;
 static u32 gcflip;
 
@@ -742,14 +729,60 @@ static inline float max3(float v0,float v1,float v2)
 	return max(max(v0,v1),v2);
 }
 
-static inline float minZ(Vertex* v,u16* mod)
+/* Maps floats to u32s that compare in the same order.
+ * -0 and +0 compare equal, so they get the same key */
+static inline u32 FloatSortKey(f32 f)
 {
-	return min(min(v[mod[0]].z,v[mod[1]].z),v[mod[2]].z);
+   u32 u = *(u32*)&f;
+   if ((u << 1) == 0)
+      u = 0;
+   return u ^ ((u32)((s32)u >> 31) | 0x80000000);
 }
 
-bool operator<(const IndexTrig &left, const IndexTrig &right)
+/* Stable LSD radix sort of vals by keys, 11 bits per pass.
+ * Passes where all keys have the same digit are skipped.
+ * Returns whichever of vals/tmp_vals ends up holding the result. */
+static u32* RadixSort(u32* keys, u32* vals, u32* tmp_keys, u32* tmp_vals, u32 count)
 {
-	return left.z<right.z;
+   static u32 hist[3][2048];
+
+   memset(hist, 0, sizeof(hist));
+
+   for (u32 i = 0; i < count; i++)
+   {
+      u32 k = keys[i];
+      hist[0][k & 2047]++;
+      hist[1][(k >> 11) & 2047]++;
+      hist[2][k >> 22]++;
+   }
+
+   for (u32 pass = 0; pass < 3; pass++)
+   {
+      u32 shift = pass * 11;
+      u32* h    = hist[pass];
+
+      if (h[(keys[0] >> shift) & 2047] == count)
+         continue;
+
+      for (u32 d = 0, sum = 0; d < 2048; d++)
+      {
+         u32 c = h[d];
+         h[d]  = sum;
+         sum  += c;
+      }
+
+      for (u32 i = 0; i < count; i++)
+      {
+         u32 pos       = h[(keys[i] >> shift) & 2047]++;
+         tmp_keys[pos] = keys[i];
+         tmp_vals[pos] = vals[i];
+      }
+
+      swap(keys, tmp_keys);
+      swap(vals, tmp_vals);
+   }
+
+   return vals;
 }
 
 //are two poly params the same?
@@ -763,14 +796,17 @@ static inline bool PP_EQ(PolyParam* pp0, PolyParam* pp1)
       && pp0->tileclip==pp1->tileclip;
 }
 
-static void GenSorted(void)
+void GenSorted(void)
 {
-   static vector<IndexTrig> lst;
-   static vector<u16> vidx_sort;
+   /* one entry per triangle: first vertex (bit 31 set if flipped), PolyParam, sort key */
+   static vector<u32> tri_vtx;
+   static vector<u16> tri_pid;
+   static vector<u32> tri_key[2];
+   static vector<u32> tri_order[2];
 
    static u32 vtx_cnt;
    int idx            = -1;
-   int pfsti          =  0;
+   u32 pfsti          =  0;
 
    pidx_sort.clear();
 
@@ -784,7 +820,6 @@ static void GenSorted(void)
    PolyParam* pp=pp_base;
    PolyParam* pp_end= pp + pvrrc.global_param_tr.used();
 
-   Vertex* vtx_arr=vtx_base+idx_base[pp->first];
    vtx_sort_base=vtx_base;
    int vtx_count=idx_base[pp_end[-1].first+pp_end[-1].count-1]-idx_base[pp->first];
    if (vtx_count>vtx_cnt)
@@ -799,15 +834,20 @@ static void GenSorted(void)
 
    /* Make lists of all triangles, with their PID and VID */
 
-   lst.resize(vtx_count*4);
+   if (tri_vtx.size() < vtx_count*4)
+   {
+      tri_vtx.resize(vtx_count*4);
+      tri_pid.resize(vtx_count*4);
+      for (int i = 0; i < 2; i++)
+      {
+         tri_key[i].resize(vtx_count*4);
+         tri_order[i].resize(vtx_count*4);
+      }
+   }
 
    while(pp != pp_end)
    {
-      Vertex *vtx     = NULL;
-      Vertex *vtx_end = NULL;
-      u16 *idx        = NULL;
-      u32 flip        = 0;
-      u32 ppid        = (pp-pp_base);
+      u16 ppid        = (pp-pp_base);
 
       if (pp->count <= 2)
       {
@@ -815,31 +855,19 @@ static void GenSorted(void)
          continue;
       }
 
-      idx             = idx_base + pp->first;
-      vtx             = vtx_base+idx[0];
-      vtx_end         = vtx_base + idx[pp->count-1]-1;
+      u16 *idx        = idx_base + pp->first;
+      u32 vtx         = idx[0];
+      u32 vtx_end     = idx[pp->count-1]-1;
+      u32 flip        = 0;
 
       while(vtx != vtx_end)
       {
-         Vertex *v0   = &vtx[0];
-         Vertex *v1   = &vtx[1];
-         Vertex *v2   = &vtx[2];
-
-         if (flip)
-         {
-            v0=&vtx[2];
-            v1=&vtx[1];
-            v2=&vtx[0];
-         }
+         Vertex *v    = vtx_base + vtx;
 
-         u16* d =lst[pfsti].id;
-         Vertex *vb = vtx_base;
-         d[0]=v0-vb;
-         d[1]=v1-vb;
-         d[2]=v2-vb;
-
-         lst[pfsti].pid= ppid ;
-         lst[pfsti].z = minZ(vtx_base,lst[pfsti].id);
+         tri_vtx[pfsti]      = vtx | (flip << 31);
+         tri_pid[pfsti]      = ppid;
+         tri_key[0][pfsti]   = FloatSortKey(min(min(v[0].z,v[1].z),v[2].z));
+         tri_order[0][pfsti] = pfsti;
          pfsti++;
 
          flip ^= 1;
@@ -850,49 +878,52 @@ static void GenSorted(void)
 
    u32 aused=pfsti;
 
-   lst.resize(aused);
-
-   /* sort them */
-   std::stable_sort(lst.begin(),lst.end());
-
-   /* Merge PIDs/draw commands if two different PIDs are actually equal */
+   if (!aused)
+      return;
 
-   for (u32 k = 1; k < aused; k++)
-   {
-      if (lst[k].pid == lst[k-1].pid)
-         continue;
+   /* sort them, equal depths keep their submission order */
+   u32* order = RadixSort(&tri_key[0][0], &tri_order[0][0], &tri_key[1][0], &tri_order[1][0], aused);
 
-      if (PP_EQ(&pp_base[lst[k].pid],&pp_base[lst[k-1].pid]))
-         lst[k].pid=lst[k-1].pid;
-   }
-
-   /* Reassemble vertex indices into drawing commands */
+   /* Reassemble vertex indices into drawing commands, merging
+    * consecutive triangles whose PIDs are different but equal */
 
    vidx_sort.resize(aused*3);
 
    for (u32 i=0; i<aused; i++)
    {
       SortTrigDrawParam stdp;
-      int   pid          = lst[i].pid;
-      u16* midx          = lst[i].id;
+      u32   t            = order[i];
+      int   pid          = tri_pid[t];
+      u32   v            = tri_vtx[t] & 0x7FFFFFFF;
 
-      vidx_sort[i*3 + 0] = midx[0];
-      vidx_sort[i*3 + 1] = midx[1];
-      vidx_sort[i*3 + 2] = midx[2];
+      if (tri_vtx[t] >> 31)
+      {
+         vidx_sort[i*3 + 0] = v + 2;
+         vidx_sort[i*3 + 1] = v + 1;
+         vidx_sort[i*3 + 2] = v;
+      }
+      else
+      {
+         vidx_sort[i*3 + 0] = v;
+         vidx_sort[i*3 + 1] = v + 1;
+         vidx_sort[i*3 + 2] = v + 2;
+      }
 
       if (idx == pid)
          continue;
 
+      if (idx != -1 && PP_EQ(&pp_base[pid],&pp_base[idx]))
+         continue;
+
       stdp.ppid  = pp_base + pid;
-      stdp.first = (u16)(i*3);
+      stdp.first = i*3;
       stdp.count = 0;
 
       if (idx!=-1)
       {
          SortTrigDrawParam *last = &pidx_sort[pidx_sort.size()-1];
 
-         if (last)
-            last->count=stdp.first-last->first;
+         last->count=stdp.first-last->first;
       }
 
       pidx_sort.push_back(stdp);
@@ -901,13 +932,15 @@ static void GenSorted(void)
 
    SortTrigDrawParam *stdp = &pidx_sort[pidx_sort.size()-1];
 
-   if (stdp)
-      stdp->count=aused*3-stdp->first;
+   stdp->count=aused*3-stdp->first;
 
 #if PRINT_SORT_STATS
    printf("Reassembled into %d from %d\n",pidx_sort.size(),pp_end-pp_base);
 #endif
+}
 
+static void UploadSorted(void)
+{
    /* Upload to GPU if needed, otherwise return */
    if (!pidx_sort.size())
       return;
@@ -1796,7 +1829,10 @@ static bool RenderFrame(void)
 	glClear(GL_COLOR_BUFFER_BIT|GL_STENCIL_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 
 	if (UsingAutoSort())
+	{
 		GenSorted();
+		UploadSorted();
+	}
 
 	//move vertex to gpu
 
@@ -1914,7 +1950,11 @@ struct glesrend : Renderer
       return true;
    }
 	void Resize(int w, int h) { gles_screen_width=w; gles_screen_height=h; }
-	void Term() { libCore_vramlock_Free(); }
+	void Term()
+   {
+      DecodeWorkersStop();
+      libCore_vramlock_Free();
+   }
 
 	bool Process(TA_context* ctx)
    {
@@ -1933,7 +1973,13 @@ struct glesrend : Renderer
          printf("Texture cache cleared\n");
       }
 
-      if (!ta_parse_vdrc(ctx))
+      bool parsed = ta_parse_vdrc(ctx);
+
+      /* textures looked up by the parse are decoded and uploaded here,
+       * even if it failed, as they are no longer marked dirty */
+      FlushStagedTextures();
+
+      if (!parsed)
          return false;
 
       CollectCleanup();
@@ -22,7 +22,32 @@ struct text_info {
 };
 
 text_info raw_GetTexture(TSP tsp, TCW tcw);
+void raw_StageTexture(TSP tsp, TCW tcw);
+void FlushStagedTextures(void);
+void DecodeWorkersStop(void);
+
+/* TCW:TSP cache, see CollectCleanup */
+struct TexCacheStats
+{
+	u32 lookups;
+	u32 misses;          /* new entries */
+	u32 evictions;
+	u32 entries;
+	u32 bytes;           /* decoded contents, shared ones count once */
+};
+extern TexCacheStats tex_cache_stats;
 void CollectCleanup();
 void SortPParams();
 
+/* Translucent triangles of pvrrc sorted by depth, as draw batches over vidx_sort */
+struct SortTrigDrawParam
+{
+	PolyParam* ppid;
+	u32 first;
+	u32 count;
+};
+extern vector<SortTrigDrawParam> pidx_sort;
+extern vector<u16> vidx_sort;
+void GenSorted();
+
 void BindRTT(u32 addy, u32 fbw, u32 fbh, u32 channels, u32 fmt);
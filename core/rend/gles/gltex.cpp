@@ -4,8 +4,10 @@
 #include "../../hw/pvr/TexCache.h"
 #include "../../hw/pvr/pvr_pixfmt.h"
 #include "../../hw/pvr/pvr_mem.h"
+#include "../../libretro/libretro.h"
 
 #include <map>
+#include <thread>
 
 #include <memalign.h>
 
@@ -31,8 +33,6 @@ Compression
 	look into it, but afaik PVRC is not realtime doable
 */
 
-typedef void TexConvFP(PixelBuffer* pb,u8* p_in,u32 Width,u32 Height);
-
 struct PvrTexInfo
 {
 	const char* name;
@@ -55,6 +55,48 @@ PvrTexInfo format[8]=
 	{"ns/1555", 0},	//ns, 1555
 };
 
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+extern retro_get_cpu_features_t perf_get_cpu_features_cb;
+
+static void texconv_apply(const TexConvTable* simd)
+{
+   for (int i = 0; i < 7; i++)
+   {
+      if (simd[i].PL)
+         format[i].PL = simd[i].PL;
+      if (simd[i].TW)
+         format[i].TW = simd[i].TW;
+      if (simd[i].VQ)
+         format[i].VQ = simd[i].VQ;
+   }
+}
+#endif
+
+/* Swap in the SIMD converters the host can run, once */
+static void texconv_select(void)
+{
+   static bool selected = false;
+
+   if (selected)
+      return;
+   selected = true;
+
+#if HOST_CPU == CPU_X86 || HOST_CPU == CPU_X64
+   unsigned cpu = 0;
+
+   if (perf_get_cpu_features_cb)
+      cpu = perf_get_cpu_features_cb();
+#if HOST_CPU == CPU_X64
+   cpu |= RETRO_SIMD_SSE2; /* part of the x64 baseline */
+#endif
+
+   if (cpu & RETRO_SIMD_SSE2)
+      texconv_apply(texconv_sse2);
+   if (cpu & RETRO_SIMD_SSSE3)
+      texconv_apply(texconv_ssse3);
+#endif
+}
+
 const u32 compressed_mipmap_offsets[8] =
 {
 	0x00006, /*    8  x 8*/
@@ -70,7 +112,6 @@ const u32 compressed_mipmap_offsets[8] =
 const GLuint PAL_TYPE[4]=
 {GL_UNSIGNED_SHORT_5_5_5_1,GL_UNSIGNED_SHORT_5_6_5,GL_UNSIGNED_SHORT_4_4_4_4,GL_UNSIGNED_SHORT_4_4_4_4};
 
-u16 temp_tex_buffer[1024*1024];
 extern u32 decoded_colors[3][65536];
 
 struct FBT
@@ -83,15 +124,42 @@ struct FBT
 
 FBT fb_rtt;
 
+/*
+	Decoded textures, keyed by a hash of their VRAM contents and everything
+	else that goes into the decode, but not their address. Cache entries
+	with identical contents share one, and a dirty entry whose contents
+	hash the same as before keeps its copy.
+*/
+struct TexContent
+{
+   GLuint texID;        /* GL texture ID */
+	u16* pData;          /* soft renderer copy */
+	u32 bytes;           /* counted against settings.rend.TexCacheBudget */
+	u32 refs;
+};
+
+map<u64,TexContent> TexContents;
+
+TexCacheStats tex_cache_stats;
+
 /* Texture Cache */
 struct TextureCacheData
 {
 	TSP tsp;             /* PowerVR texture parameters */
 	TCW tcw;
+	u64 key;             /* TCW:TSP */
 
-   GLuint texID;        /* GL texture ID */
-	u16* pData;
+	/* LRU list, see CollectCleanup */
+	TextureCacheData* lru_prev;   /* more recently used */
+	TextureCacheData* lru_next;   /* less recently used */
+	u32 last_used;                /* FrameCount of the last lookup */
+
+   GLuint texID;        /* GL texture ID, from content */
 	int tex_type;
+	bool isGL;
+
+	u64 content_key;
+	TexContent* content;
 
 	u32 Lookups;
 
@@ -109,6 +177,12 @@ struct TextureCacheData
 
 	u32 Updates;
 
+	/* Staging, see StageTexture */
+	u16* staging;               /* decoded texture, only valid between Prepare and Upload */
+	u32 stride;                 /* pixels per line in VRAM */
+	GLuint textype;             /* GL format of the decoded pixels */
+	bool staged;                /* waiting for FlushStagedTextures */
+
 	/* Used for palette updates */
 	u32  pal_local_rev;         /* Local palette rev */
 	u32* pal_table_rev;         /* Table palette rev pointer */
@@ -141,12 +215,11 @@ struct TextureCacheData
 	void Create(bool isGL)
 	{
       texID      = 0;
-
-		if (isGL)
-			glGenTextures(1, &texID);
+		this->isGL = isGL;
 		
 		/* Reset state info */
-		pData      = 0;
+		content    = 0;
+		content_key= 0;
 		tex_type   = 0;
 		Lookups    = 0;
 		Updates    = 0;
@@ -154,6 +227,7 @@ struct TextureCacheData
 		lock_block = 0;
 
 		/* Decode info from TSP/TCW into the texture struct */
+		texconv_select();
 		tex        = &format[tcw.PixelFmt==7?0:tcw.PixelFmt];		/* texture format table entry */
 
 		sa_tex     = (tcw.TexAddr<<3) & VRAM_MASK;               /* texture start address */
@@ -161,43 +235,6 @@ struct TextureCacheData
 		w          = 8 << tsp.TexU;                              /* texture width */
 		h          = 8 << tsp.TexV;                              /* texture height */
 
-		if (texID)
-      {
-         /* Bind texture to set modes */
-         glBindTexture(GL_TEXTURE_2D, texID);
-
-         /* Set texture repeat mode */
-         if (tsp.ClampU)
-            glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-         else 
-            glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tsp.FlipU ? GL_MIRRORED_REPEAT : GL_REPEAT);
-
-         if (tsp.ClampV)
-            glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-         else 
-            glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tsp.FlipV ? GL_MIRRORED_REPEAT : GL_REPEAT);
-
-#ifdef HAVE_OPENGLES
-         glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
-#endif
-
-         /* Set texture filter mode */
-         if (tsp.FilterMode == 0)
-         {
-            /* Disable filtering, mipmaps */
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
-         }
-         else
-         {
-            /* Bilinear filtering */
-            /* PowerVR supports also trilinear via two passes, but we ignore that for now */
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,
-                  (tcw.MipMapped && settings.rend.UseMipmaps)?GL_LINEAR_MIPMAP_NEAREST:GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-         }
-      }
-
       pal_table_rev = 0;
 
 		/* PAL texture */
@@ -265,20 +302,121 @@ struct TextureCacheData
          default:
             printf("Unhandled texture %d\n",tcw.PixelFmt);
             size=w*h*2;
-            memset(temp_tex_buffer,0xFFFFFFFF,size);
             break;
       }
 	}
 
-	void Update(void)
-   {
-      PixelBuffer pbt;
-      GLuint textype;
-      u32 stride         = w;
+	/* New GL texture, with the repeat and filter modes of tsp */
+	GLuint NewGLTexture(void)
+	{
+		GLuint id;
+
+		glGenTextures(1, &id);
+
+      /* Bind texture to set modes */
+      glBindTexture(GL_TEXTURE_2D, id);
+
+      /* Set texture repeat mode */
+      if (tsp.ClampU)
+         glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      else 
+         glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tsp.FlipU ? GL_MIRRORED_REPEAT : GL_REPEAT);
+
+      if (tsp.ClampV)
+         glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      else 
+         glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tsp.FlipV ? GL_MIRRORED_REPEAT : GL_REPEAT);
+
+#ifdef HAVE_OPENGLES
+      glHint(GL_GENERATE_MIPMAP_HINT, GL_NICEST);
+#endif
+
+      /* Set texture filter mode */
+      if (tsp.FilterMode == 0)
+      {
+         /* Disable filtering, mipmaps */
+         glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+         glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+      }
+      else
+      {
+         /* Bilinear filtering */
+         /* PowerVR supports also trilinear via two passes, but we ignore that for now */
+         glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,
+               (tcw.MipMapped && settings.rend.UseMipmaps)?GL_LINEAR_MIPMAP_NEAREST:GL_LINEAR);
+         glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+      }
+
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      return id;
+	}
+
+	/* Hash of the VRAM (and palette) contents plus everything else the decoded
+	 * texture depends on, except for the address */
+	u64 ContentKey(void)
+	{
+		struct
+		{
+			TexConvFP* texconv;
+			u32 offset, w, h, stride;
+			u32 textype;
+			u32 sampling;
+		} desc;
+
+		memset(&desc, 0, sizeof(desc));
+		desc.texconv  = texconv;
+		desc.offset   = sa - sa_tex;
+		desc.w        = w;
+		desc.h        = h;
+		desc.stride   = stride;
+		desc.textype  = textype;
+		/* GL textures share their repeat/filter modes too */
+		if (isGL)
+			desc.sampling = 1 | (tsp.ClampU << 1) | (tsp.ClampV << 2) | (tsp.FlipU << 3) | (tsp.FlipV << 4)
+			              | (tsp.FilterMode << 5) | (tcw.MipMapped << 7);
+
+		u64 seed = XXH64(&desc, sizeof(desc), 0);
+
+		if (pal_table_rev)
+			seed = XXH64(&palette_ram[indirect_color_ptr], (tex->bpp == 4 ? 16 : 256) * sizeof(u32), seed);
+
+		u32 end = min(sa + size, (u32)VRAM_SIZE);
+
+		return XXH64(&vram.data[sa_tex], end - sa_tex, seed);
+	}
+
+	/* Drops this entry's reference to its decoded copy */
+	void ReleaseContent(void)
+	{
+		if (content && --content->refs == 0)
+		{
+			if (content->texID)
+				glDeleteTextures(1, &content->texID);
+			if (content->pData)
+#ifdef __SSE4_1__
+				_mm_free(content->pData);
+#else
+				memalign_free(content->pData);
+#endif
+			tex_cache_stats.bytes -= content->bytes;
+			TexContents.erase(content_key);
+		}
 
+		content     = 0;
+		content_key = 0;
+		texID       = 0;
+	}
+
+	/* Render thread: bookkeeping, VRAM locking and the content lookup.
+	 * Locking first means writes that race with the hash or the decode still dirty it.
+	 * Returns true if the texture has to be decoded. */
+	bool Prepare(void)
+   {
       Updates++;                                   /* texture state tracking stuff */
       dirty              = 0;
       textype            = tex->type;
+      stride             = w;
 
       if (pal_table_rev) 
       {
@@ -287,81 +425,134 @@ struct TextureCacheData
                                                       so it won't have to redo the texture */
       }
 
-      palette_index      = indirect_color_ptr;              /* might be used if paletted texture */
-      vq_codebook        = (u8*)&vram.data[indirect_color_ptr];  /* might be used if VQ texture */
-
-      //texture conversion work
-      pbt.p_buffer_start = pbt.p_current_line=temp_tex_buffer;
-      pbt.pixels_per_line=w;
+      switch (textype)
+      {
+         case GL_UNSIGNED_SHORT_5_6_5:
+            tex_type = 0;
+            break;
+         case GL_UNSIGNED_SHORT_5_5_5_1:
+            tex_type = 1;
+            break;
+         case GL_UNSIGNED_SHORT_4_4_4_4:
+            tex_type = 2;
+            break;
+      }
 
       if (tcw.StrideSel && tcw.ScanOrder && tex->PL) 
          stride = (TEXT_CONTROL&31)*32; //I think this needs +1 ?
 
+      /* lock the texture to detect changes in it. Palette updates keep the lock */
+      if (!lock_block)
+         lock_block = libCore_vramlock_Lock(sa_tex,sa+size-1,this);
+
+      u64 key = ContentKey();
+
+      /* dirty, but the contents didn't change */
+      if (content && key == content_key)
+         return false;
+
+      ReleaseContent();
+
+      TexContent& tc = TexContents[key];
+
+      content_key = key;
+      content     = &tc;
+
+      /* identical to a texture decoded elsewhere */
+      if (tc.refs++ != 0)
+      {
+         texID = tc.texID;
+         return false;
+      }
+
+      if (isGL)
+      {
+         tc.texID = NewGLTexture();
+         tc.bytes = w * h * 2;
+         if (tcw.MipMapped && settings.rend.UseMipmaps)
+            tc.bytes += tc.bytes / 3;
+      }
+      else
+         tc.bytes = w * h * 16;
+      tex_cache_stats.bytes += tc.bytes;
+      texID = tc.texID;
+
+      /* planar converters write stride pixels per line, so the last one can run past w */
+      staging            = (u16*)malloc(max(stride, w) * h * sizeof(u16));
+
+      return true;
+   }
+
+	/* Any thread: converts VRAM to staging, and to pData for the soft renderer.
+	 * Only this entry references content at this point */
+	void Decode(void)
+   {
+      PixelBuffer pbt;
+
+      //texture conversion work
+      pbt.p_buffer_start = pbt.p_current_line=staging;
+      pbt.pixels_per_line= w;
+      pbt.palette        = &palette_ram[indirect_color_ptr];   /* might be used if paletted texture */
+      pbt.vq_codebook    = (u8*)&vram.data[indirect_color_ptr]; /* might be used if VQ texture */
+
       if(texconv)
          texconv(&pbt,(u8*)&vram.data[sa], stride, h);
       else
       {
          /* fill it in with a temporary color. */
          printf("UNHANDLED TEXTURE\n");
-         memset(temp_tex_buffer,0xF88F8F7F,w*h*2);
+         memset(staging,0xF88F8F7F,w*h*2);
       }
 
       //PrintTextureName();
 
-      /* lock the texture to detect changes in it. */
-      lock_block = libCore_vramlock_Lock(sa_tex,sa+size-1,this);
+      if (isGL)
+         return;
+
+#ifdef __SSE4_1__
+      u16* pData = (u16*)_mm_malloc(w * h * 16, 16);
+#else
+      u16* pData = (u16*)memalign_alloc(16, w * h * 16);
+#endif
+      content->pData = pData;
+
+      for (int y = 0; y < h; y++)
+      {
+         for (int x = 0; x < w; x++)
+         {
+            u32* data = (u32*)&pData[(x + y*w) * 8];
 
+            data[0]   = decoded_colors[tex_type][staging[(x + 1) % w + (y + 1) % h * w]];
+            data[1]   = decoded_colors[tex_type][staging[(x + 0) % w + (y + 1) % h * w]];
+            data[2]   = decoded_colors[tex_type][staging[(x + 1) % w + (y + 0) % h * w]];
+            data[3]   = decoded_colors[tex_type][staging[(x + 0) % w + (y + 0) % h * w]];
+         }
+      }
+   }
+
+	/* Render thread: hands the decoded texture to GL */
+	void Upload(void)
+   {
       if (texID)
       {
          glBindTexture(GL_TEXTURE_2D, texID);
          GLuint comps=textype==GL_UNSIGNED_SHORT_5_6_5?GL_RGB:GL_RGBA;
-         glTexImage2D(GL_TEXTURE_2D, 0,comps , w, h, 0, comps, textype, temp_tex_buffer);
+         glTexImage2D(GL_TEXTURE_2D, 0,comps , w, h, 0, comps, textype, staging);
          if (tcw.MipMapped && settings.rend.UseMipmaps)
             glGenerateMipmap(GL_TEXTURE_2D);
          glBindTexture(GL_TEXTURE_2D, 0);
       }
-      else
-      {
-         switch (textype)
-         {
-            case GL_UNSIGNED_SHORT_5_6_5:
-               tex_type = 0;
-               break;
-            case GL_UNSIGNED_SHORT_5_5_5_1:
-               tex_type = 1;
-               break;
-            case GL_UNSIGNED_SHORT_4_4_4_4:
-               tex_type = 2;
-               break;
-         }
 
-         if (pData)
-         {
-#ifdef __SSE4_1__
-            _mm_free(pData);
-#else
-            memalign_free(pData);
-#endif
-         }
-
-#ifdef __SSE4_1__
-         pData = (u16*)_mm_malloc(w * h * 16, 16);
-#else
-         pData = (u16*)memalign_alloc(16, w * h * 16);
-#endif
-         for (int y = 0; y < h; y++)
-         {
-            for (int x = 0; x < w; x++)
-            {
-               u32* data = (u32*)&pData[(x + y*w) * 8];
+      free(staging);
+      staging = 0;
+   }
 
-               data[0]   = decoded_colors[tex_type][temp_tex_buffer[(x + 1) % w + (y + 1) % h * w]];
-               data[1]   = decoded_colors[tex_type][temp_tex_buffer[(x + 0) % w + (y + 1) % h * w]];
-               data[2]   = decoded_colors[tex_type][temp_tex_buffer[(x + 1) % w + (y + 0) % h * w]];
-               data[3]   = decoded_colors[tex_type][temp_tex_buffer[(x + 0) % w + (y + 0) % h * w]];
-            }
-         }
-      }
+	void Update(void)
+   {
+      if (!Prepare())
+         return;
+      Decode();
+      Upload();
    }
 
 	/* true if : dirty or paletted texture and revs don't match */
@@ -372,24 +563,148 @@ struct TextureCacheData
 	
 	void Delete()
 	{
-      if (pData)
-#ifdef __SSE4_1__
-         _mm_free(pData);
-#else
-         memalign_free(pData);
-#endif
-      pData = 0;
-		if (texID)
-         glDeleteTextures(1, &texID);
-      texID = 0;
+      free(staging);
+      staging = 0;
+      ReleaseContent();
 		if (lock_block)
 			libCore_vramlock_Unlock_block(lock_block);
 		lock_block=0;
 	}
 };
 
-map<u64,TextureCacheData> TexCache;
-typedef map<u64,TextureCacheData>::iterator TexCacheIter;
+/*
+	Texture cache lookup, open addressing with linear probing on TCW:TSP.
+	Entries are allocated on their own, as vram locks and the staging list
+	point to them.
+*/
+static TextureCacheData** tc_slots;
+static u32 tc_mask;           /* slot count - 1 */
+
+static TextureCacheData* lru_head;  /* most recently used */
+static TextureCacheData* lru_tail;
+static TextureCacheData* lru_scan;  /* CollectCleanup's position, walks towards lru_head */
+
+static INLINE u32 TexCacheSlot(u64 key)
+{
+	return (u32)((key * 0x9E3779B97F4A7C15ULL) >> 32) & tc_mask;
+}
+
+static TextureCacheData* TexCacheFind(u64 key)
+{
+	if (!tc_slots)
+		return 0;
+
+	for (u32 i = TexCacheSlot(key); tc_slots[i]; i = (i + 1) & tc_mask)
+	{
+		if (tc_slots[i]->key == key)
+			return tc_slots[i];
+	}
+
+	return 0;
+}
+
+static void TexCacheInsert(TextureCacheData* tf);
+
+/* Keeps the load under 3/4 */
+static void TexCacheGrow(void)
+{
+	TextureCacheData** old = tc_slots;
+	u32 old_count = old ? tc_mask + 1 : 0;
+	u32 count = old ? old_count * 2 : 1024;
+
+	tc_slots = (TextureCacheData**)calloc(count, sizeof(TextureCacheData*));
+	tc_mask  = count - 1;
+
+	for (u32 i = 0; i < old_count; i++)
+	{
+		if (old[i])
+		{
+			tex_cache_stats.entries--;
+			TexCacheInsert(old[i]);
+		}
+	}
+
+	free(old);
+}
+
+static void TexCacheInsert(TextureCacheData* tf)
+{
+	if (!tc_slots || (tex_cache_stats.entries + 1) * 4 > (tc_mask + 1) * 3)
+		TexCacheGrow();
+
+	u32 i = TexCacheSlot(tf->key);
+
+	while (tc_slots[i])
+		i = (i + 1) & tc_mask;
+
+	tc_slots[i] = tf;
+	tex_cache_stats.entries++;
+}
+
+/* Backward shift deletion, so lookups never need tombstones */
+static void TexCacheRemove(TextureCacheData* tf)
+{
+	u32 i = TexCacheSlot(tf->key);
+
+	while (tc_slots[i] != tf)
+		i = (i + 1) & tc_mask;
+
+	for (u32 j = (i + 1) & tc_mask; tc_slots[j]; j = (j + 1) & tc_mask)
+	{
+		u32 home = TexCacheSlot(tc_slots[j]->key);
+
+		/* move j into the hole at i unless its home slot lies cyclically in (i, j] */
+		if (((j - home) & tc_mask) >= ((j - i) & tc_mask))
+		{
+			tc_slots[i] = tc_slots[j];
+			i = j;
+		}
+	}
+
+	tc_slots[i] = 0;
+	tex_cache_stats.entries--;
+}
+
+static void LruUnlink(TextureCacheData* tf)
+{
+	if (lru_scan == tf)
+		lru_scan = tf->lru_prev;
+
+	if (tf->lru_prev)
+		tf->lru_prev->lru_next = tf->lru_next;
+	else
+		lru_head = tf->lru_next;
+
+	if (tf->lru_next)
+		tf->lru_next->lru_prev = tf->lru_prev;
+	else
+		lru_tail = tf->lru_prev;
+
+	tf->lru_prev = tf->lru_next = 0;
+}
+
+static void LruPushHead(TextureCacheData* tf)
+{
+	tf->lru_prev = 0;
+	tf->lru_next = lru_head;
+
+	if (lru_head)
+		lru_head->lru_prev = tf;
+	else
+		lru_tail = tf;
+
+	lru_head = tf;
+}
+
+static void TexCacheEvict(TextureCacheData* tf)
+{
+	tf->Delete();
+	TexCacheRemove(tf);
+	LruUnlink(tf);
+	delete tf;
+
+	tex_cache_stats.evictions++;
+}
 
 void BindRTT(u32 addy, u32 fbw, u32 fbh, u32 channels, u32 fmt)
 {
@@ -458,114 +773,308 @@ void BindRTT(u32 addy, u32 fbw, u32 fbh, u32 channels, u32 fmt)
 	verify(uStatus == RARCH_GL_FRAMEBUFFER_COMPLETE);
 }
 
-GLuint gl_GetTexture(TSP tsp, TCW tcw)
+/*
+	Texture staging
+
+	ta_parse_vdrc looks up every texture of the frame. Dirty ones are only
+	prepared and queued there, FlushStagedTextures then decodes all of them
+	at once on the decode workers (and the calling thread), and does the GL
+	uploads on the render thread. Textures are only used for drawing after
+	the parse, so returning the GL id early is fine.
+*/
+static vector<TextureCacheData*> tex_staged;
+
+/* rthreads is only linked in with a render thread or the soft renderer */
+#if !defined(TARGET_NO_THREADS) || defined(HAVE_SOFTREND)
+#define MAX_DECODE_WORKERS 8
+
+static sthread_t* decode_workers[MAX_DECODE_WORKERS];
+static int decode_worker_count = -1;  /* -1: not started yet */
+
+static slock_t* decode_mtx;
+static scond_t* decode_start;
+static scond_t* decode_done;
+
+static u32 decode_batch;      /* bumped for every batch handed to the workers */
+static size_t decode_next;    /* next texture of tex_staged to decode */
+static size_t decode_pending; /* textures of the batch not decoded yet */
+static bool decode_exit;
+
+/* Called with decode_mtx held */
+static void DecodeTextures()
 {
-	TextureCacheData* tf;
+   while (decode_next < tex_staged.size())
+   {
+      TextureCacheData* tf = tex_staged[decode_next++];
 
-	if (tcw.TexAddr == fb_rtt.TexAddr && fb_rtt.tex)
-		return fb_rtt.tex;
+      slock_unlock(decode_mtx);
+      tf->Decode();
+      slock_lock(decode_mtx);
 
-	/* Lookup texture */
-	u64 key         = ((u64)tcw.full<<32) | tsp.full;
+      if (--decode_pending == 0)
+         scond_signal(decode_done);
+   }
+}
 
-	TexCacheIter tx = TexCache.find(key);
+static void DecodeWorker(void* p)
+{
+   slock_lock(decode_mtx);
 
-	if (tx!=TexCache.end())
-		tf = &tx->second;
-	else
-	{
-      /* create if not existing */
-		TextureCacheData tfc={0};
-		TexCache[key]=tfc;
+   u32 batch = decode_batch;
 
-		tx=TexCache.find(key);
-		tf=&tx->second;
+   for (;;)
+   {
+      while (batch == decode_batch && !decode_exit)
+         scond_wait(decode_start, decode_mtx);
 
-		tf->tsp=tsp;
-		tf->tcw=tcw;
-		tf->Create(true);
-	}
+      if (decode_exit)
+         break;
 
-	/* Update if needed */
-	if (tf->NeedsUpdate())
-		tf->Update();
+      batch = decode_batch;
+      DecodeTextures();
+   }
 
-	/* Update state for opts/stuff */
-	tf->Lookups++;
+   slock_unlock(decode_mtx);
+}
+
+static void DecodeWorkersStart()
+{
+   /* settings.pvr.MaxThreads counts the calling thread, 0 is one thread per core */
+   int threads = std::thread::hardware_concurrency();
+
+   if (settings.pvr.MaxThreads != 0 && threads > (int)settings.pvr.MaxThreads)
+      threads = settings.pvr.MaxThreads;
 
-	/* Return texture */
-	return tf->texID;
+   decode_worker_count = min(max(threads - 1, 0), MAX_DECODE_WORKERS);
+
+   if (decode_worker_count == 0)
+      return;
+
+   decode_mtx   = slock_new();
+   decode_start = scond_new();
+   decode_done  = scond_new();
+   decode_exit  = false;
+
+   for (int i = 0; i < decode_worker_count; i++)
+      decode_workers[i] = sthread_create(DecodeWorker, 0);
 }
 
+void DecodeWorkersStop(void)
+{
+   if (decode_worker_count <= 0)
+   {
+      decode_worker_count = -1;
+      return;
+   }
 
-text_info raw_GetTexture(TSP tsp, TCW tcw)
+   slock_lock(decode_mtx);
+   decode_exit = true;
+   scond_broadcast(decode_start);
+   slock_unlock(decode_mtx);
+
+   for (int i = 0; i < decode_worker_count; i++)
+      sthread_join(decode_workers[i]);
+
+   scond_free(decode_done);
+   scond_free(decode_start);
+   slock_free(decode_mtx);
+
+   decode_worker_count = -1;
+}
+
+static void DecodeStaged()
 {
-	TextureCacheData* tf; /* lookup texture */
-	text_info rv    = { 0 };
-	u64 key         = ((u64)tcw.full << 32) | tsp.full;
+   if (decode_worker_count < 0)
+      DecodeWorkersStart();
+
+   if (decode_worker_count == 0 || tex_staged.size() == 1)
+   {
+      for (size_t i = 0; i < tex_staged.size(); i++)
+         tex_staged[i]->Decode();
+      return;
+   }
 
-	TexCacheIter tx = TexCache.find(key);
+   slock_lock(decode_mtx);
 
-	if (tx != TexCache.end())
-		tf = &tx->second;
-	else
+   decode_next    = 0;
+   decode_pending = tex_staged.size();
+   decode_batch++;
+   scond_broadcast(decode_start);
+
+   DecodeTextures();
+
+   while (decode_pending != 0)
+      scond_wait(decode_done, decode_mtx);
+
+   slock_unlock(decode_mtx);
+}
+#else
+void DecodeWorkersStop(void) { }
+
+static void DecodeStaged()
+{
+   for (size_t i = 0; i < tex_staged.size(); i++)
+      tex_staged[i]->Decode();
+}
+#endif
+
+void FlushStagedTextures(void)
+{
+   if (tex_staged.empty())
+      return;
+
+   DecodeStaged();
+
+   for (size_t i = 0; i < tex_staged.size(); i++)
+   {
+      tex_staged[i]->Upload();
+      tex_staged[i]->staged = false;
+   }
+
+   tex_staged.clear();
+}
+
+static TextureCacheData* LookupTexture(TSP tsp, TCW tcw, bool isGL)
+{
+	u64 key         = ((u64)tcw.full<<32) | tsp.full;
+
+	TextureCacheData* tf = TexCacheFind(key);
+
+	tex_cache_stats.lookups++;
+
+	if (tf)
 	{
-      /* Create if not existing */
-		TextureCacheData tfc = { 0 };
-		TexCache[key] = tfc;
+		/* the LRU order only matters across frames, and so do vram writes */
+		if (tf->last_used != FrameCount)
+		{
+			LruUnlink(tf);
+			LruPushHead(tf);
+			tf->last_used = FrameCount;
+
+			if (tf->lock_block)
+				libCore_vramlock_Check(tf->lock_block);
+		}
+		return tf;
+	}
+
+   /* create if not existing */
+	tex_cache_stats.misses++;
+
+	tf = new TextureCacheData();
 
-		tx = TexCache.find(key);
-		tf = &tx->second;
+	tf->key=key;
+	tf->tsp=tsp;
+	tf->tcw=tcw;
+	tf->last_used=FrameCount;
+	tf->Create(isGL);
 
-		tf->tsp = tsp;
-		tf->tcw = tcw;
-		tf->Create(false);
+	TexCacheInsert(tf);
+	LruPushHead(tf);
+
+	return tf;
+}
+
+/* Queue the texture for FlushStagedTextures if it needs an update */
+static TextureCacheData* StageTexture(TSP tsp, TCW tcw, bool isGL)
+{
+	TextureCacheData* tf = LookupTexture(tsp, tcw, isGL);
+
+	if (!tf->staged && tf->NeedsUpdate() && tf->Prepare())
+	{
+		tf->staged = true;
+		tex_staged.push_back(tf);
 	}
 
+	/* Update state for opts/stuff */
+	tf->Lookups++;
+
+	return tf;
+}
+
+GLuint gl_GetTexture(TSP tsp, TCW tcw)
+{
+	if (tcw.TexAddr == fb_rtt.TexAddr && fb_rtt.tex)
+		return fb_rtt.tex;
+
+	/* Return texture, decoded and uploaded by FlushStagedTextures */
+	return StageTexture(tsp, tcw, true)->texID;
+}
+
+void raw_StageTexture(TSP tsp, TCW tcw)
+{
+	StageTexture(tsp, tcw, false);
+}
+
+text_info raw_GetTexture(TSP tsp, TCW tcw)
+{
+	text_info rv    = { 0 };
+	TextureCacheData* tf = LookupTexture(tsp, tcw, false);
+
 	/* update if needed */
-	if (tf->NeedsUpdate())
+	if (tf->staged)
+		FlushStagedTextures();
+	else if (tf->NeedsUpdate())
 		tf->Update();
 
-	/* update state for opts/stuff */
-	tf->Lookups++;
-
 	/* return gl texture */
 	rv.height  = tf->h;
 	rv.width   = tf->w;
-	rv.pdata   = tf->pData;
+	rv.pdata   = tf->content ? tf->content->pData : 0;
 	rv.textype = tf->tex_type;
 	
 	return rv;
 }
 
+/*
+	Runs once per frame, after the parse, and only does a bounded amount of work:
+	- Over settings.rend.TexCacheBudget, the least recently used entries not
+	  needed by this frame go first.
+	- Otherwise lru_scan walks from the tail over the entries unused for 120
+	  frames, a few per frame, and drops the dirty ones, as their copies
+	  are stale anyway.
+*/
 void CollectCleanup(void)
 {
-   vector<u64> list;
-
    u32 TargetFrame = max((u32)120,FrameCount) - 120;
+   u32 budget      = settings.rend.TexCacheBudget;
 
-   for (TexCacheIter i=TexCache.begin();i!=TexCache.end();i++)
+   for (int i = 0; i < 64 && budget && tex_cache_stats.bytes > budget; i++)
    {
-      if ( i->second.dirty &&  i->second.dirty < TargetFrame)
-         list.push_back(i->first);
+      TextureCacheData* tf = lru_tail;
 
-      if (list.size() > 5)
+      if (!tf || tf->last_used == FrameCount)
          break;
+
+      TexCacheEvict(tf);
    }
 
-   for (size_t i=0; i<list.size(); i++)
+   for (int i = 0; i < 32; i++)
    {
-      TexCache[list[i]].Delete();
-      TexCache.erase(list[i]);
+      if (!lru_scan)
+         lru_scan = lru_tail;
+
+      TextureCacheData* tf = lru_scan;
+
+      if (!tf || tf->last_used >= TargetFrame)
+      {
+         /* the rest is newer, start over from the tail next frame */
+         lru_scan = 0;
+         break;
+      }
+
+      lru_scan = tf->lru_prev;
+
+      if (tf->dirty)
+         TexCacheEvict(tf);
    }
 }
 
 void killtex(void)
 {
-	for (TexCacheIter i=TexCache.begin();i!=TexCache.end();i++)
-		i->second.Delete();
+	tex_staged.clear();
 
-	TexCache.clear();
+	while (lru_tail)
+		TexCacheEvict(lru_tail);
 }
 
 void rend_text_invl(vram_block* bl)
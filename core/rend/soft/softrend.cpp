@@ -1,6 +1,6 @@
-#include <omp.h>
-#include "hw\pvr\Renderer_if.h"
-#include "hw\pvr\pvr_mem.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_lock.h"
 
 /*
 	SSE/MMX based softrend
@@ -11,6 +11,9 @@
 	Renders	in some kind of tile format (that I forget now),
 	and does depth and color, but no alpha, texture, or pixel
 	processing. All of the pipeline is based on quads.
+
+	The frame is split in 32x32 tiles, each one rasterised on its own
+	by the tile workers (see TileWorker), so it scales with cores.
 */
 
 #include <mmintrin.h>
@@ -20,6 +23,7 @@
 #include <smmintrin.h>
 #endif
 #include <cmath>
+#include <thread>
 
 #include "rend/gles/gles.h"
 
@@ -30,19 +34,48 @@
 #define STRIDE_PIXEL_OFFSET MAX_RENDER_WIDTH
 #define Z_BUFFER_PIXEL_OFFSET MAX_RENDER_PIXELS
 
+#define TILE_SIZE 32
+#define TILES_X (MAX_RENDER_WIDTH / TILE_SIZE)
+#define TILES_Y (MAX_RENDER_HEIGHT / TILE_SIZE)
+#define TILE_COUNT (TILES_X * TILES_Y)
+
+#define MAX_TILE_WORKERS 32
+
+extern u32 decoded_colors[3][65536];
+
+//Screen area a Rendtriangle call is clipped to, in pixels
+struct tile_rect
+{
+	int left, top, right, bottom;
+};
+
 DECL_ALIGN(32) u32 render_buffer[MAX_RENDER_PIXELS * 2]; //Color + depth
-DECL_ALIGN(32) u32 pixels[MAX_RENDER_PIXELS];
 
-#ifdef __SSE2__
+/*
+	Output frames, top-down XRGB8888. Present converts into back_fb and
+	swaps it with ready_fb, rend_softrend_fb swaps ready_fb into front_fb
+	for video_cb. The swaps are done under re.mutx, so the render thread
+	never writes a frame the frontend may still be reading.
+*/
+DECL_ALIGN(32) static u32 pixels[3][MAX_RENDER_PIXELS];
+static u32* back_fb = pixels[0];
+static u32* ready_fb = pixels[1];
+static u32* front_fb = pixels[2];
+static bool fb_ready;
+
+#if !defined(TARGET_NO_THREADS)
+extern cResetEvent re;
+#endif
+
 union m128i
 {
 	__m128i mm;
 	int8_t m128i_i8[16];
+	uint8_t m128i_u8[16];
 	int16_t m128i_i16[8];
 	int32_t m128i_i32[4];
 	uint32_t m128i_u32[4];
 };
-#endif
 
 static __m128 _mm_load_scaled_float(float v, float s)
 {
@@ -241,7 +274,7 @@ struct IPs
 
 
 //<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-typedef void(*RendtriangleFn)(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area);
+typedef void(*RendtriangleFn)(PolyParam* pp, text_info* texture, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, tile_rect* area);
 RendtriangleFn RendtriangleFns[3][2][2][2][4][2];
 
 
@@ -308,17 +341,13 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 			__m128i vfi = _mm_cvttps_epi32(_mm_mul_ps(vf, _mm_set1_ps(256)));
 
 			//(int)v<<x+(int)u
-         __m128i textadr;
-#ifdef __SSE4_1__
+			m128i textadr;
 			textadr.mm = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#else
-			textadr    = _mm_add_epi32(_mm_slli_epi32(vi, 16), ui);//texture addresses ! 4x of em !
-#endif
-			__m128i textel;
+			m128i textel;
 
 			for (int i = 0; i < 4; i++) {
-				u32 u = textadr.m128i_i16[i * 2 + 0];
-				u32 v = textadr.m128i_i16[i * 2 + 1];
+				u32 u = (u16)textadr.m128i_i16[i * 2 + 0];
+				u32 v = (u16)textadr.m128i_i16[i * 2 + 1];
 				
 				__m128i mufi_ = _mm_shuffle_epi32(ufi, _MM_SHUFFLE(0, 0, 0, 0));
 				__m128i mufi_n = _mm_sub_epi32(_mm_set1_epi32(255), mufi_);
@@ -357,7 +386,7 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 				__m128i tex_11 = _mm_cvtepu8_epi32(_mm_shuffle_epi32(px, _MM_SHUFFLE(0, 0, 0, 3)));
 
 				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mufi_), _mm_mullo_epi32(tex_01, mufi_n));
-				tex_10 = _mm_add_epi32(_mm_mullo_epi32(tex_10, mufi_), _mm_mullo_epi32(tex_10, mufi_n));
+				tex_10 = _mm_add_epi32(_mm_mullo_epi32(tex_10, mufi_), _mm_mullo_epi32(tex_11, mufi_n));
 				
 				tex_00 = _mm_add_epi32(_mm_mullo_epi32(tex_00, mvfi_), _mm_mullo_epi32(tex_10, mvfi_n));
 				tex_00 = _mm_srli_epi32(tex_00, 16);
@@ -393,21 +422,13 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 			}
 
 			if (pp_IgnoreTexA) {
-#ifdef __SSE4_1__
-            textel.mm = _mm_or_si128(textel.mm, const_setAlpha);
-#else
-				textel = _mm_or_si128(textel, const_setAlpha);
-#endif
+				textel.mm = _mm_or_si128(textel.mm, const_setAlpha);
 			}
 
 			if (pp_ShadInstr == 0){
 					//color.rgb = texcol.rgb;
 					//color.a = texcol.a;
-#ifdef __SSE4_1__
-            rv = textel.mm;
-#else
-            rv = textel;
-#endif
+				rv = textel.mm;
 			}
 			else if (pp_ShadInstr == 1) {
 				//color.rgb *= texcol.rgb;
@@ -420,13 +441,8 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 				__m128i lo_rv = _mm_cvtepu8_epi16(rv);
 				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
 
-#ifdef __SSE4_1__
-            __m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
-            __m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
+				__m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
+				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
 
 
 				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
@@ -442,13 +458,8 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
 
 
-#ifdef __SSE4_1__
 				__m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
 				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
-#else
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
-#endif
 
 				__m128i lo_rv_alpha = _mm_shuffle_epi8(lo_fb, shuffle_alpha);
 				__m128i hi_rv_alpha = _mm_shuffle_epi8(hi_fb, shuffle_alpha);
@@ -471,8 +482,8 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 				__m128i hi_rv = _mm_cvtepu8_epi16(_mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2)));
 
 
-				__m128i lo_fb = _mm_cvtepu8_epi16(textel);
-				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel, _MM_SHUFFLE(1, 0, 3, 2)));
+				__m128i lo_fb = _mm_cvtepu8_epi16(textel.mm);
+				__m128i hi_fb = _mm_cvtepu8_epi16(_mm_shuffle_epi32(textel.mm, _MM_SHUFFLE(1, 0, 3, 2)));
 
 
 				lo_rv = _mm_mullo_epi16(lo_rv, lo_fb);
@@ -487,11 +498,7 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 			
 
 			//textadr = _mm_add_epi32(textadr, _mm_setr_epi32(tex_addr, tex_addr, tex_addr, tex_addr));
-#ifdef __SSE4_1__
 			//rv = textel.mm; // _mm_xor_si128(rv, textadr);
-#else
-			//rv = textel; // _mm_xor_si128(rv, textadr);
-#endif
 		}
 	}
 
@@ -502,26 +509,18 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 		__m128i fb = *(__m128i*)cb;
 
 #if 1
-#ifdef __SSE4_1__
-      m128i mm_rv, mm_fb;
-      mm_rv.mm = rv;
-      mm_fb.mm = fb;
-#endif
+		m128i mm_rv, mm_fb;
+		mm_rv.mm = rv;
+		mm_fb.mm = fb;
+
 		//ALPHA_TEST
 		for (int i = 0; i < 4; i++)
-      {
-#ifdef __SSE4_1__
-			if (mm_rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
+		{
+			if (mm_rv.m128i_u8[i * 4 + 3] < PT_ALPHA_REF)
 				mm_rv.m128i_u32[i] = mm_fb.m128i_u32[i];
-#else
-			if (rv.m128i_i8[i * 4 + 3] < PT_ALPHA_REF)
-				rv.m128i_u32[i] = fb.m128i_u32[i];
-#endif
 		}
 
-#ifdef __SSE4_1__
 		rv = mm_rv.mm;
-#endif
 #else
 		__m128i ALPHA_TEST = _mm_set1_epi8(PT_ALPHA_REF);
 		__m128i mask = _mm_cmplt_epi8(_mm_subs_epu16(ALPHA_TEST, rv), _mm_setzero_si128());
@@ -584,19 +583,8 @@ static void PixelFlush(PolyParam* pp, text_info* texture, __m128 x, __m128 y, u8
 
 //u32 nok,fok;
 TPL_DECL_triangle
-static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, RECT* area)
+static void Rendtriangle(PolyParam* pp, text_info* texture, int vertex_offset, const Vertex &v1, const Vertex &v2, const Vertex &v3, u32* colorBuffer, tile_rect* area)
 {
-	text_info texture = { 0 };
-
-	if (pp_Texture) {
-
-		#pragma omp critical (texture_lookup)
-		{
-			texture = raw_GetTexture(pp->tsp, pp->tcw);
-		}
-			
-	}
-
 	const int stride_bytes = STRIDE_PIXEL_OFFSET * 4;
 	//Plane equation
 
@@ -610,6 +598,24 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 	const float X2 = v2.x;// iround(16.0f * v2.x);
 	const float X3 = v3.x;// iround(16.0f * v3.x);
 
+	// Block size, standard 4x4 (must be power of two)
+	const int q = 4;
+
+	// Bounding rectangle
+	int minx = iround(mmin(X1, X2, X3, area->left));// +0xF) >> 4;
+	int miny = iround(mmin(Y1, Y2, Y3, area->top));// +0xF) >> 4;
+
+	// Start in corner of block
+	minx &= ~(q - 1);
+	miny &= ~(q - 1);
+
+	int spanx = iround(mmax(X1 + 0.5f, X2 + 0.5f, X3 + 0.5f, area->right)) - minx;
+	int spany = iround(mmax(Y1 + 0.5f, Y2 + 0.5f, Y3 + 0.5f, area->bottom)) - miny;
+
+	//Inside scissor area? Checked first, as most triangles miss most tiles
+	if (spanx <= 0 || spany <= 0)
+		return;
+
 	int sgn = 1;
 
 	// Deltas
@@ -655,24 +661,6 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 	const float FDY23 = DY23;// << 4;
 	const float FDY31 = DY31;// << 4;
 
-	// Block size, standard 4x4 (must be power of two)
-	const int q = 4;
-
-	// Bounding rectangle
-	int minx = iround(mmin(X1, X2, X3, area->left));// +0xF) >> 4;
-	int miny = iround(mmin(Y1, Y2, Y3, area->top));// +0xF) >> 4;
-
-	// Start in corner of block
-	minx &= ~(q - 1);
-	miny &= ~(q - 1);
-
-	int spanx = iround(mmax(X1 + 0.5f, X2 + 0.5f, X3 + 0.5f, area->right)) - minx;
-	int spany = iround(mmax(Y1 + 0.5f, Y2 + 0.5f, Y3 + 0.5f, area->bottom)) - miny;
-
-	//Inside scissor area?
-	if (spanx < 0 || spany < 0)
-		return;
-
 
 	// Half-edge constants
 	float C1 = DY12 * X1 - DX12 * Y1;
@@ -720,7 +708,7 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 
    DECL_ALIGN(64) IPs ip;
 
-	ip.Setup(pp, &texture, v1, v2, v3, minx, miny, q);
+	ip.Setup(pp, texture, v1, v2, v3, minx, miny, q);
 	
 	
 	__m128 y_ps = _mm_broadcast_float(miny);
@@ -761,7 +749,7 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 				__m128 yl_ps = y_ps;
 				for (int iy = q; iy > 0; iy--)
 				{
-					PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, x_ps, ip);
+					PixelFlush TPL_PRMS_pixel(false) (pp, texture, x_ps, yl_ps, cb_x, x_ps, ip);
 					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
 					cb_x += sizeof(__m128);
 				}
@@ -798,9 +786,9 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 					if (msk != 0)
 					{
 						if (msk != 0xF)
-							PixelFlush TPL_PRMS_pixel(true) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
+							PixelFlush TPL_PRMS_pixel(true) (pp, texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
 						else
-							PixelFlush TPL_PRMS_pixel(false) (pp, &texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
+							PixelFlush TPL_PRMS_pixel(false) (pp, texture, x_ps, yl_ps, cb_x, *(__m128*)&a, ip);
 					}
 
 					yl_ps = _mm_add_ps(yl_ps, *(__m128*)ones_ps);
@@ -834,6 +822,197 @@ static void Rendtriangle(PolyParam* pp, int vertex_offset, const Vertex &v1, con
 }
 
 
+//Textures are looked up once per PolyParam before the tiles are handed out,
+//so the tile workers never touch the texture cache
+static vector<text_info> param_textures[3];
+
+static void LookupTextures(List<PolyParam>* param_list, vector<text_info>& textures)
+{
+	PolyParam* params = param_list->head();
+	int param_count = param_list->used();
+
+	textures.resize(param_count);
+
+	for (int i = 0; i < param_count; i++)
+	{
+		if (params[i].pcw.Texture)
+			textures[i] = raw_GetTexture(params[i].tsp, params[i].tcw);
+		else
+			memset(&textures[i], 0, sizeof(text_info));
+	}
+}
+
+template <int alpha_mode>
+static void RenderParamList(List<PolyParam>* param_list, text_info* textures, tile_rect* area)
+{
+	Vertex* verts = pvrrc.verts.head();
+	u16* idx = pvrrc.idx.head();
+
+	PolyParam* params = param_list->head();
+	int param_count = param_list->used();
+
+	for (int i = 0; i < param_count; i++)
+	{
+		int vertex_count = params[i].count - 2;
+
+		u16* poly_idx = &idx[params[i].first];
+
+		////<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
+		RendtriangleFn fn = RendtriangleFns[alpha_mode][params[i].tsp.UseAlpha][params[i].pcw.Texture][params[i].tsp.IgnoreTexA][params[i].tsp.ShadInstr][params[i].pcw.Offset];
+
+		for (int v = 0; v < vertex_count; v++) {
+			fn(&params[i], &textures[i], v, verts[poly_idx[v]], verts[poly_idx[v + 1]], verts[poly_idx[v + 2]], render_buffer, area);
+		}
+	}
+}
+
+//Clears and rasterises one 32x32 tile, tiles never share any color or depth memory
+static void RenderTile(int tile)
+{
+	tile_rect area;
+
+	area.left   = (tile % TILES_X) * TILE_SIZE;
+	area.top    = (tile / TILES_X) * TILE_SIZE;
+	area.right  = area.left + TILE_SIZE;
+	area.bottom = area.top + TILE_SIZE;
+
+	//Each 4 line band of the tile is TILE_SIZE/4 consecutive 4x4 blocks
+	for (int y = area.top; y < area.bottom; y += 4)
+	{
+		u32* band = &render_buffer[y * STRIDE_PIXEL_OFFSET + area.left * 4];
+
+		memset(band, 0, TILE_SIZE * 4 * sizeof(u32));
+		memset(band + Z_BUFFER_PIXEL_OFFSET, 0, TILE_SIZE * 4 * sizeof(u32));
+	}
+
+	RenderParamList<0>(&pvrrc.global_param_op, param_textures[0].data(), &area);
+	RenderParamList<1>(&pvrrc.global_param_pt, param_textures[1].data(), &area);
+	RenderParamList<2>(&pvrrc.global_param_tr, param_textures[2].data(), &area);
+}
+
+/*
+	Tile workers
+
+	Render() hands out the tiles of a frame one at a time, and renders
+	tiles itself too until none are left.
+*/
+static sthread_t* tile_workers[MAX_TILE_WORKERS];
+static int tile_worker_count;
+
+static slock_t* tile_mtx;
+static scond_t* tile_start;
+static scond_t* tile_done;
+
+static u32 tile_frame;		//bumped for every frame handed to the workers
+static int tile_next;		//next tile to render
+static int tile_pending;	//tiles of the frame not rendered yet
+static bool tile_exit;
+
+//Called with tile_mtx held
+static void RenderTiles()
+{
+	while (tile_next < TILE_COUNT)
+	{
+		int tile = tile_next++;
+
+		slock_unlock(tile_mtx);
+		RenderTile(tile);
+		slock_lock(tile_mtx);
+
+		if (--tile_pending == 0)
+			scond_signal(tile_done);
+	}
+}
+
+static void TileWorker(void* p)
+{
+	slock_lock(tile_mtx);
+
+	u32 frame = tile_frame;
+
+	for (;;)
+	{
+		while (frame == tile_frame && !tile_exit)
+			scond_wait(tile_start, tile_mtx);
+
+		if (tile_exit)
+			break;
+
+		frame = tile_frame;
+		RenderTiles();
+	}
+
+	slock_unlock(tile_mtx);
+}
+
+static void TileWorkersStart()
+{
+	//settings.pvr.MaxThreads counts the calling thread, 0 is one thread per core
+	int threads = std::thread::hardware_concurrency();
+
+	if (settings.pvr.MaxThreads != 0 && threads > (int)settings.pvr.MaxThreads)
+		threads = settings.pvr.MaxThreads;
+
+	tile_worker_count = min(max(threads - 1, 0), MAX_TILE_WORKERS);
+
+	if (tile_worker_count == 0)
+		return;
+
+	tile_mtx   = slock_new();
+	tile_start = scond_new();
+	tile_done  = scond_new();
+	tile_exit  = false;
+
+	for (int i = 0; i < tile_worker_count; i++)
+		tile_workers[i] = sthread_create(TileWorker, 0);
+}
+
+static void TileWorkersStop()
+{
+	if (tile_worker_count == 0)
+		return;
+
+	slock_lock(tile_mtx);
+	tile_exit = true;
+	scond_broadcast(tile_start);
+	slock_unlock(tile_mtx);
+
+	for (int i = 0; i < tile_worker_count; i++)
+		sthread_join(tile_workers[i]);
+
+	scond_free(tile_done);
+	scond_free(tile_start);
+	slock_free(tile_mtx);
+
+	tile_worker_count = 0;
+}
+
+static void RenderAllTiles()
+{
+	if (tile_worker_count == 0)
+	{
+		for (int tile = 0; tile < TILE_COUNT; tile++)
+			RenderTile(tile);
+		return;
+	}
+
+	slock_lock(tile_mtx);
+
+	tile_next    = 0;
+	tile_pending = TILE_COUNT;
+	tile_frame++;
+	scond_broadcast(tile_start);
+
+	RenderTiles();
+
+	while (tile_pending != 0)
+		scond_wait(tile_done, tile_mtx);
+
+	slock_unlock(tile_mtx);
+}
+
+void co_dc_yield(void);
+
 struct softrend : Renderer
 {
 	virtual bool Process(TA_context* ctx) {
@@ -841,88 +1020,48 @@ struct softrend : Renderer
 		if (ctx->rend.isRTT)
 			return false;
 
-		ctx->rend_inuse.Lock();
+#ifndef TARGET_NO_THREADS
+		slock_lock(ctx->rend_inuse);
+#endif
 		ctx->MarkRend();
 
-		if (!ta_parse_vdrc(ctx))
-			return false;
+		bool parsed = ta_parse_vdrc(ctx);
 
-		return true;
-	}
-
-	
-
-	template <int alpha_mode>
-	void RenderParamList(List<PolyParam>* param_list, RECT* area) {
-		
-		Vertex* verts = pvrrc.verts.head();
-		u16* idx = pvrrc.idx.head();
-
-		PolyParam* params = param_list->head();
-		int param_count = param_list->used();
+		//decode the textures staged by GetTexture, LookupTextures then finds them ready
+		FlushStagedTextures();
 
-		for (int i = 0; i < param_count; i++)
-		{
-			int vertex_count = params[i].count - 2;
-
-			u16* poly_idx = &idx[params[i].first];
+		if (!parsed)
+			return false;
 
-			for (int v = 0; v < vertex_count; v++) {
-				////<alpha_blend, pp_UseAlpha, pp_Texture, pp_IgnoreTexA, pp_ShadInstr, pp_Offset >
-				RendtriangleFn fn = RendtriangleFns[alpha_mode][params[i].tsp.UseAlpha][params[i].pcw.Texture][params[i].tsp.IgnoreTexA][params[i].tsp.ShadInstr][params[i].pcw.Offset];
+		CollectCleanup();
 
-				fn(&params[i], v, verts[poly_idx[v]], verts[poly_idx[v + 1]], verts[poly_idx[v + 2]], render_buffer, area);
-			}
-		}
+		return true;
 	}
+
 	virtual bool Render() {
 		bool is_rtt = pvrrc.isRTT;
 
-		memset(render_buffer, 0, sizeof(render_buffer));
-
 		if (pvrrc.verts.used()<3)
+		{
+			memset(render_buffer, 0, sizeof(render_buffer));
 			return false;
+		}
 
 		if (pvrrc.isAutoSort)
 			SortPParams();
 
-		int tcount = omp_get_num_procs() - 1;
-		if (tcount == 0) tcount = 1;
-		if (tcount > settings.pvr.MaxThreads) tcount = settings.pvr.MaxThreads;
-#pragma omp parallel num_threads(tcount)
-		{
-			int thd = omp_get_thread_num();
-			int y_offs = 480 % omp_get_num_threads();
-			int y_thd = 480 / omp_get_num_threads();
-			int y_start = (!!thd) * y_offs + y_thd * thd;
-			int y_end =  y_offs + y_thd * (thd + 1);
-
-			RECT area = { 0, y_start, 640, y_end };
-			RenderParamList<0>(&pvrrc.global_param_op, &area);
-			RenderParamList<1>(&pvrrc.global_param_pt, &area);
-			RenderParamList<2>(&pvrrc.global_param_tr, &area);
-		}
+		LookupTextures(&pvrrc.global_param_op, param_textures[0]);
+		LookupTextures(&pvrrc.global_param_pt, param_textures[1]);
+		LookupTextures(&pvrrc.global_param_tr, param_textures[2]);
 
-		
-		
-
-		/*
-		for (int y = 0; y < 480; y++) {
-			for (int x = 0; x < 640; x++) {
-				color_buffer[x + y * 640] = rand();
-			}
-		} */
+		RenderAllTiles();
 
 		return !is_rtt;
 	}
 
-	HWND hWnd;
-	HBITMAP hBMP = 0, holdBMP;
-	HDC hmem;
-	
-
-
 	virtual bool Init() {
+		libCore_vramlock_Init();
+
 		const_setAlpha = _mm_set1_epi32(0xFF000000);
 		u8 ushuffle[] = { 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x0E, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80, 0x06, 0x80};
 		memcpy(&shuffle_alpha, ushuffle, sizeof(shuffle_alpha));
@@ -1137,6 +1276,8 @@ struct softrend : Renderer
 			RendtriangleFns[2][1][0][1][3][1] = &Rendtriangle<2, 1, 0, 1, 3, 1>;
 		}
 
+		TileWorkersStart();
+
 		return true;
 	}
 
@@ -1144,7 +1285,15 @@ struct softrend : Renderer
 
 	}
 
+	virtual u32 GetTexture(TSP tsp, TCW tcw) {
+		raw_StageTexture(tsp, tcw);
+		return 0;
+	}
+
 	virtual void Term() {
+		TileWorkersStop();
+		DecodeWorkersStop();
+		libCore_vramlock_Free();
 	}
 
 	#define RR(x, a, b, c, d) (x + a), (x + b), (x + c), (x + d)
@@ -1159,32 +1308,50 @@ struct softrend : Renderer
 	virtual void Present() {
 
 		__m128* psrc = (__m128*)render_buffer;
-		__m128* pdst = (__m128*)pixels;
+		__m128* pdst = (__m128*)back_fb;
 
 		#define SHUFFL(v) v
 
-		#if HOST_OS == OS_WINDOWS
-			#define FLIP_Y 479 - 
-		#else
-			#define FLIP_Y
-		#endif
-
 		const int stride = STRIDE_PIXEL_OFFSET / 4;
 		for (int y = 0; y<MAX_RENDER_HEIGHT; y += 4)
 		{
 			for (int x = 0; x<MAX_RENDER_WIDTH; x += 4)
 			{
-				pdst[(FLIP_Y - (y + 0))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 1))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 2))*stride + x / 4] = SHUFFL(*psrc++);
-				pdst[(FLIP_Y - (y + 3))*stride + x / 4] = SHUFFL(*psrc++);
+				pdst[(y + 0)*stride + x / 4] = SHUFFL(*psrc++);
+				pdst[(y + 1)*stride + x / 4] = SHUFFL(*psrc++);
+				pdst[(y + 2)*stride + x / 4] = SHUFFL(*psrc++);
+				pdst[(y + 3)*stride + x / 4] = SHUFFL(*psrc++);
 			}
 		}
 
-      /* should do a video_cb call here */
+#if !defined(TARGET_NO_THREADS)
+		slock_lock(re.mutx);
+#endif
+		std::swap(back_fb, ready_fb);
+		fb_ready = true;
+#if !defined(TARGET_NO_THREADS)
+		slock_unlock(re.mutx);
+#endif
+
+		co_dc_yield();
 	}
 };
 
 Renderer* rend_softrend() {
 	return new(_mm_malloc(sizeof(softrend), 32)) softrend();
 }
+
+u32* rend_softrend_fb() {
+#if !defined(TARGET_NO_THREADS)
+	slock_lock(re.mutx);
+#endif
+	if (fb_ready)
+	{
+		std::swap(front_fb, ready_fb);
+		fb_ready = false;
+	}
+#if !defined(TARGET_NO_THREADS)
+	slock_unlock(re.mutx);
+#endif
+	return front_fb;
+}
@@ -0,0 +1,465 @@
+#include "types.h"
+#include "rewind.h"
+#include "serialize.h"
+
+#include "hw/mem/_vmem.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_lock.h"
+#include "hw/aica/aica_if.h"
+#include "hw/arm7/arm7.h"
+#include "deps/zlib/zlib.h"
+
+#include <deque>
+
+bool VramLockedWrite(u8* address);
+
+//without the fault handler all pages are compared every snapshot
+#if defined(TARGET_NO_EXCEPTIONS)
+	#define REWIND_TRACK_WRITES 0
+#else
+	#define REWIND_TRACK_WRITES 1
+#endif
+
+struct rewind_region
+{
+	VArray2* arr;		//0 for the register state
+	u8* data;
+	u32 size;
+	u32 first_page;		//page ids in the entries are global
+	u8* shadow;			//contents at the last snapshot
+	u8* dirty;			//pages written since, when tracked
+	bool tracked;
+
+	u8* views[VMEM_MAX_VIEWS];
+	u32 nviews;
+};
+
+enum
+{
+	REWIND_RAM,
+	REWIND_VRAM,
+	REWIND_ARAM,
+	REWIND_REGS,
+	REWIND_REGIONS
+};
+
+struct rewind_entry
+{
+	u32 pages;
+	u32 raw_size;
+	u32 comp_size;
+	//u16 page ids, padded to 4 bytes, then the compressed previous contents
+};
+
+static rewind_region regions[REWIND_REGIONS];
+static bool active;
+
+static u8* ring;
+static u32 ring_size;
+static std::deque<u32> entries;	//offsets in the ring, oldest first
+
+static u32 total_pages;
+static u16* page_ids;
+static u8* raw_buf;
+static u8* comp_buf;
+static u32 comp_buf_size;
+
+static rewind_stats stats;
+
+static u32 entry_ids_size(u32 pages)
+{
+	return (pages*sizeof(u16)+3)&~3;
+}
+
+static u32 entry_size(u32 offset)
+{
+	rewind_entry* e=(rewind_entry*)&ring[offset];
+	return sizeof(rewind_entry)+entry_ids_size(e->pages)+e->comp_size;
+}
+
+static void region_protect(rewind_region& r, u32 page, u32 count, bool writable)
+{
+	for (u32 i=0;i<r.nviews;i++)
+	{
+		VArray2 view={ r.views[i], r.size };
+
+		if (writable)
+			VArray2_UnLockRegion(&view, page*PAGE_SIZE, count*PAGE_SIZE);
+		else
+			VArray2_LockRegion(&view, page*PAGE_SIZE, count*PAGE_SIZE);
+	}
+}
+
+//write protects the pages written since the last snapshot again, a run at a time
+static void region_rearm(rewind_region& r)
+{
+	if (!r.tracked)
+		return;
+
+	u32 pages=r.size/PAGE_SIZE;
+
+	for (u32 p=0;p<pages;)
+	{
+		if (!r.dirty[p])
+		{
+			p++;
+			continue;
+		}
+
+		u32 start=p;
+		while (p<pages && r.dirty[p])
+			r.dirty[p++]=0;
+
+		region_protect(r, start, p-start, false);
+	}
+}
+
+static rewind_region* region_of(u32 id, u32& page)
+{
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		page=id-regions[i].first_page;
+		if (page<regions[i].size/PAGE_SIZE)
+			return &regions[i];
+	}
+
+	die("rewind: bad page id");
+	return 0;
+}
+
+//finds room for an entry at the head, dropping the oldest ones in the way
+static u8* ring_alloc(u32 size)
+{
+	if (size>ring_size)
+	{
+		entries.clear();
+		return 0;
+	}
+
+	u32 pos=entries.empty() ? 0 : entries.back()+entry_size(entries.back());
+
+	if (pos+size>ring_size)
+	{
+		//everything past the head is older than what is at the start
+		while (!entries.empty() && entries.front()>=pos)
+			entries.pop_front();
+		pos=0;
+	}
+
+	while (!entries.empty() && entries.front()>=pos && entries.front()<pos+size)
+		entries.pop_front();
+
+	entries.push_back(pos);
+
+	return &ring[pos];
+}
+
+bool RewindLockedWrite(u8* address)
+{
+	if (!active)
+		return false;
+
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+
+		if (!r.tracked)
+			continue;
+
+		for (u32 v=0;v<r.nviews;v++)
+		{
+			size_t offset=address-r.views[v];
+
+			if (offset<r.size)
+			{
+				u32 page=offset/PAGE_SIZE;
+
+				//textures on the page still need to hear about it, through any mirror
+				if (r.arr==&vram)
+					VramLockedWrite(r.data+page*PAGE_SIZE);
+				//and so does the interpreter's decoded code
+				else if (r.arr==&mem_b)
+					RamLockedWrite(r.data+page*PAGE_SIZE);
+
+				r.dirty[page]=1;
+				region_protect(r, page, 1, true);
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool rewind_enabled(void)
+{
+	return active;
+}
+
+bool rewind_init(u32 buffer_size)
+{
+	rewind_term();
+
+	VArray2* arrs[REWIND_REGIONS]={ &mem_b, &vram, &aica_ram, 0 };
+
+	total_pages=0;
+
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+
+		memset(&r, 0, sizeof(r));
+		r.arr=arrs[i];
+
+		if (r.arr)
+		{
+			r.data=r.arr->data;
+			r.size=r.arr->size;
+			r.tracked=REWIND_TRACK_WRITES;
+			r.nviews=_vmem_get_views(*r.arr, r.views);
+		}
+		else
+		{
+			//the skipped parts have to compare equal every time
+			r.size=(dc_serialize_regs_size()+PAGE_MASK)&~PAGE_MASK;
+			r.data=(u8*)calloc(r.size, 1);
+		}
+
+		r.first_page=total_pages;
+		total_pages+=r.size/PAGE_SIZE;
+
+		r.shadow=(u8*)malloc(r.size);
+		r.dirty=(u8*)calloc(r.size/PAGE_SIZE, 1);
+
+		if (!r.data || !r.shadow || !r.dirty)
+			goto fail;
+	}
+
+	verify(total_pages<=0x10000);
+
+	page_ids=(u16*)malloc(total_pages*sizeof(u16));
+	raw_buf=(u8*)malloc(total_pages*PAGE_SIZE);
+	comp_buf_size=compressBound(total_pages*PAGE_SIZE);
+	comp_buf=(u8*)malloc(comp_buf_size);
+	ring_size=buffer_size;
+	ring=(u8*)malloc(ring_size);
+
+	if (!page_ids || !raw_buf || !comp_buf || !ring)
+		goto fail;
+
+	dc_serialize_regs(regions[REWIND_REGS].data);
+
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+
+		memcpy(r.shadow, r.data, r.size);
+
+		if (r.tracked)
+			region_protect(r, 0, r.size/PAGE_SIZE, false);
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	active=true;
+
+	printf("rewind: %d KB ring, %d pages tracked\n", ring_size/1024, total_pages);
+
+	return true;
+
+fail:
+	printf("rewind: failed to allocate buffers\n");
+	rewind_term();
+	return false;
+}
+
+void rewind_term(void)
+{
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+
+		if (active && r.tracked)
+		{
+			//texture locks share the protection, so let them go too
+			if (r.arr==&vram)
+			{
+				for (u32 p=0;p<r.size/PAGE_SIZE;p++)
+					VramLockedWrite(r.data+p*PAGE_SIZE);
+			}
+			region_protect(r, 0, r.size/PAGE_SIZE, true);
+
+			if (r.arr==&mem_b)
+				ram_UnlockCodePages();
+		}
+
+		if (!r.arr)
+			free(r.data);
+		free(r.shadow);
+		free(r.dirty);
+
+		memset(&r, 0, sizeof(r));
+	}
+
+	free(page_ids);
+	free(raw_buf);
+	free(comp_buf);
+	free(ring);
+
+	page_ids=0;
+	raw_buf=0;
+	comp_buf=0;
+	ring=0;
+	ring_size=0;
+	entries.clear();
+
+	active=false;
+}
+
+void rewind_push(void)
+{
+	if (!active)
+		return;
+
+	dc_serialize_regs(regions[REWIND_REGS].data);
+
+	u32 npages=0;
+	u8* raw=raw_buf;
+
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+		u32 pages=r.size/PAGE_SIZE;
+
+		for (u32 p=0;p<pages;p++)
+		{
+			if (r.tracked && !r.dirty[p])
+				continue;
+
+			u8* cur=r.data+p*PAGE_SIZE;
+			u8* old=r.shadow+p*PAGE_SIZE;
+
+			if (memcmp(cur, old, PAGE_SIZE)!=0)
+			{
+				page_ids[npages++]=r.first_page+p;
+				memcpy(raw, old, PAGE_SIZE);
+				memcpy(old, cur, PAGE_SIZE);
+				raw+=PAGE_SIZE;
+			}
+		}
+
+		region_rearm(r);
+	}
+
+	u32 raw_size=npages*PAGE_SIZE;
+	uLongf comp_size=0;
+
+	if (raw_size)
+	{
+		comp_size=comp_buf_size;
+		int rv=compress2(comp_buf, &comp_size, raw_buf, raw_size, Z_BEST_SPEED);
+		verify(rv==Z_OK);
+	}
+
+	u32 ids_size=entry_ids_size(npages);
+	u32 size=sizeof(rewind_entry)+ids_size+comp_size;
+
+	//if it doesn't fit, nothing older can be reached anymore either
+	u8* dst=ring_alloc(size);
+
+	if (dst)
+	{
+		rewind_entry* e=(rewind_entry*)dst;
+		e->pages=npages;
+		e->raw_size=raw_size;
+		e->comp_size=comp_size;
+
+		memcpy(dst+sizeof(rewind_entry), page_ids, npages*sizeof(u16));
+		memcpy(dst+sizeof(rewind_entry)+ids_size, comp_buf, comp_size);
+	}
+
+	stats.snapshots++;
+	stats.pages+=npages;
+	stats.raw_bytes+=raw_size;
+	stats.bytes+=size;
+}
+
+bool rewind_pop(void)
+{
+	if (!active || entries.empty())
+		return false;
+
+	//back to the last snapshot
+	for (u32 i=0;i<REWIND_REGIONS;i++)
+	{
+		rewind_region& r=regions[i];
+		u32 pages=r.size/PAGE_SIZE;
+
+		if (!r.arr)
+			continue;
+
+		for (u32 p=0;p<pages;p++)
+		{
+			if (r.tracked && !r.dirty[p])
+				continue;
+
+			u8* cur=r.data+p*PAGE_SIZE;
+			u8* old=r.shadow+p*PAGE_SIZE;
+
+			if (memcmp(cur, old, PAGE_SIZE)!=0)
+			{
+				//drops the code compiled from the page, and unlocks it
+				if (r.arr==&mem_b)
+					RamLockedWrite(cur);
+
+				memcpy(cur, old, PAGE_SIZE);
+
+				if (r.arr==&vram)
+					vramlock_mark_written(p*PAGE_SIZE, PAGE_SIZE);
+#if FEAT_AREC == DYNAREC_JIT
+				else if (r.arr==&aica_ram)
+					arm_RamWritten(p*PAGE_SIZE);
+#endif
+			}
+		}
+
+		region_rearm(r);
+	}
+
+	dc_unserialize_regs(regions[REWIND_REGS].shadow);
+
+	//and make the one before it the last, so the next pop goes there
+	u8* src=&ring[entries.back()];
+	rewind_entry* e=(rewind_entry*)src;
+	u16* ids=(u16*)(src+sizeof(rewind_entry));
+	uLongf raw_size=e->raw_size;
+
+	if (e->raw_size)
+	{
+		int rv=uncompress(raw_buf, &raw_size, src+sizeof(rewind_entry)+entry_ids_size(e->pages), e->comp_size);
+		verify(rv==Z_OK && raw_size==e->raw_size);
+	}
+
+	for (u32 i=0;i<e->pages;i++)
+	{
+		u32 page;
+		rewind_region* r=region_of(ids[i], page);
+
+		memcpy(r->shadow+page*PAGE_SIZE, raw_buf+i*PAGE_SIZE, PAGE_SIZE);
+
+		//differs from the snapshot now, so it has to be looked at next time
+		if (r->tracked)
+			r->dirty[page]=1;
+	}
+
+	entries.pop_back();
+
+	return true;
+}
+
+void rewind_get_stats(rewind_stats* st)
+{
+	*st=stats;
+	st->entries=entries.size();
+}
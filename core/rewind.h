@@ -0,0 +1,40 @@
+#pragma once
+#include "types.h"
+
+/*
+	Rewind buffer
+
+	Every frame only the 4 KB pages that changed since the previous snapshot
+	are kept, zlib compressed, in a ring of fixed size. The oldest snapshots
+	are dropped to make room.
+
+	Main, video and sound ram are write protected after each snapshot, so the
+	fault handler marks the pages as they get written and only those need to
+	be looked at. The rest of the state is small enough to be compared.
+
+	Each entry holds the previous contents of the pages, so stepping back
+	only needs the last snapshot and the newest entry.
+*/
+
+struct rewind_stats
+{
+	u32 snapshots;
+	u32 entries;	//currently in the ring
+	u32 pages;		//changed pages, all snapshots
+	u64 raw_bytes;
+	u64 bytes;		//written to the ring
+};
+
+bool rewind_init(u32 buffer_size);
+void rewind_term(void);
+bool rewind_enabled(void);
+
+//at the end of a frame
+void rewind_push(void);
+//back to the last snapshot, dropping it. false once the ring is empty
+bool rewind_pop(void);
+
+void rewind_get_stats(rewind_stats* stats);
+
+//fault handler hook
+bool RewindLockedWrite(u8* address);
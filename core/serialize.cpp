@@ -0,0 +1,321 @@
+#include "types.h"
+#include "serialize.h"
+
+#include "hw/pvr/pvr_regs.h"
+#include "hw/pvr/pvr_mem.h"
+#include "hw/pvr/pvr_lock.h"
+#include "hw/pvr/TexCache.h"
+#include "hw/pvr/Renderer_if.h"
+#include "hw/sh4/sh4_if.h"
+#include "hw/sh4/sh4_core.h"
+#include "hw/sh4/sh4_mmr.h"
+#include "hw/sh4/sh4_mem.h"
+#include "hw/sh4/modules/mmu.h"
+#include "hw/sh4/modules/ccn.h"
+#include "hw/holly/sb.h"
+#include "hw/aica/aica_if.h"
+#include "hw/aica/aica_mem.h"
+#include "hw/aica/dsp.h"
+#include "hw/arm7/arm7.h"
+#include "hw/arm7/arm_mem.h"
+
+//sh4
+extern Array<u8> OnChipRAM;
+extern u16 InterruptEnvId[32];
+extern u32 InterruptBit[32];
+extern u32 InterruptLevelBit[16];
+extern u32 interrupt_vpend;
+extern u32 interrupt_vmask;
+extern u32 decoded_srimask;
+extern u32 ITLB_LRU_USE[64];
+extern u32 mmu_error_TT;
+extern u32 tmu_shift[3];
+extern u32 tmu_mask[3];
+extern u64 tmu_mask64[3];
+extern u32 old_mode[3];
+extern u32 tmu_ch_base[3];
+extern u64 tmu_ch_base64[3];
+extern u8 SCIF_SCFRDR2;
+extern SCIF_SCFDR2_type SCIF_SCFDR2;
+extern u32 old_rm;
+extern u32 old_dn;
+
+//holly, maple
+extern u32 SB_FFST_rc;
+extern u32 dmacount;
+extern bool maple_ddt_pending_reset;
+
+//pvr
+extern u32 in_vblank;
+extern u32 clc_pvr_scanline;
+extern u32 pvr_numscanlines;
+extern u32 prv_cur_scanline;
+extern u32 vblk_cnt;
+extern u32 Line_Cycles;
+extern u32 Frame_Cycles;
+extern u32 YUV_tempdata[512/4];
+extern u32 YUV_dest;
+extern u32 YUV_blockcount;
+extern u32 YUV_x_curr;
+extern u32 YUV_y_curr;
+extern u32 YUV_x_size;
+extern u32 YUV_y_size;
+extern u8 ta_fsm[2049];
+extern u32 ta_fsm_cl;
+
+//aica, arm7
+extern u32 ARMRST;
+extern u32 rtc_EN;
+extern s32 aica_pending_dma;
+extern bool armIrqEnable;
+extern int armMode;
+extern bool Arm7Enabled;
+extern bool intState;
+extern bool stopState;
+extern bool holdState;
+extern bool aica_interr;
+extern u32 aica_reg_L;
+
+static Array<RegisterStruct>* const sh4_mmr_arrays[] =
+{
+	&CCN, &UBC, &BSC, &DMAC, &CPG, &RTC, &INTC, &TMU, &SCI, &SCIF
+};
+
+//registers handled by a read function keep no data of their own
+static void serialize_regs(Serializer& s, Array<RegisterStruct>& regs)
+{
+	for (u32 i = 0; i < regs.Size; i++)
+	{
+		u32 data = regs.data ? regs.data[i].data32 : 0;
+
+		s.value(data);
+
+		if (s.loading && !(regs.data[i].flags & REG_RF))
+			regs.data[i].data32 = data;
+	}
+}
+
+static void serialize_sh4(Serializer& s)
+{
+	s.value(p_sh4rcb->cntx);
+	s.value(p_sh4rcb->sq_buffer);
+
+	for (u32 i = 0; i < sizeof(sh4_mmr_arrays) / sizeof(sh4_mmr_arrays[0]); i++)
+		serialize_regs(s, *sh4_mmr_arrays[i]);
+
+	s.array(OnChipRAM.data, OnChipRAM_SIZE);
+
+	s.array(InterruptEnvId, 32);
+	s.array(InterruptBit, 32);
+	s.array(InterruptLevelBit, 16);
+	s.value(interrupt_vpend);
+	s.value(interrupt_vmask);
+	s.value(decoded_srimask);
+
+	s.array(CCN_QACR_TR, 2);
+	s.array(UTLB, 64);
+	s.array(ITLB, 4);
+	s.array(ITLB_LRU_USE, 64);
+	s.array(sq_remap, 64);
+	s.value(mmu_error_TT);
+
+	if (s.loading)
+		mmu_flush_cache();
+
+	s.array(tmu_shift, 3);
+	s.array(tmu_mask, 3);
+	s.array(tmu_mask64, 3);
+	s.array(old_mode, 3);
+	s.array(tmu_ch_base, 3);
+	s.array(tmu_ch_base64, 3);
+
+	s.value(BSC_PDTRA);
+	s.value(SCIF_SCFSR2);
+	s.value(SCIF_SCFRDR2);
+	s.value(SCIF_SCFDR2);
+
+	sh4_sched_serialize(s);
+}
+
+static void serialize_holly(Serializer& s)
+{
+	serialize_regs(s, sb_regs);
+	s.value(SB_ISTNRM);
+	s.value(SB_FFST_rc);
+	s.value(SB_FFST);
+	asic_serialize(s);
+
+	gdrom_serialize(s);
+
+	s.value(dmacount);
+	s.value(maple_ddt_pending_reset);
+}
+
+static void serialize_pvr(Serializer& s)
+{
+	s.array(pvr_regs, pvr_RegSize);
+
+	s.value(in_vblank);
+	s.value(clc_pvr_scanline);
+	s.value(pvr_numscanlines);
+	s.value(prv_cur_scanline);
+	s.value(vblk_cnt);
+	s.value(Line_Cycles);
+	s.value(Frame_Cycles);
+
+	s.array(YUV_tempdata, 512/4);
+	s.value(YUV_dest);
+	s.value(YUV_blockcount);
+	s.value(YUV_x_curr);
+	s.value(YUV_y_curr);
+	s.value(YUV_x_size);
+	s.value(YUV_y_size);
+
+	s.value(FrameCount);
+
+	s.value(ta_fsm[2048]);
+	s.value(ta_fsm_cl);
+}
+
+static void serialize_aica(Serializer& s)
+{
+	s.array(aica_reg, 0x8000);
+	aica_serialize(s);
+
+	//DynCode is rebuilt from the registers
+	s.raw(&dsp.TEMP, offsetof(dsp_t, dyndirty) - offsetof(dsp_t, TEMP));
+
+	sgc_serialize(s);
+
+	s.value(VREG);
+	s.value(ARMRST);
+	s.value(rtc_EN);
+	s.value(aica_pending_dma);
+	s.value(settings.dreamcast.RTC);
+
+	s.array(arm_Reg, RN_ARM_REG_COUNT);
+	s.value(armIrqEnable);
+	s.value(armFiqEnable);
+	s.value(armMode);
+	s.value(Arm7Enabled);
+	s.value(intState);
+	s.value(stopState);
+	s.value(holdState);
+	s.value(aica_interr);
+	s.value(aica_reg_L);
+	s.value(e68k_out);
+	s.value(e68k_reg_L);
+	s.value(e68k_reg_M);
+}
+
+static void dc_serialize_state(Serializer& s, bool mem)
+{
+	u32 magic = SAVESTATE_MAGIC;
+	u32 version = SAVESTATE_VERSION;
+
+	s.value(magic);
+	s.value(version);
+
+	if (mem)
+	{
+		s.array(mem_b.data, RAM_SIZE);
+		s.array(vram.data, VRAM_SIZE);
+		s.array(aica_ram.data, ARAM_SIZE);
+	}
+
+	serialize_sh4(s);
+	serialize_holly(s);
+	serialize_pvr(s);
+	serialize_aica(s);
+
+	//variable length, reserved in full, so it goes last
+	tactx_serialize(s);
+}
+
+//everything derived from the state that was just replaced
+static void dc_serialize_fixup(void)
+{
+	old_rm = old_dn = 0xFF;
+	SetFloatStatusReg();
+
+	dsp.dyndirty = true;
+	pal_needs_update = true;
+	fog_needs_update = true;
+}
+
+u32 dc_serialize_size(void)
+{
+	Serializer s(0, false);
+
+	dc_serialize_state(s, true);
+
+	return s.size;
+}
+
+bool dc_serialize(void* data, u32 size)
+{
+	if (!p_sh4rcb || size < dc_serialize_size())
+		return false;
+
+	Serializer s(data, false);
+
+	dc_serialize_state(s, true);
+
+	return true;
+}
+
+bool dc_unserialize(const void* data, u32 size)
+{
+	if (!p_sh4rcb || size < dc_serialize_size())
+		return false;
+
+	const u32* hdr = (const u32*)data;
+
+	if (hdr[0] != SAVESTATE_MAGIC || hdr[1] != SAVESTATE_VERSION)
+	{
+		printf("Save state version mismatch: %08X v%d, expected v%d\n", hdr[0], hdr[1], SAVESTATE_VERSION);
+		return false;
+	}
+
+	Serializer s((void*)data, true);
+
+	dc_serialize_state(s, true);
+
+	vramlock_mark_written(0, VRAM_SIZE);
+
+	//all of ram was replaced, so is all the code
+	sh4_cpu.ResetCache();
+#if FEAT_AREC == DYNAREC_JIT
+	arm_FlushCache();
+#endif
+
+	dc_serialize_fixup();
+
+	return true;
+}
+
+u32 dc_serialize_regs_size(void)
+{
+	Serializer s(0, false);
+
+	dc_serialize_state(s, false);
+
+	return s.size;
+}
+
+void dc_serialize_regs(void* data)
+{
+	Serializer s(data, false);
+
+	dc_serialize_state(s, false);
+}
+
+void dc_unserialize_regs(const void* data)
+{
+	Serializer s((void*)data, true);
+
+	dc_serialize_state(s, false);
+
+	//the caller restores ram itself, and drops the code on the pages it touches
+	dc_serialize_fixup();
+}
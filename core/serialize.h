@@ -0,0 +1,72 @@
+#pragma once
+#include "types.h"
+
+/*
+	Save states
+
+	The machine state is walked in a fixed order by a single function,
+	either copying it out, copying it back in, or (with no buffer) only
+	adding up the size. Using the same walk for all three keeps the layout
+	from getting out of sync, and nothing in it allocates.
+
+	The layout only depends on the build, so the size is the same for every
+	call and frontends can snapshot every frame. Bump the version whenever
+	anything is added, removed or reordered.
+*/
+#define SAVESTATE_MAGIC   0x54534352 //RCST
+#define SAVESTATE_VERSION 1
+
+#define SH4_SCHED_SLOTS 32
+
+struct Serializer
+{
+	u8* ptr;	//0 when only measuring
+	u32 size;
+	bool loading;
+
+	Serializer(void* data, bool load) : ptr((u8*)data), size(0), loading(load) { }
+
+	void raw(void* v, u32 sz)
+	{
+		if (ptr)
+		{
+			if (loading)
+				memcpy(v, ptr, sz);
+			else
+				memcpy(ptr, v, sz);
+			ptr += sz;
+		}
+		size += sz;
+	}
+
+	//reserves space without touching it, to keep the size fixed
+	void skip(u32 sz)
+	{
+		if (ptr)
+			ptr += sz;
+		size += sz;
+	}
+
+	template<typename T>
+	void value(T& v) { raw(&v, sizeof(v)); }
+
+	template<typename T>
+	void array(T* v, u32 count) { raw(v, sizeof(T) * count); }
+};
+
+u32 dc_serialize_size(void);
+bool dc_serialize(void* data, u32 size);
+bool dc_unserialize(const void* data, u32 size);
+
+//the same, minus main, video and sound ram, which the rewind buffer keeps on its own
+u32 dc_serialize_regs_size(void);
+void dc_serialize_regs(void* data);
+void dc_unserialize_regs(const void* data);
+
+//module state that isn't reachable from outside
+void sh4_sched_serialize(Serializer& s);
+void asic_serialize(Serializer& s);
+void gdrom_serialize(Serializer& s);
+void aica_serialize(Serializer& s);
+void sgc_serialize(Serializer& s);
+void tactx_serialize(Serializer& s);
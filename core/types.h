@@ -187,6 +187,8 @@ struct vram_block
 	u32 type;
  
 	void* userdata;
+	struct vram_lock_link* links;	//one per page, see pvr_lock.cpp
+	u64 gen;						//vram_gen when locked, for settings.pvr.VramSoftTracking
 };
 
 
@@ -307,6 +309,7 @@ enum ndc_error_codes
 void libCore_vramlock_Unlock_block  (vram_block* block);
 void libCore_vramlock_Unlock_block_wb  (vram_block* block);
 vram_block* libCore_vramlock_Lock(u32 start_offset,u32 end_offset,void* userdata);
+void libCore_vramlock_Check(vram_block* block);
 
 
 
@@ -570,6 +573,7 @@ struct settings_t
 	{
 		bool UseMipmaps;
 		bool WideScreen;
+		u32 TexCacheBudget;     //bytes of decoded textures kept around, 0 for no limit
 	} rend;
 
 	struct
@@ -653,10 +657,14 @@ struct settings_t
 
 		u32 ta_skip;
 		u32 subdivide_transp;
-		u32 rend;
+		u32 rend;	//0: gles, 2: soft
 		
 		u32 MaxThreads;
 		u32 SynchronousRendering;
+		bool VramSoftTracking;	//vram writes stamp their pages instead of faulting, fixed at boot
+		bool TAStreaming;		//decode the TA lists on a worker as they end
+		u32 RenderQueueDepth;	//frames queued for the render thread, 1 to RQUEUE_MAX_DEPTH
+		u32 RenderQueuePolicy;	//RenderQueuePolicy, when the queue is full
 	} pvr;
 
    unsigned UpdateMode;